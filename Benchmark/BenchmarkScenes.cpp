@@ -0,0 +1,388 @@
+#include "BenchmarkScenes.hpp"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+using namespace std;
+using namespace DirectX;
+
+static const LinearVelocityBounds SCENE_BOUNDS = { -1000, 1000, -1000, 1000, -1000, 1000 };
+
+static BodyProperties MakeProps(
+	const XMFLOAT3& position,
+	float massInv,
+	float elasticity,
+	float friction)
+{
+	BodyProperties props;
+	props.position = position;
+	props.linVelocity = { 0, 0, 0 };
+	props.angVelocity = { 0, 0, 0 };
+	props.rotation = { 0, 0, 0, 1 };
+	props.massInv = massInv;
+	props.elasticity = elasticity;
+	props.friction = friction;
+	return props;
+}
+
+static uint64_t AddStaticBox(
+	PhysicsEnigne* engine,
+	const XMFLOAT3& position,
+	const XMFLOAT3& scales)
+{
+	uint64_t bodyId;
+	BodyProperties props = MakeProps(position, 0.0f, 1.0f, 0.01f);
+	engine->AddBody(props, ShapeType::OrientedBox, scales, false, &bodyId, true, SCENE_BOUNDS);
+	return bodyId;
+}
+
+static void AddDynamicBoxes(
+	PhysicsEnigne* engine,
+	const vector<BodyProperties>& props,
+	const XMFLOAT3& scales,
+	uint64_t* lastBodyId)
+{
+	vector<uint64_t> bodyIds(props.size());
+	engine->AddBodies(props.data(), props.size(), ShapeType::OrientedBox, scales, true, bodyIds.data(), true, SCENE_BOUNDS);
+	*lastBodyId = bodyIds.back();
+}
+
+// same floor and walls as Scene::GenerateObjects, top of the floor is at y = -1
+static void AddArena(
+	PhysicsEnigne* engine)
+{
+	AddStaticBox(engine, { 0, -2, 0 }, { 35, 1, 35 });
+	AddStaticBox(engine, { -35, 0, 0 }, { 1, 20, 39 });
+	AddStaticBox(engine, { 35, 0, 0 }, { 1, 20, 35 });
+	AddStaticBox(engine, { 0, 0, -35 }, { 35, 20, 1 });
+	AddStaticBox(engine, { 0, 0, 35 }, { 35, 20, 1 });
+}
+
+static void BuildBoxPyramid(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t BASE = 12;
+	AddArena(engine);
+
+	vector<BodyProperties> props;
+	for (size_t row = 0; row < BASE; row++)
+	{
+		for (size_t i = 0; i < BASE - row; i++)
+		{
+			float x = ((float)i - (BASE - row - 1) * 0.5f) * 1.05f;
+			props.push_back(MakeProps({ x, -0.5f + row * 1.0f, 0 }, 1.0f / 20.0f, 0.0f, 0.5f));
+		}
+	}
+	AddDynamicBoxes(engine, props, { 0.5f, 0.5f, 0.5f }, probeBodyId);
+}
+
+static void BuildFallingCrates(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t SIDE = 25;
+	constexpr size_t LAYERS = 16;
+	AddArena(engine);
+
+	vector<BodyProperties> props;
+	for (size_t layer = 0; layer < LAYERS; layer++)
+	{
+		for (size_t i = 0; i < SIDE * SIDE; i++)
+		{
+			float x = ((float)(i % SIDE) - SIDE * 0.5f) * 2.5f;
+			float z = ((float)(i / SIDE) - SIDE * 0.5f) * 2.5f;
+			props.push_back(MakeProps({ x, 2.0f + layer * 2.5f, z }, 1.0f / 20.0f, 0.5f, 0.5f));
+		}
+	}
+	AddDynamicBoxes(engine, props, { 0.5f, 0.5f, 0.5f }, probeBodyId);
+}
+
+static void BuildDominoChain(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t COUNT = 50;
+	AddArena(engine);
+
+	vector<BodyProperties> props;
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		props.push_back(MakeProps({ -30.0f + i * 1.2f, 0.0f, 0 }, 1.0f / 5.0f, 0.0f, 0.5f));
+	}
+	// push first domino towards the chain
+	props[0].angVelocity = { 0, 0, -3.0f };
+	// last domino falls only when whole chain did
+	AddDynamicBoxes(engine, props, { 0.1f, 1.0f, 0.5f }, probeBodyId);
+}
+
+static void BuildRotatedPile(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t COUNT = 500;
+	AddArena(engine);
+
+	// fixed LCG keeps the scene identical between runs
+	uint32_t seed = 12345;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (float)(seed >> 8) / (float)(1 << 24);
+	};
+
+	vector<BodyProperties> props;
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		BodyProperties body = MakeProps({ (float)(i % 5) * 1.6f - 3.2f, 1.0f + (i / 25) * 1.6f, (float)(i / 5 % 5) * 1.6f - 3.2f },
+			1.0f / 20.0f, 0.2f, 0.5f);
+		XMVECTOR rotation = XMQuaternionNormalize(XMVectorSet(random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f));
+		XMStoreFloat4(&body.rotation, rotation);
+		props.push_back(body);
+	}
+	AddDynamicBoxes(engine, props, { 0.5f, 0.5f, 0.5f }, probeBodyId);
+}
+
+constexpr float THIN_WALL_X = 10.0f;
+constexpr float THIN_WALL_HALF_THICKNESS = 0.05f;
+
+static void BuildProjectileAndThinWall(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	AddStaticBox(engine, { 0, -2, 0 }, { 35, 1, 35 });
+	// wall is thinner than distance projectile travels in one step
+	AddStaticBox(engine, { THIN_WALL_X, 2, 0 }, { THIN_WALL_HALF_THICKNESS, 3, 3 });
+
+	BodyProperties projectile = MakeProps({ 0, 2, 0 }, 1.0f / 2.0f, 0.5f, 0.5f);
+	projectile.linVelocity = { 300, 0, 0 };
+	engine->AddBody(projectile, ShapeType::OrientedBox, { 0.25f, 0.25f, 0.25f }, true, probeBodyId, true,
+		SCENE_BOUNDS, { 0, 0, 0 });
+}
+
+// projectile has to stay on its side of the wall, bounced back or stopped at it
+static bool CheckProjectileInFront(
+	const XMFLOAT3& position)
+{
+	return position.x < THIN_WALL_X - THIN_WALL_HALF_THICKNESS;
+}
+
+// crates on 4k x 4k terrain, narrow phase cost follows crate footprints, not the terrain size
+static void BuildTerrainCrates(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr uint32_t SAMPLES = 4096;
+	constexpr size_t SIDE = 20;
+
+	vector<uint16_t> heights((size_t)SAMPLES * SAMPLES);
+	for (uint32_t z = 0; z < SAMPLES; z++)
+	{
+		for (uint32_t x = 0; x < SAMPLES; x++)
+		{
+			heights[(size_t)z * SAMPLES + x] = (uint16_t)(32768.0f + 8000.0f * sinf(x * 0.05f) * cosf(z * 0.04f));
+		}
+	}
+
+	HeightfieldDesc desc;
+	desc.columns = SAMPLES;
+	desc.rows = SAMPLES;
+	desc.cellSize = 0.5f;
+	desc.heightScale = 0.0001f;
+	desc.heightOffset = -3.2768f;
+	desc.heights = heights.data();
+	desc.materials = nullptr;
+	uint64_t terrainId;
+	engine->AddHeightfield(desc, MakeProps({ 0, 0, 0 }, 0.0f, 0.2f, 0.5f), &terrainId);
+
+	vector<BodyProperties> props;
+	for (size_t i = 0; i < SIDE * SIDE; i++)
+	{
+		float x = ((float)(i % SIDE) - SIDE * 0.5f) * 2.5f;
+		float z = ((float)(i / SIDE) - SIDE * 0.5f) * 2.5f;
+		props.push_back(MakeProps({ x, 2.0f, z }, 1.0f / 20.0f, 0.2f, 0.5f));
+	}
+	AddDynamicBoxes(engine, props, { 0.5f, 0.5f, 0.5f }, probeBodyId);
+}
+
+// 4096 stepped blocks of level geometry merged into one static mesh body
+static void BuildMeshLevel(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr uint32_t BLOCKS = 64;
+	constexpr float BLOCK_SIZE = 1.0f;
+	constexpr size_t SIDE = 20;
+
+	vector<XMFLOAT3> vertices;
+	vector<uint32_t> indices;
+	float half = BLOCKS * BLOCK_SIZE * 0.5f;
+	for (uint32_t z = 0; z < BLOCKS; z++)
+	{
+		for (uint32_t x = 0; x < BLOCKS; x++)
+		{
+			float x0 = x * BLOCK_SIZE - half;
+			float z0 = z * BLOCK_SIZE - half;
+			float top = 0.25f * ((x / 4 + z / 4) % 3);
+			uint32_t first = (uint32_t)vertices.size();
+			vertices.push_back({ x0, top, z0 });
+			vertices.push_back({ x0 + BLOCK_SIZE, top, z0 });
+			vertices.push_back({ x0 + BLOCK_SIZE, top, z0 + BLOCK_SIZE });
+			vertices.push_back({ x0, top, z0 + BLOCK_SIZE });
+			vertices.push_back({ x0, -1.0f, z0 });
+			vertices.push_back({ x0 + BLOCK_SIZE, -1.0f, z0 });
+			vertices.push_back({ x0 + BLOCK_SIZE, -1.0f, z0 + BLOCK_SIZE });
+			vertices.push_back({ x0, -1.0f, z0 + BLOCK_SIZE });
+
+			// top and four sides, every face wound outwards
+			const uint32_t faces[5][4] = { { 0, 3, 2, 1 }, { 0, 1, 5, 4 }, { 1, 2, 6, 5 }, { 2, 3, 7, 6 }, { 3, 0, 4, 7 } };
+			for (const uint32_t* face : faces)
+			{
+				indices.insert(indices.end(), { first + face[0], first + face[1], first + face[2] });
+				indices.insert(indices.end(), { first + face[0], first + face[2], first + face[3] });
+			}
+		}
+	}
+
+	MeshDesc desc;
+	desc.vertices = vertices.data();
+	desc.vertexCount = (uint32_t)vertices.size();
+	desc.indices = indices.data();
+	desc.triangleCount = (uint32_t)(indices.size() / 3);
+	desc.materials = nullptr;
+	uint64_t levelId;
+	engine->AddMesh(desc, MakeProps({ 0, 0, 0 }, 0.0f, 0.2f, 0.5f), &levelId);
+
+	vector<BodyProperties> props;
+	for (size_t i = 0; i < SIDE * SIDE; i++)
+	{
+		float x = ((float)(i % SIDE) - SIDE * 0.5f) * 2.5f;
+		float z = ((float)(i / SIDE) - SIDE * 0.5f) * 2.5f;
+		props.push_back(MakeProps({ x, 2.0f, z }, 1.0f / 20.0f, 0.2f, 0.5f));
+	}
+	AddDynamicBoxes(engine, props, { 0.5f, 0.5f, 0.5f }, probeBodyId);
+}
+
+// tables of one compound shape, top and four legs, narrow phase visits only touching children
+static void BuildCompoundTables(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t SIDE = 10;
+	AddArena(engine);
+
+	vector<CompoundChildDesc> table;
+	table.push_back({ ShapeType::OrientedBox, { 1.0f, 0.1f, 0.6f }, { 0, 0.9f, 0 }, { 0, 0, 0, 1 }, 4.0f });
+	for (uint8_t leg = 0; leg < 4; leg++)
+	{
+		XMFLOAT3 position = { (leg & 1) ? 0.9f : -0.9f, 0.4f, (leg & 2) ? 0.5f : -0.5f };
+		table.push_back({ ShapeType::OrientedBox, { 0.08f, 0.4f, 0.08f }, position, { 0, 0, 0, 1 }, 0.5f });
+	}
+
+	vector<BodyProperties> props;
+	for (size_t i = 0; i < SIDE * SIDE; i++)
+	{
+		float x = ((float)(i % SIDE) - SIDE * 0.5f) * 3.0f;
+		float z = ((float)(i / SIDE) - SIDE * 0.5f) * 3.0f;
+		props.push_back(MakeProps({ x, 0.0f + (i % 3) * 1.5f, z }, 1.0f / 6.0f, 0.1f, 0.5f));
+	}
+	vector<uint64_t> bodyIds(props.size());
+	engine->AddCompoundBodies(table.data(), table.size(), props.data(), props.size(), true, bodyIds.data(), true, SCENE_BOUNDS);
+	*probeBodyId = bodyIds.back();
+}
+
+/*
+	10k bodies in grid for ray queries, static boxes and capsules with few dynamic capsules floating
+	without gravity, so dynamic tree is refit every step. Broad phase sweeps one axis only,
+	so dense field of dynamic bodies would spend the step in narrow phase of distant pairs.
+*/
+static void BuildRayField(
+	PhysicsEnigne* engine,
+	uint64_t* probeBodyId)
+{
+	constexpr size_t SIDE = 100;
+	constexpr size_t DYNAMIC_EVERY = 157;
+	AddStaticBox(engine, { 0, -1, 0 }, { SIDE * 1.5f + 10.0f, 1, SIDE * 1.5f + 10.0f });
+
+	vector<BodyProperties> boxes;
+	vector<BodyProperties> capsules;
+	vector<BodyProperties> dynamicCapsules;
+	for (size_t i = 0; i < SIDE * SIDE; i++)
+	{
+		float x = ((float)(i % SIDE) - SIDE * 0.5f) * 3.0f;
+		float z = ((float)(i / SIDE) - SIDE * 0.5f) * 3.0f;
+		float angle = i * 0.37f;
+		if (i % DYNAMIC_EVERY == 0)
+		{
+			dynamicCapsules.push_back(MakeProps({ x, 1.5f, z }, 1.0f / 20.0f, 0.5f, 0.5f));
+			dynamicCapsules.back().linVelocity = { 0.1f * cosf(angle), 0, 0.1f * sinf(angle) };
+		}
+		else if ((i + i / SIDE) % 2 == 0)
+		{
+			boxes.push_back(MakeProps({ x, 0.5f, z }, 0.0f, 0.5f, 0.5f));
+			boxes.back().rotation = { 0, sinf(angle), 0, cosf(angle) };
+		}
+		else
+		{
+			capsules.push_back(MakeProps({ x, 1.0f, z }, 0.0f, 0.5f, 0.5f));
+		}
+	}
+	vector<uint64_t> bodyIds(max(boxes.size(), capsules.size()));
+	engine->AddBodies(boxes.data(), boxes.size(), ShapeType::OrientedBox, { 0.5f, 0.5f, 0.5f }, false, bodyIds.data(), true, SCENE_BOUNDS);
+	engine->AddBodies(capsules.data(), capsules.size(), ShapeType::Capsule, { 0.5f, 0.5f, 0.5f }, false, bodyIds.data(), true, SCENE_BOUNDS);
+	engine->AddBodies(dynamicCapsules.data(), dynamicCapsules.size(), ShapeType::Capsule, { 0.5f, 0.5f, 0.5f }, true, bodyIds.data(), true, SCENE_BOUNDS, { 0, 0, 0 });
+	*probeBodyId = bodyIds[dynamicCapsules.size() - 1];
+}
+
+// same value on every platform, unlike distributions of <random>
+static float HashToSigned(
+	uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return (float)(x >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+/*
+	Agents stand between bodies of ray field, each casts 4 line of sight rays to points
+	up to 20 m around it and 4 ground probes. Rays of one agent are neighbours, so packets stay coherent.
+*/
+static void BuildAgentRays(
+	vector<RayQuery>* rays)
+{
+	constexpr size_t RAY_COUNT = 10000;
+	constexpr size_t RAYS_PER_AGENT = 8;
+	rays->resize(RAY_COUNT);
+	for (size_t i = 0; i < RAY_COUNT; i++)
+	{
+		size_t agent = i / RAYS_PER_AGENT;
+		XMFLOAT3 origin = { (agent % 50) * 6.0f - 148.5f, 1.2f, (agent / 50) * 12.0f - 148.5f };
+		XMFLOAT3 target = { origin.x, -5.0f, origin.z };
+		if (i % RAYS_PER_AGENT < RAYS_PER_AGENT / 2)
+		{
+			target = { origin.x + HashToSigned((uint32_t)i * 3) * 20.0f, 0.5f + HashToSigned((uint32_t)i * 3 + 1) * 0.5f, origin.z + HashToSigned((uint32_t)i * 3 + 2) * 20.0f };
+		}
+
+		XMVECTOR toTarget = XMLoadFloat3(&target) - XMLoadFloat3(&origin);
+		(*rays)[i].origin = origin;
+		XMStoreFloat3(&(*rays)[i].direction, XMVector3Normalize(toTarget));
+		XMStoreFloat(&(*rays)[i].maxDistance, XMVector3Length(toTarget));
+	}
+}
+
+const BenchmarkScene BENCHMARK_SCENES[] =
+{
+	{ "box_pyramid", 600, 1.0f / 120.0f, BuildBoxPyramid, nullptr, nullptr },
+	{ "falling_crates_10k", 120, 1.0f / 120.0f, BuildFallingCrates, nullptr, nullptr },
+	{ "domino_chain", 600, 1.0f / 120.0f, BuildDominoChain, nullptr, nullptr },
+	{ "rotated_box_pile", 600, 1.0f / 120.0f, BuildRotatedPile, nullptr, nullptr },
+	{ "projectile_thin_wall", 120, 1.0f / 60.0f, BuildProjectileAndThinWall, CheckProjectileInFront, nullptr },
+	{ "terrain_crates", 300, 1.0f / 120.0f, BuildTerrainCrates, nullptr, nullptr },
+	{ "mesh_level", 300, 1.0f / 120.0f, BuildMeshLevel, nullptr, nullptr },
+	{ "compound_tables", 600, 1.0f / 120.0f, BuildCompoundTables, nullptr, nullptr },
+	{ "ray_queries", 60, 1.0f / 60.0f, BuildRayField, nullptr, BuildAgentRays },
+};
+
+const size_t BENCHMARK_SCENE_COUNT = sizeof(BENCHMARK_SCENES) / sizeof(BENCHMARK_SCENES[0]);
@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+#include "../Physics/PhysicsEnigne.h"
+
+/*
+	Canonical scene for benchmarking the physics engine without window or renderer.
+	build fills empty engine and returns body whose final position is reported,
+	e.g. projectile that must not tunnel through the wall. Rays of buildRays are cast
+	with CastRays in both modes after every step.
+*/
+struct BenchmarkScene
+{
+	const char* name;
+	size_t defaultSteps;
+	float dt;
+	void (*build)(PhysicsEnigne* engine, uint64_t* probeBodyId);
+	bool (*checkProbe)(const DirectX::XMFLOAT3& position); // final position of probe is valid, nullptr when anything is
+	void (*buildRays)(std::vector<RayQuery>* rays); // nullptr when scene casts no rays
+};
+
+extern const BenchmarkScene BENCHMARK_SCENES[];
+extern const size_t BENCHMARK_SCENE_COUNT;
@@ -0,0 +1,467 @@
+#include "BenchmarkScenes.hpp"
+#include "../Physics/PhysicsWorldBatch.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+/*
+	Runs canonical scenes headless and prints results as JSON.
+	Rays of a scene are cast on the calling thread after every step, closest and any hit casts are timed apart.
+	With --batch every scene is stepped again as that many worlds of PhysicsWorldBatch,
+	each world must end with checksum of the scene stepped alone.
+	With --rollback every scene snapshots at its start and takes delta that many steps before its end,
+	once the scene finished it restores the delta and steps again, repeatedly, like rollback netcode does
+	after late input. Every resimulation must end with checksum of the straight run.
+	With --replay recording of PhysicsEnigne::StartRecording is replayed instead of scenes,
+	time of every step and the first step that diverged from the recorded checksum are reported.
+	Exits with 1 when probe of some scene fails its check, e.g. projectile tunnelled through the wall,
+	when any hit and closest casts hit different number of rays, when resimulation after rollback diverged,
+	when some world of the batch diverged or when replay diverged.
+	usage: PhysicsBenchmark [--scene name] [--steps count] [--threads count] [--contacts substeps|speculative] [--reorder steps] [--batch worlds] [--rollback steps] [--replay path] [--out path]
+*/
+
+struct SceneResult
+{
+	const char* name;
+	size_t bodyCount;
+	size_t steps;
+	float dt;
+	double totalMs;
+	double meanStepMs;
+	double maxStepMs;
+	double p99StepMs;
+	double phaseMs[(size_t)PhysicsPhase::Count]; // mean per step
+	double candidatePairs; // mean per step
+	double contacts; // mean per step
+	uint64_t substeps;
+	uint64_t triangleTests;
+	uint64_t gjkMaxIterationHits;
+	uint64_t speculativeContacts;
+	uint64_t reorderedBodies;
+	size_t peakMemoryBytes;
+	uint64_t checksum;
+	bool hasProbe;
+	DirectX::XMFLOAT3 probePosition;
+	bool probeValid; // probe passed the check of its scene
+	size_t rayCount; // rays cast in every mode after every step
+	double rayMeanMs[2]; // indexed by RayQueryMode
+	double rayMaxMs[2];
+	size_t rayHits[2]; // of the last step
+	bool rayHitsValid; // every ray hit by closest cast was hit by any hit cast too
+	size_t rollbackSteps; // 0 when scene wasn't rolled back
+	double rollbackMeanMs;
+	double rollbackMaxMs;
+	bool rollbackValid; // every resimulation ended with checksum of the straight run
+	size_t batchWorlds; // 0 when scene wasn't stepped in PhysicsWorldBatch
+	double batchTotalMs;
+	size_t batchMismatches; // worlds whose checksum differs from the scene stepped alone
+};
+
+// resimulation of ROLLBACK_REPEATS rollbacks is timed, restore included
+constexpr size_t ROLLBACK_REPEATS = 10;
+constexpr double ROLLBACK_BUDGET_MS = 16.0;
+
+static const char* PHASE_NAMES[] = { "broadPhase", "narrowPhase", "sort", "resolve", "integrate" };
+
+static SceneResult RunScene(
+	const BenchmarkScene& scene,
+	size_t steps,
+	ContactMode contactMode,
+	uint32_t reorderInterval,
+	size_t rollbackSteps,
+	JobSystem* jobSystem)
+{
+	PhysicsEnigne engine(200, 200, jobSystem);
+	uint64_t probeBodyId = 0;
+	engine.SetContactMode(contactMode);
+	engine.SetBodyReorderInterval(reorderInterval);
+	scene.build(&engine, &probeBodyId);
+
+	SceneResult result = {};
+	result.name = scene.name;
+	result.bodyCount = engine.dynamicBodies.size() + engine.staticBodies.size();
+	result.steps = steps;
+	result.dt = scene.dt;
+
+	vector<RayQuery> rays;
+	if (scene.buildRays)
+	{
+		scene.buildRays(&rays);
+	}
+	vector<RayHit> hits(rays.size());
+	result.rayCount = rays.size();
+	result.rayHitsValid = true;
+
+	// delta against snapshot of the start holds bodies that moved since, as netcode would keep it
+	PhysicsSnapshot rollbackBase;
+	PhysicsSnapshot rollbackDelta;
+	rollbackSteps = min(rollbackSteps, steps);
+	if (rollbackSteps > 0)
+	{
+		engine.Snapshot(&rollbackBase);
+	}
+
+	vector<double> stepTimes(steps);
+	PhysicsStats stats;
+	for (size_t i = 0; i < steps; i++)
+	{
+		if (rollbackSteps > 0 && i == steps - rollbackSteps)
+		{
+			engine.Snapshot(&rollbackDelta, &rollbackBase);
+		}
+
+		auto start = chrono::steady_clock::now();
+		engine.UpdateBodies(scene.dt);
+		stepTimes[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		for (size_t mode = 0; mode < 2 && !rays.empty(); mode++)
+		{
+			start = chrono::steady_clock::now();
+			result.rayHits[mode] = engine.CastRays(rays.data(), rays.size(), (RayQueryMode)mode, hits.data());
+			double rayMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			result.rayMeanMs[mode] += rayMs;
+			result.rayMaxMs[mode] = max(result.rayMaxMs[mode], rayMs);
+		}
+		result.rayHitsValid = result.rayHitsValid && result.rayHits[(size_t)RayQueryMode::Closest] == result.rayHits[(size_t)RayQueryMode::AnyHit];
+
+		engine.GetStats(&stats);
+		for (size_t phase = 0; phase < (size_t)PhysicsPhase::Count; phase++)
+		{
+			result.phaseMs[phase] += stats.phaseMs[phase];
+		}
+		result.candidatePairs += (double)stats.candidatePairs;
+		result.contacts += (double)stats.contacts;
+		result.substeps += stats.intersection.substeps;
+		result.triangleTests += stats.intersection.triangleTests;
+		result.gjkMaxIterationHits += stats.intersection.gjkMaxIterationHits;
+		result.speculativeContacts += stats.intersection.speculativeContacts;
+		result.reorderedBodies += stats.reorderedBodies;
+		result.peakMemoryBytes = max(result.peakMemoryBytes, engine.GetMemoryUsage());
+	}
+
+	for (double stepTime : stepTimes)
+	{
+		result.totalMs += stepTime;
+		result.maxStepMs = max(result.maxStepMs, stepTime);
+	}
+	if (steps > 0)
+	{
+		result.meanStepMs = result.totalMs / steps;
+		for (double& phaseMs : result.phaseMs)
+		{
+			phaseMs /= steps;
+		}
+		result.candidatePairs /= steps;
+		result.contacts /= steps;
+		result.rayMeanMs[0] /= steps;
+		result.rayMeanMs[1] /= steps;
+
+		sort(stepTimes.begin(), stepTimes.end());
+		result.p99StepMs = stepTimes[min(steps - 1, steps * 99 / 100)];
+	}
+
+	result.checksum = engine.GetStateChecksum();
+	result.rollbackSteps = rollbackSteps;
+	result.rollbackValid = true;
+	for (size_t repeat = 0; repeat < ROLLBACK_REPEATS && rollbackSteps > 0; repeat++)
+	{
+		auto start = chrono::steady_clock::now();
+		bool restored = engine.Restore(rollbackDelta, &rollbackBase) == 0;
+		for (size_t i = 0; i < rollbackSteps && restored; i++)
+		{
+			engine.UpdateBodies(scene.dt);
+		}
+		double rollbackMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		result.rollbackMeanMs += rollbackMs / ROLLBACK_REPEATS;
+		result.rollbackMaxMs = max(result.rollbackMaxMs, rollbackMs);
+		result.rollbackValid = result.rollbackValid && restored && engine.GetStateChecksum() == result.checksum;
+	}
+	if (rollbackSteps > 0)
+	{
+		engine.ReleaseSnapshot(&rollbackDelta);
+		engine.ReleaseSnapshot(&rollbackBase);
+	}
+
+	const Body* probe = engine.GetBody(probeBodyId);
+	result.hasProbe = probe != nullptr;
+	if (probe)
+	{
+		result.probePosition = probe->position;
+	}
+	result.probeValid = !scene.checkProbe || (probe && scene.checkProbe(result.probePosition));
+	return result;
+}
+
+static void RunBatch(
+	const BenchmarkScene& scene,
+	size_t steps,
+	ContactMode contactMode,
+	uint32_t reorderInterval,
+	size_t worldCount,
+	JobSystem* jobSystem,
+	SceneResult* result)
+{
+	PhysicsWorldBatch batch(jobSystem);
+	for (size_t i = 0; i < worldCount; i++)
+	{
+		PhysicsEnigne* world = batch.GetWorld(batch.AddWorld(200, 200));
+		uint64_t probeBodyId = 0;
+		world->SetContactMode(contactMode);
+		world->SetBodyReorderInterval(reorderInterval);
+		scene.build(world, &probeBodyId);
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < steps; i++)
+	{
+		batch.UpdateWorlds(scene.dt);
+	}
+	result->batchTotalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	result->batchWorlds = worldCount;
+
+	// every world is the same scene, grouping must not change its result
+	for (size_t i = 0; i < worldCount; i++)
+	{
+		result->batchMismatches += batch.GetWorld(i)->GetStateChecksum() != result->checksum ? 1 : 0;
+	}
+}
+
+static void WriteResult(
+	FILE* out,
+	const SceneResult& result,
+	bool last)
+{
+	fprintf(out, "    {\n");
+	fprintf(out, "      \"name\": \"%s\",\n", result.name);
+	fprintf(out, "      \"bodies\": %zu,\n", result.bodyCount);
+	fprintf(out, "      \"steps\": %zu,\n", result.steps);
+	fprintf(out, "      \"dt\": %g,\n", result.dt);
+	fprintf(out, "      \"totalMs\": %.3f,\n", result.totalMs);
+	fprintf(out, "      \"stepsPerSecond\": %.2f,\n", result.totalMs > 0.0 ? result.steps * 1000.0 / result.totalMs : 0.0);
+	fprintf(out, "      \"stepMs\": { \"mean\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		result.meanStepMs, result.p99StepMs, result.maxStepMs);
+	fprintf(out, "      \"phaseMs\": {");
+	for (size_t phase = 0; phase < (size_t)PhysicsPhase::Count; phase++)
+	{
+		fprintf(out, "%s \"%s\": %.4f", phase > 0 ? "," : "", PHASE_NAMES[phase], result.phaseMs[phase]);
+	}
+	fprintf(out, " },\n");
+	fprintf(out, "      \"candidatePairs\": %.1f,\n", result.candidatePairs);
+	fprintf(out, "      \"contacts\": %.1f,\n", result.contacts);
+	fprintf(out, "      \"substeps\": %llu,\n", (unsigned long long)result.substeps);
+	fprintf(out, "      \"triangleTests\": %llu,\n", (unsigned long long)result.triangleTests);
+	fprintf(out, "      \"gjkMaxIterationHits\": %llu,\n", (unsigned long long)result.gjkMaxIterationHits);
+	fprintf(out, "      \"speculativeContacts\": %llu,\n", (unsigned long long)result.speculativeContacts);
+	fprintf(out, "      \"reorderedBodies\": %llu,\n", (unsigned long long)result.reorderedBodies);
+	fprintf(out, "      \"peakMemoryBytes\": %zu,\n", result.peakMemoryBytes);
+	if (result.hasProbe)
+	{
+		fprintf(out, "      \"probe\": [%.4f, %.4f, %.4f],\n",
+			result.probePosition.x, result.probePosition.y, result.probePosition.z);
+	}
+	fprintf(out, "      \"probeValid\": %s,\n", result.probeValid ? "true" : "false");
+	if (result.rayCount > 0)
+	{
+		fprintf(out, "      \"rays\": { \"count\": %zu, \"hitsValid\": %s,\n", result.rayCount, result.rayHitsValid ? "true" : "false");
+		fprintf(out, "        \"closest\": { \"meanMs\": %.4f, \"maxMs\": %.4f, \"hits\": %zu },\n",
+			result.rayMeanMs[(size_t)RayQueryMode::Closest], result.rayMaxMs[(size_t)RayQueryMode::Closest], result.rayHits[(size_t)RayQueryMode::Closest]);
+		fprintf(out, "        \"anyHit\": { \"meanMs\": %.4f, \"maxMs\": %.4f, \"hits\": %zu } },\n",
+			result.rayMeanMs[(size_t)RayQueryMode::AnyHit], result.rayMaxMs[(size_t)RayQueryMode::AnyHit], result.rayHits[(size_t)RayQueryMode::AnyHit]);
+	}
+	if (result.rollbackSteps > 0)
+	{
+		fprintf(out, "      \"rollback\": { \"steps\": %zu, \"meanMs\": %.4f, \"maxMs\": %.4f, \"withinBudget\": %s, \"valid\": %s },\n",
+			result.rollbackSteps, result.rollbackMeanMs, result.rollbackMaxMs,
+			result.rollbackMaxMs <= ROLLBACK_BUDGET_MS ? "true" : "false", result.rollbackValid ? "true" : "false");
+	}
+	if (result.batchWorlds > 0)
+	{
+		fprintf(out, "      \"batch\": { \"worlds\": %zu, \"totalMs\": %.3f, \"worldStepsPerSecond\": %.2f, \"mismatches\": %zu },\n",
+			result.batchWorlds, result.batchTotalMs,
+			result.batchTotalMs > 0.0 ? result.batchWorlds * result.steps * 1000.0 / result.batchTotalMs : 0.0,
+			result.batchMismatches);
+	}
+	fprintf(out, "      \"checksum\": \"%016llx\"\n", (unsigned long long)result.checksum);
+	fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+static void WriteReplay(
+	FILE* out,
+	const char* path,
+	const vector<ReplayStep>& steps,
+	size_t firstDivergedStep)
+{
+	vector<double> stepTimes;
+	double totalMs = 0.0;
+	for (const ReplayStep& step : steps)
+	{
+		stepTimes.push_back(step.stepTimeMs);
+		totalMs += step.stepTimeMs;
+	}
+	sort(stepTimes.begin(), stepTimes.end());
+
+	fprintf(out, "  \"replay\": {\n");
+	fprintf(out, "    \"path\": \"%s\",\n", path);
+	fprintf(out, "    \"steps\": %zu,\n", steps.size());
+	fprintf(out, "    \"totalMs\": %.3f,\n", totalMs);
+	fprintf(out, "    \"stepMs\": { \"mean\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		steps.empty() ? 0.0 : totalMs / steps.size(),
+		steps.empty() ? 0.0 : stepTimes[min(steps.size() - 1, steps.size() * 99 / 100)],
+		steps.empty() ? 0.0 : stepTimes.back());
+	if (firstDivergedStep == SIZE_MAX)
+	{
+		fprintf(out, "    \"firstDivergedStep\": null,\n");
+	}
+	else
+	{
+		fprintf(out, "    \"firstDivergedStep\": %zu,\n", firstDivergedStep);
+	}
+	fprintf(out, "    \"timesMs\": [");
+	for (size_t i = 0; i < steps.size(); i++)
+	{
+		fprintf(out, "%s%.4f", i > 0 ? ", " : "", steps[i].stepTimeMs);
+	}
+	fprintf(out, "]\n  }\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* sceneFilter = nullptr;
+	const char* outPath = nullptr;
+	const char* replayPath = nullptr;
+	size_t steps = 0;
+	size_t threads = SIZE_MAX;
+	ContactMode contactMode = ContactMode::Substeps;
+	uint32_t reorderInterval = 0;
+	size_t batchWorlds = 0;
+	size_t rollbackSteps = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "--scene") == 0) { sceneFilter = argv[++i]; }
+		else if (i + 1 < argc && strcmp(argv[i], "--steps") == 0) { steps = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) { threads = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--out") == 0) { outPath = argv[++i]; }
+		else if (i + 1 < argc && strcmp(argv[i], "--contacts") == 0 && strcmp(argv[i + 1], "substeps") == 0) { contactMode = ContactMode::Substeps; i++; }
+		else if (i + 1 < argc && strcmp(argv[i], "--contacts") == 0 && strcmp(argv[i + 1], "speculative") == 0) { contactMode = ContactMode::Speculative; i++; }
+		else if (i + 1 < argc && strcmp(argv[i], "--reorder") == 0) { reorderInterval = (uint32_t)strtoul(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--batch") == 0) { batchWorlds = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--rollback") == 0) { rollbackSteps = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--replay") == 0) { replayPath = argv[++i]; }
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	// --threads counts calling thread as well
+	JobSystem jobSystem(threads == SIZE_MAX ? max(thread::hardware_concurrency(), 1u) - 1 : (threads > 0 ? threads - 1 : 0));
+
+	if (replayPath)
+	{
+		// recording brings its own contact mode and bodies, scene options don't apply
+		PhysicsRecorder recorder;
+		PhysicsEnigne engine(200, 200, &jobSystem);
+		vector<ReplayStep> replaySteps;
+		size_t firstDivergedStep = SIZE_MAX;
+		if (recorder.Load(replayPath) != 0 || ReplayRecording(recorder, &engine, &replaySteps, &firstDivergedStep) != 0)
+		{
+			fprintf(stderr, "failed to replay %s\n", replayPath);
+			return -1;
+		}
+
+		FILE* out = outPath ? fopen(outPath, "w") : stdout;
+		if (!out)
+		{
+			fprintf(stderr, "failed to open %s\n", outPath);
+			return -1;
+		}
+		fprintf(out, "{\n  \"threads\": %zu,\n", jobSystem.GetThreadCount());
+		WriteReplay(out, replayPath, replaySteps, firstDivergedStep);
+		fprintf(out, "}\n");
+		if (out != stdout)
+		{
+			fclose(out);
+		}
+
+		if (firstDivergedStep != SIZE_MAX)
+		{
+			fprintf(stderr, "replay of %s diverged at step %zu\n", replayPath, firstDivergedStep);
+			return 1;
+		}
+		return 0;
+	}
+
+	vector<SceneResult> results;
+	for (size_t i = 0; i < BENCHMARK_SCENE_COUNT; i++)
+	{
+		const BenchmarkScene& scene = BENCHMARK_SCENES[i];
+		if (sceneFilter && strcmp(sceneFilter, scene.name) != 0)
+		{
+			continue;
+		}
+		size_t sceneSteps = steps > 0 ? steps : scene.defaultSteps;
+		results.push_back(RunScene(scene, sceneSteps, contactMode, reorderInterval, rollbackSteps, &jobSystem));
+		if (batchWorlds > 0)
+		{
+			RunBatch(scene, sceneSteps, contactMode, reorderInterval, batchWorlds, &jobSystem, &results.back());
+		}
+	}
+
+	if (results.empty())
+	{
+		fprintf(stderr, "no scene matches %s\n", sceneFilter);
+		return -1;
+	}
+
+	FILE* out = outPath ? fopen(outPath, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "failed to open %s\n", outPath);
+		return -1;
+	}
+
+	fprintf(out, "{\n  \"threads\": %zu,\n  \"scenes\": [\n", jobSystem.GetThreadCount());
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		WriteResult(out, results[i], i + 1 == results.size());
+	}
+	fprintf(out, "  ]\n}\n");
+
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+
+	// e.g. projectile tunnelled through the wall
+	int exitCode = 0;
+	for (const SceneResult& result : results)
+	{
+		if (!result.probeValid)
+		{
+			fprintf(stderr, "probe of %s failed check of the scene\n", result.name);
+			exitCode = 1;
+		}
+		if (!result.rayHitsValid)
+		{
+			fprintf(stderr, "any hit rays of %s hit different number of rays than closest ones\n", result.name);
+			exitCode = 1;
+		}
+		if (!result.rollbackValid)
+		{
+			fprintf(stderr, "resimulation of %s after rollback diverged from the straight run\n", result.name);
+			exitCode = 1;
+		}
+		if (result.batchMismatches > 0)
+		{
+			fprintf(stderr, "%zu of %zu batched worlds of %s diverged from the scene stepped alone\n",
+				result.batchMismatches, result.batchWorlds, result.name);
+			exitCode = 1;
+		}
+	}
+	return exitCode;
+}
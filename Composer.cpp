@@ -1,10 +1,10 @@
 #include "Composer.hpp"
 #include "Renderer/CommonShapes.hpp"
 #include <random>
+#include <algorithm>
 using namespace DirectX;
 using namespace std;
 
-static constexpr XMFLOAT3 gravityForce = { 0, -15, 0 };
 static constexpr XMFLOAT3 eyeInitial = { -10.0f, 9.0f, -25.0f };
 static constexpr XMFLOAT3 lookDirInitial = { 0.0f, 0.0f, 1.0f };
 static constexpr XMFLOAT3 upInitial = { 0.0f, 1.0f, 0.0f };
@@ -14,24 +14,60 @@ struct Texel
     char r, g, b, a;
 };
 
-struct PointProjection
+static int64_t OnEntitiesAdded(
+    void* context,
+    size_t firstEntity,
+    size_t count)
 {
-    float dist;
-    XMFLOAT3 ptOnSurfA;
-    XMFLOAT3 ptOnSurfB;
-    size_t idBodyA;
-    size_t idBodyB;
-};
+    Composer* composer = (Composer*)context;
+    Scene* scene = composer->scene;
+    vector<uint64_t> uboIds(count);
+    if (composer->renderer->AllocateUboResources(composer->uboPool, UBO_OBJ_TRSF_RESOURCE_TYPE, count, uboIds.data()) != 0)
+    {
+        return -1;
+    }
+
+    composer->physicsEntitiesTrsfm.resize(firstEntity + count);
+    composer->renderEntities.resize(firstEntity + count, { 0, 0, 0, 0 });
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t entityIdx = firstEntity + i;
+        ObjectUbo& entityTrsfm = composer->physicsEntitiesTrsfm[entityIdx];
+        const XMUINT4& objInfo = scene->entityInfos[entityIdx];
+        composer->renderEntities[entityIdx].transformUboId = uboIds[i];
+        scene->physicsEngine->GetTransformMatrixForBody(scene->physicsEntities[entityIdx], &entityTrsfm.transform);
+
+        entityTrsfm.objInfo[0] = objInfo.x;
+        entityTrsfm.objInfo[1] = objInfo.y;
+        entityTrsfm.objInfo[2] = objInfo.z;
+        entityTrsfm.objInfo[3] = objInfo.w;
+    }
+    return 0;
+}
+
+static void OnEntityRemoved(
+    void* context,
+    size_t entityIdx)
+{
+    Composer* composer = (Composer*)context;
+    size_t lastIdx = composer->renderEntities.size() - 1;
+    composer->renderer->FreeUboResources(composer->uboPool, &composer->renderEntities[entityIdx].transformUboId, 1);
+    if (entityIdx != lastIdx)
+    {
+        composer->physicsEntitiesTrsfm[entityIdx] = composer->physicsEntitiesTrsfm[lastIdx];
+        composer->renderEntities[entityIdx] = composer->renderEntities[lastIdx];
+    }
+    composer->physicsEntitiesTrsfm.pop_back();
+    composer->renderEntities.pop_back();
+}
 
 Composer::Composer(
     Renderer* renderer,
-    PhysicsEnigne* physicsEngine)
+    Scene* scene)
     :
     cameraAngleX(0), cameraAngleY(0), camOrientation(eyeInitial, upInitial, lookDirInitial),
-    renderer(renderer), physicsEngine(physicsEngine), calculatePhysics(true), frameMode(true),
-    characterVelocity({ 0, 0, 0 }), constForce(gravityForce), dragCoeff({ 0.98f, 1.0f,  0.98f }),
-    orientationDir({ 1, 0, 0 }), forwardDir({ 1, 0, 0 }), upDir({ 0,1,0 }), rightDir({ 0,0,-1 }),
-    characterVelocityCoeff({ 70000, 70000, 70000 }), freeFall(true), scalesVel({1.0f, 1.0f, 1.0f})
+    renderer(renderer), scene(scene)
 {
     lights = { Light{{1, 1, 1, 1.0f}, {-40.0f, 20.0f, 0.0f, 0.05f} } };
     vector<TextureDim> dims(10, TextureDim{ 300, 300});
@@ -52,7 +88,7 @@ Composer::Composer(
 
     UpdateShadowmapGlobalBuffer();
     UpdateGlobalBuffer();
-    GenerateObjects();
+    scene->SetListener({ this, OnEntitiesAdded, OnEntityRemoved });
     UpdateTextures(dims, { 1000,  1000 });
 }
 
@@ -67,13 +103,6 @@ void Composer::RenderScene()
     renderer->Present();
 }
 
-void Composer::AddWalkableCuboid(
-    uint64_t bodyId, 
-    uint8_t faceId)
-{
-    walkableCuboids.push_back({ bodyId, faceId });
-}
-
 void Composer::UpdateTextures(
     const std::vector<TextureDim>& dims,
     TextureDim skyboxDims)
@@ -145,24 +174,6 @@ void Composer::UpdateTextures(
     delete[] texData;
 }
 
-bool Composer::CheckIfObjIsOnWalkableCuboidSurface(
-    const DirectX::XMFLOAT3& ptOnCuboid,
-    size_t cuboidIdx)
-{
-    XMFLOAT3 faceNormal;
-    WalkableCuboid& cuboidDex = walkableCuboids[cuboidIdx];
-    Body* cuboid = physicsEngine->GetBody(cuboidDex.bodyId);
-    cuboid->GetLocalSpaceFaceNormalFromPoint(&ptOnCuboid, &faceNormal);
-
-    if (faceNormal.x == 1.0f && (cuboidDex.faceIds & w_right) > 0) { return true; };
-    if (faceNormal.x == -1.0f && (cuboidDex.faceIds & w_left) > 0) { return true; };
-    if (faceNormal.y == 1.0f && (cuboidDex.faceIds & w_top) > 0) { return true; };
-    if (faceNormal.y == -1.0f && (cuboidDex.faceIds & w_bottom) > 0) { return true; };
-    if (faceNormal.z == 1.0f && (cuboidDex.faceIds & w_back) > 0) { return true; };
-    if (faceNormal.z == -1.0f && (cuboidDex.faceIds & w_front) > 0) { return true; };
-    return false;
-}
-
 void Composer::UpdateCamera()
 {
     XMVECTOR eyePos = XMLoadFloat3(&camOrientation.eye);
@@ -175,212 +186,27 @@ void Composer::UpdateCamera()
     renderer->UpdateUboMemory(uboPool, globalUbo, globalUboBuffer);
 }
 
-void Composer::GenerateObjects()
-{
-    // character
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { -3, 1, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 1.0f/40.f;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 0.0f;
-        bodyProps.friction = 0.0f;
-        XMFLOAT3 scales = { 0.5f, 0.5f, 0.5f};
-        XMUINT4 objInfo = {0, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, false, { 0, 0, 0 });
-        characterId = physicsEntities.back();
-    }
-    
-    // collider
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 10, 2, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 1.0f / 20.f;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 0.5f;
-        bodyProps.friction = 1.0f;
-        XMFLOAT3 scales = { 1.0f, 1.0f, 1.0f };
-        XMUINT4 objInfo = { 1, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-    }
-
-    // floor
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 0, -2, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 35, 1, 35 };
-        XMUINT4 objInfo = { 2, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-        AddWalkableCuboid(physicsEntities.back(), w_top);
-    }
-    // left wall
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { -35, 0, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 1, 20, 39 };
-        XMUINT4 objInfo = { 3, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-    }
-
-    // right wall
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 35, 0, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 1, 20, 35 };
-        XMUINT4 objInfo = { 3, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-    }
-
-    // front wall
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 0, 0, -35 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 35, 20, 1 };
-        XMUINT4 objInfo = { 3, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-    }
-
-    // back wall
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 0, 0, 35 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 35, 20, 1 };
-        XMUINT4 objInfo = { 3, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-    }
-
-
-    // ramp
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 0, 0, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        float angle = -3.14f / 6.0f;
-        bodyProps.rotation = { 0, 0, 1.0f * sinf(angle/2.0f), cosf(angle/ 2.0f)};
-        bodyProps.elasticity = 0.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 5, 1, 1 };
-        XMUINT4 objInfo = { 4, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-        AddWalkableCuboid(physicsEntities.back(), w_top);
-    }
-
-    // balcony
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { 8.85, 2.374, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0, 0, 0, 1 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 5, 1, 5 };
-        XMUINT4 objInfo = { 5, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
-        AddWalkableCuboid(physicsEntities.back(), w_top);
-    }
-
-    // rotated box
-    {
-        BodyProperties bodyProps;
-        bodyProps.position = { -15, 14, 0 };
-        bodyProps.linVelocity = { 0, 0, 0 };
-        bodyProps.angVelocity = { 0, 0, 0 };
-        bodyProps.massInv = 0;
-        bodyProps.rotation = { 0.4364358, 0.8728716, 0.2182179, 0.7 };
-        bodyProps.elasticity = 1.0f;
-        bodyProps.friction = 0.01f;
-        XMFLOAT3 scales = { 1.4, 1.4, 1.4 };
-        XMUINT4 objInfo = { 5, 0, 0 ,0 };
-        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
-        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, false);
-    }
-
-}
-
 void Composer::UpdateObjects(
     float dt)
 {
-    if (calculatePhysics)
+    // bodies in view are kept at full rate even when camera is away from the character
+    scene->lodObservers.assign(1, camOrientation.eye);
+    scene->Step(dt);
+
+    // only entities that moved since last frame get new matrix and upload
+    // export can't write mapped ubo memory directly: ubo entries of entities aren't one strided array,
+    // freed ids are reused and removing an entity moves the last one into its place. Pool memory is
+    // mapped once and not ring buffered per frame in flight, so one bufferId is enough for the copy.
+    size_t movedCount = 0;
+    movedEntities.resize(physicsEntitiesTrsfm.size());
+    scene->physicsEngine->ExportTransforms(0, physicsEntitiesTrsfm.data(), sizeof(ObjectUbo), scene->physicsEntities.data(),
+        physicsEntitiesTrsfm.size(), movedEntities.data(), &movedCount);
+
+    for (size_t i = 0; i < movedCount; i++)
     {
-        XMFLOAT3 velocity;
-        XMStoreFloat3(&velocity,
-           XMLoadFloat3(&scalesVel) * 
-           ( characterVelocity.z * XMLoadFloat3(&forwardDir) + characterVelocity.x * XMLoadFloat3(&rightDir)));
-
-
-        physicsEngine->AddForce(characterId, X_COMPONENT | Y_COMPONENT | Z_COMPONENT, constForce);
-        physicsEngine->AddForce(characterId, X_COMPONENT | Y_COMPONENT | Z_COMPONENT, velocity);
-        physicsEngine->UpdateBodies(dt);
-
-  
-
-        physicsEngine->GetLinearVelocity(characterId, &velocity);
-        velocity.x *= dragCoeff.x;
-        velocity.y *= dragCoeff.y;
-        velocity.z *= dragCoeff.z;
-        physicsEngine->SetLinearVelocity(characterId, X_COMPONENT | Y_COMPONENT | Z_COMPONENT, velocity);
-
-        if (frameMode)
-        {
-            calculatePhysics = false;
-        }
+        uint32_t entityIdx = movedEntities[i];
+        renderer->UpdateUboMemory(uboPool, renderEntities[entityIdx].transformUboId, (char*) &physicsEntitiesTrsfm[entityIdx].transform);
     }
-
-    for (size_t i = 0; i < physicsEntitiesTrsfm.size(); i++)
-    {
-        physicsEngine->GetTransformMatrixForBody(physicsEntities[i], &physicsEntitiesTrsfm[i].transform);
-        renderer->UpdateUboMemory(uboPool, renderEntities[i].transformUboId, (char*) &physicsEntitiesTrsfm[i].transform);
-    }
-
-    UpdateMovementVectors();
-    characterVelocity = { 0, 0, 0 };
     return;
 }
 
@@ -401,11 +227,11 @@ void Composer::ProcessUserInput(
     {
         if (event.Code == 'T' && event.Type == Window::KeyEvent::Event::Press)
         {
-            calculatePhysics = !calculatePhysics;
+            scene->calculatePhysics = !scene->calculatePhysics;
         }
         else if (event.Code == 'Y' && event.Type == Window::KeyEvent::Event::Press)
         {
-            frameMode = !frameMode;
+            scene->frameMode = !scene->frameMode;
         }
         event = window->ReadKeyEvent();
     }
@@ -419,19 +245,19 @@ void Composer::ProcessUserInput(
 
     if (window->IsKeyPressed(VK_UP))
     {
-        characterVelocity.z += characterVelocityCoeff.z * dt;
+        scene->characterVelocity.z += 1.0f;
     }
     if (window->IsKeyPressed(VK_DOWN))
     {
-        characterVelocity.z -= characterVelocityCoeff.z * dt;
+        scene->characterVelocity.z -= 1.0f;
     }
     if (window->IsKeyPressed(VK_LEFT))
     {
-        characterVelocity.x -= characterVelocityCoeff.x * dt;
+        scene->characterVelocity.x -= 1.0f;
     }
     if (window->IsKeyPressed(VK_RIGHT))
     {
-        characterVelocity.x += characterVelocityCoeff.x * dt;
+        scene->characterVelocity.x += 1.0f;
     }
     
 
@@ -515,96 +341,10 @@ void Composer::UpdateShadowmapGlobalBuffer()
     renderer->UpdateUboMemory(uboPool, shadowmapGlobalUbo, shadowmapUboBuffer);
 }
 
-void Composer::AddBody(
-    const ShapeType& type,
-    const BodyProperties& props,
-    const DirectX::XMFLOAT3& scales,
-    const DirectX::XMUINT4& objInfo,
-    const LinearVelocityBounds& vBounds,
-    bool allowAngularImpulse,
-    const DirectX::XMFLOAT3& constForce)
-{
-    uint64_t uboId;
-    renderer->AllocateUboResource(uboPool, UBO_OBJ_TRSF_RESOURCE_TYPE, &uboId);
-    renderEntities.push_back({ 0, 0, uboId, 0 });
-
-    size_t entitySize = physicsEntities.size();
-    physicsEntities.push_back(0);
-    physicsEntitiesTrsfm.push_back({});
-
-    bool isDynamic = props.massInv != 0.0f;
-    physicsEngine->AddBody(props, type, scales, isDynamic, &physicsEntities[entitySize], allowAngularImpulse, vBounds, constForce);
-    physicsEngine->GetTransformMatrixForBody(physicsEntities[entitySize], &physicsEntitiesTrsfm[entitySize].transform);
-
-    physicsEntitiesTrsfm[entitySize].objInfo[0] = objInfo.x;
-    physicsEntitiesTrsfm[entitySize].objInfo[1] = objInfo.y;
-    physicsEntitiesTrsfm[entitySize].objInfo[2] = objInfo.z;
-    physicsEntitiesTrsfm[entitySize].objInfo[3] = objInfo.w;
-
-}
-
-void Composer::UpdateMovementVectors()
+void Composer::GetPhysicsStats(
+    PhysicsStats* stats) const
 {
-    PointProjection projection{ 1e10 };
-
-    size_t id = 0;
-    for (size_t j = 0; j < walkableCuboids.size(); j++)
-    {
-        float dist;
-        XMFLOAT3 ptOnCharacter, ptOnSurface;
-        physicsEngine->GetDistanceBetweenBodies(characterId, walkableCuboids[j].bodyId, &ptOnCharacter, &ptOnSurface, &dist);
-        if (dist > 0.0f &&  dist < projection.dist)
-        {
-            projection.dist = dist;
-            projection.ptOnSurfA = ptOnCharacter;
-            projection.ptOnSurfB = ptOnSurface;
-            projection.idBodyA = characterId;
-            projection.idBodyB = walkableCuboids[j].bodyId;
-            id = j;
-        }
-    }
-
-    if (!CheckIfObjIsOnWalkableCuboidSurface(projection.ptOnSurfB, id))
-    {
-        return;
-    }
-
-    Body* surface = physicsEngine->GetBody(projection.idBodyB);
-    surface->GetWorldSpaceFaceNormalFromPoint(&projection.ptOnSurfB, &upDir);
-
-    XMVECTOR v_upDir = XMLoadFloat3(&upDir);
-    XMVECTOR v_orientation = XMLoadFloat3(&orientationDir);
-    XMVECTOR v_projection = -v_upDir * XMVector3Dot(v_orientation, -v_upDir);
-    XMVECTOR v_forwardDir = XMVector3Normalize(v_orientation - v_projection);
-    XMStoreFloat3(&forwardDir, v_forwardDir);
-    XMStoreFloat3(&rightDir, XMVector3Normalize(XMVector3Cross(v_forwardDir, -v_upDir)));
-    //lastSurface = walkableCuboids[j].bodyId;
-
-    constForce = { 0, 0, 0 };
-    scalesVel = { 1, 1, 1 };
-    if (characterVelocity.z == 0.0f && characterVelocity.x == 0.0f && characterVelocity.y == 0.0f)
-    {
-        //dragCoeff = { 0.7f, 0.7f, 0.7f };
-    }
-    else
-    {
-        dragCoeff = { 0.99f, 0.99f, 0.99f };
-    }
-
-    if (projection.dist > 0.1f)
-    {
-        constForce = { 0, -30, 0 };
-        if (projection.dist > 0.2f)
-        {
-            dragCoeff.y = 1.0f;
-        }
-        if (projection.dist > 0.5f)
-        {
-            dragCoeff = { 0.7f, 1.0f,  0.7f };
-            scalesVel = { 0, 0, 0 };
-        }
-    }
-
+    scene->GetPhysicsStats(stats);
 }
 
 void Composer::GetLightViewMatrix(
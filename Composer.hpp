@@ -2,8 +2,9 @@
 #include "window.hpp"
 #include <DirectXMath.h>
 #include "Renderer//Renderer.hpp"
-#include "Physics/PhysicsEnigne.h"
+#include "Scene.hpp"
 #include <set>
+#include <unordered_map>
 struct  CameraOrientation
 {
 	DirectX::XMFLOAT3 eye;
@@ -13,43 +14,20 @@ struct  CameraOrientation
 		eye(eye), up(up), lookDir(lookDir) {}
 };
 
-constexpr uint8_t w_top = 0x1;
-constexpr uint8_t w_bottom = 0x1 << 1;
-constexpr uint8_t w_front = 0x1 << 2;
-constexpr uint8_t w_back = 0x1 << 3;
-constexpr uint8_t w_left = 0x1 << 4;
-constexpr uint8_t w_right = 0x1 << 5;
-
-struct WalkableCuboid
-{
-	uint64_t bodyId;
-	uint8_t faceIds;
-};
-
 struct Composer
 {
 	Composer(
 		Renderer* renderer,
-		PhysicsEnigne* physicsEngine);
+		Scene* scene);
 
 	void RenderScene();
 
-	void AddWalkableCuboid(
-		uint64_t bodyId, 
-		uint8_t faceId);
-
 	void UpdateTextures(
 		const std::vector<TextureDim>& dims,
 		TextureDim skyboxDims = { 0, 0 });
 
-	bool CheckIfObjIsOnWalkableCuboidSurface(
-		const DirectX::XMFLOAT3& ptOnCuboid,
-		size_t cuboidIdx);
-
 	void UpdateCamera();
 
-	void GenerateObjects();
-
 	void UpdateObjects(
 		float dt);
 
@@ -61,47 +39,25 @@ struct Composer
 	
 	void UpdateShadowmapGlobalBuffer();
 
-	void AddBody( const ShapeType& type, 
-		const BodyProperties& props,
-		const DirectX::XMFLOAT3& scales, 
-		const DirectX::XMUINT4& objInfo,
-		const LinearVelocityBounds& vBounds,
-		bool allowAngularImpulse,
-		const DirectX::XMFLOAT3& constForce = { 0, -15, 0 });
-
-	void UpdateMovementVectors();
+	// statistics of the last physics step
+	void GetPhysicsStats(
+		PhysicsStats* stats) const;
 
 	void GetLightViewMatrix(
 		DirectX::XMFLOAT4X4* lightViewMatrix);
 public:
 	Renderer* renderer;
-	PhysicsEnigne* physicsEngine;
+	Scene* scene;
 	float cameraAngleX;
 	float cameraAngleY;
 	uint64_t boxCollection;
 	uint64_t uboPool;
-	bool calculatePhysics;
-	bool frameMode;
 	uint64_t pipelineId;
 	uint64_t shadowmapPipelineId;
-	// ----- character management ----- 
-	DirectX::XMFLOAT3 scalesVel;
-	DirectX::XMFLOAT3 characterVelocity;
-	DirectX::XMFLOAT3 characterVelocityCoeff;
-	DirectX::XMFLOAT3 orientationDir;
-	DirectX::XMFLOAT3 forwardDir;
-	DirectX::XMFLOAT3 rightDir;
-	DirectX::XMFLOAT3 upDir;
-	DirectX::XMFLOAT3 constForce;
-	DirectX::XMFLOAT3 dragCoeff;
-	std::vector<WalkableCuboid> walkableCuboids;
-	uint64_t lastSurface;
-	uint64_t characterId;
-	bool freeFall;
 	// ----- Entity related -----
-	std::vector<uint64_t> physicsEntities;
-	std::vector<ObjectUbo> physicsEntitiesTrsfm;
+	std::vector<ObjectUbo> physicsEntitiesTrsfm; // mirrors entity arrays of the scene
 	std::vector<RenderItem> renderEntities;
+	std::vector<uint32_t> movedEntities; // written by ExportTransforms every frame
 	// ----- camera related -----
 	uint64_t globalUbo;
 	uint64_t shadowmapGlobalUbo;
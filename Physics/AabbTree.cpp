@@ -0,0 +1,183 @@
+#include "AabbTree.hpp"
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+constexpr uint32_t MAX_LEAF_ITEMS = 4;
+
+static float Center(
+	const BoundingBox& box,
+	uint8_t axis)
+{
+	switch (axis)
+	{
+	case 0: return box.minC.x + box.maxC.x;
+	case 1: return box.minC.y + box.maxC.y;
+	default: return box.minC.z + box.maxC.z;
+	}
+}
+
+static float SurfaceArea(
+	const BoundingBox& box)
+{
+	float x = box.maxC.x - box.minC.x;
+	float y = box.maxC.y - box.minC.y;
+	float z = box.maxC.z - box.minC.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static float GetTreeArea(
+	const AabbTree& tree)
+{
+	float area = 0.0f;
+	for (const AabbTreeNode& node : tree.nodes)
+	{
+		area += SurfaceArea(node.box);
+	}
+	return area;
+}
+
+static void BuildNode(
+	AabbTree* tree,
+	size_t nodeIdx,
+	uint32_t first,
+	uint32_t count)
+{
+	BoundingBox box;
+	BoundingBox centers;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const BoundingBox& itemBox = tree->itemBoxes[tree->items[i]];
+		box.Expand(itemBox.minC);
+		box.Expand(itemBox.maxC);
+		centers.Expand({ Center(itemBox, 0), Center(itemBox, 1), Center(itemBox, 2) });
+	}
+	tree->nodes[nodeIdx].box = box;
+
+	if (count <= MAX_LEAF_ITEMS)
+	{
+		tree->nodes[nodeIdx].first = first;
+		tree->nodes[nodeIdx].count = count;
+		return;
+	}
+
+	XMFLOAT3 extent = { centers.maxC.x - centers.minC.x, centers.maxC.y - centers.minC.y, centers.maxC.z - centers.minC.z };
+	uint8_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	uint32_t half = count / 2;
+	const vector<BoundingBox>& itemBoxes = tree->itemBoxes;
+	nth_element(tree->items.begin() + first, tree->items.begin() + first + half, tree->items.begin() + first + count,
+		[&itemBoxes, axis](uint32_t l, uint32_t r) { return Center(itemBoxes[l], axis) < Center(itemBoxes[r], axis); });
+
+	// children are allocated as a pair, node may move when nodes grow
+	uint32_t left = (uint32_t)tree->nodes.size();
+	tree->nodes.resize(tree->nodes.size() + 2);
+	tree->nodes[nodeIdx].first = left;
+	tree->nodes[nodeIdx].count = 0;
+	BuildNode(tree, left, first, half);
+	BuildNode(tree, left + 1, first + half, count - half);
+}
+
+void AabbTree::Build(
+	const BoundingBox* boxes,
+	size_t count)
+{
+	Clear();
+	if (count == 0)
+	{
+		return;
+	}
+
+	itemBoxes.assign(boxes, boxes + count);
+	items.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		items[i] = (uint32_t)i;
+	}
+
+	nodes.reserve(count * 2);
+	nodes.resize(1);
+	BuildNode(this, 0, 0, (uint32_t)count);
+
+	// build sorted boxes by index, from now on they follow items
+	vector<BoundingBox> leafOrder(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		leafOrder[i] = itemBoxes[items[i]];
+	}
+	itemBoxes.swap(leafOrder);
+	buildArea = GetTreeArea(*this);
+}
+
+void AabbTree::Clear()
+{
+	nodes.clear();
+	items.clear();
+	itemBoxes.clear();
+}
+
+float AabbTree::Refit()
+{
+	if (nodes.empty())
+	{
+		return 1.0f;
+	}
+
+	// children are always allocated after their parent
+	for (size_t nodeIdx = nodes.size(); nodeIdx-- > 0;)
+	{
+		AabbTreeNode& node = nodes[nodeIdx];
+		BoundingBox box;
+		if (node.count == 0)
+		{
+			for (uint32_t child = node.first; child < node.first + 2; child++)
+			{
+				box.Expand(nodes[child].box.minC);
+				box.Expand(nodes[child].box.maxC);
+			}
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			box.Expand(itemBoxes[i].minC);
+			box.Expand(itemBoxes[i].maxC);
+		}
+		node.box = box;
+	}
+	return buildArea > 0.0f ? GetTreeArea(*this) / buildArea : 1.0f;
+}
+
+void AabbTree::Query(
+	const BoundingBox& box,
+	std::vector<uint32_t>* result) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const AabbTreeNode& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!Overlaps(node.box, box))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			if (Overlaps(itemBoxes[i], box))
+			{
+				result->push_back(items[i]);
+			}
+		}
+	}
+}
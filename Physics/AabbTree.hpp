@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <inttypes.h>
+#include "BoundingBox.hpp"
+
+// leaf when count > 0, items [first, first + count) of AabbTree::items, otherwise children first and first + 1
+struct AabbTreeNode
+{
+	BoundingBox box;
+	uint32_t first;
+	uint32_t count;
+};
+
+/*
+	Bounding volume hierarchy over boxes. Built top down with median split along the
+	longest axis of centers, query cost depends on number of overlapping boxes, not on
+	total count. Moved boxes are refit without changing the structure, queries slow down
+	as boxes drift away from where they were at Build.
+*/
+struct AabbTree
+{
+	void Build(
+		const BoundingBox* boxes,
+		size_t count);
+
+	void Clear();
+
+	/*
+		Recomputes node boxes after itemBoxes changed, items stay in their leaves.
+		Returns summed surface area of nodes relative to the one after Build.
+	*/
+	float Refit();
+
+	// appends indices of boxes overlapping box, as passed to Build
+	void Query(
+		const BoundingBox& box,
+		std::vector<uint32_t>* result) const;
+
+public:
+	std::vector<AabbTreeNode> nodes;
+	std::vector<uint32_t> items;
+	std::vector<BoundingBox> itemBoxes; // box of items[i], leaves read their boxes contiguously
+	float buildArea; // summed surface area of nodes after Build
+	mutable std::vector<uint32_t> stack;
+};
+
+inline bool Overlaps(
+	const BoundingBox& a,
+	const BoundingBox& b)
+{
+	return a.minC.x <= b.maxC.x && a.maxC.x >= b.minC.x &&
+		a.minC.y <= b.maxC.y && a.maxC.y >= b.minC.y &&
+		a.minC.z <= b.maxC.z && a.maxC.z >= b.minC.z;
+}
@@ -13,21 +13,19 @@ void Body::UpdateBody(
 	GetCenterOfMassWorldSpace(&CoM);
 	XMVECTOR v_posToCoM = v_newPosition - XMLoadFloat3(&CoM);
 
-	XMFLOAT4X4 partialInertiaTensor;
-	shape.getPartialInertiaTensor(&shape, &partialInertiaTensor);
-
-	XMMATRIX v_rotationMatrix =  XMMatrixRotationQuaternion(XMQuaternionNormalize(XMLoadFloat4(&rotation)));
-	
-	XMMATRIX v_partialInertiaTensorWorld = XMMatrixTranspose(v_rotationMatrix) *
-										   XMLoadFloat4x4(&partialInertiaTensor) *
-										   v_rotationMatrix;
-
-
+	// gyroscopic term evaluated in local space, local tensors are constant so no inverse is needed
+	XMMATRIX v_rotationMatrix = XMLoadFloat4x4(&rotationMatrix);
+	XMMATRIX v_rotationMatrixInv = XMMatrixTranspose(v_rotationMatrix);
 	XMVECTOR v_angVelocity = XMLoadFloat3(&angVelocity);
-	auto l = XMVector3Cross(XMVector3Transform(v_angVelocity, v_partialInertiaTensorWorld), v_angVelocity);
-	XMVECTOR v_alpha = XMVector3Transform(
-		XMVector3Cross(XMVector3Transform(v_angVelocity, v_partialInertiaTensorWorld), v_angVelocity ),
-		XMMatrixInverse(nullptr, v_partialInertiaTensorWorld));
+	XMVECTOR v_angVelocityLocal = XMVector3TransformNormal(v_angVelocity, v_rotationMatrix);
+	XMVECTOR v_angMomentum = XMVector3TransformNormal(
+		XMVector3TransformNormal(v_angVelocityLocal, XMLoadFloat4x4(&partialInertiaTensorLocal)),
+		v_rotationMatrixInv);
+
+	XMVECTOR v_torqueLocal = XMVector3TransformNormal(XMVector3Cross(v_angMomentum, v_angVelocity), v_rotationMatrix);
+	XMVECTOR v_alpha = XMVector3TransformNormal(
+		XMVector3TransformNormal(v_torqueLocal, XMLoadFloat4x4(&invPartialInertiaTensorLocal)),
+		v_rotationMatrixInv);
 	
 	v_angVelocity = v_angVelocity + v_alpha * dt;
 	XMStoreFloat3(&angVelocity, v_angVelocity);
@@ -42,6 +40,7 @@ void Body::UpdateBody(
 	v_rotation = XMQuaternionMultiply(v_dRotation, v_rotation);
 	v_rotation = XMQuaternionNormalize(v_rotation);
 	XMStoreFloat4(&rotation, v_rotation);
+	UpdateCachedTransforms();
 
 	XMStoreFloat3(&position, XMLoadFloat3(&CoM) + XMVector3Transform(v_posToCoM, XMMatrixTranspose(XMMatrixRotationQuaternion(v_dRotation))));
 
@@ -68,12 +67,9 @@ void Body::ApplyAngularImpulse(
 		return;
 	}
 
-	XMFLOAT4X4 invInertiaTensor;
 	XMVECTOR vImpulse = XMLoadFloat3(Impulse);
-	shape.getInverseInertiaTensorWorldSpace(&shape, massInv, &rotation, &invInertiaTensor);
-	auto p = XMVector3Transform(vImpulse, XMLoadFloat4x4(&invInertiaTensor));
 	XMStoreFloat3(&angVelocity,
-		XMLoadFloat3(&angVelocity) + XMVector3Transform(vImpulse, XMLoadFloat4x4(&invInertiaTensor)) );
+		XMLoadFloat3(&angVelocity) + XMVector3Transform(vImpulse, XMLoadFloat4x4(&invInertiaTensorWorld)) );
 
 	constexpr float maxAngularVelocity = 30.0f;
 	float len;
@@ -108,13 +104,7 @@ void Body::ApplyImpulse(
 void Body::GetCenterOfMassWorldSpace(
 	DirectX::XMFLOAT3* centerOfMass) const
 {
-	shape.getCenterOfMass(&shape, centerOfMass);
-	XMVECTOR Q = XMLoadFloat4(&rotation);
-	XMVECTOR Q_inv = XMQuaternionInverse(Q);
-	XMVECTOR pos = XMLoadFloat3(&position);
-	XMVECTOR CoM = XMLoadFloat3(centerOfMass);
-
-	XMStoreFloat3(centerOfMass, pos + XMQuaternionMultiply(XMQuaternionMultiply(Q, CoM), Q_inv));
+	XMStoreFloat3(centerOfMass, XMLoadFloat3(&position) + XMLoadFloat3(&centerOfMassOffset));
 }
 
 void Body::GetPointInLocalSpace(
@@ -124,16 +114,15 @@ void Body::GetPointInLocalSpace(
 	XMFLOAT3 CoM;
 	GetCenterOfMassWorldSpace(&CoM);
 	
-	XMMATRIX v_invRotiation = XMMatrixRotationQuaternion(XMQuaternionInverse(XMLoadFloat4(&rotation)));
 	XMVECTOR v_point = XMLoadFloat3(point) - XMLoadFloat3(&CoM);
-	XMVECTOR v_localPoint = XMVector3Transform(v_point, XMMatrixTranspose(v_invRotiation));
+	XMVECTOR v_localPoint = XMVector3Transform(v_point, XMMatrixTranspose(XMLoadFloat4x4(&rotationMatrix)));
 	XMStoreFloat3(localSpacePoint, v_localPoint);
 }
 
 void Body::GetInverseInertiaTensorWorldSpace(
 	DirectX::XMFLOAT4X4* tensor) const
 {
-	shape.getInverseInertiaTensorWorldSpace(&shape, massInv, &rotation, tensor);
+	*tensor = invInertiaTensorWorld;
 }
 
 void Body::GetLocalSpaceFaceNormalFromPoint(
@@ -151,8 +140,7 @@ void Body::GetWorldSpaceFaceNormalFromPoint(
 {
 	GetLocalSpaceFaceNormalFromPoint(point, normal);
 
-	XMMATRIX v_Rotation = XMMatrixTranspose(XMMatrixRotationQuaternion((XMLoadFloat4(&rotation))));
-	XMVECTOR v_localPoint = XMVector3Transform(XMLoadFloat3(normal), v_Rotation);
+	XMVECTOR v_localPoint = XMVector3Transform(XMLoadFloat3(normal), XMLoadFloat4x4(&rotationMatrix));
 	XMStoreFloat3(normal, XMVector3Normalize(v_localPoint));
 }
 
@@ -160,3 +148,25 @@ BoundingBox Body::getBoundingBox() const
 {
 	return shape.getBoundingBox(&shape, &position, &rotation);
 }
+
+void Body::InitCachedProperties()
+{
+	shape.getInverseInertiaTensor(&shape, massInv, &invInertiaTensorLocal);
+	shape.getPartialInertiaTensor(&shape, &partialInertiaTensorLocal);
+	XMStoreFloat4x4(&invPartialInertiaTensorLocal,
+		XMMatrixInverse(nullptr, XMLoadFloat4x4(&partialInertiaTensorLocal)));
+	shape.getCenterOfMass(&shape, &centerOfMassLocal);
+
+	UpdateCachedTransforms();
+}
+
+void Body::UpdateCachedTransforms()
+{
+	XMMATRIX v_rotationMatrix = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&rotation)));
+	XMStoreFloat4x4(&rotationMatrix, v_rotationMatrix);
+
+	XMMATRIX v_tensor = v_rotationMatrix * XMLoadFloat4x4(&invInertiaTensorLocal) * XMMatrixTranspose(v_rotationMatrix);
+	XMStoreFloat4x4(&invInertiaTensorWorld, v_tensor);
+
+	XMStoreFloat3(&centerOfMassOffset, XMVector3TransformNormal(XMLoadFloat3(&centerOfMassLocal), v_rotationMatrix));
+}
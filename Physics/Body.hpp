@@ -5,7 +5,8 @@
 enum class ShapeType
 {
 	OrientedBox, // box constructed by combining scaled vectors [1,0,0],[0,1,0],[0,0,1]
-	Sphere
+	Sphere,
+	Capsule // segment along local y inflated by radius, scales are {radius, half height of segment, radius}
 };
 
 struct BodyProperties
@@ -19,6 +20,16 @@ struct BodyProperties
 	float friction;
 };
 
+// convex piece of compound body, mass only weights the piece in center of mass and inertia
+struct CompoundChildDesc
+{
+	ShapeType type;
+	DirectX::XMFLOAT3 scales;
+	DirectX::XMFLOAT3 position; // relative to body position
+	DirectX::XMFLOAT4 rotation;
+	float mass;
+};
+
 struct LinearVelocityBounds
 {
 	float x_min, x_max;
@@ -26,6 +37,29 @@ struct LinearVelocityBounds
 	float z_min, z_max;
 };
 
+constexpr uint32_t COLLISION_LAYER_DEFAULT = 0x1;
+constexpr uint32_t COLLISION_MASK_ALL = 0xFFFFFFFF;
+constexpr uint32_t COLLISION_GROUP_NONE = 0;
+
+/*
+	Pair is generated only when layer of each body is in mask of the other
+	and bodies don't share non zero ignore group.
+*/
+struct CollisionFilter
+{
+	uint32_t layer;
+	uint32_t mask;
+	uint32_t ignoreGroup; // e.g. character and its own projectiles
+};
+
+inline bool ShouldCollide(
+	const CollisionFilter& a,
+	const CollisionFilter& b)
+{
+	return (a.layer & b.mask) != 0 && (b.layer & a.mask) != 0 &&
+		(a.ignoreGroup == COLLISION_GROUP_NONE || a.ignoreGroup != b.ignoreGroup);
+}
+
 struct Body
 {
 	DirectX::XMFLOAT3 position;
@@ -36,8 +70,31 @@ struct Body
 	DirectX::XMFLOAT4 rotation;
 	DirectX::XMFLOAT3 angVelocity;
 	bool allowAngularImpulse;
+	bool isSensor; // only reports overlaps, never gets contacts
+	bool isKinematic; // static body moved by SetKinematicTarget
+	bool speculativeContacts; // pairs with this body use speculative contacts instead of substeps
+	// ----- simulation LOD, set by engine every step -----
+	uint8_t lodTier; // body is stepped every 2^lodTier-th UpdateBodies
+	bool lodSkipped; // not stepped in current step, only stepped bodies collide with it
+	float lodPendingTime; // skipped time, integrated before next step of the body
 	LinearVelocityBounds vBounds;
 	Shape shape;
+	CollisionFilter filter;
+	// fields above except shape are stored in snapshots as BodyState, new ones go there too
+	// ----- cached, refreshed by UpdateCachedTransforms whenever rotation changes -----
+	DirectX::XMFLOAT4X4 rotationMatrix; // transposed XMMatrixRotationQuaternion(rotation)
+	DirectX::XMFLOAT4X4 invInertiaTensorWorld;
+	DirectX::XMFLOAT3 centerOfMassOffset; // world space vector from position to center of mass
+	// ----- constant for lifetime of the body, set by InitCachedProperties -----
+	DirectX::XMFLOAT4X4 invInertiaTensorLocal;
+	DirectX::XMFLOAT4X4 partialInertiaTensorLocal;
+	DirectX::XMFLOAT4X4 invPartialInertiaTensorLocal;
+	DirectX::XMFLOAT3 centerOfMassLocal;
+
+	// must be called after shape and massInv are set
+	void InitCachedProperties();
+
+	void UpdateCachedTransforms();
 
 	void UpdateBody(
 		float dt);
@@ -0,0 +1,79 @@
+#include "BodyHandleTable.hpp"
+
+static inline uint64_t MakeHandle(
+	uint32_t slotIdx,
+	uint32_t generation)
+{
+	return ((uint64_t)(generation & BODY_GENERATION_MASK) << 32) | ((uint64_t)slotIdx + 1);
+}
+
+uint64_t BodyHandleTable::CreateHandle()
+{
+	uint32_t slotIdx;
+	if (freeSlots.size() > 0)
+	{
+		slotIdx = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slotIdx = (uint32_t)slots.size();
+		slots.push_back({ 0, 0 });
+	}
+
+	slots[slotIdx].denseIdx = (uint32_t)denseToSlot.size();
+	denseToSlot.push_back(slotIdx);
+	return MakeHandle(slotIdx, slots[slotIdx].generation);
+}
+
+size_t BodyHandleTable::GetDenseIndex(
+	uint64_t handle) const
+{
+	uint64_t slotId = handle & 0xFFFFFFFFULL;
+	uint32_t generation = (uint32_t)((handle >> 32) & BODY_GENERATION_MASK);
+	if (slotId == 0 || slotId > slots.size())
+	{
+		return SIZE_MAX;
+	}
+
+	const BodySlot& slot = slots[slotId - 1];
+	if (slot.generation != generation || slot.denseIdx >= denseToSlot.size())
+	{
+		return SIZE_MAX;
+	}
+	return slot.denseIdx;
+}
+
+uint64_t BodyHandleTable::GetHandle(
+	size_t denseIdx) const
+{
+	uint32_t slotIdx = denseToSlot[denseIdx];
+	return MakeHandle(slotIdx, slots[slotIdx].generation);
+}
+
+void BodyHandleTable::DestroyHandle(
+	uint64_t handle)
+{
+	size_t denseIdx = GetDenseIndex(handle);
+	if (denseIdx == SIZE_MAX)
+	{
+		return;
+	}
+
+	uint32_t slotIdx = (uint32_t)(handle & 0xFFFFFFFFULL) - 1;
+	uint32_t lastSlotIdx = denseToSlot.back();
+	slots[lastSlotIdx].denseIdx = (uint32_t)denseIdx;
+	denseToSlot[denseIdx] = lastSlotIdx;
+	denseToSlot.pop_back();
+
+	slots[slotIdx].generation = (slots[slotIdx].generation + 1) & BODY_GENERATION_MASK;
+	slots[slotIdx].denseIdx = UINT32_MAX;
+	freeSlots.push_back(slotIdx);
+}
+
+void BodyHandleTable::Reserve(
+	size_t count)
+{
+	slots.reserve(count);
+	denseToSlot.reserve(count);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <inttypes.h>
+#include <cstddef>
+
+/*
+	Body handle layout:
+		bit 63     - static body flag
+		bits 32-62 - generation of the slot
+		bits 0-31  - slot index + 1, so handle 0 is never valid
+*/
+constexpr uint64_t BODY_STATIC_FLAG = 0x01ULL << 63;
+constexpr uint64_t BODY_GENERATION_MASK = 0x7FFFFFFFULL;
+
+struct BodySlot
+{
+	uint32_t denseIdx;
+	uint32_t generation;
+};
+
+/*
+	Sparse to dense table for one body array. Removal is swap-and-pop, 
+	the table keeps slot of the moved element pointing at its new dense index.
+*/
+struct BodyHandleTable
+{
+	// handle for element that was just appended to dense array
+	uint64_t CreateHandle();
+
+	// returns SIZE_MAX when handle is stale or was never created
+	size_t GetDenseIndex(
+		uint64_t handle) const;
+
+	uint64_t GetHandle(
+		size_t denseIdx) const;
+
+	/*
+		Invalidates handle, last dense element takes place of removed one.
+		Caller has to move its data the same way.
+	*/
+	void DestroyHandle(
+		uint64_t handle);
+
+	void Reserve(
+		size_t count);
+
+public:
+	std::vector<BodySlot> slots;
+	std::vector<uint32_t> denseToSlot;
+	std::vector<uint32_t> freeSlots;
+};
@@ -0,0 +1,526 @@
+#include "CharacterController.hpp"
+#include "Shapes/ShapeCapsule.hpp"
+#include "Shapes/ShapeTriangle.hpp"
+#include <cmath>
+using namespace std;
+using namespace DirectX;
+
+constexpr uint8_t MAX_CAST_ITERATIONS = 24;
+constexpr float CAST_TOLERANCE = 0.001f;
+constexpr float MIN_MOVE_SQ = 1e-10f;
+
+CharacterControllerSettings GetDefaultCharacterControllerSettings()
+{
+	CharacterControllerSettings settings;
+	settings.radius = 0.4f;
+	settings.halfHeight = 0.5f;
+	settings.maxSlopeCos = cosf(XM_PI / 4.0f);
+	settings.stepHeight = 0.35f;
+	settings.skinWidth = 0.02f;
+	settings.groundSnapDistance = 0.3f;
+	settings.gravity = { 0, -15, 0 };
+	settings.up = { 0, 1, 0 };
+	settings.maxSlideIterations = 4;
+	settings.filter = { COLLISION_LAYER_DEFAULT, COLLISION_MASK_ALL, COLLISION_GROUP_NONE };
+	return settings;
+}
+
+CharacterController::CharacterController(
+	PhysicsEnigne* physicsEngine,
+	const CharacterControllerSettings& settings) :
+	physicsEngine(physicsEngine),
+	settings(settings),
+	position({ 0, 0, 0 }),
+	verticalSpeed(0.0f),
+	bodyId(0),
+	grounded(false),
+	groundBodyId(0),
+	groundNormal(settings.up),
+	stats{}
+{
+	// only pose and shape of core are read by GJK
+	core = {};
+	core.rotation = { 0, 0, 0, 1 };
+	core.shape = GetDefaultCapsuleShape({ 0.0f, settings.halfHeight, 0.0f });
+
+	// triangles of concave bodies are given in world space, body stays at origin
+	triangle = {};
+	triangle.rotation = { 0, 0, 0, 1 };
+	triangle.shape = GetTriangleShape({});
+	triangle.UpdateCachedTransforms();
+}
+
+CharacterController::~CharacterController()
+{
+	core.shape.freeShapeData(&core.shape);
+	triangle.shape.freeShapeData(&triangle.shape);
+}
+
+void CharacterController::SetPosition(
+	const DirectX::XMFLOAT3& position)
+{
+	this->position = position;
+	grounded = false;
+	groundBodyId = 0;
+	groundNormal = settings.up;
+}
+
+void CharacterController::Jump(
+	float speed)
+{
+	if (grounded)
+	{
+		verticalSpeed = speed;
+		grounded = false;
+		groundBodyId = 0;
+	}
+}
+
+bool CharacterController::IsWalkable(
+	const DirectX::XMFLOAT3& normal) const
+{
+	float cosine;
+	XMStoreFloat(&cosine, XMVector3Dot(XMLoadFloat3(&normal), XMLoadFloat3(&settings.up)));
+	return cosine >= settings.maxSlopeCos;
+}
+
+void CharacterController::GatherCandidates(
+	const BoundingBox& box)
+{
+	candidates.clear();
+	physicsEngine->QueryStaticBodies(box, &candidates);
+
+	size_t kept = 0;
+	for (uint64_t candidate : candidates)
+	{
+		const Body* body = physicsEngine->GetBody(candidate);
+		if (candidate != bodyId && !body->isSensor && ShouldCollide(settings.filter, body->filter))
+		{
+			candidates[kept++] = candidate;
+		}
+	}
+	candidates.resize(kept);
+	stats.candidates = (uint32_t)kept;
+}
+
+bool CharacterController::CastAgainstBody(
+	uint64_t bodyId,
+	const DirectX::XMFLOAT3& start,
+	const DirectX::XMFLOAT3& displacement,
+	CharacterHit* hit)
+{
+	Body* body = physicsEngine->GetBody(bodyId);
+	if (!body)
+	{
+		return false;
+	}
+
+	// swept bounds of the capsule reject far bodies without GJK
+	XMVECTOR v_start = XMLoadFloat3(&start);
+	XMVECTOR v_delta = XMLoadFloat3(&displacement);
+	XMVECTOR extent = XMVectorAbs(XMLoadFloat3(&settings.up) * settings.halfHeight) +
+		XMVectorReplicate(settings.radius + settings.skinWidth + CAST_TOLERANCE);
+	BoundingBox swept;
+	XMStoreFloat3(&swept.minC, XMVectorMin(v_start, v_start + v_delta) - extent);
+	XMStoreFloat3(&swept.maxC, XMVectorMax(v_start, v_start + v_delta) + extent);
+	if (!Overlaps(swept, body->getBoundingBox()))
+	{
+		return false;
+	}
+
+	if (body->shape.collectChildren)
+	{
+		// compound body, only children under the swept bounds are cast against
+		children.clear();
+		body->shape.collectChildren(&body->shape, &body->position, &body->rotation, &swept, &children);
+		bool anyHit = false;
+		for (const ShapeChild& shapeChild : children)
+		{
+			GetCompoundChildBody(body, shapeChild, &child);
+			CharacterHit childHit;
+			if (CastAgainstConvex(&child, start, displacement, &childHit) &&
+				(!anyHit || childHit.fraction < hit->fraction))
+			{
+				*hit = childHit;
+				anyHit = true;
+			}
+		}
+		hit->bodyId = bodyId;
+		return anyHit;
+	}
+
+	if (!body->shape.collectTriangles)
+	{
+		hit->bodyId = bodyId;
+		return CastAgainstConvex(body, start, displacement, hit);
+	}
+
+	// concave body, only triangles under the swept bounds are cast against
+	triangles.clear();
+	body->shape.collectTriangles(&body->shape, &body->position, &body->rotation, &swept, &triangles);
+	bool anyHit = false;
+	for (const WorldTriangle& worldTriangle : triangles)
+	{
+		SetTriangleShapeTriangle(&triangle.shape, worldTriangle);
+		CharacterHit triangleHit;
+		if (CastAgainstConvex(&triangle, start, displacement, &triangleHit) &&
+			(!anyHit || triangleHit.fraction < hit->fraction))
+		{
+			*hit = triangleHit;
+			anyHit = true;
+		}
+	}
+	hit->bodyId = bodyId;
+	return anyHit;
+}
+
+bool CharacterController::CastAgainstConvex(
+	Body* body,
+	const DirectX::XMFLOAT3& start,
+	const DirectX::XMFLOAT3& displacement,
+	CharacterHit* hit)
+{
+	XMVECTOR v_start = XMLoadFloat3(&start);
+	XMVECTOR v_delta = XMLoadFloat3(&displacement);
+	stats.casts++;
+
+	/*
+		Distance between convex shapes moving along a line is convex in time,
+		so advancing to the root of its tangent never steps past the first contact.
+	*/
+	float t = 0.0f;
+	for (uint8_t iter = 0; iter < MAX_CAST_ITERATIONS; iter++)
+	{
+		XMStoreFloat3(&core.position, v_start + v_delta * t);
+		XMFLOAT3 ptOnCore, ptOnBody;
+		float dist;
+		DistanceBetweenBodies(&core, body, &ptOnCore, &ptOnBody, &dist);
+		stats.distanceQueries++;
+
+		// segment inside body, block the motion
+		if (dist < 1e-6f)
+		{
+			hit->fraction = t;
+			XMStoreFloat3(&hit->normal, -XMVector3Normalize(v_delta));
+			hit->point = ptOnBody;
+			body->GetWorldSpaceFaceNormalFromPoint(&ptOnBody, &hit->surfaceNormal);
+			return true;
+		}
+
+		XMVECTOR normal = (XMLoadFloat3(&ptOnCore) - XMLoadFloat3(&ptOnBody)) / dist;
+		float approach;
+		XMStoreFloat(&approach, -XMVector3Dot(v_delta, normal));
+		if (approach <= 1e-6f)
+		{
+			return false;
+		}
+
+		float gap = dist - settings.radius - settings.skinWidth;
+		if (gap <= CAST_TOLERANCE || iter + 1 == MAX_CAST_ITERATIONS)
+		{
+			hit->fraction = t;
+			XMStoreFloat3(&hit->normal, normal);
+			hit->point = ptOnBody;
+			body->GetWorldSpaceFaceNormalFromPoint(&ptOnBody, &hit->surfaceNormal);
+			return true;
+		}
+
+		t += gap / approach;
+		if (t > 1.0f)
+		{
+			return false;
+		}
+	}
+	return false;
+}
+
+bool CharacterController::CastCapsule(
+	const DirectX::XMFLOAT3& start,
+	const DirectX::XMFLOAT3& displacement,
+	CharacterHit* hit)
+{
+	bool anyHit = false;
+	hit->fraction = 1.0f;
+	for (uint64_t candidate : candidates)
+	{
+		CharacterHit bodyHit;
+		if (CastAgainstBody(candidate, start, displacement, &bodyHit) && bodyHit.fraction <= hit->fraction)
+		{
+			*hit = bodyHit;
+			anyHit = true;
+		}
+	}
+	return anyHit;
+}
+
+void CharacterController::Depenetrate()
+{
+	for (uint64_t candidate : candidates)
+	{
+		Body* body = physicsEngine->GetBody(candidate);
+		if (!body->shape.collectTriangles && !body->shape.collectChildren)
+		{
+			DepenetrateFrom(body);
+			continue;
+		}
+
+		XMVECTOR extent = XMVectorAbs(XMLoadFloat3(&settings.up) * settings.halfHeight) +
+			XMVectorReplicate(settings.radius + settings.skinWidth);
+		BoundingBox box;
+		XMStoreFloat3(&box.minC, XMLoadFloat3(&position) - extent);
+		XMStoreFloat3(&box.maxC, XMLoadFloat3(&position) + extent);
+		if (body->shape.collectChildren)
+		{
+			children.clear();
+			body->shape.collectChildren(&body->shape, &body->position, &body->rotation, &box, &children);
+			for (const ShapeChild& shapeChild : children)
+			{
+				GetCompoundChildBody(body, shapeChild, &child);
+				DepenetrateFrom(&child);
+			}
+			continue;
+		}
+
+		triangles.clear();
+		body->shape.collectTriangles(&body->shape, &body->position, &body->rotation, &box, &triangles);
+		for (const WorldTriangle& worldTriangle : triangles)
+		{
+			SetTriangleShapeTriangle(&triangle.shape, worldTriangle);
+			DepenetrateFrom(&triangle);
+		}
+	}
+}
+
+void CharacterController::DepenetrateFrom(
+	Body* body)
+{
+	core.position = position;
+	XMFLOAT3 ptOnCore, ptOnBody;
+	float dist;
+	DistanceBetweenBodies(&core, body, &ptOnCore, &ptOnBody, &dist);
+	stats.distanceQueries++;
+
+	float penetration = settings.radius + settings.skinWidth - dist;
+	if (penetration > CAST_TOLERANCE && dist > 1e-6f)
+	{
+		XMVECTOR normal = (XMLoadFloat3(&ptOnCore) - XMLoadFloat3(&ptOnBody)) / dist;
+		XMStoreFloat3(&position, XMLoadFloat3(&position) + normal * penetration);
+	}
+}
+
+bool CharacterController::TryStepUp(
+	const DirectX::XMFLOAT3& displacement)
+{
+	XMVECTOR up = XMLoadFloat3(&settings.up);
+	XMVECTOR horizontal = XMLoadFloat3(&displacement);
+	horizontal = horizontal - up * XMVector3Dot(horizontal, up);
+
+	// lift, move over the obstacle, then land on its top
+	CharacterHit hit;
+	XMFLOAT3 lift, stepStart, forward, drop;
+	XMStoreFloat3(&lift, up * settings.stepHeight);
+	float liftHeight = CastCapsule(position, lift, &hit) ? settings.stepHeight * hit.fraction : settings.stepHeight;
+	XMStoreFloat3(&stepStart, XMLoadFloat3(&position) + up * liftHeight);
+
+	XMStoreFloat3(&forward, horizontal);
+	float forwardFraction = CastCapsule(stepStart, forward, &hit) ? hit.fraction : 1.0f;
+	float progress;
+	XMStoreFloat(&progress, XMVector3Length(horizontal * forwardFraction));
+	if (progress < CAST_TOLERANCE)
+	{
+		return false;
+	}
+	XMStoreFloat3(&stepStart, XMLoadFloat3(&stepStart) + horizontal * forwardFraction);
+
+	XMStoreFloat3(&drop, -up * liftHeight);
+	if (!CastCapsule(stepStart, drop, &hit) || !IsWalkable(hit.surfaceNormal))
+	{
+		return false;
+	}
+
+	XMStoreFloat3(&position, XMLoadFloat3(&stepStart) + XMLoadFloat3(&drop) * hit.fraction);
+	groundNormal = hit.surfaceNormal;
+	groundBodyId = hit.bodyId;
+	return true;
+}
+
+bool CharacterController::SlideMove(
+	const DirectX::XMFLOAT3& displacement,
+	bool horizontal)
+{
+	XMVECTOR up = XMLoadFloat3(&settings.up);
+	XMVECTOR remaining = XMLoadFloat3(&displacement);
+	XMVECTOR previousNormal = XMVectorZero();
+	bool blocked = false;
+	bool stepped = false;
+	for (uint8_t iter = 0; iter < settings.maxSlideIterations; iter++)
+	{
+		float lengthSq;
+		XMStoreFloat(&lengthSq, XMVector3LengthSq(remaining));
+		if (lengthSq < MIN_MOVE_SQ)
+		{
+			break;
+		}
+
+		XMFLOAT3 move;
+		XMStoreFloat3(&move, remaining);
+		CharacterHit hit;
+		if (!CastCapsule(position, move, &hit))
+		{
+			XMStoreFloat3(&position, XMLoadFloat3(&position) + remaining);
+			break;
+		}
+
+		blocked = true;
+		XMStoreFloat3(&position, XMLoadFloat3(&position) + remaining * hit.fraction);
+		remaining = remaining * (1.0f - hit.fraction);
+		XMVECTOR normal = XMLoadFloat3(&hit.normal);
+		float normalUp;
+		XMStoreFloat(&normalUp, XMVector3Dot(normal, up));
+		bool walkable = normalUp > 0.0f && IsWalkable(hit.surfaceNormal);
+
+		if (!horizontal && walkable)
+		{
+			// landed, ground probe takes it from here
+			break;
+		}
+
+		if (horizontal && !walkable)
+		{
+			XMStoreFloat3(&move, remaining);
+			if (!stepped && grounded && TryStepUp(move))
+			{
+				stepped = true;
+				remaining = XMVectorZero();
+				break;
+			}
+
+			// steep surface acts as vertical wall, sliding can't climb it
+			XMVECTOR wallNormal = normal - up * normalUp;
+			float wallLengthSq;
+			XMStoreFloat(&wallLengthSq, XMVector3LengthSq(wallNormal));
+			if (normalUp > 0.0f && wallLengthSq > MIN_MOVE_SQ)
+			{
+				normal = XMVector3Normalize(wallNormal);
+			}
+		}
+
+		remaining = remaining - normal * XMVector3Dot(remaining, normal);
+
+		// in a crease between two surfaces only the direction along both is free
+		float intoPrevious;
+		XMStoreFloat(&intoPrevious, XMVector3Dot(remaining, previousNormal));
+		if (intoPrevious < 0.0f)
+		{
+			XMVECTOR crease = XMVector3Cross(previousNormal, normal);
+			float creaseLengthSq;
+			XMStoreFloat(&creaseLengthSq, XMVector3LengthSq(crease));
+			remaining = creaseLengthSq > MIN_MOVE_SQ ?
+				XMVector3Normalize(crease) * XMVector3Dot(remaining, XMVector3Normalize(crease)) : XMVectorZero();
+		}
+		previousNormal = normal;
+	}
+	return blocked;
+}
+
+void CharacterController::ProbeGround()
+{
+	if (verticalSpeed > 0.0f)
+	{
+		grounded = false;
+		groundBodyId = 0;
+		groundNormal = settings.up;
+		return;
+	}
+
+	// grounded character is pulled down to ground it walks off, falling one only lands
+	XMVECTOR up = XMLoadFloat3(&settings.up);
+	float probeLength = (grounded ? settings.groundSnapDistance : 0.0f) + settings.skinWidth + CAST_TOLERANCE;
+	XMFLOAT3 probe;
+	XMStoreFloat3(&probe, -up * probeLength);
+
+	// touching ground of the last step leaves no room for anything closer
+	CharacterHit hit;
+	bool found = false;
+	stats.groundFromCache = false;
+	if (groundBodyId != 0 && CastAgainstBody(groundBodyId, position, probe, &hit) &&
+		hit.fraction * probeLength <= 2.0f * CAST_TOLERANCE && IsWalkable(hit.surfaceNormal))
+	{
+		found = true;
+		stats.groundFromCache = true;
+	}
+	else
+	{
+		found = CastCapsule(position, probe, &hit) && IsWalkable(hit.surfaceNormal);
+	}
+
+	grounded = found;
+	if (!found)
+	{
+		groundBodyId = 0;
+		groundNormal = settings.up;
+		return;
+	}
+
+	XMStoreFloat3(&position, XMLoadFloat3(&position) + XMLoadFloat3(&probe) * hit.fraction);
+	groundBodyId = hit.bodyId;
+	groundNormal = hit.surfaceNormal;
+	verticalSpeed = 0.0f;
+}
+
+void CharacterController::Move(
+	const DirectX::XMFLOAT3& velocity,
+	float dt)
+{
+	stats = {};
+	XMVECTOR up = XMLoadFloat3(&settings.up);
+	XMVECTOR horizontal = XMLoadFloat3(&velocity) * dt;
+	horizontal = horizontal - up * XMVector3Dot(horizontal, up);
+
+	// on ground walk along its plane keeping horizontal speed
+	float horizontalLength;
+	XMStoreFloat(&horizontalLength, XMVector3Length(horizontal));
+	if (grounded && horizontalLength > 0.0f)
+	{
+		XMVECTOR normal = XMLoadFloat3(&groundNormal);
+		XMVECTOR alongGround = horizontal - normal * XMVector3Dot(horizontal, normal);
+		horizontal = XMVector3Normalize(alongGround) * horizontalLength;
+	}
+
+	if (!grounded)
+	{
+		float gravityUp;
+		XMStoreFloat(&gravityUp, XMVector3Dot(XMLoadFloat3(&settings.gravity), up));
+		verticalSpeed += gravityUp * dt;
+	}
+	XMVECTOR vertical = up * verticalSpeed * dt;
+
+	// one query covers every cast of this step
+	float reach;
+	XMStoreFloat(&reach, XMVector3Length(horizontal) + XMVector3Length(vertical));
+	reach += settings.radius + settings.stepHeight + settings.groundSnapDistance + settings.skinWidth;
+	XMVECTOR v_position = XMLoadFloat3(&position);
+	XMVECTOR extent = XMVectorAbs(up * settings.halfHeight) + XMVectorReplicate(reach);
+	BoundingBox box;
+	XMStoreFloat3(&box.minC, v_position - extent);
+	XMStoreFloat3(&box.maxC, v_position + extent);
+	GatherCandidates(box);
+	Depenetrate();
+
+	XMFLOAT3 move;
+	XMStoreFloat3(&move, horizontal);
+	SlideMove(move, true);
+
+	XMStoreFloat3(&move, vertical);
+	if (SlideMove(move, false) && verticalSpeed > 0.0f)
+	{
+		// head hit ceiling
+		verticalSpeed = 0.0f;
+	}
+	ProbeGround();
+
+	if (bodyId != 0)
+	{
+		physicsEngine->SetKinematicTarget(bodyId, position, { 0, 0, 0, 1 });
+	}
+}
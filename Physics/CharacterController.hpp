@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+#include "PhysicsEnigne.h"
+
+struct CharacterControllerSettings
+{
+	float radius;
+	float halfHeight; // half length of capsule segment, capsule is 2 * (halfHeight + radius) tall
+	float maxSlopeCos; // cosine of the steepest walkable slope
+	float stepHeight; // higher obstacles block the character
+	float skinWidth; // gap kept between capsule and geometry
+	float groundSnapDistance; // grounded character follows ground that drops by at most this per step
+	DirectX::XMFLOAT3 gravity;
+	DirectX::XMFLOAT3 up; // unit vector
+	uint8_t maxSlideIterations;
+	CollisionFilter filter; // only bodies accepted by filter block the character
+};
+
+CharacterControllerSettings GetDefaultCharacterControllerSettings();
+
+struct CharacterHit
+{
+	uint64_t bodyId;
+	float fraction; // of cast displacement at which capsule stops skinWidth from body
+	DirectX::XMFLOAT3 normal; // from body towards capsule
+	DirectX::XMFLOAT3 surfaceNormal; // of body face at point, edges don't make flat ground steep
+	DirectX::XMFLOAT3 point; // on body
+};
+
+// work of the last Move
+struct CharacterControllerStats
+{
+	uint32_t candidates; // bodies returned by broad phase query
+	uint32_t casts; // capsule casts against single convex body, compound child or triangle
+	uint32_t distanceQueries; // GJK distance calls of all casts
+	bool groundFromCache; // ground probe only tested body from previous step
+};
+
+/*
+	Kinematic capsule moved by sweeps instead of forces. Displacement is cast against static
+	and kinematic bodies near the character (PhysicsEnigne::QueryStaticBodies) with conservative
+	advancement, concave bodies are cast against triangle by triangle and compounds child by child. Character stops skinWidth
+	before first hit and slides along it. Slopes steeper than maxSlopeCos act as walls, obstacles
+	lower than stepHeight are stepped over. Ground found by last probe is tested first in the next
+	step. Dynamic bodies don't block the character, they are pushed by its kinematic body through
+	regular contacts.
+*/
+struct CharacterController
+{
+	CharacterController(
+		PhysicsEnigne* physicsEngine,
+		const CharacterControllerSettings& settings);
+
+	CharacterController(const CharacterController&) = delete;
+	CharacterController& operator=(const CharacterController&) = delete;
+
+	~CharacterController();
+
+	/*
+		Walks with velocity for dt, component of velocity along up is ignored and the rest follows ground.
+		Kinematic body, when set, gets target at the new position.
+	*/
+	void Move(
+		const DirectX::XMFLOAT3& velocity,
+		float dt);
+
+	// leaves ground with speed along up, ignored in the air
+	void Jump(
+		float speed);
+
+	// teleports without collision checks, ground cache is dropped
+	void SetPosition(
+		const DirectX::XMFLOAT3& position);
+
+	// nearest hit of capsule at start moved by displacement among candidates of current Move
+	bool CastCapsule(
+		const DirectX::XMFLOAT3& start,
+		const DirectX::XMFLOAT3& displacement,
+		CharacterHit* hit);
+
+	bool CastAgainstBody(
+		uint64_t bodyId,
+		const DirectX::XMFLOAT3& start,
+		const DirectX::XMFLOAT3& displacement,
+		CharacterHit* hit);
+
+	// hit leaves bodyId to the caller
+	bool CastAgainstConvex(
+		Body* body,
+		const DirectX::XMFLOAT3& start,
+		const DirectX::XMFLOAT3& displacement,
+		CharacterHit* hit);
+
+	void GatherCandidates(
+		const BoundingBox& box);
+
+	// pushes capsule out of candidates it penetrates, e.g. after kinematic body moved into it
+	void Depenetrate();
+
+	void DepenetrateFrom(
+		Body* body);
+
+	// returns true when displacement was blocked
+	bool SlideMove(
+		const DirectX::XMFLOAT3& displacement,
+		bool horizontal);
+
+	bool TryStepUp(
+		const DirectX::XMFLOAT3& displacement);
+
+	void ProbeGround();
+
+	bool IsWalkable(
+		const DirectX::XMFLOAT3& normal) const;
+
+public:
+	PhysicsEnigne* physicsEngine;
+	CharacterControllerSettings settings;
+	DirectX::XMFLOAT3 position; // center of capsule
+	float verticalSpeed; // along up
+	uint64_t bodyId; // kinematic body following the controller, 0 when there is none
+	bool grounded;
+	uint64_t groundBodyId; // ground found by last probe, 0 in the air
+	DirectX::XMFLOAT3 groundNormal;
+	CharacterControllerStats stats;
+	Body core; // segment of capsule, casts add radius to its distances
+	Body triangle; // current triangle of concave candidate
+	Body child; // current child of compound candidate
+	std::vector<uint64_t> candidates;
+	std::vector<WorldTriangle> triangles;
+	std::vector<ShapeChild> children;
+};
@@ -0,0 +1,138 @@
+#include "FrameArena.hpp"
+#include <algorithm>
+using namespace std;
+
+static constexpr size_t FRAME_ARENA_MIN_BLOCK = 64 * 1024;
+static constexpr size_t FRAME_ARENA_BLOCK_ALIGNMENT = 4096;
+
+FrameArena::FrameArena() :
+	current(0),
+	offset(0),
+	usedBefore(0),
+	peak(0)
+{
+}
+
+void FrameArena::Reserve(
+	size_t bytes)
+{
+	// blocks can't be replaced while something lives in them, next Reset grows the arena
+	peak = max(peak, bytes);
+	if (current == 0 && offset == 0)
+	{
+		Reset();
+	}
+}
+
+void* FrameArena::Allocate(
+	size_t bytes,
+	size_t alignment)
+{
+	while (true)
+	{
+		if (current < blocks.size())
+		{
+			Block& block = blocks[current];
+			uintptr_t base = (uintptr_t)block.data.get();
+			size_t start = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+			if (start + bytes <= block.size)
+			{
+				offset = start + bytes;
+				peak = max(peak, usedBefore + offset);
+				return block.data.get() + start;
+			}
+			if (current + 1 < blocks.size())
+			{
+				// blocks after current are free, rest of current is left unused until Reset
+				usedBefore += block.size;
+				current++;
+				offset = 0;
+				continue;
+			}
+		}
+
+		// chained block is at least as large as all blocks before, so chain stays short
+		size_t size = max(bytes + alignment, max(GetCapacity(), FRAME_ARENA_MIN_BLOCK));
+		blocks.push_back({ unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+		if (blocks.size() > 1)
+		{
+			usedBefore += blocks[current].size;
+			current = blocks.size() - 1;
+			offset = 0;
+		}
+	}
+}
+
+bool FrameArena::Extend(
+	void* ptr,
+	size_t oldBytes,
+	size_t newBytes)
+{
+	if (current >= blocks.size())
+	{
+		return false;
+	}
+
+	Block& block = blocks[current];
+	uint8_t* bytes = (uint8_t*)ptr;
+	if (bytes < block.data.get() || bytes + oldBytes != block.data.get() + offset)
+	{
+		return false;
+	}
+
+	size_t start = bytes - block.data.get();
+	if (start + newBytes > block.size)
+	{
+		return false;
+	}
+	offset = start + newBytes;
+	peak = max(peak, usedBefore + offset);
+	return true;
+}
+
+FrameArenaMark FrameArena::GetMark() const
+{
+	return { current, offset };
+}
+
+void FrameArena::Rewind(
+	const FrameArenaMark& mark)
+{
+	current = mark.block;
+	offset = mark.offset;
+	usedBefore = 0;
+	for (size_t i = 0; i < current; i++)
+	{
+		usedBefore += blocks[i].size;
+	}
+
+	if (current != 0 || offset != 0)
+	{
+		return;
+	}
+
+	// arena is empty, replace chain by one block that holds the whole peak with some slack
+	if (blocks.size() > 1 || (blocks.size() == 1 && blocks[0].size < peak) || (blocks.empty() && peak > 0))
+	{
+		size_t size = peak + peak / 4;
+		size = max((size + FRAME_ARENA_BLOCK_ALIGNMENT - 1) & ~(FRAME_ARENA_BLOCK_ALIGNMENT - 1), FRAME_ARENA_MIN_BLOCK);
+		blocks.clear();
+		blocks.push_back({ unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+	}
+	peak = 0;
+}
+
+void FrameArena::Reset()
+{
+	Rewind({ 0, 0 });
+}
+
+size_t FrameArena::GetCapacity() const
+{
+	size_t bytes = 0;
+	for (const Block& block : blocks)
+	{
+		bytes += block.size;
+	}
+	return bytes;
+}
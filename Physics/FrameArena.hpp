@@ -0,0 +1,191 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <inttypes.h>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+struct FrameArenaMark
+{
+	size_t block;
+	size_t offset;
+};
+
+/*
+	Linear allocator for data that lives for one step. Allocation bumps an offset,
+	Reset releases everything at once. A step that doesn't fit gets extra blocks,
+	next Reset merges them into one block sized by peak usage of the step,
+	so once capacity settles steps don't touch the heap.
+	Not thread safe, every thread needs its own arena.
+*/
+struct FrameArena
+{
+	FrameArena();
+
+	void Reserve(
+		size_t bytes);
+
+	void* Allocate(
+		size_t bytes,
+		size_t alignment);
+
+	template<typename T>
+	T* Allocate(
+		size_t count)
+	{
+		return (T*)Allocate(count * sizeof(T), alignof(T));
+	}
+
+	// grows allocation in place, false when ptr isn't the last allocation or block is full
+	bool Extend(
+		void* ptr,
+		size_t oldBytes,
+		size_t newBytes);
+
+	FrameArenaMark GetMark() const;
+
+	// releases everything allocated after mark, rewinding to the start also merges blocks
+	void Rewind(
+		const FrameArenaMark& mark);
+
+	void Reset();
+
+	size_t GetCapacity() const;
+
+public:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t current; // block that is allocated from
+	size_t offset; // first free byte of current block
+	size_t usedBefore; // bytes of blocks before current, whole blocks are counted
+	size_t peak; // since last Reset
+};
+
+// releases allocations made during its lifetime
+struct FrameArenaScope
+{
+	explicit FrameArenaScope(
+		FrameArena* arena) :
+		arena(arena),
+		mark(arena->GetMark())
+	{
+	}
+
+	~FrameArenaScope()
+	{
+		arena->Rewind(mark);
+	}
+
+	FrameArenaScope(const FrameArenaScope&) = delete;
+	FrameArenaScope& operator=(const FrameArenaScope&) = delete;
+
+public:
+	FrameArena* arena;
+	FrameArenaMark mark;
+};
+
+/*
+	Growable array in FrameArena, method names follow std::vector so it can replace one.
+	Growing the last allocation of the arena happens in place, otherwise items are copied and
+	old storage is left until arena is reset. Storage is gone after arena Reset, Init has to
+	be called again before array is used.
+*/
+template<typename T>
+struct FrameArray
+{
+	static_assert(std::is_trivially_copyable<T>::value, "FrameArray items are moved with memcpy");
+
+	void Init(
+		FrameArena* arena)
+	{
+		this->arena = arena;
+		items = nullptr;
+		count = 0;
+		capacity = 0;
+	}
+
+	void reserve(
+		size_t n)
+	{
+		if (n <= capacity)
+		{
+			return;
+		}
+		if (!items || !arena->Extend(items, capacity * sizeof(T), n * sizeof(T)))
+		{
+			T* moved = arena->Allocate<T>(n);
+			if (count)
+			{
+				memcpy(moved, items, count * sizeof(T));
+			}
+			items = moved;
+		}
+		capacity = n;
+	}
+
+	// new items are value initialized
+	void resize(
+		size_t n)
+	{
+		reserve(n);
+		for (size_t i = count; i < n; i++)
+		{
+			items[i] = T{};
+		}
+		count = n;
+	}
+
+	void assign(
+		size_t n,
+		const T& value)
+	{
+		reserve(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			items[i] = value;
+		}
+		count = n;
+	}
+
+	void push_back(
+		const T& value)
+	{
+		if (count == capacity)
+		{
+			reserve(capacity ? capacity * 2 : 16);
+		}
+		items[count++] = value;
+	}
+
+	T* erase(
+		T* it)
+	{
+		memmove(it, it + 1, (end() - it - 1) * sizeof(T));
+		count--;
+		return it;
+	}
+
+	void clear() { count = 0; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T* data() { return items; }
+	const T* data() const { return items; }
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+	T& operator[](size_t i) { return items[i]; }
+	const T& operator[](size_t i) const { return items[i]; }
+
+public:
+	FrameArena* arena = nullptr;
+	T* items = nullptr;
+	size_t count = 0;
+	size_t capacity = 0;
+};
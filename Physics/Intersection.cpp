@@ -1,6 +1,11 @@
 #include "Intersection.hpp"
+#include "AabbTree.hpp"
+#include "FrameArena.hpp"
+#include "Shapes/ShapeCompound.hpp"
 #include <cstdlib>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 using namespace std;
 using namespace DirectX;
 
@@ -131,8 +136,8 @@ static float SignedDistanceToSurface(
 }
 
 static size_t RemoveTrianglesFacingPoint(
-	std::vector<Triangle>* triangles,
-	const std::vector<SupportPoint>& vertecies,
+	FrameArray<Triangle>* triangles,
+	const FrameArray<SupportPoint>& vertecies,
 	const SupportPoint& pt)
 {
 	size_t removedTriangles = 0;
@@ -157,8 +162,8 @@ static size_t RemoveTrianglesFacingPoint(
 
 static bool HasPoint(
 	const SupportPoint& point,
-	const std::vector<Triangle>& triangles, 
-	const std::vector<SupportPoint>& vertecies) 
+	const FrameArray<Triangle>& triangles, 
+	const FrameArray<SupportPoint>& vertecies) 
 {
 	const float epsilons = 0.001f * 0.001f;
 	XMVECTOR vec = XMLoadFloat3(&point.ptOnSimplex);
@@ -198,8 +203,8 @@ static bool HasPoint(
 
 
 static size_t NearestTriangleToPoint(
-	const std::vector<Triangle>& triangles, 
-	const std::vector<SupportPoint>& vertecies,
+	const FrameArray<Triangle>& triangles, 
+	const FrameArray<SupportPoint>& vertecies,
 	const XMFLOAT3* point)
 {
 	float distSq = 1e10;
@@ -222,8 +227,8 @@ static size_t NearestTriangleToPoint(
 }
 
 static void FindDanglingEdges(
-	vector<Edge>* danglingEdges,
-	const vector<Triangle>& triangles)
+	FrameArray<Edge>* danglingEdges,
+	const FrameArray<Triangle>& triangles)
 {
 	for (int i = 0; i < triangles.size(); i++) 
 	{
@@ -353,18 +358,30 @@ static void BarycentricCoords(
 
 }
 
+// typical polytopes fit, larger ones grow inside scratch
+static constexpr size_t EPA_RESERVED_POINTS = 64;
+static thread_local FrameArena epaScratch;
+
 static float EpaContactInfo(
 	const Body* bodyA, 
 	const Body* bodyB,
 	const float bias, 
 	const Simplex simplexPoints[4],
 	XMFLOAT3* ptOnA,
-	XMFLOAT3* ptOnB)
+	XMFLOAT3* ptOnB,
+	IntersectionStats* stats)
 {
-
-	vector<SupportPoint> points;
-	vector<Triangle> triangles;
-	vector<Edge> danglingEdges;
+	// polytope lives in scratch of calling thread, released when EPA returns
+	FrameArenaScope scope(&epaScratch);
+	FrameArray<SupportPoint> points;
+	FrameArray<Triangle> triangles;
+	FrameArray<Edge> danglingEdges;
+	points.Init(&epaScratch);
+	triangles.Init(&epaScratch);
+	danglingEdges.Init(&epaScratch);
+	points.reserve(EPA_RESERVED_POINTS);
+	triangles.reserve(EPA_RESERVED_POINTS * 2);
+	danglingEdges.reserve(EPA_RESERVED_POINTS);
 
 	XMFLOAT3 center = {};
 	for (int i = 0; i < 4; i++)
@@ -402,9 +419,11 @@ static float EpaContactInfo(
 	XMFLOAT3 origin = { 0, 0, 0 };
 	XMFLOAT3 normal;
 	SupportPoint suppPoint;
+	size_t iterCount = 0;
 
 	while (true)
 	{
+		iterCount++;
 		const size_t idx = NearestTriangleToPoint(triangles, points, &origin);
 		const Triangle& tri = triangles[idx];
 		XMVECTOR vecBA = XMLoadFloat3(&points[tri.b].ptOnSimplex) - XMLoadFloat3(&points[tri.a].ptOnSimplex);
@@ -462,6 +481,11 @@ static float EpaContactInfo(
 		}
 
 	}
+	if (stats)
+	{
+		stats->epaIterations[min(iterCount, EPA_HISTOGRAM_BUCKETS - 1)]++;
+	}
+
 	const int idx = NearestTriangleToPoint(triangles, points, &origin);
 	const Triangle& tri = triangles[idx];
 	float lambdas[3];
@@ -543,11 +567,17 @@ static void SignedDistance1D(
 		lambdas[0] = C1 / mu_max;
 		lambdas[1] = C2 / mu_max;
 	}
-	else
+	else if (CompareSigns(mu_max, C1))
 	{
+		// origin projects past s1
 		lambdas[0] = 1.0f;
 		lambdas[1] = 0;
 	}
+	else
+	{
+		lambdas[0] = 0;
+		lambdas[1] = 1.0f;
+	}
 	return;
 }
 
@@ -777,16 +807,17 @@ static bool CoplanarTest(const Simplex& simplex)
 	return abs(prod) <= eps;
 }
 
-static bool GjkIntersectionTest(
+// runs GJK until simplex encloses origin, returns false when bodies are separated
+static bool GjkContainsOrigin(
 	Body* bodyA,
 	Body* bodyB,
-	Contact* contact,
-	float bias)
+	Simplex* simplexOut,
+	IntersectionStats* stats)
 {
 	constexpr float epsilon = 0.0001;
 	constexpr uint8_t maxIters = 10;
 
-	Simplex simplex;
+	Simplex& simplex = *simplexOut;
 	XMFLOAT3 dir = { 0, 1, 0 };
 	float lambdas[4] = {};
 	SupportPoint support;
@@ -863,7 +894,24 @@ static bool GjkIntersectionTest(
 		iterCount++;
 	}
 
-	if (!hasOrigin)
+	if (stats)
+	{
+		stats->gjkIterations[min((size_t)iterCount, GJK_HISTOGRAM_BUCKETS - 1)]++;
+		stats->gjkMaxIterationHits += iterCount >= maxIters ? 1 : 0;
+	}
+
+	return hasOrigin;
+}
+
+static bool GjkIntersectionTest(
+	Body* bodyA,
+	Body* bodyB,
+	Contact* contact,
+	float bias,
+	IntersectionStats* stats)
+{
+	Simplex simplex;
+	if (!GjkContainsOrigin(bodyA, bodyB, &simplex, stats))
 	{
 		return false;
 	}
@@ -935,38 +983,422 @@ static bool GjkIntersectionTest(
 	}
 	
 
-	EpaContactInfo(bodyA, bodyB, bias, &simplex, &contact->ptOnA, &contact->ptOnB);
+	EpaContactInfo(bodyA, bodyB, bias, &simplex, &contact->ptOnA, &contact->ptOnB, stats);
+	return true;
+}
+
+static void ProjectBody(
+	const Body* body,
+	FXMVECTOR axis,
+	float* minProj,
+	float* maxProj)
+{
+	XMFLOAT3 dir, support;
+	XMStoreFloat3(&dir, axis);
+	body->shape.supportFunction(&body->shape, &body->position, &dir, &body->rotation, &support, 0.0f);
+	XMStoreFloat(maxProj, XMVector3Dot(XMLoadFloat3(&support), axis));
+	XMStoreFloat3(&dir, -axis);
+	body->shape.supportFunction(&body->shape, &body->position, &dir, &body->rotation, &support, 0.0f);
+	XMStoreFloat(minProj, XMVector3Dot(XMLoadFloat3(&support), axis));
+}
+
+/*
+	Separating axis test of convex body against one triangle. Axes are triangle normal,
+	local axes of the body and their cross products with triangle edges, body is projected
+	by its support function, so the test is exact for boxes. Triangle is one sided,
+	normal points out of triangle towards the body and ptOnBody is the deepest point.
+*/
+static bool TriangleSatTest(
+	const Body* body,
+	const WorldTriangle& triangle,
+	XMFLOAT3* normal,
+	float* depth,
+	XMFLOAT3* ptOnBody,
+	XMFLOAT3* ptOnTriangle)
+{
+	XMVECTOR vertices[3] = { XMLoadFloat3(&triangle.vertices[0]), XMLoadFloat3(&triangle.vertices[1]), XMLoadFloat3(&triangle.vertices[2]) };
+	XMVECTOR triangleNormal = XMLoadFloat3(&triangle.normal);
+	XMVECTOR triangleCenter = (vertices[0] + vertices[1] + vertices[2]) / 3.0f;
+	XMVECTOR bodyCenter = XMLoadFloat3(&body->position);
+
+	XMVECTOR axes[13];
+	axes[0] = triangleNormal;
+	XMMATRIX rotationMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&body->rotation)));
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		axes[1 + i] = rotationMat.r[i];
+		for (uint8_t j = 0; j < 3; j++)
+		{
+			axes[4 + i * 3 + j] = XMVector3Cross(rotationMat.r[i], vertices[(j + 1) % 3] - vertices[j]);
+		}
+	}
+
+	float faceDepth = 0.0f;
+	float bestDepth = FLT_MAX;
+	XMVECTOR bestAxis = triangleNormal;
+	for (uint8_t i = 0; i < 13; i++)
+	{
+		float lengthSq;
+		XMStoreFloat(&lengthSq, XMVector3LengthSq(axes[i]));
+		if (lengthSq < 1e-10f)
+		{
+			continue;
+		}
+
+		XMVECTOR axis = XMVector3Normalize(axes[i]);
+		float towardsBody;
+		XMStoreFloat(&towardsBody, XMVector3Dot(bodyCenter - triangleCenter, axis));
+		if (i > 0 && towardsBody < 0.0f)
+		{
+			axis = -axis;
+		}
+
+		float bodyMin, bodyMax;
+		ProjectBody(body, axis, &bodyMin, &bodyMax);
+		float triangleMin = FLT_MAX;
+		float triangleMax = -FLT_MAX;
+		for (const XMVECTOR& vertex : vertices)
+		{
+			float proj;
+			XMStoreFloat(&proj, XMVector3Dot(vertex, axis));
+			triangleMin = min(triangleMin, proj);
+			triangleMax = max(triangleMax, proj);
+		}
+
+		float axisDepth = triangleMax - bodyMin;
+		if (axisDepth < 0.0f || bodyMax < triangleMin)
+		{
+			return false;
+		}
+
+		if (i == 0)
+		{
+			faceDepth = axisDepth;
+		}
+		if (axisDepth < bestDepth)
+		{
+			bestDepth = axisDepth;
+			bestAxis = axis;
+		}
+	}
+
+	// face normal unless edge is clearly better, keeps bodies from catching on inner edges of flat ground
+	if (faceDepth <= bestDepth * 1.1f + 0.001f)
+	{
+		XMStoreFloat3(normal, triangleNormal);
+		*depth = faceDepth;
+		XMFLOAT3 dir;
+		XMStoreFloat3(&dir, -triangleNormal);
+		body->shape.supportFunction(&body->shape, &body->position, &dir, &body->rotation, ptOnBody, 0.0f);
+		XMStoreFloat3(ptOnTriangle, XMLoadFloat3(ptOnBody) + triangleNormal * faceDepth);
+		return true;
+	}
+
+	// triangle vertex deepest inside the body
+	XMStoreFloat3(normal, bestAxis);
+	*depth = bestDepth;
+	XMVECTOR deepest = vertices[0];
+	float deepestProj = -FLT_MAX;
+	for (const XMVECTOR& vertex : vertices)
+	{
+		float proj;
+		XMStoreFloat(&proj, XMVector3Dot(vertex, bestAxis));
+		if (proj > deepestProj)
+		{
+			deepestProj = proj;
+			deepest = vertex;
+		}
+	}
+	XMStoreFloat3(ptOnTriangle, deepest);
+	XMStoreFloat3(ptOnBody, deepest - bestAxis * bestDepth);
+	return true;
+}
+
+// deepest contact between convex and world space triangles of the concave body, points and normal follow convention of GJK contacts
+static bool TrianglesIntersectionTest(
+	Body* convex,
+	bool concaveIsA,
+	const std::vector<WorldTriangle>& triangles,
+	Contact* contact,
+	IntersectionStats* stats)
+{
+	bool found = false;
+	float deepest = -1.0f;
+	for (const WorldTriangle& triangle : triangles)
+	{
+		XMFLOAT3 normal, ptOnBody, ptOnTriangle;
+		float depth;
+		if (!TriangleSatTest(convex, triangle, &normal, &depth, &ptOnBody, &ptOnTriangle) || depth <= deepest)
+		{
+			continue;
+		}
+
+		found = true;
+		deepest = depth;
+		contact->ptOnA = concaveIsA ? ptOnTriangle : ptOnBody;
+		contact->ptOnB = concaveIsA ? ptOnBody : ptOnTriangle;
+		contact->normal = concaveIsA ? XMFLOAT3{ -normal.x, -normal.y, -normal.z } : normal;
+	}
+
+	if (stats)
+	{
+		stats->triangleTests += triangles.size();
+	}
+	return found;
+}
+
+// scratch per worker thread, narrow phase runs on several threads
+static thread_local std::vector<WorldTriangle> concaveTriangles;
+static thread_local std::vector<ShapeChild> childrenA;
+static thread_local std::vector<ShapeChild> childrenB;
+
+// triangles that convex body can touch during dt
+static void CollectTrianglesForStep(
+	const Body* concave,
+	const Body* convex,
+	float dt)
+{
+	BoundingBox box = convex->getBoundingBox();
+	XMVECTOR travel = XMVectorAbs(XMLoadFloat3(&convex->linVelocity) * dt);
+	XMStoreFloat3(&box.minC, XMLoadFloat3(&box.minC) - travel);
+	XMStoreFloat3(&box.maxC, XMLoadFloat3(&box.maxC) + travel);
+
+	concaveTriangles.clear();
+	concave->shape.collectTriangles(&concave->shape, &concave->position, &concave->rotation, &box, &concaveTriangles);
+}
+
+// children of compound that other body can touch during dt, motion of both bodies widens the box
+static void CollectChildrenForStep(
+	const Body* compound,
+	const Body* other,
+	float dt,
+	std::vector<ShapeChild>* children)
+{
+	BoundingBox own = compound->getBoundingBox();
+	float travel;
+	XMStoreFloat(&travel, (XMVector3Length(XMLoadFloat3(&other->linVelocity)) + XMVector3Length(XMLoadFloat3(&compound->linVelocity)) +
+		XMVector3Length(XMLoadFloat3(&compound->angVelocity)) * XMVector3Length(XMLoadFloat3(&own.maxC) - XMLoadFloat3(&own.minC))) * dt);
+
+	BoundingBox box = other->getBoundingBox();
+	XMStoreFloat3(&box.minC, XMLoadFloat3(&box.minC) - XMVectorReplicate(travel));
+	XMStoreFloat3(&box.maxC, XMLoadFloat3(&box.maxC) + XMVectorReplicate(travel));
+
+	children->clear();
+	compound->shape.collectChildren(&compound->shape, &compound->position, &compound->rotation, &box, children);
+}
+
+void GetCompoundChildBody(
+	const Body* compound,
+	const ShapeChild& child,
+	Body* childBody)
+{
+	*childBody = *compound;
+	childBody->shape = *child.shape;
+	GetCompoundChildPose(child, &compound->position, &compound->rotation, &childBody->position, &childBody->rotation);
+	XMMATRIX rotationMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&childBody->rotation)));
+	XMStoreFloat4x4(&childBody->rotationMatrix, rotationMat);
+	child.shape->getCenterOfMass(child.shape, &childBody->centerOfMassLocal);
+	XMStoreFloat3(&childBody->centerOfMassOffset, XMVector3TransformNormal(XMLoadFloat3(&childBody->centerOfMassLocal), rotationMat));
+}
+
+// pair of convex bodies, at most one of them concave
+static bool ConvexIntersectionTest(
+	Body* bodyA,
+	Body* bodyB,
+	bool concaveA,
+	bool concaveB,
+	Contact* contact,
+	IntersectionStats* stats)
+{
+	if (concaveA || concaveB)
+	{
+		return TrianglesIntersectionTest(concaveA ? bodyB : bodyA, concaveA, concaveTriangles, contact, stats);
+	}
+
+	if (!GjkIntersectionTest(bodyA, bodyB, contact, 0.001, stats))
+	{
+		return false;
+	}
+	XMStoreFloat3(&contact->normal,
+		XMVector3Normalize(XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&contact->ptOnA))
+	);
 	return true;
 }
 
+// deepest contact among collected children, body that isn't compound acts as its only child
+static bool CompoundIntersectionTest(
+	Body* bodyA,
+	Body* bodyB,
+	bool compoundA,
+	bool compoundB,
+	bool concaveA,
+	bool concaveB,
+	Contact* contact,
+	IntersectionStats* stats)
+{
+	size_t countA = compoundA ? childrenA.size() : 1;
+	size_t countB = compoundB ? childrenB.size() : 1;
+	bool found = false;
+	float deepest = -1.0f;
+	Body childA, childB;
+	for (size_t i = 0; i < countA; i++)
+	{
+		Body* testA = bodyA;
+		if (compoundA)
+		{
+			GetCompoundChildBody(bodyA, childrenA[i], &childA);
+			testA = &childA;
+		}
+
+		for (size_t j = 0; j < countB; j++)
+		{
+			Body* testB = bodyB;
+			if (compoundB)
+			{
+				GetCompoundChildBody(bodyB, childrenB[j], &childB);
+				testB = &childB;
+			}
+			// children of two compounds were collected against whole other body
+			if (compoundA && compoundB && !Overlaps(testA->getBoundingBox(), testB->getBoundingBox()))
+			{
+				continue;
+			}
+
+			Contact childContact;
+			if (!ConvexIntersectionTest(testA, testB, concaveA, concaveB, &childContact, stats))
+			{
+				continue;
+			}
+
+			float depth;
+			XMStoreFloat(&depth, XMVector3Length(XMLoadFloat3(&childContact.ptOnB) - XMLoadFloat3(&childContact.ptOnA)));
+			if (depth > deepest)
+			{
+				found = true;
+				deepest = depth;
+				contact->ptOnA = childContact.ptOnA;
+				contact->ptOnB = childContact.ptOnB;
+				contact->normal = childContact.normal;
+			}
+		}
+	}
+	return found;
+}
+
 bool CheckIntersection(
 	Body* bodyA,
 	Body* bodyB,
 	Contact* contact,
-	float dt)
+	float dt,
+	IntersectionStats* stats)
 {
 	Body copyBodyA = *bodyA;
 	Body copyBodyB = *bodyB;
 	// divide time into sections and iterate
 	constexpr uint8_t ITERS = 10;
-	float stepSize = dt / (float)ITERS;
+	// samples include start and end pose, body that ends the step inside thin shape is still found
+	float stepSize = dt / (float)(ITERS - 1);
 	float total_time = 0;
+	// without time there is nothing to sweep, only current poses are tested
+	const uint8_t iterCount = dt > 0.0f ? ITERS : 1;
+	// halvings of section where bodies started to overlap
+	constexpr uint8_t TOI_BISECTIONS = 6;
+	// resting bodies overlap this little after a section, their contact isn't bisected
+	constexpr float TOI_MIN_DEPTH = 0.02f;
+
+	// concave shapes are tested triangle by triangle, two concave shapes never collide
+	bool concaveA = bodyA->shape.collectTriangles != nullptr;
+	bool concaveB = bodyB->shape.collectTriangles != nullptr;
+	if (concaveA && concaveB)
+	{
+		return false;
+	}
+	if (concaveA || concaveB)
+	{
+		CollectTrianglesForStep(concaveA ? bodyA : bodyB, concaveA ? bodyB : bodyA, dt);
+		if (concaveTriangles.empty())
+		{
+			return false;
+		}
+	}
 
-	for (size_t i = 0; i < ITERS; i++)
+	// compounds are tested child by child, only children near the other body are visited
+	bool compoundA = bodyA->shape.collectChildren != nullptr;
+	bool compoundB = bodyB->shape.collectChildren != nullptr;
+	if (compoundA)
+	{
+		CollectChildrenForStep(bodyA, bodyB, dt, &childrenA);
+		if (childrenA.empty())
+		{
+			return false;
+		}
+	}
+	if (compoundB)
 	{
-		if (GjkIntersectionTest(&copyBodyA, &copyBodyB, contact, 0.001))
+		CollectChildrenForStep(bodyB, bodyA, dt, &childrenB);
+		if (childrenB.empty())
 		{
-			XMStoreFloat3(&contact->normal,
-				XMVector3Normalize(XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&contact->ptOnA))
-			);
+			return false;
+		}
+	}
+
+	auto test = [&](Body* testA, Body* testB, Contact* testContact)
+	{
+		if (stats)
+		{
+			stats->substeps++;
+		}
+		return compoundA || compoundB ?
+			CompoundIntersectionTest(testA, testB, compoundA, compoundB, concaveA, concaveB, testContact, stats) :
+			ConvexIntersectionTest(testA, testB, concaveA, concaveB, testContact, stats);
+	};
+
+	Body previousA = copyBodyA;
+	Body previousB = copyBodyB;
+	for (size_t i = 0; i < iterCount; i++)
+	{
+		bool hit = test(&copyBodyA, &copyBodyB, contact);
+		if (hit)
+		{
+			// bodies moving fast overlap deep at the first sample after impact, contact is taken
+			// closer to the last separated sample so resolution doesn't push them through thin shapes
+			const float previousTime = total_time - stepSize;
+			float separatedTime = previousTime;
+			float depth;
+			XMStoreFloat(&depth, XMVector3Length(XMLoadFloat3(&contact->ptOnA) - XMLoadFloat3(&contact->ptOnB)));
+			const uint8_t bisections = i > 0 && depth > TOI_MIN_DEPTH ? TOI_BISECTIONS : 0;
+			for (uint8_t j = 0; j < bisections; j++)
+			{
+				float time = (separatedTime + total_time) * 0.5f;
+				Body testA = previousA;
+				Body testB = previousB;
+				testA.UpdateBody(time - previousTime);
+				testB.UpdateBody(time - previousTime);
+				Contact testContact;
+				if (test(&testA, &testB, &testContact))
+				{
+					copyBodyA = testA;
+					copyBodyB = testB;
+					*contact = testContact;
+					total_time = time;
+				}
+				else
+				{
+					separatedTime = time;
+				}
+			}
 
 			copyBodyA.GetPointInLocalSpace(&contact->ptOnA, &contact->localPtOnA);
 			copyBodyB.GetPointInLocalSpace(&contact->ptOnB, &contact->localPtOnB);
 			contact->timeOfImpact = total_time;
+			contact->isSpeculative = false;
+			contact->manifoldPointCount = 0;
 			contact->bodyA = bodyA;
 			contact->bodyB = bodyB;
 			return true;
 		}
+		previousA = copyBodyA;
+		previousB = copyBodyB;
 		copyBodyA.UpdateBody(stepSize);
 		copyBodyB.UpdateBody(stepSize);
 		total_time += stepSize;
@@ -975,6 +1407,363 @@ bool CheckIntersection(
 	return false;
 }
 
+// farthest point of body from its center of mass, bounds how fast rotation moves a surface point
+static float GetRotationRadius(
+	const Body* body)
+{
+	XMFLOAT3 CoM;
+	body->GetCenterOfMassWorldSpace(&CoM);
+	BoundingBox box = body->getBoundingBox();
+	XMVECTOR center = XMLoadFloat3(&CoM);
+	XMVECTOR extent = XMVectorMax(XMVectorAbs(XMLoadFloat3(&box.maxC) - center), XMVectorAbs(XMLoadFloat3(&box.minC) - center));
+	float radius;
+	XMStoreFloat(&radius, XMVector3Length(extent));
+	return radius;
+}
+
+// corners of face or ends of edge of body farthest along dir, ordered around dir in plane of u and v
+static size_t GetFacingFeature(
+	const Body* body,
+	XMVECTOR dir,
+	XMVECTOR u,
+	XMVECTOR v,
+	XMVECTOR* points)
+{
+	constexpr size_t SAMPLES = 8;
+	constexpr float TILT = 0.1f; // faces turned less than this from dir give all their corners
+	constexpr float FEATURE_TOLERANCE = 0.02f;
+	constexpr float SAME_POINT_SQ = 1e-6f;
+
+	XMFLOAT3 direction, support;
+	XMStoreFloat3(&direction, dir);
+	body->shape.supportFunction(&body->shape, &body->position, &direction, &body->rotation, &support, 0.0f);
+	float deepest;
+	XMStoreFloat(&deepest, XMVector3Dot(XMLoadFloat3(&support), dir));
+
+	size_t count = 0;
+	for (size_t i = 0; i < SAMPLES; i++)
+	{
+		float angle = 2.0f * XM_PI * i / SAMPLES;
+		XMStoreFloat3(&direction, dir + (u * cosf(angle) + v * sinf(angle)) * TILT);
+		body->shape.supportFunction(&body->shape, &body->position, &direction, &body->rotation, &support, 0.0f);
+		XMVECTOR point = XMLoadFloat3(&support);
+
+		float depth;
+		XMStoreFloat(&depth, XMVector3Dot(point, dir));
+		bool known = depth < deepest - FEATURE_TOLERANCE;
+		for (size_t j = 0; j < count && !known; j++)
+		{
+			known = XMVectorGetX(XMVector3LengthSq(point - points[j])) < SAME_POINT_SQ;
+		}
+		if (!known)
+		{
+			points[count++] = point;
+		}
+	}
+	return count;
+}
+
+// keeps points of subject inside clip polygon, both are ordered counter clockwise in plane of u and v
+static size_t ClipFeature(
+	const XMVECTOR* subject,
+	size_t subjectCount,
+	const XMVECTOR* clip,
+	size_t clipCount,
+	XMVECTOR u,
+	XMVECTOR v,
+	XMVECTOR* out)
+{
+	// every clip edge adds at most one point
+	XMVECTOR buffers[2][16];
+	size_t count = subjectCount;
+	XMVECTOR* input = buffers[0];
+	for (size_t i = 0; i < count; i++)
+	{
+		input[i] = subject[i];
+	}
+
+	for (size_t edge = 0; edge < clipCount && count > 0; edge++)
+	{
+		XMVECTOR start = clip[edge];
+		XMVECTOR end = clip[(edge + 1) % clipCount];
+		float edgeU = XMVectorGetX(XMVector3Dot(end - start, u));
+		float edgeV = XMVectorGetX(XMVector3Dot(end - start, v));
+		auto side = [&](XMVECTOR point)
+		{
+			return edgeU * XMVectorGetX(XMVector3Dot(point - start, v)) - edgeV * XMVectorGetX(XMVector3Dot(point - start, u));
+		};
+
+		XMVECTOR* output = input == buffers[0] ? buffers[1] : buffers[0];
+		size_t outCount = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			XMVECTOR current = input[i];
+			XMVECTOR next = input[(i + 1) % count];
+			float sideCurrent = side(current);
+			float sideNext = side(next);
+			if (sideCurrent >= 0.0f)
+			{
+				output[outCount++] = current;
+			}
+			// single point has no edge to cut
+			if (count > 1 && (sideCurrent >= 0.0f) != (sideNext >= 0.0f))
+			{
+				output[outCount++] = XMVectorLerp(current, next, sideCurrent / (sideCurrent - sideNext));
+			}
+		}
+		input = output;
+		count = outCount;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = input[i];
+	}
+	return count;
+}
+
+// reduces points to CONTACT_MANIFOLD_SIZE: smallest gap, farthest from it and widest on both sides of that line
+static size_t ReduceManifold(
+	XMVECTOR* points,
+	float* gaps,
+	size_t count,
+	XMVECTOR normal)
+{
+	if (count <= CONTACT_MANIFOLD_SIZE)
+	{
+		return count;
+	}
+
+	size_t picked[CONTACT_MANIFOLD_SIZE] = {};
+	for (size_t i = 1; i < count; i++)
+	{
+		picked[0] = gaps[i] < gaps[picked[0]] ? i : picked[0];
+	}
+	float farthest = -1.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		float distSq = XMVectorGetX(XMVector3LengthSq(points[i] - points[picked[0]]));
+		if (distSq > farthest)
+		{
+			farthest = distSq;
+			picked[1] = i;
+		}
+	}
+	float minArea = 0.0f;
+	float maxArea = 0.0f;
+	picked[2] = picked[3] = picked[0];
+	for (size_t i = 0; i < count; i++)
+	{
+		float area = XMVectorGetX(XMVector3Dot(XMVector3Cross(points[picked[1]] - points[picked[0]], points[i] - points[picked[0]]), normal));
+		if (area > maxArea)
+		{
+			maxArea = area;
+			picked[2] = i;
+		}
+		if (area < minArea)
+		{
+			minArea = area;
+			picked[3] = i;
+		}
+	}
+
+	XMVECTOR keptPoints[CONTACT_MANIFOLD_SIZE];
+	float keptGaps[CONTACT_MANIFOLD_SIZE];
+	size_t kept = 0;
+	for (size_t i = 0; i < CONTACT_MANIFOLD_SIZE; i++)
+	{
+		bool duplicate = false;
+		for (size_t j = 0; j < i; j++)
+		{
+			duplicate = duplicate || picked[j] == picked[i];
+		}
+		if (!duplicate)
+		{
+			keptPoints[kept] = points[picked[i]];
+			keptGaps[kept++] = gaps[picked[i]];
+		}
+	}
+	for (size_t i = 0; i < kept; i++)
+	{
+		points[i] = keptPoints[i];
+		gaps[i] = keptGaps[i];
+	}
+	return kept;
+}
+
+/*
+	Points where facing features of bodies overlap seen along normal, with gap of each point, 0 when touching.
+	Points lie on the feature that was clipped, the line along normal through them hits both bodies.
+	Returns 0 when neither feature is a face, e.g. two edges, closest points are used then.
+*/
+static size_t GetContactManifold(
+	const Body* bodyA,
+	const Body* bodyB,
+	XMVECTOR normal,
+	XMVECTOR ptOnA,
+	XMVECTOR ptOnB,
+	XMVECTOR* points,
+	float* gaps)
+{
+	XMVECTOR u = XMVector3Normalize(XMVector3Cross(normal, fabsf(XMVectorGetX(normal)) < 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0)));
+	XMVECTOR v = XMVector3Cross(normal, u);
+
+	// normal points from B to A, both features are sampled counter clockwise in plane of u and v
+	XMVECTOR featureA[8];
+	XMVECTOR featureB[8];
+	size_t countA = GetFacingFeature(bodyA, -normal, u, v, featureA);
+	size_t countB = GetFacingFeature(bodyB, normal, u, v, featureB);
+
+	XMVECTOR clipped[16];
+	size_t count = 0;
+	bool onA = countB >= 3;
+	if (onA)
+	{
+		count = ClipFeature(featureA, countA, featureB, countB, u, v, clipped);
+	}
+	else if (countA >= 3)
+	{
+		count = ClipFeature(featureB, countB, featureA, countA, u, v, clipped);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		points[i] = clipped[i];
+		// gap to the plane of the other feature through its closest point
+		gaps[i] = std::max(XMVectorGetX(XMVector3Dot(onA ? clipped[i] - ptOnB : ptOnA - clipped[i], normal)), 0.0f);
+	}
+	return ReduceManifold(points, gaps, count, normal);
+}
+
+// single point between faces turns part of the impulse into spin, faces get a point per corner of their overlap
+static void SetContactManifold(
+	const Body* bodyA,
+	const Body* bodyB,
+	Contact* contact,
+	float dist,
+	float dt)
+{
+	XMVECTOR normal = XMLoadFloat3(&contact->normal);
+	XMVECTOR points[16];
+	float gaps[16];
+	size_t count = GetContactManifold(bodyA, bodyB, normal, XMLoadFloat3(&contact->ptOnA), XMLoadFloat3(&contact->ptOnB), points, gaps);
+	if (count == 0)
+	{
+		points[0] = XMLoadFloat3(&contact->ptOnA);
+		gaps[0] = dist;
+		count = 1;
+	}
+
+	contact->manifoldPointCount = (uint8_t)count;
+	for (size_t i = 0; i < count; i++)
+	{
+		// touching bodies must not approach at all
+		XMStoreFloat4(&contact->manifoldPoints[i], XMVectorSetW(points[i], dt > 0.0f ? gaps[i] / dt : 0.0f));
+	}
+}
+
+bool CheckSpeculativeContact(
+	Body* bodyA,
+	Body* bodyB,
+	Contact* contact,
+	float dt,
+	IntersectionStats* stats)
+{
+	// closest distance isn't defined for concave shapes and measures every child of compounds
+	if (bodyA->shape.collectTriangles || bodyB->shape.collectTriangles ||
+		bodyA->shape.collectChildren || bodyB->shape.collectChildren)
+	{
+		return CheckIntersection(bodyA, bodyB, contact, dt, stats);
+	}
+
+	bool hit = CheckIntersection(bodyA, bodyB, contact, 0.0f, stats);
+	if (hit)
+	{
+		SetContactManifold(bodyA, bodyB, contact, 0.0f, 0.0f);
+		return true;
+	}
+	if (dt <= 0.0f)
+	{
+		return false;
+	}
+
+	XMFLOAT3 ptOnA, ptOnB;
+	float dist;
+	DistanceBetweenBodies(bodyA, bodyB, &ptOnA, &ptOnB, &dist);
+	if (dist <= 0.0f)
+	{
+		return false;
+	}
+
+	// upper bound of how far surfaces can approach in dt, pairs that can't close the gap get no contact
+	float reach;
+	XMStoreFloat(&reach,
+		XMVector3Length(XMLoadFloat3(&bodyA->linVelocity) - XMLoadFloat3(&bodyB->linVelocity)) +
+		XMVector3Length(XMLoadFloat3(&bodyA->angVelocity)) * GetRotationRadius(bodyA) +
+		XMVector3Length(XMLoadFloat3(&bodyB->angVelocity)) * GetRotationRadius(bodyB));
+	if (reach * dt < dist)
+	{
+		return false;
+	}
+
+	// normal points from B to A like normals of touching contacts
+	contact->ptOnA = ptOnA;
+	contact->ptOnB = ptOnB;
+	XMStoreFloat3(&contact->normal, (XMLoadFloat3(&ptOnA) - XMLoadFloat3(&ptOnB)) * (1.0f / dist));
+	bodyA->GetPointInLocalSpace(&contact->ptOnA, &contact->localPtOnA);
+	bodyB->GetPointInLocalSpace(&contact->ptOnB, &contact->localPtOnB);
+	contact->timeOfImpact = 0.0f;
+	contact->isSpeculative = true;
+	contact->bodyA = bodyA;
+	contact->bodyB = bodyB;
+	SetContactManifold(bodyA, bodyB, contact, dist, dt);
+	if (stats)
+	{
+		stats->speculativeContacts++;
+	}
+	return true;
+}
+
+bool CheckOverlap(
+	Body* bodyA,
+	Body* bodyB,
+	IntersectionStats* stats)
+{
+	bool concaveA = bodyA->shape.collectTriangles != nullptr;
+	bool concaveB = bodyB->shape.collectTriangles != nullptr;
+	bool compoundA = bodyA->shape.collectChildren != nullptr;
+	bool compoundB = bodyB->shape.collectChildren != nullptr;
+	if (concaveA && concaveB)
+	{
+		return false;
+	}
+	if (concaveA || concaveB)
+	{
+		CollectTrianglesForStep(concaveA ? bodyA : bodyB, concaveA ? bodyB : bodyA, 0.0f);
+	}
+
+	Contact contact;
+	if (compoundA || compoundB)
+	{
+		if (compoundA)
+		{
+			CollectChildrenForStep(bodyA, bodyB, 0.0f, &childrenA);
+		}
+		if (compoundB)
+		{
+			CollectChildrenForStep(bodyB, bodyA, 0.0f, &childrenB);
+		}
+		return CompoundIntersectionTest(bodyA, bodyB, compoundA, compoundB, concaveA, concaveB, &contact, stats);
+	}
+	if (concaveA || concaveB)
+	{
+		return TrianglesIntersectionTest(concaveA ? bodyB : bodyA, concaveA, concaveTriangles, &contact, stats);
+	}
+
+	Simplex simplex;
+	return GjkContainsOrigin(bodyA, bodyB, &simplex, stats);
+}
+
 static void GjkClosestDistance(
 	Body* bodyA,
 	Body* bodyB,
@@ -987,7 +1776,7 @@ static void GjkClosestDistance(
 
 	Simplex simplex;
 	XMFLOAT3 dir = { 0, 1, 0 };
-	float lambdas[4] = {};
+	float lambdas[4] = { 1.0f }; // single point simplex when loop stops before first solve
 	SupportPoint support;
 	uint8_t iterCount = 0;
 
@@ -1031,17 +1820,14 @@ static void GjkClosestDistance(
 				last--;
 			}
 		}
-		// bubble up lambdas == 0
-		for (int i = 0; i < 4; i++)
+		// keep lambdas aligned with supports left in the simplex
+		uint8_t kept = 0;
+		for (uint8_t i = 0; i < simplex.idxCount; i++)
 		{
-			if (lambdas[i] == 0.0f)
+			if (lambdas[i] != 0.0f)
 			{
-				for (int j = i + 1; j < 4; j++)
-				{
-					std::swap(lambdas[j - 1], lambdas[j]);
-				}
+				lambdas[kept++] = lambdas[i];
 			}
-			
 		}
 
 		simplex.idxCount = last + 1;
@@ -1065,6 +1851,38 @@ static void GjkClosestDistance(
 	return;
 }
 
+// closest pair of children, every child is visited
+static void CompoundClosestDistance(
+	Body* bodyA,
+	Body* bodyB,
+	XMFLOAT3* ptOnA,
+	XMFLOAT3* ptOnB)
+{
+	bool compoundA = bodyA->shape.collectChildren != nullptr;
+	Body* compound = compoundA ? bodyA : bodyB;
+	BoundingBox everything;
+	everything.minC = { -1e30f, -1e30f, -1e30f };
+	everything.maxC = { 1e30f, 1e30f, 1e30f };
+	std::vector<ShapeChild> children;
+	compound->shape.collectChildren(&compound->shape, &compound->position, &compound->rotation, &everything, &children);
+
+	float closest = FLT_MAX;
+	for (const ShapeChild& child : children)
+	{
+		Body childBody;
+		GetCompoundChildBody(compound, child, &childBody);
+		XMFLOAT3 a, b;
+		float dist;
+		DistanceBetweenBodies(compoundA ? &childBody : bodyA, compoundA ? bodyB : &childBody, &a, &b, &dist);
+		if (dist < closest)
+		{
+			closest = dist;
+			*ptOnA = a;
+			*ptOnB = b;
+		}
+	}
+}
+
 void DistanceBetweenBodies(
 	Body* bodyA, 
 	Body* bodyB,
@@ -1073,7 +1891,14 @@ void DistanceBetweenBodies(
 	float* dist)
 {
 	XMFLOAT3 a, b;
-	GjkClosestDistance(bodyA, bodyB, &a, &b, 0);
+	if (bodyA->shape.collectChildren || bodyB->shape.collectChildren)
+	{
+		CompoundClosestDistance(bodyA, bodyB, &a, &b);
+	}
+	else
+	{
+		GjkClosestDistance(bodyA, bodyB, &a, &b, 0);
+	}
 
 	if (ptOnA)
 	{
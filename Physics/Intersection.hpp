@@ -1,5 +1,8 @@
 #pragma once
 #include "Body.hpp"
+#include "PhysicsStats.hpp"
+
+constexpr size_t CONTACT_MANIFOLD_SIZE = 4;
 
 struct Contact
 {
@@ -9,16 +12,49 @@ struct Contact
 	DirectX::XMFLOAT3 localPtOnA;
 	DirectX::XMFLOAT3 localPtOnB;
 	float timeOfImpact;
+	bool isSpeculative; // bodies don't touch yet, at every manifold point only approach faster than its w is removed
+	uint8_t manifoldPointCount; // 0 for contacts of CheckIntersection, they are resolved at ptOnA and ptOnB
+	DirectX::XMFLOAT4 manifoldPoints[CONTACT_MANIFOLD_SIZE]; // xyz on line along normal through both bodies, w speed closing gap there within the step
+	size_t islandId;
 	Body* bodyA;
 	Body* bodyB;
 };
 
+// stats are optional, counters are added to the ones already in stats; dt 0 tests current poses without CCD
 bool CheckIntersection(
 	Body* bodyA,
 	Body* bodyB,
 	Contact* contact,
-	float dt);
+	float dt,
+	IntersectionStats* stats = nullptr);
+
+/*
+	Contact without substeps: touching bodies get the contact of CheckIntersection with dt 0,
+	separated ones a speculative contact when their motion can close the gap within dt.
+	Both get manifold of facing features clipped against each other, faces get up to
+	CONTACT_MANIFOLD_SIZE points, other features the closest point only.
+	Pairs with concave or compound body fall back to CheckIntersection.
+*/
+bool CheckSpeculativeContact(
+	Body* bodyA,
+	Body* bodyB,
+	Contact* contact,
+	float dt,
+	IntersectionStats* stats = nullptr);
+
+// boolean GJK test at current poses, no contact info and no substeps
+bool CheckOverlap(
+	Body* bodyA,
+	Body* bodyB,
+	IntersectionStats* stats = nullptr);
+
+// convex child of compound body placed as standalone body, valid only for queries at current pose
+void GetCompoundChildBody(
+	const Body* compound,
+	const ShapeChild& child,
+	Body* childBody);
 
+// closest points, compounds are measured child by child
 void DistanceBetweenBodies(
 	Body* bodyA,
 	Body* bodyB,
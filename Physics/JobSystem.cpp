@@ -0,0 +1,231 @@
+#include "JobSystem.hpp"
+#include <algorithm>
+using namespace std;
+
+uint32_t TaskGraph::AddTask(
+	JobFunction job,
+	size_t itemCount,
+	size_t chunkSize)
+{
+	TaskNode node;
+	node.job = std::move(job);
+	node.itemCount = itemCount;
+	node.chunkSize = max(chunkSize, (size_t)1);
+	node.dependencyCount = 0;
+	tasks.push_back(std::move(node));
+	return (uint32_t)(tasks.size() - 1);
+}
+
+uint32_t TaskGraph::AddTask(
+	JobFunction job,
+	ItemCountQuery itemCountQuery,
+	size_t chunkSize)
+{
+	uint32_t task = AddTask(std::move(job), 0, chunkSize);
+	tasks[task].itemCountQuery = std::move(itemCountQuery);
+	return task;
+}
+
+void TaskGraph::AddDependency(
+	uint32_t task,
+	uint32_t dependsOn)
+{
+	tasks[dependsOn].successors.push_back(task);
+	tasks[task].dependencyCount++;
+}
+
+void TaskGraph::Clear()
+{
+	tasks.clear();
+}
+
+JobSystem::JobSystem(
+	size_t workerCount) :
+	taskStateCapacity(0),
+	currentGraph(nullptr),
+	remainingTasks(0),
+	queuedJobs(0),
+	stop(false)
+{
+	for (size_t i = 0; i < workerCount + 1; i++)
+	{
+		queues.push_back(make_unique<JobQueue>());
+	}
+
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		stop = true;
+	}
+	wakeCondition.notify_all();
+
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+size_t JobSystem::GetThreadCount() const
+{
+	return queues.size();
+}
+
+void JobSystem::Run(
+	const TaskGraph& graph)
+{
+	if (graph.tasks.empty())
+	{
+		return;
+	}
+
+	lock_guard<mutex> runLock(runMutex);
+	if (taskStateCapacity < graph.tasks.size())
+	{
+		taskStateCapacity = graph.tasks.size();
+		taskStates.reset(new TaskState[taskStateCapacity]);
+	}
+
+	for (size_t i = 0; i < graph.tasks.size(); i++)
+	{
+		taskStates[i].pendingDependencies = graph.tasks[i].dependencyCount;
+	}
+	currentGraph = &graph;
+	remainingTasks = graph.tasks.size();
+
+	for (uint32_t i = 0; i < graph.tasks.size(); i++)
+	{
+		if (graph.tasks[i].dependencyCount == 0)
+		{
+			ScheduleTask(0, i);
+		}
+	}
+
+	// calling thread works until the whole graph is finished
+	while (remainingTasks > 0)
+	{
+		Job job;
+		if (TryGetJob(0, &job))
+		{
+			ExecuteJob(0, job);
+		}
+		else
+		{
+			this_thread::yield();
+		}
+	}
+	currentGraph = nullptr;
+}
+
+void JobSystem::WorkerLoop(
+	size_t queueIdx)
+{
+	while (true)
+	{
+		Job job;
+		if (TryGetJob(queueIdx, &job))
+		{
+			ExecuteJob(queueIdx, job);
+			continue;
+		}
+
+		unique_lock<mutex> lock(sleepMutex);
+		wakeCondition.wait(lock, [this]() { return stop || queuedJobs > 0; });
+		if (stop)
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::TryGetJob(
+	size_t queueIdx,
+	Job* job)
+{
+	{
+		JobQueue& own = *queues[queueIdx];
+		lock_guard<mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			*job = own.jobs.back();
+			own.jobs.pop_back();
+			queuedJobs--;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		JobQueue& victim = *queues[(queueIdx + i) % queues.size()];
+		lock_guard<mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			*job = victim.jobs.front();
+			victim.jobs.pop_front();
+			queuedJobs--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::ScheduleTask(
+	size_t queueIdx,
+	uint32_t task)
+{
+	const TaskNode& node = currentGraph->tasks[task];
+	size_t itemCount = node.itemCountQuery ? node.itemCountQuery() : node.itemCount;
+	size_t chunkCount = max((itemCount + node.chunkSize - 1) / node.chunkSize, (size_t)1);
+	taskStates[task].pendingChunks = chunkCount;
+
+	{
+		JobQueue& queue = *queues[queueIdx];
+		lock_guard<mutex> lock(queue.mutex);
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			size_t begin = i * node.chunkSize;
+			queue.jobs.push_back({ task, begin, min(begin + node.chunkSize, itemCount) });
+		}
+		queuedJobs += chunkCount;
+	}
+
+	if (chunkCount > 1 || queueIdx != 0)
+	{
+		// taking sleepMutex makes sure no worker misses the wake up between its check and wait
+		{
+			lock_guard<mutex> lock(sleepMutex);
+		}
+		wakeCondition.notify_all();
+	}
+}
+
+void JobSystem::ExecuteJob(
+	size_t queueIdx,
+	const Job& job)
+{
+	const TaskNode& node = currentGraph->tasks[job.task];
+	if (job.begin < job.end)
+	{
+		node.job(job.begin, job.end);
+	}
+
+	if (--taskStates[job.task].pendingChunks > 0)
+	{
+		return;
+	}
+
+	for (uint32_t successor : node.successors)
+	{
+		if (--taskStates[successor].pendingDependencies == 0)
+		{
+			ScheduleTask(queueIdx, successor);
+		}
+	}
+	remainingTasks--;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <inttypes.h>
+
+typedef std::function<void(size_t begin, size_t end)> JobFunction;
+typedef std::function<size_t()> ItemCountQuery;
+
+/*
+	Task is parallel-for over [0, itemCount) split into chunks of chunkSize items.
+	Task starts when every task it depends on has finished.
+	When item count is known only after previous tasks finish, itemCountQuery is
+	evaluated at the moment task becomes ready.
+*/
+struct TaskNode
+{
+	JobFunction job;
+	size_t itemCount;
+	ItemCountQuery itemCountQuery;
+	size_t chunkSize;
+	uint32_t dependencyCount;
+	std::vector<uint32_t> successors;
+};
+
+struct TaskGraph
+{
+	uint32_t AddTask(
+		JobFunction job,
+		size_t itemCount = 1,
+		size_t chunkSize = 1);
+
+	uint32_t AddTask(
+		JobFunction job,
+		ItemCountQuery itemCountQuery,
+		size_t chunkSize);
+
+	void AddDependency(
+		uint32_t task,
+		uint32_t dependsOn);
+
+	void Clear();
+
+public:
+	std::vector<TaskNode> tasks;
+};
+
+/*
+	Fixed pool of worker threads, every thread owns a deque of jobs.
+	Owner takes jobs from back of its deque, idle threads steal from front of other deques.
+	Thread calling Run takes part in execution, with 0 workers graph runs on calling thread only.
+*/
+class JobSystem
+{
+public:
+	// one worker per hardware thread besides the caller is max(hardware_concurrency(), 1u) - 1
+	explicit JobSystem(
+		size_t workerCount);
+
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// blocks until every task in graph has finished
+	void Run(
+		const TaskGraph& graph);
+
+	size_t GetThreadCount() const;
+
+private:
+	struct Job
+	{
+		uint32_t task;
+		size_t begin;
+		size_t end;
+	};
+
+	struct JobQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	struct TaskState
+	{
+		std::atomic<uint32_t> pendingDependencies;
+		std::atomic<size_t> pendingChunks;
+	};
+
+	void WorkerLoop(
+		size_t queueIdx);
+
+	bool TryGetJob(
+		size_t queueIdx,
+		Job* job);
+
+	void ScheduleTask(
+		size_t queueIdx,
+		uint32_t task);
+
+	void ExecuteJob(
+		size_t queueIdx,
+		const Job& job);
+
+private:
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<JobQueue>> queues; // queue 0 belongs to thread calling Run
+	std::unique_ptr<TaskState[]> taskStates;
+	size_t taskStateCapacity;
+	const TaskGraph* currentGraph;
+	std::atomic<size_t> remainingTasks;
+	std::atomic<size_t> queuedJobs;
+	std::atomic<bool> stop;
+	std::mutex runMutex;
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+};
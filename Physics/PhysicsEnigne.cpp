@@ -1,40 +1,119 @@
 #include "PhysicsEnigne.h"
 #include "Shapes//ShapeBox.hpp"
+#include "Shapes/ShapeCapsule.hpp"
 #include <inttypes.h>
 #include "Intersection.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cstring>
 using namespace std;
 using namespace DirectX;
 
-#define GET_BODY(id) if((id & STATIC_FLAG > 0) {staticBodies[(id & ~STATIC_FLAG) - 1];}else {dynamicBodies[(id & ~STATIC_FLAG) - 1];}
-constexpr static uint64_t BODY_STATIC_FLAG = 0x01ULL << 63;
+static const XMFLOAT3 BROAD_PHASE_AXIS = { 1.0f, 1.0f, 1.0f };
+constexpr float DYNAMIC_TREE_MAX_REFIT_GROWTH = 2.0f; // refit nodes covering more area than this times built ones are rebuilt
+
 
 PhysicsEnigne::PhysicsEnigne(
 	size_t expectedDynamicBodies,
-	size_t expectedStaticBodies)
+	size_t expectedStaticBodies,
+	JobSystem* jobSystem) :
+	sensorEventCapacity(DEFAULT_SENSOR_EVENT_CAPACITY),
+	lodSettings(DEFAULT_SIMULATION_LOD),
+	lodStepCounter(0),
+	lodTiersUsed(false),
+	contactMode(ContactMode::Substeps),
+	bodyReorderInterval(0),
+	stepsSinceReorder(0),
+	staticTreeDirty(true),
+	dynamicTreeDirty(true),
+	dynamicTreeMoved(false),
+	jobSystem(jobSystem),
+	snapshotCounter(0),
+	recorder(nullptr),
+	shapeCache(nullptr),
+	stepStats{}
 {
-	// some arbitrary value, can be changed
-	contactPoints.resize(expectedDynamicBodies * expectedDynamicBodies * 2);
+	sensorEvents.reserve(sensorEventCapacity);
 	sortedBodies.resize((expectedDynamicBodies + expectedStaticBodies) * 2);
-	collisionPairs.resize((expectedDynamicBodies + expectedStaticBodies) * 2);
+	// first guess of two pairs per body, arena grows to what steps really use
+	size_t expectedPairs = (expectedDynamicBodies + expectedStaticBodies) * 2;
+	frameArena.Reserve(expectedPairs * (sizeof(CollisionPair) + 2 * sizeof(Contact) + sizeof(uint8_t) + sizeof(size_t)));
+	InitFrameArrays();
+
+	if (!this->jobSystem)
+	{
+		ownedJobSystem = make_unique<JobSystem>(max(thread::hardware_concurrency(), 1u) - 1);
+		this->jobSystem = ownedJobSystem.get();
+	}
 }
 
 int64_t PhysicsEnigne::FindIntersections(float dt)
 {
-	contactPoints.clear();
-	contactPoints.push_back({});
-	for (size_t i = 0; i < collisionPairs.size(); i++)
+	pairContacts.resize(collisionPairs.size());
+	pairHits.assign(collisionPairs.size(), 0);
+	NarrowPhase(dt, 0, collisionPairs.size());
+	CollectContacts();
+	return 0;
+}
+
+void PhysicsEnigne::NarrowPhase(
+	float dt,
+	size_t begin,
+	size_t end)
+{
+	// bodies are only read here, every pair writes its own slot
+	IntersectionStats stats = {};
+	for (size_t i = begin; i < end; i++)
 	{
 		Body* bodyA = GetBody(collisionPairs[i].idA);
 		Body* bodyB = GetBody(collisionPairs[i].idB);
+		if (!bodyA || !bodyB)
+		{
+			continue;
+		}
+
+		// far bodies get no CCD, their pairs are tested at current poses only
+		float pairDt = bodyA->lodTier == 0 && bodyB->lodTier == 0 ? dt : 0.0f;
+		bool speculative = contactMode == ContactMode::Speculative || bodyA->speculativeContacts || bodyB->speculativeContacts;
+		bool hit = speculative ?
+			CheckSpeculativeContact(bodyA, bodyB, &pairContacts[i], pairDt, &stats) :
+			CheckIntersection(bodyA, bodyB, &pairContacts[i], pairDt, &stats);
+		pairHits[i] = hit ? 1 : 0;
+	}
+
+	// one merge per chunk keeps counters cheap
+	lock_guard<mutex> lock(statsMutex);
+	stepStats.intersection.Add(stats);
+}
+
+void PhysicsEnigne::CollectContacts()
+{
+	size_t hitCount = 0;
+	for (size_t i = 0; i < pairHits.size(); i++)
+	{
+		hitCount += pairHits[i];
+	}
 
-		if (CheckIntersection(bodyA, bodyB, &contactPoints[contactPoints.size() - 1], dt))
+	contactPoints.clear();
+	contactPoints.reserve(hitCount + 1);
+	for (size_t i = 0; i < collisionPairs.size(); i++)
+	{
+		if (pairHits[i])
 		{
-			contactPoints.push_back({});
+			contactPoints.push_back(pairContacts[i]);
 		}
-	
 	}
-	return 0;
+	contactPoints.push_back({});
+}
+
+void PhysicsEnigne::InitFrameArrays()
+{
+	contactPoints.Init(&frameArena);
+	collisionPairs.Init(&frameArena);
+	pairContacts.Init(&frameArena);
+	pairHits.Init(&frameArena);
+	islandContactStarts.Init(&frameArena);
 }
 
 void PhysicsEnigne::AddForce(
@@ -42,17 +121,23 @@ void PhysicsEnigne::AddForce(
 	uint8_t	forceComponent,
 	const DirectX::XMFLOAT3& Force)
 {
-	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	if (recorder)
+	{
+		recorder->RecordAddForce(bodyId, forceComponent, Force);
+	}
+
+	size_t idx = GetDynamicBodyIndex(bodyId);
+	if (idx == SIZE_MAX)
 	{
 		return;
 	}
 
 	XMFLOAT3 force;
-	XMStoreFloat3(&force, XMLoadFloat3(&dynamicForces[bodyId - 1]) + XMLoadFloat3(&Force));
+	XMStoreFloat3(&force, XMLoadFloat3(&dynamicForces[idx]) + XMLoadFloat3(&Force));
 
-	if ((forceComponent & X_COMPONENT) > 0) { dynamicForces[bodyId - 1].x = force.x; }
-	if ((forceComponent & Y_COMPONENT) > 0) { dynamicForces[bodyId - 1].y = force.y; }
-	if ((forceComponent & Z_COMPONENT) > 0) { dynamicForces[bodyId - 1].z = force.z; }
+	if ((forceComponent & X_COMPONENT) > 0) { dynamicForces[idx].x = force.x; }
+	if ((forceComponent & Y_COMPONENT) > 0) { dynamicForces[idx].y = force.y; }
+	if ((forceComponent & Z_COMPONENT) > 0) { dynamicForces[idx].z = force.z; }
 
 	return;
 }
@@ -62,14 +147,20 @@ void PhysicsEnigne::SetLinearVelocity(
 	uint8_t	velocityComponent,
 	const DirectX::XMFLOAT3& v)
 {
-	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	if (recorder)
+	{
+		recorder->RecordSetLinearVelocity(bodyId, velocityComponent, v);
+	}
+
+	size_t idx = GetDynamicBodyIndex(bodyId);
+	if (idx == SIZE_MAX)
 	{
 		return;
 	}
 
-	if ((velocityComponent & X_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.x = v.x; }
-	if ((velocityComponent & Y_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.y = v.y; }
-	if ((velocityComponent & Z_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.z = v.z; }
+	if ((velocityComponent & X_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.x = v.x; }
+	if ((velocityComponent & Y_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.y = v.y; }
+	if ((velocityComponent & Z_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.z = v.z; }
 	return;
 }
 
@@ -77,383 +168,1989 @@ void PhysicsEnigne::GetLinearVelocity(
 	uint64_t bodyId, 
 	DirectX::XMFLOAT3* v)
 {
-	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	size_t idx = GetDynamicBodyIndex(bodyId);
+	if (idx == SIZE_MAX)
 	{
 		return;
 	}
-	*v = dynamicBodies[bodyId - 1].linVelocity;
+	*v = dynamicBodies[idx].linVelocity;
 }
 
-void PhysicsEnigne::AddLinearVelocity(
+int64_t PhysicsEnigne::SetCollisionFilter(
 	uint64_t bodyId,
-	uint8_t velocityComponent, 
-	const DirectX::XMFLOAT3& v)
+	const CollisionFilter& filter)
 {
-	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	Body* body = GetBody(bodyId);
+	if (!body)
 	{
-		return;
+		return -1;
 	}
 
-	if ((velocityComponent & X_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.x += v.x; }
-	if ((velocityComponent & Y_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.y += v.y; }
-	if ((velocityComponent & Z_COMPONENT) > 0) { dynamicBodies[bodyId - 1].linVelocity.z += v.z; }
-	return;
-}
-
-void PhysicsEnigne::GetDistanceBetweenBodies(
-	uint64_t idBodyA,
-	uint64_t idBodyB,
-	float* dist)
-{
-	DistanceBetweenBodies(GetBody(idBodyA), GetBody(idBodyB), nullptr, nullptr, dist);
+	if (recorder)
+	{
+		recorder->RecordSetCollisionFilter(bodyId, filter);
+	}
+	body->filter = filter;
+	return 0;
 }
 
-void PhysicsEnigne::GetDistanceBetweenBodies(
-	uint64_t idBodyA,
-	uint64_t idBodyB,
-	DirectX::XMFLOAT3* ptOnA,
-	DirectX::XMFLOAT3* ptOnB,
-	float* dist)
+int64_t PhysicsEnigne::GetCollisionFilter(
+	uint64_t bodyId,
+	CollisionFilter* filter)
 {
-	DistanceBetweenBodies(GetBody(idBodyA), GetBody(idBodyB), ptOnA, ptOnB, dist);
+	Body* body = GetBody(bodyId);
+	if (!body)
+	{
+		return -1;
+	}
+	*filter = body->filter;
+	return 0;
 }
 
-Body* PhysicsEnigne::GetBody(
-	uint64_t bodyId)
+int64_t PhysicsEnigne::SetSensor(
+	uint64_t bodyId,
+	bool isSensor)
 {
-	if ((bodyId & BODY_STATIC_FLAG) > 0)
-	{ 
-		return &staticBodies[(bodyId & ~BODY_STATIC_FLAG) - 1];
+	Body* body = GetBody(bodyId);
+	if (!body)
+	{
+		return -1;
 	}
-	else 
-	{ 
-		return &dynamicBodies[bodyId - 1];
+
+	if (recorder)
+	{
+		recorder->RecordSetSensor(bodyId, isSensor);
 	}
+	body->isSensor = isSensor;
+	return 0;
 }
 
-Shape PhysicsEnigne::CreateDefaultShape(
-	ShapeType type, 
-	DirectX::XMFLOAT3 scales)
+void PhysicsEnigne::SetSensorEventCapacity(
+	size_t capacity)
 {
-	switch (type)
-	{
-	case ShapeType::OrientedBox:
-		return GetDefaultBoxShape(scales);
-		break;
-	default:
-		exit(-1);
-		break;
-	};
+	sensorEventCapacity = capacity;
+	sensorEvents.reserve(capacity);
 }
 
-void PhysicsEnigne::ResolveContact(
-	Contact* contact)
+void PhysicsEnigne::GetSensorEvents(
+	const SensorEvent** events,
+	size_t* count) const
 {
-	Body* bodyA = contact->bodyA;
-	Body* bodyB= contact->bodyB;
-	XMVECTOR v_normal = XMLoadFloat3(&contact->normal);
-	float elastictyFactor =  bodyA->elasticity * bodyB->elasticity;
+	*events = sensorEvents.data();
+	*count = sensorEvents.size();
+}
 
-	XMFLOAT3 angularImpulseA;
-	XMFLOAT3 angularImpulseB;
-	float angularFactor;
-	GetAngularImpulse(bodyA, &contact->ptOnA, &contact->normal, &angularImpulseA);
-	GetAngularImpulse(bodyB, &contact->ptOnB, &contact->normal, &angularImpulseB);
-	XMVECTOR totalAngularImpulse = XMLoadFloat3(&angularImpulseA) + XMLoadFloat3(&angularImpulseB);
-	XMStoreFloat(&angularFactor, XMVector3Dot(totalAngularImpulse, v_normal));
-	float denominator = 1.0f / (bodyA->massInv + bodyB->massInv + angularFactor);
+static bool PairLess(
+	const CollisionPair& l,
+	const CollisionPair& r)
+{
+	return l.idA != r.idA ? l.idA < r.idA : l.idB < r.idB;
+}
 
-	XMFLOAT3 CoM;
-	bodyA->GetCenterOfMassWorldSpace(&CoM);
-	XMVECTOR v_velA = XMLoadFloat3(&bodyA->linVelocity) + XMVector3Cross(XMLoadFloat3(&contact->ptOnA) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyA->angVelocity));
-	bodyB->GetCenterOfMassWorldSpace(&CoM);
-	XMVECTOR v_velB = XMLoadFloat3(&bodyB->linVelocity) + XMVector3Cross(XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyB->angVelocity));
-	XMVECTOR closingSpeed = denominator * (1 + elastictyFactor) * XMVector3Dot(v_velA - v_velB, v_normal);
-	XMVECTOR reboundImpulse = v_normal * closingSpeed;
+void PhysicsEnigne::UpdateSensors()
+{
+	IntersectionStats stats = {};
+	currentOverlaps.clear();
+	for (const CollisionPair& pair : sensorPairs)
+	{
+		Body* sensor = GetBody(pair.idA);
+		Body* other = GetBody(pair.idB);
+		if (sensor && other && CheckOverlap(sensor, other, &stats))
+		{
+			currentOverlaps.push_back(pair);
+		}
+	}
+	stepStats.intersection.Add(stats);
+	sort(currentOverlaps.begin(), currentOverlaps.end(), PairLess);
 
-	//XMVECTOR I_A = denominator * (XMLoadFloat3(&bodyB->linVelocity) - XMLoadFloat3(&bodyA->linVelocity));
-	//XMVECTOR I_B = -I_A;
-	//XMVECTOR totalImpulse = elastictyFactor * (I_A - I_B);
-	//XMVECTOR closingSpeed = XMVector3Dot(totalImpulse, XMLoadFloat3(&contact->normal));
-	//XMVECTOR reboundImpulse = XMLoadFloat3(&contact->normal) * closingSpeed;
+	// both lists are sorted, pairs only in previous step exit, pairs only in current one enter
+	sensorEvents.clear();
+	stepStats.droppedSensorEvents = 0;
+	auto emit = [this](const CollisionPair& pair, SensorEventType type)
+	{
+		if (sensorEvents.size() < sensorEventCapacity)
+		{
+			sensorEvents.push_back({ pair.idA, pair.idB, type });
+		}
+		else
+		{
+			stepStats.droppedSensorEvents++;
+		}
+	};
 
-	XMFLOAT3 ImpulseStorage;
-	XMStoreFloat3(&ImpulseStorage, -1.0f * reboundImpulse);
-	bodyA->ApplyImpulse(&contact->ptOnA, &ImpulseStorage);
+	size_t prev = 0;
+	size_t cur = 0;
+	while (prev < sensorOverlaps.size() || cur < currentOverlaps.size())
+	{
+		if (cur == currentOverlaps.size() ||
+			(prev < sensorOverlaps.size() && PairLess(sensorOverlaps[prev], currentOverlaps[cur])))
+		{
+			emit(sensorOverlaps[prev++], SensorEventType::Exit);
+		}
+		else if (prev == sensorOverlaps.size() || PairLess(currentOverlaps[cur], sensorOverlaps[prev]))
+		{
+			emit(currentOverlaps[cur++], SensorEventType::Enter);
+		}
+		else
+		{
+			prev++;
+			cur++;
+		}
+	}
+	sensorOverlaps.swap(currentOverlaps);
+}
 
-	XMStoreFloat3(&ImpulseStorage, reboundImpulse);
-	bodyB->ApplyImpulse(&contact->ptOnB, &ImpulseStorage);
+int64_t PhysicsEnigne::SetKinematic(
+	uint64_t bodyId,
+	bool isKinematic)
+{
+	Body* body = GetBody(bodyId);
+	if (!body || (bodyId & BODY_STATIC_FLAG) == 0)
+	{
+		return -1;
+	}
 
+	if (recorder)
+	{
+		recorder->RecordSetKinematic(bodyId, isKinematic);
+	}
+	body->isKinematic = isKinematic;
+	staticTreeDirty = true;
+	body->linVelocity = { 0, 0, 0 };
+	body->angVelocity = { 0, 0, 0 };
+	return 0;
+}
 
-	float frictionCoeff = bodyA->friction * bodyB->friction;
-	XMVECTOR v_velProjection = v_normal * XMVector3Dot(v_velA - v_velB, v_normal);
-	XMVECTOR v_velTang = v_velA - v_velB - v_velProjection;
+int64_t PhysicsEnigne::SetKinematicTarget(
+	uint64_t bodyId,
+	const DirectX::XMFLOAT3& position,
+	const DirectX::XMFLOAT4& rotation)
+{
+	Body* body = GetBody(bodyId);
+	if (!body || !body->isKinematic)
+	{
+		return -1;
+	}
 
-	XMFLOAT3 angularImpulseFrictionA;
-	XMFLOAT3 angularImpulseFrictionB;
-	XMFLOAT3 v_velTangNorm;
-	XMStoreFloat3(&v_velTangNorm, XMVector3Normalize(v_velTang));
+	if (recorder)
+	{
+		recorder->RecordSetKinematicTarget(bodyId, position, rotation);
+	}
+	kinematicTargets.push_back({ bodyId, position, rotation });
+	return 0;
+}
 
-	GetAngularImpulse(bodyA, &contact->ptOnA, &v_velTangNorm, &angularImpulseFrictionA);
-	GetAngularImpulse(bodyB, &contact->ptOnB, &v_velTangNorm, &angularImpulseFrictionB);
-	float angularFrictionFactor;
-	XMStoreFloat(&angularFrictionFactor,
-		XMVector3Dot(XMLoadFloat3(&angularImpulseFrictionA) + XMLoadFloat3(&angularImpulseFrictionB), XMLoadFloat3(&v_velTangNorm)));
-	float denominatorFriction = 1.0f / (bodyA->massInv + bodyB->massInv + angularFrictionFactor);
+void PhysicsEnigne::SetLodObservers(
+	const DirectX::XMFLOAT3* positions,
+	size_t count)
+{
+	if (recorder)
+	{
+		recorder->RecordSetLodObservers(positions, count);
+	}
+	lodObservers.assign(positions, positions + count);
+}
 
-	XMVECTOR ImpulseFriction = denominatorFriction * frictionCoeff * v_velTang;
-	XMStoreFloat3(&ImpulseStorage, -1.0f * ImpulseFriction);
-	//bodyA->ApplyImpulse(&contact->ptOnA, &ImpulseStorage);
+void PhysicsEnigne::SetContactMode(
+	ContactMode mode)
+{
+	if (recorder)
+	{
+		recorder->RecordSetContactMode(mode);
+	}
+	contactMode = mode;
+}
 
-	XMStoreFloat3(&ImpulseStorage, ImpulseFriction);
-	//bodyB->ApplyImpulse(&contact->ptOnB, &ImpulseStorage);
+int64_t PhysicsEnigne::SetSpeculativeContacts(
+	uint64_t bodyId,
+	bool enabled)
+{
+	Body* body = GetBody(bodyId);
+	if (!body)
+	{
+		return -1;
+	}
 
-	// projecting bodies outside of eachother
-	if (contact->timeOfImpact == 0.0f)
+	if (recorder)
 	{
-		XMVECTOR dist = XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&contact->ptOnA);
+		recorder->RecordSetSpeculativeContacts(bodyId, enabled);
+	}
+	body->speculativeContacts = enabled;
+	return 0;
+}
 
-		float totalMassInv = bodyA->massInv + bodyB->massInv;
-		XMStoreFloat3(&bodyA->position, XMLoadFloat3(&bodyA->position) + dist * bodyA->massInv / totalMassInv);
-		XMStoreFloat3(&bodyB->position, XMLoadFloat3(&bodyB->position) - dist * bodyB->massInv / totalMassInv);
+void PhysicsEnigne::SetSimulationLod(
+	const SimulationLodSettings& settings)
+{
+	if (recorder)
+	{
+		recorder->RecordSetSimulationLod(settings);
 	}
-	
+	lodSettings = settings;
 }
 
-void PhysicsEnigne::SortBodiesByDistanceToPlane(
-	const DirectX::XMFLOAT3* normal,
+void PhysicsEnigne::UpdateSimulationLod(
 	float dt)
 {
-	XMVECTOR n = XMLoadFloat3(normal);
-	size_t i;
-	for (i = 0; i < dynamicBodies.size() * 2; i+=2)
+	if (lodObservers.empty() && !lodTiersUsed)
 	{
-		constexpr float eps = 0.01f;
-		size_t bodyId = i / 2;
-		Body* body = &dynamicBodies[bodyId];
-		AddBodyToSortedDistanceList(body, normal, dt, i, bodyId + 1);
+		return;
 	}
 
-	for (size_t j = 0; j < staticBodies.size() * 2; j += 2)
+	lodStepCounter++;
+	lodTiersUsed = false;
+	for (size_t i = 0; i < dynamicBodies.size(); i++)
 	{
-		constexpr float eps = 0.01f;
-		size_t bodyIdx = i + j;
-		size_t bodyId = (j / 2) | BODY_STATIC_FLAG;
-		Body* body = &staticBodies[j/2];
-		AddBodyToSortedDistanceList(body, normal, dt, bodyIdx, bodyId + 1);
-	}
+		Body* body = &dynamicBodies[i];
+		float distSq = FLT_MAX;
+		for (const XMFLOAT3& observer : lodObservers)
+		{
+			float d;
+			XMStoreFloat(&d, XMVector3LengthSq(XMLoadFloat3(&body->position) - XMLoadFloat3(&observer)));
+			distSq = min(distSq, d);
+		}
 
-	size_t bodyCount = (dynamicBodies.size() + staticBodies.size());
-	std::sort(sortedBodies.begin(), sortedBodies.begin() + bodyCount * 2,
-		[](const BodyPlaneDistance& l, const BodyPlaneDistance& r) { return l.distance < r.distance; });
+		// border a body is already past moves towards the observer, so it isn't crossed back right away
+		uint8_t tier = 0;
+		for (uint8_t t = 0; t < SIMULATION_LOD_TIERS - 1 && !lodObservers.empty(); t++)
+		{
+			float border = lodSettings.tierDistances[t] + (body->lodTier > t ? -lodSettings.hysteresis : lodSettings.hysteresis);
+			if (distSq > border * border)
+			{
+				tier = t + 1;
+			}
+		}
+		body->lodTier = tier;
+
+		// handle slot spreads bodies of one tier over the steps of its period
+		uint64_t period = 1ULL << tier;
+		uint64_t slot = dynamicHandles.GetHandle(i) & 0xFFFFFFFFULL;
+		body->lodSkipped = ((lodStepCounter + slot) & (period - 1)) != 0;
+		if (body->lodSkipped)
+		{
+			// already "integrated" for this step, so narrow phase and integration leave it in place
+			body->lodPendingTime += dt;
+			bodyLocalTimes[i] = dt;
+			stepStats.lodSkippedBodies++;
+		}
+		else
+		{
+			// skipped time is integrated together with this step, after contacts are resolved
+			bodyLocalTimes[i] = -body->lodPendingTime;
+		}
+		lodTiersUsed = lodTiersUsed || tier > 0 || body->lodSkipped;
+	}
 }
 
-void PhysicsEnigne::BroadPhase(float dt)
+void PhysicsEnigne::SetBodyReorderInterval(
+	uint32_t steps)
 {
-	XMFLOAT3 normal = { 1.0f, 1.0f, 1.0f };
-	SortBodiesByDistanceToPlane(&normal, dt);
-	BuildCollisionPairs();
+	if (recorder)
+	{
+		recorder->RecordSetBodyReorderInterval(steps);
+	}
+	bodyReorderInterval = steps;
+	stepsSinceReorder = 0;
 }
 
-void PhysicsEnigne::GetAngularImpulse(
-	const Body* body, 
-	const DirectX::XMFLOAT3* point,
-	const DirectX::XMFLOAT3* normal, 
-	DirectX::XMFLOAT3* Impulse)
+size_t PhysicsEnigne::ReorderBodies()
 {
-	XMFLOAT4X4 inertiaTensor;
-	body->GetInverseInertiaTensorWorldSpace(&inertiaTensor);
-
-	XMFLOAT3 CoM;
-	body->GetCenterOfMassWorldSpace(&CoM);
+	if (recorder)
+	{
+		recorder->RecordReorderBodies();
+	}
+	return SortBodiesByMortonCode();
+}
 
-	XMVECTOR r = XMLoadFloat3(point) - XMLoadFloat3(&CoM);
-	XMVECTOR n = XMLoadFloat3(normal);
-	XMVECTOR prod =  XMVector3Transform(XMVector3Cross(n, r), XMLoadFloat4x4(&inertiaTensor));
-	XMStoreFloat3(Impulse, XMVector3Cross(r, prod));
+// spreads lower 10 bits of v so two zero bits follow every one of them
+static uint32_t SpreadMortonBits(
+	uint32_t v)
+{
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
 }
 
-void PhysicsEnigne::AddBodyToSortedDistanceList(
-	const Body* body,
-	const DirectX::XMFLOAT3* normal,
-	float dt,
-	size_t bodyIdx,
-	size_t bodyId)
+size_t PhysicsEnigne::SortBodiesByMortonCode()
 {
-	constexpr float eps = 0.01f;
-	BoundingBox bBox = body->getBoundingBox();
-	XMFLOAT3 expansion;
-	XMVECTOR n = XMLoadFloat3(normal);
+	constexpr float MORTON_CELLS = 1023.0f; // 10 bits per axis
+	stepsSinceReorder = 0;
+	size_t count = dynamicBodies.size();
+	if (count < 2)
+	{
+		return 0;
+	}
 
-	XMStoreFloat3(&expansion,
+	FrameArenaScope scope(&frameArena);
+	XMFLOAT3* centers = frameArena.Allocate<XMFLOAT3>(count);
+	XMVECTOR minCenter = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maxCenter = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		BoundingBox box = dynamicBodies[i].getBoundingBox();
+		XMVECTOR center = (XMLoadFloat3(&box.minC) + XMLoadFloat3(&box.maxC)) * 0.5f;
+		XMStoreFloat3(&centers[i], center);
+		minCenter = XMVectorMin(minCenter, center);
+		maxCenter = XMVectorMax(maxCenter, center);
+	}
+
+	// low half of key is the old index, so equal codes keep their order and key tells where body comes from
+	uint64_t* keys = frameArena.Allocate<uint64_t>(count);
+	XMVECTOR scale = XMVectorReplicate(MORTON_CELLS) / XMVectorMax(maxCenter - minCenter, XMVectorReplicate(FLT_EPSILON));
+	for (size_t i = 0; i < count; i++)
+	{
+		XMFLOAT3 cell;
+		XMStoreFloat3(&cell, XMVectorClamp((XMLoadFloat3(&centers[i]) - minCenter) * scale,
+			XMVectorZero(), XMVectorReplicate(MORTON_CELLS)));
+		uint64_t code = SpreadMortonBits((uint32_t)cell.x) | (SpreadMortonBits((uint32_t)cell.y) << 1) |
+			(SpreadMortonBits((uint32_t)cell.z) << 2);
+		keys[i] = (code << 32) | i;
+	}
+	sort(keys, keys + count);
+
+	size_t movedCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		movedCount += (uint32_t)keys[i] != i;
+	}
+	if (movedCount == 0)
+	{
+		return 0;
+	}
+
+	// body at i comes from index in keys[i], cycles of the permutation are walked in place
+	vector<uint32_t>& denseToSlot = dynamicHandles.denseToSlot;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t src = (uint32_t)keys[i];
+		if (src == i)
+		{
+			continue;
+		}
+
+		Body body = dynamicBodies[i];
+		XMFLOAT3 constForce = constForces[i];
+		XMFLOAT3 dynamicForce = dynamicForces[i];
+		uint32_t slot = denseToSlot[i];
+		size_t dst = i;
+		while (src != i)
+		{
+			dynamicBodies[dst] = dynamicBodies[src];
+			constForces[dst] = constForces[src];
+			dynamicForces[dst] = dynamicForces[src];
+			denseToSlot[dst] = denseToSlot[src];
+			keys[dst] = dst;
+			dst = src;
+			src = (uint32_t)keys[src];
+		}
+		dynamicBodies[dst] = body;
+		constForces[dst] = constForce;
+		dynamicForces[dst] = dynamicForce;
+		denseToSlot[dst] = slot;
+		keys[dst] = dst;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		dynamicHandles.slots[denseToSlot[i]].denseIdx = (uint32_t)i;
+	}
+	dynamicTreeDirty = true;
+	return movedCount;
+}
+
+void PhysicsEnigne::ApplyKinematicTargets(
+	float dt)
+{
+	if (dt <= 0.0f)
+	{
+		return;
+	}
+
+	for (const KinematicTarget& target : kinematicTargets)
+	{
+		Body* body = GetBody(target.bodyId);
+		if (!body || !body->isKinematic)
+		{
+			continue;
+		}
+
+		XMStoreFloat3(&body->linVelocity, (XMLoadFloat3(&target.position) - XMLoadFloat3(&body->position)) / dt);
+
+		// UpdateBody composes rotation as XMQuaternionMultiply(dRotation, rotation)
+		XMVECTOR v_dRotation = XMQuaternionMultiply(XMQuaternionNormalize(XMLoadFloat4(&target.rotation)),
+			XMQuaternionConjugate(XMLoadFloat4(&body->rotation)));
+		XMFLOAT4 dRotation;
+		XMStoreFloat4(&dRotation, v_dRotation);
+		if (dRotation.w < 0.0f)
+		{
+			v_dRotation = -v_dRotation;
+			XMStoreFloat4(&dRotation, v_dRotation);
+		}
+
+		float sinHalf;
+		XMStoreFloat(&sinHalf, XMVector3Length(v_dRotation));
+		if (sinHalf < 1e-6f)
+		{
+			body->angVelocity = { 0, 0, 0 };
+			continue;
+		}
+		float angle = 2.0f * atan2f(sinHalf, dRotation.w);
+		XMStoreFloat3(&body->angVelocity, XMVector3Normalize(XMVectorSetW(v_dRotation, 0.0f)) * (angle / dt));
+	}
+}
+
+void PhysicsEnigne::FinishKinematicTargets()
+{
+	for (const KinematicTarget& target : kinematicTargets)
+	{
+		Body* body = GetBody(target.bodyId);
+		if (!body || !body->isKinematic)
+		{
+			continue;
+		}
+
+		body->position = target.position;
+		XMStoreFloat4(&body->rotation, XMQuaternionNormalize(XMLoadFloat4(&target.rotation)));
+		body->linVelocity = { 0, 0, 0 };
+		body->angVelocity = { 0, 0, 0 };
+		body->UpdateCachedTransforms();
+	}
+	kinematicTargets.clear();
+}
+
+void PhysicsEnigne::AddLinearVelocity(
+	uint64_t bodyId,
+	uint8_t velocityComponent, 
+	const DirectX::XMFLOAT3& v)
+{
+	if (recorder)
+	{
+		recorder->RecordAddLinearVelocity(bodyId, velocityComponent, v);
+	}
+
+	size_t idx = GetDynamicBodyIndex(bodyId);
+	if (idx == SIZE_MAX)
+	{
+		return;
+	}
+
+	if ((velocityComponent & X_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.x += v.x; }
+	if ((velocityComponent & Y_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.y += v.y; }
+	if ((velocityComponent & Z_COMPONENT) > 0) { dynamicBodies[idx].linVelocity.z += v.z; }
+	return;
+}
+
+void PhysicsEnigne::GetDistanceBetweenBodies(
+	uint64_t idBodyA,
+	uint64_t idBodyB,
+	float* dist)
+{
+	GetDistanceBetweenBodies(idBodyA, idBodyB, nullptr, nullptr, dist);
+}
+
+void PhysicsEnigne::GetDistanceBetweenBodies(
+	uint64_t idBodyA,
+	uint64_t idBodyB,
+	DirectX::XMFLOAT3* ptOnA,
+	DirectX::XMFLOAT3* ptOnB,
+	float* dist)
+{
+	Body* bodyA = GetBody(idBodyA);
+	Body* bodyB = GetBody(idBodyB);
+	if (!bodyA || !bodyB)
+	{
+		if (dist)
+		{
+			*dist = -1.0f;
+		}
+		return;
+	}
+	DistanceBetweenBodies(bodyA, bodyB, ptOnA, ptOnB, dist);
+}
+
+void PhysicsEnigne::QueryStaticBodies(
+	const BoundingBox& box,
+	std::vector<uint64_t>* bodyIds)
+{
+	if (staticTreeDirty)
+	{
+		RebuildStaticTree();
+	}
+
+	staticQueryItems.clear();
+	staticTree.Query(box, &staticQueryItems);
+	for (uint32_t item : staticQueryItems)
+	{
+		bodyIds->push_back(staticHandles.GetHandle(staticTreeBodies[item]) | BODY_STATIC_FLAG);
+	}
+
+	for (uint32_t staticIdx : kinematicBodyIndices)
+	{
+		if (Overlaps(staticBodies[staticIdx].getBoundingBox(), box))
+		{
+			bodyIds->push_back(staticHandles.GetHandle(staticIdx) | BODY_STATIC_FLAG);
+		}
+	}
+}
+
+void PhysicsEnigne::RebuildStaticTree()
+{
+	vector<BoundingBox> boxes;
+	boxes.reserve(staticBodies.size());
+	staticTreeBodies.clear();
+	kinematicBodyIndices.clear();
+	for (size_t i = 0; i < staticBodies.size(); i++)
+	{
+		if (staticBodies[i].isKinematic)
+		{
+			kinematicBodyIndices.push_back((uint32_t)i);
+			continue;
+		}
+		boxes.push_back(staticBodies[i].getBoundingBox());
+		staticTreeBodies.push_back((uint32_t)i);
+	}
+
+	staticTree.Build(boxes.data(), boxes.size());
+	staticTreeDirty = false;
+}
+
+void PhysicsEnigne::RebuildDynamicTree()
+{
+	vector<BoundingBox> boxes(dynamicBodies.size());
+	for (size_t i = 0; i < dynamicBodies.size(); i++)
+	{
+		boxes[i] = dynamicBodies[i].getBoundingBox();
+	}
+	dynamicTree.Build(boxes.data(), boxes.size());
+	dynamicTreeDirty = false;
+	dynamicTreeMoved = false;
+}
+
+void PhysicsEnigne::RefitDynamicTree()
+{
+	for (size_t i = 0; i < dynamicTree.items.size(); i++)
+	{
+		dynamicTree.itemBoxes[i] = dynamicBodies[dynamicTree.items[i]].getBoundingBox();
+	}
+	dynamicTreeMoved = false;
+	if (dynamicTree.Refit() > DYNAMIC_TREE_MAX_REFIT_GROWTH)
+	{
+		RebuildDynamicTree();
+	}
+}
+
+struct RayCastContext
+{
+	PhysicsEnigne* engine;
+	const RayQuery* rays; // of current packet
+	RayHit* hits;
+	const CollisionFilter* filter;
+	bool anyHit;
+};
+
+// tests lanes against one body, hits lower maxDistance of their lane
+static void CastRayPacketAgainstBody(
+	const RayCastContext& context,
+	const Body& body,
+	uint64_t bodyId,
+	uint32_t lanes,
+	RayPacket* packet)
+{
+	if (!body.shape.raycast || body.isSensor || (context.filter && !ShouldCollide(*context.filter, body.filter)))
+	{
+		return;
+	}
+
+	for (uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+	{
+		if ((lanes & (1u << lane)) == 0)
+		{
+			continue;
+		}
+
+		const RayQuery& ray = context.rays[lane];
+		float distance;
+		XMFLOAT3 normal;
+		if (!body.shape.raycast(&body.shape, &body.position, &body.rotation, &ray.origin, &ray.direction,
+			packet->maxDistance[lane], &distance, &normal))
+		{
+			continue;
+		}
+
+		RayHit& hit = context.hits[lane];
+		hit.hit = true;
+		hit.bodyId = bodyId;
+		hit.distance = distance;
+		hit.normal = normal;
+		packet->maxDistance[lane] = distance;
+		if (context.anyHit)
+		{
+			packet->activeMask &= ~(1u << lane);
+		}
+	}
+}
+
+static void VisitDynamicBody(
+	void* context,
+	uint32_t item,
+	uint32_t lanes,
+	RayPacket* packet)
+{
+	const RayCastContext& rayContext = *(const RayCastContext*)context;
+	PhysicsEnigne* engine = rayContext.engine;
+	CastRayPacketAgainstBody(rayContext, engine->dynamicBodies[item], engine->dynamicHandles.GetHandle(item), lanes, packet);
+}
+
+static void VisitStaticBody(
+	void* context,
+	uint32_t item,
+	uint32_t lanes,
+	RayPacket* packet)
+{
+	const RayCastContext& rayContext = *(const RayCastContext*)context;
+	PhysicsEnigne* engine = rayContext.engine;
+	uint32_t staticIdx = engine->staticTreeBodies[item];
+	CastRayPacketAgainstBody(rayContext, engine->staticBodies[staticIdx],
+		engine->staticHandles.GetHandle(staticIdx) | BODY_STATIC_FLAG, lanes, packet);
+}
+
+size_t PhysicsEnigne::CastRays(
+	const RayQuery* rays,
+	size_t count,
+	RayQueryMode mode,
+	RayHit* hits,
+	const CollisionFilter* filter)
+{
+	if (staticTreeDirty)
+	{
+		RebuildStaticTree();
+	}
+	if (dynamicTreeDirty)
+	{
+		RebuildDynamicTree();
+	}
+	else if (dynamicTreeMoved)
+	{
+		RefitDynamicTree();
+	}
+
+	RayCastContext context = { this, nullptr, nullptr, filter, mode == RayQueryMode::AnyHit };
+	size_t hitCount = 0;
+	for (size_t first = 0; first < count; first += RAY_PACKET_SIZE)
+	{
+		size_t packetCount = min(RAY_PACKET_SIZE, count - first);
+		for (size_t i = first; i < first + packetCount; i++)
+		{
+			hits[i] = {};
+		}
+
+		RayPacket packet;
+		InitRayPacket(&packet, rays + first, packetCount);
+		context.rays = rays + first;
+		context.hits = hits + first;
+		TraverseRayPacket(staticTree, &packet, VisitStaticBody, &context);
+		TraverseRayPacket(dynamicTree, &packet, VisitDynamicBody, &context);
+		for (uint32_t staticIdx : kinematicBodyIndices)
+		{
+			const Body& body = staticBodies[staticIdx];
+			uint32_t lanes = RayPacketHitsBox(packet, body.getBoundingBox());
+			if (lanes != 0)
+			{
+				CastRayPacketAgainstBody(context, body, staticHandles.GetHandle(staticIdx) | BODY_STATIC_FLAG, lanes, &packet);
+			}
+		}
+
+		for (size_t i = first; i < first + packetCount; i++)
+		{
+			if (hits[i].hit)
+			{
+				XMStoreFloat3(&hits[i].point, XMLoadFloat3(&rays[i].origin) + XMLoadFloat3(&rays[i].direction) * hits[i].distance);
+				hitCount++;
+			}
+		}
+	}
+	return hitCount;
+}
+
+Body* PhysicsEnigne::GetBody(
+	uint64_t bodyId)
+{
+	size_t idx;
+	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	{ 
+		idx = staticHandles.GetDenseIndex(bodyId & ~BODY_STATIC_FLAG);
+		return idx == SIZE_MAX ? nullptr : &staticBodies[idx];
+	}
+	else 
+	{ 
+		idx = dynamicHandles.GetDenseIndex(bodyId);
+		return idx == SIZE_MAX ? nullptr : &dynamicBodies[idx];
+	}
+}
+
+size_t PhysicsEnigne::GetDynamicBodyIndex(
+	uint64_t bodyId) const
+{
+	if ((bodyId & BODY_STATIC_FLAG) > 0)
+	{
+		return SIZE_MAX;
+	}
+	return dynamicHandles.GetDenseIndex(bodyId);
+}
+
+int64_t PhysicsEnigne::RemoveBody(
+	uint64_t bodyId)
+{
+	bool isStatic = (bodyId & BODY_STATIC_FLAG) > 0;
+	BodyHandleTable* handles = isStatic ? &staticHandles : &dynamicHandles;
+	vector<Body>* bodies = isStatic ? &staticBodies : &dynamicBodies;
+	size_t idx = handles->GetDenseIndex(bodyId & ~BODY_STATIC_FLAG);
+	if (idx == SIZE_MAX)
+	{
+		return -1;
+	}
+
+	if (recorder)
+	{
+		recorder->RecordRemoveBody(bodyId);
+	}
+
+	Body* body = &(*bodies)[idx];
+	body->shape.freeShapeData(&body->shape);
+
+	size_t lastIdx = bodies->size() - 1;
+	(*bodies)[idx] = (*bodies)[lastIdx];
+	bodies->pop_back();
+	if (!isStatic)
+	{
+		constForces[idx] = constForces[lastIdx];
+		constForces.pop_back();
+		dynamicForces[idx] = dynamicForces[lastIdx];
+		dynamicForces.pop_back();
+	}
+
+	handles->DestroyHandle(bodyId & ~BODY_STATIC_FLAG);
+	staticTreeDirty = staticTreeDirty || isStatic;
+	dynamicTreeDirty = dynamicTreeDirty || !isStatic;
+	return 0;
+}
+
+Shape PhysicsEnigne::CreateDefaultShape(
+	ShapeType type, 
+	DirectX::XMFLOAT3 scales)
+{
+	if (shapeCache)
+	{
+		return shapeCache->Acquire(type, scales);
+	}
+
+	switch (type)
+	{
+	case ShapeType::OrientedBox:
+		return GetDefaultBoxShape(scales);
+		break;
+	case ShapeType::Capsule:
+		return GetDefaultCapsuleShape(scales);
+		break;
+	default:
+		exit(-1);
+		break;
+	};
+}
+
+// relative speed of bodies at point along normal
+static float GetNormalSpeed(
+	const Body* bodyA,
+	const Body* bodyB,
+	const XMFLOAT3* point,
+	XMVECTOR normal)
+{
+	XMFLOAT3 CoM;
+	bodyA->GetCenterOfMassWorldSpace(&CoM);
+	XMVECTOR v_velA = XMLoadFloat3(&bodyA->linVelocity) + XMVector3Cross(XMLoadFloat3(point) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyA->angVelocity));
+	bodyB->GetCenterOfMassWorldSpace(&CoM);
+	XMVECTOR v_velB = XMLoadFloat3(&bodyB->linVelocity) + XMVector3Cross(XMLoadFloat3(point) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyB->angVelocity));
+	float normalSpeed;
+	XMStoreFloat(&normalSpeed, XMVector3Dot(v_velA - v_velB, normal));
+	return normalSpeed;
+}
+
+static void SeparateBodies(
+	const Contact* contact)
+{
+	Body* bodyA = contact->bodyA;
+	Body* bodyB = contact->bodyB;
+	XMVECTOR dist = XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&contact->ptOnA);
+
+	// static bodies are shared between islands resolved in parallel, they must not be written
+	float totalMassInv = bodyA->massInv + bodyB->massInv;
+	if (bodyA->massInv > 0.0f)
+	{
+		XMStoreFloat3(&bodyA->position, XMLoadFloat3(&bodyA->position) + dist * bodyA->massInv / totalMassInv);
+	}
+	if (bodyB->massInv > 0.0f)
+	{
+		XMStoreFloat3(&bodyB->position, XMLoadFloat3(&bodyB->position) - dist * bodyB->massInv / totalMassInv);
+	}
+}
+
+void PhysicsEnigne::ResolveContact(
+	Contact* contact)
+{
+	if (contact->manifoldPointCount > 0)
+	{
+		ResolveManifoldContact(contact);
+		return;
+	}
+
+	Body* bodyA = contact->bodyA;
+	Body* bodyB= contact->bodyB;
+	XMVECTOR v_normal = XMLoadFloat3(&contact->normal);
+	float elastictyFactor =  bodyA->elasticity * bodyB->elasticity;
+
+	XMFLOAT3 angularImpulseA;
+	XMFLOAT3 angularImpulseB;
+	float angularFactor;
+	GetAngularImpulse(bodyA, &contact->ptOnA, &contact->normal, &angularImpulseA);
+	GetAngularImpulse(bodyB, &contact->ptOnB, &contact->normal, &angularImpulseB);
+	XMVECTOR totalAngularImpulse = XMLoadFloat3(&angularImpulseA) + XMLoadFloat3(&angularImpulseB);
+	XMStoreFloat(&angularFactor, XMVector3Dot(totalAngularImpulse, v_normal));
+	float denominator = 1.0f / (bodyA->massInv + bodyB->massInv + angularFactor);
+
+	XMFLOAT3 CoM;
+	bodyA->GetCenterOfMassWorldSpace(&CoM);
+	XMVECTOR v_velA = XMLoadFloat3(&bodyA->linVelocity) + XMVector3Cross(XMLoadFloat3(&contact->ptOnA) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyA->angVelocity));
+	bodyB->GetCenterOfMassWorldSpace(&CoM);
+	XMVECTOR v_velB = XMLoadFloat3(&bodyB->linVelocity) + XMVector3Cross(XMLoadFloat3(&contact->ptOnB) - XMLoadFloat3(&CoM), XMLoadFloat3(&bodyB->angVelocity));
+	XMVECTOR closingSpeed = denominator * (1 + elastictyFactor) * XMVector3Dot(v_velA - v_velB, v_normal);
+	XMVECTOR reboundImpulse = v_normal * closingSpeed;
+
+	//XMVECTOR I_A = denominator * (XMLoadFloat3(&bodyB->linVelocity) - XMLoadFloat3(&bodyA->linVelocity));
+	//XMVECTOR I_B = -I_A;
+	//XMVECTOR totalImpulse = elastictyFactor * (I_A - I_B);
+	//XMVECTOR closingSpeed = XMVector3Dot(totalImpulse, XMLoadFloat3(&contact->normal));
+	//XMVECTOR reboundImpulse = XMLoadFloat3(&contact->normal) * closingSpeed;
+
+	XMFLOAT3 ImpulseStorage;
+	XMStoreFloat3(&ImpulseStorage, -1.0f * reboundImpulse);
+	bodyA->ApplyImpulse(&contact->ptOnA, &ImpulseStorage);
+
+	XMStoreFloat3(&ImpulseStorage, reboundImpulse);
+	bodyB->ApplyImpulse(&contact->ptOnB, &ImpulseStorage);
+
+
+	float frictionCoeff = bodyA->friction * bodyB->friction;
+	XMVECTOR v_velProjection = v_normal * XMVector3Dot(v_velA - v_velB, v_normal);
+	XMVECTOR v_velTang = v_velA - v_velB - v_velProjection;
+
+	XMFLOAT3 angularImpulseFrictionA;
+	XMFLOAT3 angularImpulseFrictionB;
+	XMFLOAT3 v_velTangNorm;
+	XMStoreFloat3(&v_velTangNorm, XMVector3Normalize(v_velTang));
+
+	GetAngularImpulse(bodyA, &contact->ptOnA, &v_velTangNorm, &angularImpulseFrictionA);
+	GetAngularImpulse(bodyB, &contact->ptOnB, &v_velTangNorm, &angularImpulseFrictionB);
+	float angularFrictionFactor;
+	XMStoreFloat(&angularFrictionFactor,
+		XMVector3Dot(XMLoadFloat3(&angularImpulseFrictionA) + XMLoadFloat3(&angularImpulseFrictionB), XMLoadFloat3(&v_velTangNorm)));
+	float denominatorFriction = 1.0f / (bodyA->massInv + bodyB->massInv + angularFrictionFactor);
+
+	XMVECTOR ImpulseFriction = denominatorFriction * frictionCoeff * v_velTang;
+	XMStoreFloat3(&ImpulseStorage, -1.0f * ImpulseFriction);
+	//bodyA->ApplyImpulse(&contact->ptOnA, &ImpulseStorage);
+
+	XMStoreFloat3(&ImpulseStorage, ImpulseFriction);
+	//bodyB->ApplyImpulse(&contact->ptOnB, &ImpulseStorage);
+
+	// projecting bodies outside of eachother
+	if (contact->timeOfImpact == 0.0f)
+	{
+		SeparateBodies(contact);
+	}
+	
+}
+
+void PhysicsEnigne::ResolveManifoldContact(
+	Contact* contact)
+{
+	// points share bodies, few passes with accumulated impulses spread the impulse between them
+	constexpr size_t ITERATIONS = 4;
+	Body* bodyA = contact->bodyA;
+	Body* bodyB = contact->bodyB;
+	XMVECTOR v_normal = XMLoadFloat3(&contact->normal);
+	float elastictyFactor = bodyA->elasticity * bodyB->elasticity;
+
+	// point is on line along normal through both bodies, same lever arm works for A and B
+	XMFLOAT3 points[CONTACT_MANIFOLD_SIZE];
+	float denominators[CONTACT_MANIFOLD_SIZE];
+	float targetSpeeds[CONTACT_MANIFOLD_SIZE];
+	for (size_t i = 0; i < contact->manifoldPointCount; i++)
+	{
+		points[i] = { contact->manifoldPoints[i].x, contact->manifoldPoints[i].y, contact->manifoldPoints[i].z };
+		XMFLOAT3 angularImpulseA;
+		XMFLOAT3 angularImpulseB;
+		float angularFactor;
+		GetAngularImpulse(bodyA, &points[i], &contact->normal, &angularImpulseA);
+		GetAngularImpulse(bodyB, &points[i], &contact->normal, &angularImpulseB);
+		XMStoreFloat(&angularFactor, XMVector3Dot(XMLoadFloat3(&angularImpulseA) + XMLoadFloat3(&angularImpulseB), v_normal));
+		denominators[i] = 1.0f / (bodyA->massInv + bodyB->massInv + angularFactor);
+
+		// normal points to A, bodies approach while normal speed is negative; speculative points
+		// may approach by their gap without rebound, touching ones rebound by elasticity
+		targetSpeeds[i] = -contact->manifoldPoints[i].w;
+		if (!contact->isSpeculative)
+		{
+			targetSpeeds[i] = max(-elastictyFactor * GetNormalSpeed(bodyA, bodyB, &points[i], v_normal), 0.0f);
+		}
+	}
+
+	float impulses[CONTACT_MANIFOLD_SIZE] = {};
+	for (size_t iteration = 0; iteration < ITERATIONS; iteration++)
+	{
+		for (size_t i = 0; i < contact->manifoldPointCount; i++)
+		{
+			// accumulated impulse never pulls bodies together
+			float excessSpeed = targetSpeeds[i] - GetNormalSpeed(bodyA, bodyB, &points[i], v_normal);
+			float impulse = max(impulses[i] + excessSpeed * denominators[i], 0.0f);
+			float delta = impulse - impulses[i];
+			impulses[i] = impulse;
+			if (delta == 0.0f)
+			{
+				continue;
+			}
+
+			XMFLOAT3 ImpulseStorage;
+			XMStoreFloat3(&ImpulseStorage, v_normal * delta);
+			bodyA->ApplyImpulse(&points[i], &ImpulseStorage);
+
+			XMStoreFloat3(&ImpulseStorage, v_normal * -delta);
+			bodyB->ApplyImpulse(&points[i], &ImpulseStorage);
+		}
+	}
+
+	if (!contact->isSpeculative)
+	{
+		SeparateBodies(contact);
+	}
+}
+
+void PhysicsEnigne::SortBodiesByDistanceToPlane(
+	const DirectX::XMFLOAT3* normal,
+	float dt)
+{
+	ComputeSortedDistances(normal, dt, 0, dynamicBodies.size() + staticBodies.size());
+	SortDistanceList();
+}
+
+void PhysicsEnigne::ComputeSortedDistances(
+	const DirectX::XMFLOAT3* normal,
+	float dt,
+	size_t begin,
+	size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		if (i < dynamicBodies.size())
+		{
+			AddBodyToSortedDistanceList(&dynamicBodies[i], normal, dt, i * 2, dynamicHandles.GetHandle(i));
+			continue;
+		}
+
+		size_t staticIdx = i - dynamicBodies.size();
+		uint64_t bodyId = staticHandles.GetHandle(staticIdx) | BODY_STATIC_FLAG;
+		AddBodyToSortedDistanceList(&staticBodies[staticIdx], normal, dt, i * 2, bodyId);
+	}
+}
+
+void PhysicsEnigne::SortDistanceList()
+{
+	size_t bodyCount = (dynamicBodies.size() + staticBodies.size());
+	std::sort(sortedBodies.begin(), sortedBodies.begin() + bodyCount * 2,
+		[](const BodyPlaneDistance& l, const BodyPlaneDistance& r) { return l.distance < r.distance; });
+}
+
+void PhysicsEnigne::PartitionBodiesByPairs()
+{
+	bodyInPair.assign(dynamicBodies.size(), 0);
+	for (const CollisionPair& pair : collisionPairs)
+	{
+		size_t idxA = GetDynamicBodyIndex(pair.idA);
+		size_t idxB = GetDynamicBodyIndex(pair.idB);
+		if (idxA != SIZE_MAX) { bodyInPair[idxA] = 1; }
+		if (idxB != SIZE_MAX) { bodyInPair[idxB] = 1; }
+	}
+
+	freeBodyIndices.clear();
+	pairedBodyIndices.clear();
+	for (uint32_t i = 0; i < dynamicBodies.size(); i++)
+	{
+		if (bodyInPair[i])
+		{
+			pairedBodyIndices.push_back(i);
+		}
+		else
+		{
+			freeBodyIndices.push_back(i);
+		}
+	}
+}
+
+void PhysicsEnigne::BroadPhase(float dt)
+{
+	XMFLOAT3 normal = { 1.0f, 1.0f, 1.0f };
+	SortBodiesByDistanceToPlane(&normal, dt);
+	BuildCollisionPairs();
+}
+
+void PhysicsEnigne::GetAngularImpulse(
+	const Body* body, 
+	const DirectX::XMFLOAT3* point,
+	const DirectX::XMFLOAT3* normal, 
+	DirectX::XMFLOAT3* Impulse)
+{
+	XMFLOAT3 CoM;
+	body->GetCenterOfMassWorldSpace(&CoM);
+
+	XMVECTOR r = XMLoadFloat3(point) - XMLoadFloat3(&CoM);
+	XMVECTOR n = XMLoadFloat3(normal);
+	XMVECTOR prod =  XMVector3Transform(XMVector3Cross(n, r), XMLoadFloat4x4(&body->invInertiaTensorWorld));
+	XMStoreFloat3(Impulse, XMVector3Cross(r, prod));
+}
+
+void PhysicsEnigne::AddBodyToSortedDistanceList(
+	const Body* body,
+	const DirectX::XMFLOAT3* normal,
+	float dt,
+	size_t bodyIdx,
+	uint64_t bodyId)
+{
+	constexpr float eps = 0.01f;
+	BoundingBox bBox = body->getBoundingBox();
+	XMFLOAT3 expansion;
+	XMVECTOR n = XMLoadFloat3(normal);
+
+	XMStoreFloat3(&expansion,
 		XMLoadFloat3(&bBox.maxC) + XMLoadFloat3(&body->linVelocity) * dt);
 	bBox.Expand(expansion);
 	XMStoreFloat3(&expansion,
 		XMLoadFloat3(&bBox.maxC) + 1.0f * XMVectorSet(eps, eps, eps, 0));
 	bBox.Expand(expansion);
 
-	XMStoreFloat3(&expansion,
-		XMLoadFloat3(&bBox.minC) + XMLoadFloat3(&body->linVelocity) * dt);
-	bBox.Expand(expansion);
-	XMStoreFloat3(&expansion,
-		XMLoadFloat3(&bBox.minC) - 1.0f * XMVectorSet(eps, eps, eps, 0));
-	bBox.Expand(expansion);
+	XMStoreFloat3(&expansion,
+		XMLoadFloat3(&bBox.minC) + XMLoadFloat3(&body->linVelocity) * dt);
+	bBox.Expand(expansion);
+	XMStoreFloat3(&expansion,
+		XMLoadFloat3(&bBox.minC) - 1.0f * XMVectorSet(eps, eps, eps, 0));
+	bBox.Expand(expansion);
+
+	sortedBodies[bodyIdx].bodyId = bodyId;
+	sortedBodies[bodyIdx].filter = body->filter;
+	sortedBodies[bodyIdx].isSensor = body->isSensor;
+	sortedBodies[bodyIdx].isPassive = (bodyId & BODY_STATIC_FLAG) || body->lodSkipped;
+	sortedBodies[bodyIdx].isMin = true;
+	XMStoreFloat(&sortedBodies[bodyIdx].distance, XMVector3Dot(n, XMLoadFloat3(&bBox.minC)));
+
+	sortedBodies[bodyIdx + 1].bodyId = bodyId;
+	sortedBodies[bodyIdx + 1].filter = body->filter;
+	sortedBodies[bodyIdx + 1].isSensor = body->isSensor;
+	sortedBodies[bodyIdx + 1].isPassive = sortedBodies[bodyIdx].isPassive;
+	sortedBodies[bodyIdx + 1].isMin = false;
+	XMStoreFloat(&sortedBodies[bodyIdx + 1].distance, XMVector3Dot(n, XMLoadFloat3(&bBox.maxC)));
+
+}
+
+void PhysicsEnigne::BuildCollisionPairs()
+{
+	collisionPairs.clear();
+	sensorPairs.clear();
+	size_t bodyCount = (dynamicBodies.size() + staticBodies.size());
+	// Now that the bodies are sorted, build the collision pairs
+	for (int i = 0; i < bodyCount * 2; i++) 
+	{
+		const BodyPlaneDistance& a = sortedBodies[i];
+		if (!a.isMin) 
+		{
+			continue;
+		}
+
+		CollisionPair pair;
+		pair.idA = a.bodyId;
+
+		for (int j = i + 1; j < bodyCount * 2; j++)
+		{
+			const BodyPlaneDistance& b = sortedBodies[j];
+			// if we've hit the end of the a element, then we're done creating pairs with a
+			if (b.bodyId == a.bodyId )
+			{
+				break;
+			}
+
+			// static pairs never collide, dynamic vs static is kept in whichever order they come
+			if (!b.isMin || (a.isPassive && b.isPassive) || !ShouldCollide(a.filter, b.filter))
+			{
+				continue;
+			}
+
+			if (a.isSensor || b.isSensor)
+			{
+				if (!a.isSensor || !b.isSensor)
+				{
+					sensorPairs.push_back(a.isSensor ? CollisionPair{ a.bodyId, b.bodyId } : CollisionPair{ b.bodyId, a.bodyId });
+				}
+				continue;
+			}
+
+			pair.idB = b.bodyId;
+			collisionPairs.push_back(pair);
+		}
+	}
+
+}
+
+
+
+int64_t PhysicsEnigne::AddBody(
+	const BodyProperties& props,
+	ShapeType shapeType,
+	const DirectX::XMFLOAT3& scales,
+	bool isDynamic,
+	uint64_t* bodyId,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	return AddBodies(&props, 1, shapeType, scales, isDynamic, bodyId, allowAngularImpulse, vBounds, constForce);
+}
+
+int64_t PhysicsEnigne::AddBodies(
+	const BodyProperties* props,
+	size_t count,
+	ShapeType shapeType,
+	const DirectX::XMFLOAT3& scales,
+	bool isDynamic,
+	uint64_t* bodyIds,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// shape data is immutable, whole batch references the same instance
+	Shape shape = CreateDefaultShape(shapeType, scales);
+	PushBodies(props, count, shape, isDynamic, bodyIds, allowAngularImpulse, vBounds, constForce);
+
+	if (recorder)
+	{
+		recorder->RecordAddBodies(props, count, shapeType, scales, isDynamic, bodyIds, allowAngularImpulse, vBounds, constForce);
+	}
+	return 0;
+}
+
+int64_t PhysicsEnigne::AddCompoundBodies(
+	const CompoundChildDesc* children,
+	size_t childCount,
+	const BodyProperties* props,
+	size_t count,
+	bool isDynamic,
+	uint64_t* bodyIds,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	if (childCount == 0 || childCount > UINT32_MAX)
+	{
+		return -1;
+	}
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	vector<Shape> shapes(childCount);
+	vector<ShapeChild> placed(childCount);
+	vector<float> masses(childCount);
+	for (size_t i = 0; i < childCount; i++)
+	{
+		shapes[i] = CreateDefaultShape(children[i].type, children[i].scales);
+		placed[i] = { &shapes[i], children[i].position, children[i].rotation };
+		masses[i] = children[i].mass;
+	}
+	Shape shape = GetCompoundShape(placed.data(), masses.data(), (uint32_t)childCount);
+	if (shape.shapeData == nullptr)
+	{
+		return -1;
+	}
+	PushBodies(props, count, shape, isDynamic, bodyIds, allowAngularImpulse, vBounds, constForce);
+
+	if (recorder)
+	{
+		recorder->RecordAddCompoundBodies(children, childCount, props, count, isDynamic, bodyIds, allowAngularImpulse, vBounds, constForce);
+	}
+	return 0;
+}
+
+void PhysicsEnigne::PushBodies(
+	const BodyProperties* props,
+	size_t count,
+	Shape shape,
+	bool isDynamic,
+	uint64_t* bodyIds,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	vector<Body>* bodies = isDynamic ? &dynamicBodies : &staticBodies;
+	BodyHandleTable* handles = isDynamic ? &dynamicHandles : &staticHandles;
+	bodies->reserve(bodies->size() + count);
+	handles->Reserve(bodies->size() + count);
+	if (isDynamic)
+	{
+		constForces.resize(constForces.size() + count, constForce);
+		dynamicForces.resize(dynamicForces.size() + count, { 0, 0, 0 });
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i > 0)
+		{
+			shape.addShapeReference(&shape);
+		}
+
+		Body body;
+		body.angVelocity = props[i].angVelocity;
+		body.linVelocity = props[i].linVelocity;
+		body.massInv = isDynamic ? props[i].massInv : 0.0f;
+		body.position = props[i].position;
+		body.rotation = props[i].rotation;
+		body.elasticity = props[i].elasticity;
+		body.allowAngularImpulse = allowAngularImpulse;
+		body.vBounds = vBounds;
+		body.friction = props[i].friction;
+		body.filter = { COLLISION_LAYER_DEFAULT, COLLISION_MASK_ALL, COLLISION_GROUP_NONE };
+		body.isSensor = false;
+		body.isKinematic = false;
+		body.speculativeContacts = false;
+		body.lodTier = 0;
+		body.lodSkipped = false;
+		body.lodPendingTime = 0.0f;
+		body.shape = shape;
+		body.InitCachedProperties();
+
+		bodies->push_back(body);
+		bodyIds[i] = handles->CreateHandle();
+		if (!isDynamic)
+		{
+			bodyIds[i] |= BODY_STATIC_FLAG;
+		}
+	}
+	staticTreeDirty = staticTreeDirty || !isDynamic;
+	dynamicTreeDirty = dynamicTreeDirty || isDynamic;
+
+	// every body has min and max entry in broad phase list
+	size_t bodyCount = dynamicBodies.size() + staticBodies.size();
+	if (sortedBodies.size() < bodyCount * 2)
+	{
+		sortedBodies.resize(bodyCount * 2);
+	}
+}
+
+int64_t PhysicsEnigne::AddHeightfield(
+	const HeightfieldDesc& desc,
+	const BodyProperties& props,
+	uint64_t* bodyId)
+{
+	Shape shape = GetHeightfieldShape(desc);
+	if (shape.shapeData == nullptr)
+	{
+		return -1;
+	}
+
+	BodyProperties terrainProps = props;
+	terrainProps.rotation = { 0, 0, 0, 1 };
+	terrainProps.linVelocity = { 0, 0, 0 };
+	terrainProps.angVelocity = { 0, 0, 0 };
+	PushBodies(&terrainProps, 1, shape, false, bodyId, false, { -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX }, { 0, 0, 0 });
+
+	if (recorder)
+	{
+		recorder->RecordAddHeightfield(desc, terrainProps, *bodyId);
+	}
+	return 0;
+}
+
+int64_t PhysicsEnigne::AddMesh(
+	const MeshDesc& desc,
+	const BodyProperties& props,
+	uint64_t* bodyId)
+{
+	return PushMesh(GetMeshShape(desc), props, bodyId);
+}
+
+int64_t PhysicsEnigne::AddMeshFromBlob(
+	const uint8_t* blob,
+	size_t size,
+	const BodyProperties& props,
+	uint64_t* bodyId)
+{
+	return PushMesh(GetMeshShapeFromBlob(blob, size), props, bodyId);
+}
+
+int64_t PhysicsEnigne::PushMesh(
+	Shape shape,
+	const BodyProperties& props,
+	uint64_t* bodyId)
+{
+	if (shape.shapeData == nullptr)
+	{
+		return -1;
+	}
+
+	BodyProperties meshProps = props;
+	meshProps.linVelocity = { 0, 0, 0 };
+	meshProps.angVelocity = { 0, 0, 0 };
+	PushBodies(&meshProps, 1, shape, false, bodyId, false, { -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX }, { 0, 0, 0 });
+
+	if (recorder)
+	{
+		recorder->RecordAddMesh(&shape, meshProps, *bodyId);
+	}
+	return 0;
+}
+
+bool PhysicsEnigne::RaycastMesh(
+	uint64_t bodyId,
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& direction,
+	float maxDistance,
+	MeshRayHit* hit)
+{
+	const Body* body = GetBody(bodyId);
+	if (!body)
+	{
+		return false;
+	}
+	return ::RaycastMesh(&body->shape, body->position, body->rotation, origin, direction, maxDistance, hit);
+}
+
+int64_t PhysicsEnigne::StartRecording(
+	PhysicsRecorder* recorder)
+{
+	if (!dynamicBodies.empty() || !staticBodies.empty())
+	{
+		return -1;
+	}
+	this->recorder = recorder;
+	return 0;
+}
+
+void PhysicsEnigne::StopRecording()
+{
+	recorder = nullptr;
+}
 
-	sortedBodies[bodyIdx].bodyId = bodyId;
-	sortedBodies[bodyIdx].isMin = true;
-	XMStoreFloat(&sortedBodies[bodyIdx].distance, XMVector3Dot(n, XMLoadFloat3(&bBox.minC)));
+uint64_t PhysicsEnigne::GetStateChecksum() const
+{
+	// FNV-1a over bit patterns, any difference in simulation shows up
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto hashBytes = [&hash](const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+		}
+	};
 
-	sortedBodies[bodyIdx + 1].bodyId = bodyId;
-	sortedBodies[bodyIdx + 1].isMin = false;
-	XMStoreFloat(&sortedBodies[bodyIdx + 1].distance, XMVector3Dot(n, XMLoadFloat3(&bBox.maxC)));
+	for (const vector<Body>* bodies : { &dynamicBodies, &staticBodies })
+	{
+		for (const Body& body : *bodies)
+		{
+			hashBytes(&body.position, sizeof(XMFLOAT3));
+			hashBytes(&body.rotation, sizeof(XMFLOAT4));
+			hashBytes(&body.linVelocity, sizeof(XMFLOAT3));
+			hashBytes(&body.angVelocity, sizeof(XMFLOAT3));
+		}
+	}
+	return hash;
+}
 
+int64_t PhysicsEnigne::RemoveBodies(
+	const uint64_t* bodyIds,
+	size_t count)
+{
+	int64_t result = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (RemoveBody(bodyIds[i]) != 0)
+		{
+			result = -1;
+		}
+	}
+	return result;
 }
 
-void PhysicsEnigne::BuildCollisionPairs()
+int64_t PhysicsEnigne::GetTransformMatrixForBody(
+	uint64_t bodyId, 
+	DirectX::XMFLOAT4X4* mat,
+	uint32_t child)
 {
-	collisionPairs.clear();
-	size_t bodyCount = (dynamicBodies.size() + staticBodies.size());
-	// Now that the bodies are sorted, build the collision pairs
-	for (int i = 0; i < bodyCount * 2; i++) 
+	const Body* body = GetBody(bodyId);
+	if (!body)
 	{
-		const BodyPlaneDistance& a = sortedBodies[i];
-		if (!a.isMin) 
+		return -1;
+	}
+	if (body->shape.collectChildren)
+	{
+		if (GetCompoundChildTransform(&body->shape, child, mat) != 0)
 		{
-			continue;
+			return -1;
+		}
+	}
+	else
+	{
+		if (child != 0)
+		{
+			return -1;
 		}
+		body->shape.getTrasformationMatrix(body->shape.shapeData, mat);
+	}
 
-		CollisionPair pair;
-		pair.idA = a.bodyId;
+	XMMATRIX translation = XMMatrixTranslation(body->position.x, body->position.y, body->position.z);
+	XMMATRIX rotation = XMLoadFloat4x4(&body->rotationMatrix);
+	XMMATRIX transform = XMLoadFloat4x4(mat) *
+						 rotation *
+						 translation;
+						
 
-		for (int j = i + 1; j < bodyCount * 2; j++)
+	XMStoreFloat4x4(mat, transform);
+	return 0;
+}
+
+static bool IsScaleMatrix(
+	const XMFLOAT4X4& mat)
+{
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
 		{
-			const BodyPlaneDistance& b = sortedBodies[j];
-			// if we've hit the end of the a element, then we're done creating pairs with a
-			if (b.bodyId == a.bodyId )
+			if (r != c && mat.m[r][c] != 0.0f)
 			{
-				break;
+				return false;
 			}
+		}
+	}
+	return mat._44 == 1.0f;
+}
 
-			if (!b.isMin || (b.bodyId & BODY_STATIC_FLAG) > 0)
-			{
-				continue;
-			}
+int64_t PhysicsEnigne::ExportTransforms(
+	uint64_t bufferId,
+	void* dst,
+	size_t stride,
+	const uint64_t* ids,
+	size_t count,
+	uint32_t* changed,
+	size_t* changedCount)
+{
+	if (!dst || stride < sizeof(XMFLOAT4X4) || (count > 0 && !ids))
+	{
+		return -1;
+	}
 
-			pair.idB = b.bodyId;
-			collisionPairs.push_back(pair);
+	// nothing is known about a new buffer or a different stride, every slot is written
+	TransformExportBuffer& buffer = exportBuffers[bufferId];
+	if (buffer.stride != stride)
+	{
+		buffer.stride = stride;
+		buffer.slots.clear();
+	}
+	if (buffer.slots.size() < count)
+	{
+		// handle 0 is never valid, new slots are always written
+		buffer.slots.resize(count, TransformExportSlot{});
+	}
+
+	size_t written = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const Body* body = GetBody(ids[i]);
+		if (!body)
+		{
+			continue;
+		}
+
+		TransformExportSlot& slot = buffer.slots[i];
+		if (slot.bodyId == ids[i] &&
+			memcmp(&slot.position, &body->position, sizeof(XMFLOAT3)) == 0 &&
+			memcmp(&slot.rotation, &body->rotation, sizeof(XMFLOAT4)) == 0)
+		{
+			continue;
+		}
+
+		if (slot.bodyId != ids[i])
+		{
+			// shape of body never changes, its matrix is read once per slot
+			XMFLOAT4X4 shapeMat;
+			body->shape.getTrasformationMatrix(body->shape.shapeData, &shapeMat);
+			slot.bodyId = ids[i];
+			slot.scale = { shapeMat._11, shapeMat._22, shapeMat._33 };
+			slot.useShapeMatrix = body->shape.collectChildren || !IsScaleMatrix(shapeMat);
+		}
+		slot.position = body->position;
+		slot.rotation = body->rotation;
+
+		XMFLOAT4X4* mat = (XMFLOAT4X4*)((uint8_t*)dst + i * stride);
+		if (slot.useShapeMatrix)
+		{
+			GetTransformMatrixForBody(ids[i], mat);
+		}
+		else
+		{
+			// scale * rotation * translation: rotation rows are scaled, translation is the last row
+			const XMFLOAT4X4& rot = body->rotationMatrix;
+			XMStoreFloat4((XMFLOAT4*)mat->m[0], XMLoadFloat4((const XMFLOAT4*)rot.m[0]) * slot.scale.x);
+			XMStoreFloat4((XMFLOAT4*)mat->m[1], XMLoadFloat4((const XMFLOAT4*)rot.m[1]) * slot.scale.y);
+			XMStoreFloat4((XMFLOAT4*)mat->m[2], XMLoadFloat4((const XMFLOAT4*)rot.m[2]) * slot.scale.z);
+			XMStoreFloat4((XMFLOAT4*)mat->m[3], XMVectorSetW(XMLoadFloat3(&body->position), 1.0f));
 		}
+
+		if (changed)
+		{
+			changed[written] = (uint32_t)i;
+		}
+		written++;
 	}
 
+	if (changedCount)
+	{
+		*changedCount = written;
+	}
+	return 0;
 }
 
+void PhysicsEnigne::ReleaseExportBuffer(
+	uint64_t bufferId)
+{
+	exportBuffers.erase(bufferId);
+}
 
+uint32_t PhysicsEnigne::GetBodyChildCount(
+	uint64_t bodyId)
+{
+	const Body* body = GetBody(bodyId);
+	if (!body)
+	{
+		return 0;
+	}
+	return body->shape.collectChildren ? GetCompoundChildCount(&body->shape) : 1;
+}
 
-int64_t PhysicsEnigne::AddBody(
-	const BodyProperties& props,
-	ShapeType shapeType,
-	const DirectX::XMFLOAT3& scales,
-	bool isDynamic,
-	uint64_t* bodyId,
-	bool allowAngularImpulse,
-	const LinearVelocityBounds& vBounds,
-	const DirectX::XMFLOAT3& constForce)
+int64_t PhysicsEnigne::UpdateBodies(float dt)
+{
+	constexpr size_t BODY_CHUNK = 256;
+	constexpr size_t ENTRY_CHUNK = 128;
+	constexpr size_t PAIR_CHUNK = 8;
+	const XMFLOAT3 normal = BROAD_PHASE_AXIS;
+	BeginStep();
+	ApplyKinematicTargets(dt);
+	UpdateSimulationLod(dt);
+
+	/*
+		forces -> distances -> pairs -> narrow phase -> islands -> resolve -> integrate paired
+		                               \-> integrate free
+		Bodies without collision pair can't get contact, so they are integrated
+		while narrow phase and resolution run on the rest.
+	*/
+	stepGraph.Clear();
+	uint32_t forces = stepGraph.AddTask(TimedJob(PhysicsPhase::Integrate,
+		[this, dt](size_t begin, size_t end) { ApplyForces(dt, begin, end); }),
+		dynamicBodies.size(), BODY_CHUNK);
+
+	uint32_t distances = stepGraph.AddTask(TimedJob(PhysicsPhase::BroadPhase,
+		[this, dt, normal](size_t begin, size_t end) { ComputeSortedDistances(&normal, dt, begin, end); }),
+		dynamicBodies.size() + staticBodies.size(), ENTRY_CHUNK);
+	stepGraph.AddDependency(distances, forces);
+
+	uint32_t sortDistances = stepGraph.AddTask(TimedJob(PhysicsPhase::Sort,
+		[this](size_t, size_t) { SortDistanceList(); }));
+	stepGraph.AddDependency(sortDistances, distances);
+
+	uint32_t pairs = stepGraph.AddTask(TimedJob(PhysicsPhase::BroadPhase,
+		[this](size_t, size_t)
+		{
+			BuildCollisionPairs();
+			PartitionBodiesByPairs();
+			pairContacts.resize(collisionPairs.size());
+			pairHits.assign(collisionPairs.size(), 0);
+		}));
+	stepGraph.AddDependency(pairs, sortDistances);
+
+	uint32_t narrowPhase = stepGraph.AddTask(TimedJob(PhysicsPhase::NarrowPhase,
+		[this, dt](size_t begin, size_t end) { NarrowPhase(dt, begin, end); }),
+		[this]() { return collisionPairs.size(); }, PAIR_CHUNK);
+	stepGraph.AddDependency(narrowPhase, pairs);
+
+	uint32_t integrateFree = stepGraph.AddTask(TimedJob(PhysicsPhase::Integrate,
+		[this, dt](size_t begin, size_t end) { IntegrateBodies(freeBodyIndices, dt, begin, end); }),
+		[this]() { return freeBodyIndices.size(); }, BODY_CHUNK);
+	stepGraph.AddDependency(integrateFree, pairs);
+
+	uint32_t islands = stepGraph.AddTask(TimedJob(PhysicsPhase::Sort,
+		[this](size_t, size_t)
+		{
+			CollectContacts();
+			BuildIslands();
+			SortContactsByIsland();
+		}));
+	stepGraph.AddDependency(islands, narrowPhase);
+
+	uint32_t resolve = stepGraph.AddTask(TimedJob(PhysicsPhase::Resolve,
+		[this](size_t begin, size_t end) { ResolveIslands(begin, end); }),
+		[this]() { return islandContactStarts.size() - 1; }, 1);
+	stepGraph.AddDependency(resolve, islands);
+
+	uint32_t integratePaired = stepGraph.AddTask(TimedJob(PhysicsPhase::Integrate,
+		[this, dt](size_t begin, size_t end) { IntegrateBodies(pairedBodyIndices, dt, begin, end); }),
+		[this]() { return pairedBodyIndices.size(); }, BODY_CHUNK);
+	stepGraph.AddDependency(integratePaired, resolve);
+
+	jobSystem->Run(stepGraph);
+	FinishStep(dt);
+	return 0;
+}
+
+void PhysicsEnigne::BeginStep()
 {
-	Body body;
-	body.angVelocity = props.angVelocity;
-	body.linVelocity = props.linVelocity;
-	body.massInv = props.massInv;
-	body.position = props.position;
-	body.rotation = props.rotation;
-	body.elasticity = props.elasticity;
-	body.allowAngularImpulse = allowAngularImpulse;
-	body.vBounds = vBounds;
-	body.friction = props.friction;
-	body.shape = CreateDefaultShape(shapeType, scales);
+	// only bodies taking part in contact are moved to the time of impact,
+	// every other body is integrated once over the whole step
+	bodyLocalTimes.assign(dynamicBodies.size(), 0.0f);
+	dynamicTreeMoved = true;
+	frameArena.Reset();
+	InitFrameArrays();
+
+	stepStart = chrono::steady_clock::now();
+	stepStats = {};
+	for (atomic<uint64_t>& nanoseconds : phaseNanoseconds)
+	{
+		nanoseconds = 0;
+	}
 
-	if (isDynamic)
+	if (bodyReorderInterval > 0 && ++stepsSinceReorder >= bodyReorderInterval)
 	{
-		constForces.push_back(constForce);
-		dynamicForces.push_back({ 0, 0, 0 });
-		dynamicBodies.push_back(body);
-		*bodyId = dynamicBodies.size();
-		return 0;
+		auto reorderStart = chrono::steady_clock::now();
+		stepStats.reorderedBodies = SortBodiesByMortonCode();
+		phaseNanoseconds[(size_t)PhysicsPhase::Sort] +=
+			chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - reorderStart).count();
 	}
-	else
+}
+
+void PhysicsEnigne::StepSerial(
+	float dt)
+{
+	auto timed = [this](PhysicsPhase phase, auto&& job)
 	{
-		body.massInv = 0.0f;
-		staticBodies.push_back(body);
-		*bodyId = staticBodies.size();
-		*bodyId |= BODY_STATIC_FLAG;
-		return 0;
+		auto start = chrono::steady_clock::now();
+		job();
+		auto duration = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+		phaseNanoseconds[(size_t)phase].fetch_add(duration.count(), memory_order_relaxed);
+	};
+
+	BeginStep();
+	ApplyKinematicTargets(dt);
+	UpdateSimulationLod(dt);
+	timed(PhysicsPhase::Integrate, [&]() { ApplyForces(dt, 0, dynamicBodies.size()); });
+	timed(PhysicsPhase::BroadPhase, [&]()
+		{
+			ComputeSortedDistances(&BROAD_PHASE_AXIS, dt, 0, dynamicBodies.size() + staticBodies.size());
+		});
+	timed(PhysicsPhase::Sort, [&]() { SortDistanceList(); });
+	timed(PhysicsPhase::BroadPhase, [&]()
+		{
+			BuildCollisionPairs();
+			pairContacts.resize(collisionPairs.size());
+			pairHits.assign(collisionPairs.size(), 0);
+		});
+	timed(PhysicsPhase::NarrowPhase, [&]() { NarrowPhase(dt, 0, collisionPairs.size()); });
+	timed(PhysicsPhase::Sort, [&]()
+		{
+			CollectContacts();
+			BuildIslands();
+			SortContactsByIsland();
+		});
+	timed(PhysicsPhase::Resolve, [&]() { ResolveIslands(0, islandContactStarts.size() - 1); });
+	timed(PhysicsPhase::Integrate, [&]()
+		{
+			for (size_t i = 0; i < dynamicBodies.size(); i++)
+			{
+				IntegrateBody(i, dt);
+			}
+		});
+	FinishStep(dt);
+}
+
+void PhysicsEnigne::FinishStep(
+	float dt)
+{
+	FinishKinematicTargets();
+
+	auto sensorsStart = chrono::steady_clock::now();
+	UpdateSensors();
+	phaseNanoseconds[(size_t)PhysicsPhase::NarrowPhase] +=
+		chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sensorsStart).count();
+
+	for (size_t i = 0; i < (size_t)PhysicsPhase::Count; i++)
+	{
+		stepStats.phaseMs[i] = phaseNanoseconds[i] / 1e6;
+	}
+	stepStats.stepMs = chrono::duration<double, milli>(chrono::steady_clock::now() - stepStart).count();
+	stepStats.candidatePairs = collisionPairs.size();
+	stepStats.contacts = contactPoints.size() - 1;
+	stepStats.islands = islandContactStarts.size() - 1;
+	stepStats.awakeBodies = dynamicBodies.size();
+	stepStats.sensorPairs = sensorPairs.size();
+	stepStats.sensorEvents = sensorEvents.size();
+
+	if (recorder)
+	{
+		recorder->RecordUpdateBodies(dt, GetStateChecksum());
 	}
-	return 1;
 }
 
-int64_t PhysicsEnigne::GetTransformMatrixForBody(
-	uint64_t bodyId, 
-	DirectX::XMFLOAT4X4* mat)
+JobFunction PhysicsEnigne::TimedJob(
+	PhysicsPhase phase,
+	JobFunction job)
 {
-	const Body* body = GetBody(bodyId);
-	body->shape.getTrasformationMatrix(body->shape.shapeData, mat);
+	return [this, phase, job](size_t begin, size_t end)
+	{
+		auto start = chrono::steady_clock::now();
+		job(begin, end);
+		auto duration = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+		phaseNanoseconds[(size_t)phase].fetch_add(duration.count(), memory_order_relaxed);
+	};
+}
 
-	XMMATRIX translation = XMMatrixTranslation(body->position.x, body->position.y, body->position.z);
-	XMMATRIX rotation = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&body->rotation)));
-	XMMATRIX transform = XMLoadFloat4x4(mat) *
-						 rotation *
-						 translation;
-						
+void PhysicsEnigne::GetStats(
+	PhysicsStats* stats) const
+{
+	*stats = stepStats;
+}
 
-	XMStoreFloat4x4(mat, transform);
-	return 0;
+template<typename T>
+static size_t GetCapacityBytes(
+	const vector<T>& v)
+{
+	return v.capacity() * sizeof(T);
 }
 
-int64_t PhysicsEnigne::UpdateBodies(float dt)
+size_t PhysicsEnigne::GetMemoryUsage() const
 {
+	size_t bytes = GetCapacityBytes(staticBodies) + GetCapacityBytes(dynamicBodies) +
+		GetCapacityBytes(constForces) + GetCapacityBytes(dynamicForces) +
+		frameArena.GetCapacity() + GetCapacityBytes(sortedBodies) +
+		GetCapacityBytes(sensorPairs) + GetCapacityBytes(sensorOverlaps) + GetCapacityBytes(currentOverlaps) +
+		GetCapacityBytes(sensorEvents) + GetCapacityBytes(kinematicTargets) +
+		GetCapacityBytes(islandParents) + GetCapacityBytes(bodyLocalTimes) +
+		GetCapacityBytes(bodyInPair) +
+		GetCapacityBytes(freeBodyIndices) + GetCapacityBytes(pairedBodyIndices) +
+		GetCapacityBytes(staticTree.nodes) + GetCapacityBytes(staticTree.items) + GetCapacityBytes(staticTree.itemBoxes) +
+		GetCapacityBytes(staticTreeBodies) + GetCapacityBytes(kinematicBodyIndices) + GetCapacityBytes(staticQueryItems) +
+		GetCapacityBytes(dynamicTree.nodes) + GetCapacityBytes(dynamicTree.items) + GetCapacityBytes(dynamicTree.itemBoxes);
+
+	for (const BodyHandleTable* handles : { &staticHandles, &dynamicHandles })
+	{
+		bytes += GetCapacityBytes(handles->slots) + GetCapacityBytes(handles->denseToSlot) + GetCapacityBytes(handles->freeSlots);
+	}
 
-	for (size_t i = 0; i < dynamicBodies.size(); i++)
+	for (const auto& buffer : exportBuffers)
+	{
+		bytes += GetCapacityBytes(buffer.second.slots);
+	}
+	return bytes;
+}
+
+void PhysicsEnigne::ApplyForces(
+	float dt,
+	size_t begin,
+	size_t end)
+{
+	for (size_t i = begin; i < end; i++)
 	{
 		Body* body = &dynamicBodies[i];
 		float mass = 1.0f / body->massInv;
 
 		XMVECTOR v_constForce = XMLoadFloat3(&constForces[i]);
 		XMVECTOR v_dynamicForce = XMLoadFloat3(&dynamicForces[i]);
-		XMVECTOR v_Impulse = (v_constForce + v_dynamicForce) * mass * dt;
+		XMVECTOR v_Impulse;
+		if (body->lodSkipped || body->lodPendingTime > 0.0f)
+		{
+			// constant force of skipped steps waits for the next step of the body, so resting bodies don't sink
+			float constForceDt = body->lodSkipped ? 0.0f : dt + body->lodPendingTime;
+			v_Impulse = v_constForce * mass * constForceDt + v_dynamicForce * mass * dt;
+			if (!body->lodSkipped)
+			{
+				body->lodPendingTime = 0.0f;
+			}
+		}
+		else
+		{
+			v_Impulse = (v_constForce + v_dynamicForce) * mass * dt;
+		}
 		XMFLOAT3 Impulse;
 		XMStoreFloat3(&Impulse, v_Impulse);
 		body->ApplyLinearImpulse(&Impulse);
 	
 		dynamicForces[i] = { .0f, .0f, .0f };
 	}
+}
 
-	BroadPhase(dt);
-
-	FindIntersections(dt);
+void PhysicsEnigne::SortContactsByIsland()
+{
+	// contacts of one island are kept together, inside island ordered by TOI
 	sort(contactPoints.begin(), contactPoints.end() - 1, [](const Contact& l, const Contact& r)
 		{
+			if (l.islandId != r.islandId)
+			{
+				return l.islandId < r.islandId;
+			}
 			return l.timeOfImpact < r.timeOfImpact;
 		}
 	);
 
-	float accumulatedTime = 0.0f;
+	islandContactStarts.clear();
+	size_t contactCount = contactPoints.size() - 1;
+	islandContactStarts.reserve(contactCount + 1);
+	for (size_t i = 0; i < contactCount; i++)
+	{
+		if (i == 0 || contactPoints[i].islandId != contactPoints[i - 1].islandId)
+		{
+			islandContactStarts.push_back(i);
+		}
+	}
+	islandContactStarts.push_back(contactCount);
+}
+
+void PhysicsEnigne::ResolveIslands(
+	size_t begin,
+	size_t end)
+{
+	for (size_t island = begin; island < end; island++)
+	{
+		for (size_t i = islandContactStarts[island]; i < islandContactStarts[island + 1]; i++)
+		{
+			Contact& contact = contactPoints[i];
+			AdvanceBodyToTime(contact.bodyA, contact.timeOfImpact);
+			AdvanceBodyToTime(contact.bodyB, contact.timeOfImpact);
+
+			ResolveContact(&contact);
+		}
+	}
+}
+
+void PhysicsEnigne::IntegrateBodies(
+	const std::vector<uint32_t>& bodyIndices,
+	float dt,
+	size_t begin,
+	size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		IntegrateBody(bodyIndices[i], dt);
+	}
+}
+
+void PhysicsEnigne::IntegrateBody(
+	size_t bodyIdx,
+	float dt)
+{
+	const float timeRemaining = dt - bodyLocalTimes[bodyIdx];
+	if (timeRemaining > 0.0f)
+	{
+		dynamicBodies[bodyIdx].UpdateBody(timeRemaining);
+	}
+}
+
+void PhysicsEnigne::BuildIslands()
+{
+	islandParents.resize(dynamicBodies.size());
+	for (size_t i = 0; i < islandParents.size(); i++)
+	{
+		islandParents[i] = i;
+	}
+
 	for (size_t i = 0; i < contactPoints.size() - 1; i++)
 	{
-		Contact& contact = contactPoints[i];
-		const float dt_c = contact.timeOfImpact - accumulatedTime;
+		size_t idxA = GetDynamicBodyIndex(contactPoints[i].bodyA);
+		size_t idxB = GetDynamicBodyIndex(contactPoints[i].bodyB);
+		if (idxA == SIZE_MAX || idxB == SIZE_MAX)
+		{
+			continue;
+		}
 
-		for (size_t i = 0; i < dynamicBodies.size(); i++)
+		size_t rootA = FindIslandRoot(idxA);
+		size_t rootB = FindIslandRoot(idxB);
+		if (rootA != rootB)
 		{
-			dynamicBodies[i].UpdateBody(dt_c);
+			islandParents[rootB] = rootA;
 		}
+	}
 
+	for (size_t i = 0; i < contactPoints.size() - 1; i++)
+	{
+		// static bodies are never part of an island, at least one body in contact is dynamic
+		size_t idx = GetDynamicBodyIndex(contactPoints[i].bodyA);
+		if (idx == SIZE_MAX)
+		{
+			idx = GetDynamicBodyIndex(contactPoints[i].bodyB);
+		}
+		contactPoints[i].islandId = FindIslandRoot(idx);
+	}
+}
 
-		ResolveContact(&contactPoints[i]);
-		accumulatedTime += dt_c;
+size_t PhysicsEnigne::FindIslandRoot(
+	size_t bodyIdx)
+{
+	while (islandParents[bodyIdx] != bodyIdx)
+	{
+		islandParents[bodyIdx] = islandParents[islandParents[bodyIdx]];
+		bodyIdx = islandParents[bodyIdx];
 	}
+	return bodyIdx;
+}
 
-	const float timeRemaining = dt - accumulatedTime;
-	for (size_t i = 0; i < dynamicBodies.size(); i++)
+size_t PhysicsEnigne::GetDynamicBodyIndex(
+	const Body* body) const
+{
+	if (dynamicBodies.size() == 0 || body < &dynamicBodies.front() || body > &dynamicBodies.back())
 	{
-		dynamicBodies[i].UpdateBody(dt);
+		return SIZE_MAX;
+	}
+	return body - dynamicBodies.data();
+}
+
+void PhysicsEnigne::AdvanceBodyToTime(
+	const Body* body,
+	float time)
+{
+	size_t idx = GetDynamicBodyIndex(body);
+	if (idx == SIZE_MAX)
+	{
+		return;
+	}
+
+	// far bodies integrate skipped time after contacts, their contacts are all at step start
+	if (time <= 0.0f)
+	{
+		return;
+	}
+
+	const float dt_c = time - bodyLocalTimes[idx];
+	if (dt_c > 0.0f)
+	{
+		dynamicBodies[idx].UpdateBody(dt_c);
+		bodyLocalTimes[idx] = time;
 	}
-	return 0;
 }
@@ -2,19 +2,99 @@
 #include <vector>
 #include "Body.hpp"
 #include "Intersection.hpp"
+#include "BodyHandleTable.hpp"
+#include "FrameArena.hpp"
+#include "JobSystem.hpp"
+#include "PhysicsSnapshot.hpp"
+#include "PhysicsRecorder.hpp"
+#include "PhysicsStats.hpp"
+#include "ShapeCache.hpp"
+#include "AabbTree.hpp"
+#include "RayPacket.hpp"
+#include "Shapes/ShapeHeightfield.hpp"
+#include "Shapes/ShapeMesh.hpp"
+#include "Shapes/ShapeCompound.hpp"
+#include <atomic>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
 
 
 struct BodyPlaneDistance
 {
-	size_t bodyId;
+	uint64_t bodyId;
 	float distance;
+	CollisionFilter filter; // copy of body filter, pairs are filtered without touching bodies
 	bool isMin;
+	bool isSensor;
+	bool isPassive; // static or skipped by simulation LOD, two passive bodies are never paired
 };
 
 struct CollisionPair
 {
-	size_t idA;
-	size_t idB;
+	uint64_t idA;
+	uint64_t idB;
+};
+
+enum class SensorEventType : uint8_t
+{
+	Enter,
+	Exit
+};
+
+// other body of exit event may be already removed
+struct SensorEvent
+{
+	uint64_t sensorId;
+	uint64_t otherId;
+	SensorEventType type;
+};
+
+constexpr size_t DEFAULT_SENSOR_EVENT_CAPACITY = 256;
+
+struct KinematicTarget
+{
+	uint64_t bodyId;
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;
+};
+
+// what ExportTransforms last wrote into one slot of its buffer
+struct TransformExportSlot
+{
+	uint64_t bodyId;
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;
+	DirectX::XMFLOAT3 scale; // diagonal of shape matrix
+	bool useShapeMatrix; // shape matrix isn't plain scale, slot is written by GetTransformMatrixForBody
+};
+
+// export state of one caller buffer
+struct TransformExportBuffer
+{
+	size_t stride;
+	std::vector<TransformExportSlot> slots;
+};
+
+constexpr uint8_t SIMULATION_LOD_TIERS = 3; // tier n is stepped every 2^n-th UpdateBodies
+
+/*
+	Tier of dynamic body is given by distance to nearest observer. Bodies near a border
+	keep their tier until they are hysteresis inside the neighbouring one.
+*/
+struct SimulationLodSettings
+{
+	float tierDistances[SIMULATION_LOD_TIERS - 1]; // where tier 1 and tier 2 start
+	float hysteresis;
+};
+
+constexpr SimulationLodSettings DEFAULT_SIMULATION_LOD = { { 40.0f, 80.0f }, 4.0f };
+
+// how narrow phase keeps fast bodies from tunneling
+enum class ContactMode : uint8_t
+{
+	Substeps, // CheckIntersection samples poses along the step
+	Speculative // one closest distance query per pair, see CheckSpeculativeContact
 };
 
 constexpr uint8_t X_COMPONENT = 0x01;
@@ -23,7 +103,14 @@ constexpr uint8_t Z_COMPONENT = 0x01 << 2;
 
 struct PhysicsEnigne
 {
-	PhysicsEnigne(size_t expectedDynamicBodies = 200, size_t expectedStaticBodies = 200);
+	/*
+		Step phases run on jobSystem, engine creates its own
+		with one worker per hardware thread when nullptr is passed.
+	*/
+	PhysicsEnigne(
+		size_t expectedDynamicBodies = 200,
+		size_t expectedStaticBodies = 200,
+		JobSystem* jobSystem = nullptr);
 
 
 	int64_t AddBody(
@@ -36,15 +123,184 @@ struct PhysicsEnigne
 		const LinearVelocityBounds& vBounds,
 		const DirectX::XMFLOAT3& constForce = {0, -9.8, 0});
 	
+	/*
+		Creates count bodies of one kind sharing single shape instance,
+		bodyIds must have space for count handles.
+	*/
+	int64_t AddBodies(
+		const BodyProperties* props,
+		size_t count,
+		ShapeType shapeType,
+		const DirectX::XMFLOAT3& scales,
+		bool isDynamic,
+		uint64_t* bodyIds,
+		bool allowAngularImpulse,
+		const LinearVelocityBounds& vBounds,
+		const DirectX::XMFLOAT3& constForce = {0, -9.8, 0});
+
+	/*
+		Creates count bodies sharing one compound shape, child shapes come from the same
+		cache as AddBodies. massInv of props is for the whole body and position is origin
+		of children. Returns -1 for invalid children.
+	*/
+	int64_t AddCompoundBodies(
+		const CompoundChildDesc* children,
+		size_t childCount,
+		const BodyProperties* props,
+		size_t count,
+		bool isDynamic,
+		uint64_t* bodyIds,
+		bool allowAngularImpulse,
+		const LinearVelocityBounds& vBounds,
+		const DirectX::XMFLOAT3& constForce = {0, -9.8, 0});
+
+	/*
+		Static terrain body, heights are copied. Only position, elasticity and friction
+		of props are used, grid stays aligned with world axes. Returns -1 for invalid desc.
+	*/
+	int64_t AddHeightfield(
+		const HeightfieldDesc& desc,
+		const BodyProperties& props,
+		uint64_t* bodyId);
+
+	/*
+		Static triangle mesh body, geometry is copied and its BVH built once.
+		Position, rotation, elasticity and friction of props are used. Returns -1 for invalid desc.
+	*/
+	int64_t AddMesh(
+		const MeshDesc& desc,
+		const BodyProperties& props,
+		uint64_t* bodyId);
+
+	// same as AddMesh for mesh saved with SaveMeshBlob, returns -1 for malformed blob
+	int64_t AddMeshFromBlob(
+		const uint8_t* blob,
+		size_t size,
+		const BodyProperties& props,
+		uint64_t* bodyId);
+
+	// nearest hit on mesh body, false when there is none or handle isn't a mesh
+	bool RaycastMesh(
+		uint64_t bodyId,
+		const DirectX::XMFLOAT3& origin,
+		const DirectX::XMFLOAT3& direction,
+		float maxDistance,
+		MeshRayHit* hit);
+
+	// returns -1 if any of the handles was stale, valid ones are still removed
+	int64_t RemoveBodies(
+		const uint64_t* bodyIds,
+		size_t count);
+
+	/*
+		Removes body in O(1), last body of the same kind is moved into freed place.
+		Handle becomes stale, must not be called during UpdateBodies.
+	*/
+	int64_t RemoveBody(
+		uint64_t bodyId);
+
+	/*
+		Stores bodies, forces and handles into snapshot, previous content of snapshot is released.
+		With base, only bodies that differ from base are stored, base must be full snapshot
+		and has to be kept until every delta taken against it is released.
+	*/
+	int64_t Snapshot(
+		PhysicsSnapshot* snapshot,
+		const PhysicsSnapshot* base = nullptr);
+
+	/*
+		Returns world to the state of snapshot, delta snapshot needs its base.
+		Kinematic targets set before Restore are dropped.
+		Returns -1 while recording, snapshot blob can't be written to recording.
+		Doesn't allocate when world already held at least as many bodies.
+		Must not be called during UpdateBodies.
+	*/
+	int64_t Restore(
+		const PhysicsSnapshot& snapshot,
+		const PhysicsSnapshot* base = nullptr);
+
+	// drops shape references held by snapshot
+	void ReleaseSnapshot(
+		PhysicsSnapshot* snapshot);
+
+	/*
+		Every following AddBodies, AddCompoundBodies, AddHeightfield, AddMesh, RemoveBody, AddForce, SetLinearVelocity, AddLinearVelocity, SetCollisionFilter,
+		SetSensor, SetKinematic, SetKinematicTarget, SetLodObservers, SetSimulationLod, SetContactMode, SetSpeculativeContacts, SetBodyReorderInterval, ReorderBodies and UpdateBodies is written to recorder. Returns -1 when world isn't empty, recording has to cover
+		whole history of the world to be replayed.
+	*/
+	int64_t StartRecording(
+		PhysicsRecorder* recorder);
+
+	void StopRecording();
+
+	// hash of motion state of all bodies
+	uint64_t GetStateChecksum() const;
+
+	// statistics of last UpdateBodies
+	void GetStats(
+		PhysicsStats* stats) const;
+
+	// bytes reserved by engine owned arrays, shape data is not included
+	size_t GetMemoryUsage() const;
+
+	// compound bodies are drawn one matrix per child, other bodies have only child 0
 	int64_t GetTransformMatrixForBody(
 		uint64_t bodyId,
-		DirectX::XMFLOAT4X4* mat);
+		DirectX::XMFLOAT4X4* mat,
+		uint32_t child = 0);
+
+	/*
+		Writes matrix of ids[i], same as GetTransformMatrixForBody with child 0, to dst + i * stride.
+		dst can be mapped GPU memory, only matrix bytes of a slot are touched. bufferId names the memory
+		behind dst, dst may be mapped at another address every call. Slots whose body kept its pose since
+		the previous export with the same bufferId are skipped and keep their bytes, so ring-buffered
+		memory uses one id per frame in flight. Changing stride of an id writes every slot.
+		changed (optional, count entries) receives indices of written slots, changedCount their number.
+		Bodies are processed one by one, matrix is built from cached rotation matrix scaled by the shape.
+		Stale handles are skipped. Returns -1 for nullptr dst or stride smaller than a matrix.
+	*/
+	int64_t ExportTransforms(
+		uint64_t bufferId,
+		void* dst,
+		size_t stride,
+		const uint64_t* ids,
+		size_t count,
+		uint32_t* changed = nullptr,
+		size_t* changedCount = nullptr);
+
+	// forgets content of buffer, next export with bufferId writes every slot
+	void ReleaseExportBuffer(
+		uint64_t bufferId);
+
+	// number of matrices GetTransformMatrixForBody gives for body, 0 for stale handle
+	uint32_t GetBodyChildCount(
+		uint64_t bodyId);
 
 	int64_t UpdateBodies(float dt);
 
+	// runs every phase of UpdateBodies on the calling thread, without job system, used by PhysicsWorldBatch
+	void StepSerial(
+		float dt);
+
+	// fills statistics and records the step started by BeginStep
+	void FinishStep(
+		float dt);
+
+	// resets per step state and statistics, contacts and pairs of last step are released with frame arena
+	void BeginStep();
+
 	int64_t FindIntersections(
 		float dt);
 
+	// checks collisionPairs [begin, end), results are stored per pair until CollectContacts
+	void NarrowPhase(
+		float dt,
+		size_t begin,
+		size_t end);
+
+	// moves hits of NarrowPhase into contactPoints
+	void CollectContacts();
+
 	void AddForce(
 		uint64_t bodyId,
 		uint8_t	forceComponent,
@@ -59,6 +315,141 @@ struct PhysicsEnigne
 		uint64_t bodyId,
 		DirectX::XMFLOAT3* v);
 
+	// bodies start with COLLISION_LAYER_DEFAULT, COLLISION_MASK_ALL and no ignore group
+	int64_t SetCollisionFilter(
+		uint64_t bodyId,
+		const CollisionFilter& filter);
+
+	int64_t GetCollisionFilter(
+		uint64_t bodyId,
+		CollisionFilter* filter);
+
+	/*
+		Sensor is tested against overlapping bodies with boolean GJK after integration
+		and reports enter and exit events, it never takes part in contact resolution.
+		Sensors don't report other sensors.
+	*/
+	int64_t SetSensor(
+		uint64_t bodyId,
+		bool isSensor);
+
+	// events beyond capacity are dropped and counted in PhysicsStats
+	void SetSensorEventCapacity(
+		size_t capacity);
+
+	// events of the last step, valid until next UpdateBodies
+	void GetSensorEvents(
+		const SensorEvent** events,
+		size_t* count) const;
+
+	// tests sensorPairs and diffs overlaps with previous step into sensorEvents
+	void UpdateSensors();
+
+	/*
+		Kinematic body is static body with infinite mass that can be moved. It isn't affected
+		by forces or contacts, but dynamic bodies see its velocity during contact resolution.
+		Returns -1 for dynamic or stale handles.
+	*/
+	int64_t SetKinematic(
+		uint64_t bodyId,
+		bool isKinematic);
+
+	/*
+		Kinematic body reaches target at the end of next UpdateBodies, velocities
+		for that step are derived from the distance to target. Without new target
+		body stops after the step.
+	*/
+	int64_t SetKinematicTarget(
+		uint64_t bodyId,
+		const DirectX::XMFLOAT3& position,
+		const DirectX::XMFLOAT4& rotation);
+
+	/*
+		Dynamic bodies far from every observer are stepped at 1/2 or 1/4 rate. Skipped time is
+		integrated in one go before the next step of the body, pairs with such bodies are tested
+		without CCD and skipped bodies only collide with stepped ones. Observers replace the
+		previous ones, e.g. cameras or player positions set before every UpdateBodies.
+		Without observers every body is stepped at full rate.
+	*/
+	void SetLodObservers(
+		const DirectX::XMFLOAT3* positions,
+		size_t count);
+
+	void SetSimulationLod(
+		const SimulationLodSettings& settings);
+
+	// picks tiers, skips bodies that aren't stepped and catches up the ones that are
+	void UpdateSimulationLod(
+		float dt);
+
+	/*
+		Speculative mode gives every pair one contact at the start of the step, bodies that
+		don't touch yet may still approach by their gap. Cheaper than substeps for fast bodies,
+		but rotation during the step is not swept. Default is ContactMode::Substeps.
+	*/
+	void SetContactMode(
+		ContactMode mode);
+
+	// pairs with body use speculative contacts whatever mode of the world is
+	int64_t SetSpeculativeContacts(
+		uint64_t bodyId,
+		bool enabled);
+
+	/*
+		Every steps-th UpdateBodies dynamic bodies are sorted by Morton code of their bounding box
+		centres, so bodies close in space are close in dynamicBodies and pairs touch memory in order.
+		Handles stay valid, dense indices and Body pointers don't. Pairs and contacts follow body order,
+		so results differ from an unsorted world, replays stay exact. 0, the default, never reorders.
+	*/
+	void SetBodyReorderInterval(
+		uint32_t steps);
+
+	// sorts dynamic bodies by Morton code now, returns number of bodies that moved. Must not be called during UpdateBodies.
+	size_t ReorderBodies();
+
+	// same as ReorderBodies without recording, used by the periodic pass of BeginStep
+	size_t SortBodiesByMortonCode();
+
+	// sets velocities of kinematic bodies so they reach their targets in dt
+	void ApplyKinematicTargets(
+		float dt);
+
+	// places kinematic bodies exactly at their targets and stops them
+	void FinishKinematicTargets();
+
+	/*
+		Appends handles of static and kinematic bodies whose bounding box overlaps box.
+		Static bodies are kept in staticTree, rebuilt on first query after they change,
+		so cost depends on bodies near box. Dynamic bodies are not reported.
+	*/
+	void QueryStaticBodies(
+		const BoundingBox& box,
+		std::vector<uint64_t>* bodyIds);
+
+	void RebuildStaticTree();
+
+	/*
+		Casts count rays, hits[i] belongs to rays[i]. Consecutive rays are traversed together in packets
+		of RAY_PACKET_SIZE through staticTree and dynamicTree, so rays with close origins and directions
+		should be neighbours. With filter only bodies that ShouldCollide with it are hit, sensors never are.
+		RayQueryMode::AnyHit reports the first hit found, not the nearest one. Returns number of rays that hit.
+		Misses the budget of 10k rays within 1 ms on one core: ray_queries scene of PhysicsBenchmark
+		casts 10k rays against 10k bodies in about 5 ms closest and 4 ms any hit.
+		Must not be called during UpdateBodies.
+	*/
+	size_t CastRays(
+		const RayQuery* rays,
+		size_t count,
+		RayQueryMode mode,
+		RayHit* hits,
+		const CollisionFilter* filter = nullptr);
+
+	// dynamic bodies at current poses, rebuilt on first ray query after bodies were added or removed
+	void RebuildDynamicTree();
+
+	// keeps structure of dynamicTree for moved bodies, rebuilds it once refit nodes grew too much
+	void RefitDynamicTree();
+
 	void AddLinearVelocity(
 		uint64_t bodyId,
 		uint8_t	velocityComponent,
@@ -70,17 +461,43 @@ struct PhysicsEnigne
 		float* dist);
 
 
+	// returns nullptr for stale handles, pointer is valid until bodies are added, removed or reordered
 	Body* GetBody(
 		uint64_t bodyId);
 
+	// returns SIZE_MAX for static or stale handles
+	size_t GetDynamicBodyIndex(
+		uint64_t bodyId) const;
+
 	Shape CreateDefaultShape(
 		ShapeType type,
 		DirectX::XMFLOAT3 scales);
 
+	// stores bodies using shape, reference of shape is handed over to the first body
+	void PushBodies(
+		const BodyProperties* props,
+		size_t count,
+		Shape shape,
+		bool isDynamic,
+		uint64_t* bodyIds,
+		bool allowAngularImpulse,
+		const LinearVelocityBounds& vBounds,
+		const DirectX::XMFLOAT3& constForce);
+
+	// stores static body owning mesh shape, -1 when shape data is missing
+	int64_t PushMesh(
+		Shape shape,
+		const BodyProperties& props,
+		uint64_t* bodyId);
+
 	void ResolveContact(
 		Contact* contact
 	);
 
+	// resolves every manifold point together, speculative ones remove only approach beyond their gap
+	void ResolveManifoldContact(
+		Contact* contact);
+
 	void GetDistanceBetweenBodies(
 		uint64_t idBodyA,
 		uint64_t idBodyB,
@@ -94,6 +511,18 @@ struct PhysicsEnigne
 
 	void BroadPhase(float dt);
 
+	// writes broad phase entries of bodies [begin, end), dynamic bodies come first
+	void ComputeSortedDistances(
+		const DirectX::XMFLOAT3* normal,
+		float dt,
+		size_t begin,
+		size_t end);
+
+	void SortDistanceList();
+
+	// splits dynamic bodies into those that appear in collision pairs and the rest
+	void PartitionBodiesByPairs();
+
 	void GetAngularImpulse(
 		const Body* body, 
 		const DirectX::XMFLOAT3* point,
@@ -105,19 +534,108 @@ struct PhysicsEnigne
 		const DirectX::XMFLOAT3* normal,
 		float dt,
 		size_t bodyIdx,
-		size_t bodyId);
+		uint64_t bodyId);
 
 	void BuildCollisionPairs();
 
-	
+	// points per step arrays at empty frameArena
+	void InitFrameArrays();
+
+	// groups dynamic bodies connected by contacts, sets Contact::islandId
+	void BuildIslands();
+
+	// sorts contacts by island and TOI, fills islandContactStarts
+	void SortContactsByIsland();
+
+	// resolves contacts of islands [begin, end), islands share no dynamic bodies
+	void ResolveIslands(
+		size_t begin,
+		size_t end);
+
+	void ApplyForces(
+		float dt,
+		size_t begin,
+		size_t end);
+
+	// wraps job so time spent in it is added to phase
+	JobFunction TimedJob(
+		PhysicsPhase phase,
+		JobFunction job);
+
+	void IntegrateBodies(
+		const std::vector<uint32_t>& bodyIndices,
+		float dt,
+		size_t begin,
+		size_t end);
+
+	// integrates body over the part of dt it didn't reach yet, dt - bodyLocalTimes[bodyIdx]
+	void IntegrateBody(
+		size_t bodyIdx,
+		float dt);
+
+	size_t FindIslandRoot(
+		size_t bodyIdx);
+
+	// returns SIZE_MAX for bodies that are not stored in dynamicBodies
+	size_t GetDynamicBodyIndex(
+		const Body* body) const;
+
+	void AdvanceBodyToTime(
+		const Body* body,
+		float time);
 
 public:
 	std::vector<Body> staticBodies;
 	std::vector<DirectX::XMFLOAT3> constForces; // per dynamic body
 	std::vector<DirectX::XMFLOAT3> dynamicForces; // per dynamic body
 	std::vector<Body> dynamicBodies;
-	std::vector<Contact> contactPoints;
-	std::vector<CollisionPair> collisionPairs;
+	BodyHandleTable staticHandles;
+	BodyHandleTable dynamicHandles;
+	FrameArena frameArena; // transient data of one step, reset by BeginStep
+	FrameArray<Contact> contactPoints;
+	FrameArray<CollisionPair> collisionPairs;
+	std::vector<CollisionPair> sensorPairs; // idA is sensor
+	std::vector<CollisionPair> sensorOverlaps; // overlapping sensor pairs of last step, sorted
+	std::vector<CollisionPair> currentOverlaps;
+	std::vector<SensorEvent> sensorEvents;
+	size_t sensorEventCapacity;
+	std::vector<KinematicTarget> kinematicTargets; // set since last step, later entries win
+	std::vector<DirectX::XMFLOAT3> lodObservers;
+	SimulationLodSettings lodSettings;
+	uint64_t lodStepCounter;
+	bool lodTiersUsed; // some body was in far tier or skipped during last step
+	ContactMode contactMode;
+	uint32_t bodyReorderInterval;
+	uint32_t stepsSinceReorder;
 	std::vector<BodyPlaneDistance> sortedBodies;
+	AabbTree staticTree; // non kinematic static bodies
+	std::vector<uint32_t> staticTreeBodies; // per tree item, index into staticBodies
+	std::vector<uint32_t> kinematicBodyIndices; // moving static bodies, tested one by one
+	std::vector<uint32_t> staticQueryItems;
+	bool staticTreeDirty;
+	AabbTree dynamicTree; // items are indices into dynamicBodies
+	bool dynamicTreeDirty; // bodies were added, removed or reordered, tree is rebuilt
+	bool dynamicTreeMoved; // bodies moved, tree is refit
+	std::vector<size_t> islandParents; // per dynamic body
+	std::vector<float> bodyLocalTimes; // per dynamic body, time already integrated in current step
+	FrameArray<Contact> pairContacts; // per collision pair
+	FrameArray<uint8_t> pairHits; // per collision pair
+	std::vector<uint8_t> bodyInPair; // per dynamic body
+	std::vector<uint32_t> freeBodyIndices; // dynamic bodies without collision pair, integrated while narrow phase runs
+	std::vector<uint32_t> pairedBodyIndices;
+	FrameArray<size_t> islandContactStarts; // first contact of every island, ends with contact count
+	std::unordered_map<uint64_t, TransformExportBuffer> exportBuffers; // by caller buffer id
+	JobSystem* jobSystem;
+	std::unique_ptr<JobSystem> ownedJobSystem;
+	TaskGraph stepGraph;
+	uint64_t snapshotCounter;
+	std::vector<Shape> snapshotShapes; // shape table of snapshot being taken
+	std::unordered_map<const char*, uint32_t> snapshotShapeIndices; // by shapeData
+	PhysicsRecorder* recorder;
+	ShapeCache* shapeCache; // shapes shared with other engines, nullptr creates shape per AddBodies call
+	std::chrono::steady_clock::time_point stepStart;
+	PhysicsStats stepStats;
+	std::atomic<uint64_t> phaseNanoseconds[(size_t)PhysicsPhase::Count];
+	std::mutex statsMutex;
 };
 
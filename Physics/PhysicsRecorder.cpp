@@ -0,0 +1,663 @@
+#include "PhysicsRecorder.hpp"
+#include "PhysicsEnigne.h"
+#include <string.h>
+#include <fstream>
+#include <chrono>
+#include <unordered_map>
+using namespace std;
+using namespace DirectX;
+
+template<typename T>
+static void Append(
+	vector<uint8_t>* log,
+	const T& value)
+{
+	size_t offset = log->size();
+	log->resize(offset + sizeof(T));
+	memcpy(log->data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+static bool Read(
+	const vector<uint8_t>& log,
+	size_t* offset,
+	T* value)
+{
+	if (*offset + sizeof(T) > log.size())
+	{
+		return false;
+	}
+	memcpy(value, log.data() + *offset, sizeof(T));
+	*offset += sizeof(T);
+	return true;
+}
+
+PhysicsRecorder::PhysicsRecorder()
+{
+	Clear();
+}
+
+void PhysicsRecorder::Clear()
+{
+	log.clear();
+	Append(&log, RECORDING_MAGIC);
+	Append(&log, RECORDING_VERSION);
+}
+
+void PhysicsRecorder::RecordAddBodies(
+	const BodyProperties* props,
+	size_t count,
+	ShapeType shapeType,
+	const DirectX::XMFLOAT3& scales,
+	bool isDynamic,
+	const uint64_t* bodyIds,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	Append(&log, RecordedCall::AddBodies);
+	Append(&log, (uint64_t)count);
+	Append(&log, (uint32_t)shapeType);
+	Append(&log, scales);
+	Append(&log, (uint8_t)isDynamic);
+	Append(&log, (uint8_t)allowAngularImpulse);
+	Append(&log, vBounds);
+	Append(&log, constForce);
+	for (size_t i = 0; i < count; i++)
+	{
+		Append(&log, props[i]);
+		Append(&log, bodyIds[i]);
+	}
+}
+
+void PhysicsRecorder::RecordAddCompoundBodies(
+	const CompoundChildDesc* children,
+	size_t childCount,
+	const BodyProperties* props,
+	size_t count,
+	bool isDynamic,
+	const uint64_t* bodyIds,
+	bool allowAngularImpulse,
+	const LinearVelocityBounds& vBounds,
+	const DirectX::XMFLOAT3& constForce)
+{
+	Append(&log, RecordedCall::AddCompoundBodies);
+	Append(&log, (uint64_t)childCount);
+	for (size_t i = 0; i < childCount; i++)
+	{
+		Append(&log, children[i]);
+	}
+	Append(&log, (uint64_t)count);
+	Append(&log, (uint8_t)isDynamic);
+	Append(&log, (uint8_t)allowAngularImpulse);
+	Append(&log, vBounds);
+	Append(&log, constForce);
+	for (size_t i = 0; i < count; i++)
+	{
+		Append(&log, props[i]);
+		Append(&log, bodyIds[i]);
+	}
+}
+
+void PhysicsRecorder::RecordAddHeightfield(
+	const HeightfieldDesc& desc,
+	const BodyProperties& props,
+	uint64_t bodyId)
+{
+	Append(&log, RecordedCall::AddHeightfield);
+	Append(&log, desc.columns);
+	Append(&log, desc.rows);
+	Append(&log, desc.cellSize);
+	Append(&log, desc.heightScale);
+	Append(&log, desc.heightOffset);
+	Append(&log, (uint8_t)(desc.materials != nullptr));
+	Append(&log, props);
+	Append(&log, bodyId);
+
+	size_t heightBytes = (size_t)desc.columns * desc.rows * sizeof(uint16_t);
+	size_t materialBytes = desc.materials ? (size_t)(desc.columns - 1) * (desc.rows - 1) : 0;
+	size_t offset = log.size();
+	log.resize(offset + heightBytes + materialBytes);
+	memcpy(log.data() + offset, desc.heights, heightBytes);
+	if (materialBytes > 0)
+	{
+		memcpy(log.data() + offset + heightBytes, desc.materials, materialBytes);
+	}
+}
+
+void PhysicsRecorder::RecordAddMesh(
+	const Shape* shape,
+	const BodyProperties& props,
+	uint64_t bodyId)
+{
+	vector<uint8_t> blob;
+	SaveMeshBlob(shape, &blob);
+	Append(&log, RecordedCall::AddMesh);
+	Append(&log, props);
+	Append(&log, bodyId);
+	Append(&log, (uint64_t)blob.size());
+	log.insert(log.end(), blob.begin(), blob.end());
+}
+
+void PhysicsRecorder::RecordRemoveBody(
+	uint64_t bodyId)
+{
+	Append(&log, RecordedCall::RemoveBody);
+	Append(&log, bodyId);
+}
+
+void PhysicsRecorder::RecordAddForce(
+	uint64_t bodyId,
+	uint8_t forceComponent,
+	const DirectX::XMFLOAT3& force)
+{
+	Append(&log, RecordedCall::AddForce);
+	Append(&log, bodyId);
+	Append(&log, forceComponent);
+	Append(&log, force);
+}
+
+void PhysicsRecorder::RecordSetLinearVelocity(
+	uint64_t bodyId,
+	uint8_t velocityComponent,
+	const DirectX::XMFLOAT3& v)
+{
+	Append(&log, RecordedCall::SetLinearVelocity);
+	Append(&log, bodyId);
+	Append(&log, velocityComponent);
+	Append(&log, v);
+}
+
+void PhysicsRecorder::RecordAddLinearVelocity(
+	uint64_t bodyId,
+	uint8_t velocityComponent,
+	const DirectX::XMFLOAT3& v)
+{
+	Append(&log, RecordedCall::AddLinearVelocity);
+	Append(&log, bodyId);
+	Append(&log, velocityComponent);
+	Append(&log, v);
+}
+
+void PhysicsRecorder::RecordSetCollisionFilter(
+	uint64_t bodyId,
+	const CollisionFilter& filter)
+{
+	Append(&log, RecordedCall::SetCollisionFilter);
+	Append(&log, bodyId);
+	Append(&log, filter);
+}
+
+void PhysicsRecorder::RecordSetSensor(
+	uint64_t bodyId,
+	bool isSensor)
+{
+	Append(&log, RecordedCall::SetSensor);
+	Append(&log, bodyId);
+	Append(&log, (uint8_t)isSensor);
+}
+
+void PhysicsRecorder::RecordSetKinematic(
+	uint64_t bodyId,
+	bool isKinematic)
+{
+	Append(&log, RecordedCall::SetKinematic);
+	Append(&log, bodyId);
+	Append(&log, (uint8_t)isKinematic);
+}
+
+void PhysicsRecorder::RecordSetKinematicTarget(
+	uint64_t bodyId,
+	const DirectX::XMFLOAT3& position,
+	const DirectX::XMFLOAT4& rotation)
+{
+	Append(&log, RecordedCall::SetKinematicTarget);
+	Append(&log, bodyId);
+	Append(&log, position);
+	Append(&log, rotation);
+}
+
+void PhysicsRecorder::RecordSetLodObservers(
+	const DirectX::XMFLOAT3* positions,
+	size_t count)
+{
+	Append(&log, RecordedCall::SetLodObservers);
+	Append(&log, (uint64_t)count);
+	for (size_t i = 0; i < count; i++)
+	{
+		Append(&log, positions[i]);
+	}
+}
+
+void PhysicsRecorder::RecordSetSimulationLod(
+	const SimulationLodSettings& settings)
+{
+	Append(&log, RecordedCall::SetSimulationLod);
+	Append(&log, settings);
+}
+
+void PhysicsRecorder::RecordSetContactMode(
+	ContactMode mode)
+{
+	Append(&log, RecordedCall::SetContactMode);
+	Append(&log, (uint8_t)mode);
+}
+
+void PhysicsRecorder::RecordSetSpeculativeContacts(
+	uint64_t bodyId,
+	bool enabled)
+{
+	Append(&log, RecordedCall::SetSpeculativeContacts);
+	Append(&log, bodyId);
+	Append(&log, (uint8_t)enabled);
+}
+
+void PhysicsRecorder::RecordSetBodyReorderInterval(
+	uint32_t steps)
+{
+	Append(&log, RecordedCall::SetBodyReorderInterval);
+	Append(&log, steps);
+}
+
+void PhysicsRecorder::RecordReorderBodies()
+{
+	Append(&log, RecordedCall::ReorderBodies);
+}
+
+void PhysicsRecorder::RecordUpdateBodies(
+	float dt,
+	uint64_t checksum)
+{
+	Append(&log, RecordedCall::UpdateBodies);
+	Append(&log, dt);
+	Append(&log, checksum);
+}
+
+int64_t PhysicsRecorder::Save(
+	const char* path) const
+{
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file.is_open())
+	{
+		return -1;
+	}
+
+	file.write((const char*)log.data(), log.size());
+	return file.good() ? 0 : -1;
+}
+
+int64_t PhysicsRecorder::Load(
+	const char* path)
+{
+	ifstream file(path, ios::ate | ios::binary);
+	if (!file.is_open())
+	{
+		return -1;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	log.resize(fileSize);
+	file.seekg(0);
+	file.read((char*)log.data(), fileSize);
+
+	size_t offset = 0;
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	if (!file.good() || !Read(log, &offset, &magic) || !Read(log, &offset, &version) ||
+		magic != RECORDING_MAGIC || version != RECORDING_VERSION)
+	{
+		Clear();
+		return -1;
+	}
+	return 0;
+}
+
+int64_t ReplayRecording(
+	const PhysicsRecorder& recorder,
+	PhysicsEnigne* engine,
+	std::vector<ReplayStep>* steps,
+	size_t* firstDivergedStep)
+{
+	const vector<uint8_t>& log = recorder.log;
+	size_t offset = 0;
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	*firstDivergedStep = SIZE_MAX;
+	steps->clear();
+	if (!Read(log, &offset, &magic) || !Read(log, &offset, &version) ||
+		magic != RECORDING_MAGIC || version != RECORDING_VERSION)
+	{
+		return -1;
+	}
+
+	// recorded handle -> handle in replaying engine, unknown handles are passed as they are
+	unordered_map<uint64_t, uint64_t> handles;
+	auto mapHandle = [&handles](uint64_t bodyId)
+	{
+		auto it = handles.find(bodyId);
+		return it == handles.end() ? bodyId : it->second;
+	};
+
+	vector<BodyProperties> props;
+	vector<uint64_t> recordedIds;
+	vector<uint64_t> replayedIds;
+	while (offset < log.size())
+	{
+		RecordedCall call;
+		if (!Read(log, &offset, &call))
+		{
+			return -1;
+		}
+		switch (call)
+		{
+		case RecordedCall::AddBodies:
+		{
+			uint64_t count;
+			uint32_t shapeType;
+			XMFLOAT3 scales;
+			uint8_t isDynamic;
+			uint8_t allowAngularImpulse;
+			LinearVelocityBounds vBounds;
+			XMFLOAT3 constForce;
+			if (!Read(log, &offset, &count) || !Read(log, &offset, &shapeType) || !Read(log, &offset, &scales) ||
+				!Read(log, &offset, &isDynamic) || !Read(log, &offset, &allowAngularImpulse) ||
+				!Read(log, &offset, &vBounds) || !Read(log, &offset, &constForce) ||
+				count > (log.size() - offset) / (sizeof(BodyProperties) + sizeof(uint64_t)))
+			{
+				return -1;
+			}
+			// engine exits on shape it can't create, only shapes of CreateDefaultShape are accepted
+			if ((ShapeType)shapeType != ShapeType::OrientedBox && (ShapeType)shapeType != ShapeType::Capsule)
+			{
+				return -1;
+			}
+
+			props.resize(count);
+			recordedIds.resize(count);
+			replayedIds.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				Read(log, &offset, &props[i]);
+				Read(log, &offset, &recordedIds[i]);
+			}
+
+			engine->AddBodies(props.data(), count, (ShapeType)shapeType, scales, isDynamic != 0,
+				replayedIds.data(), allowAngularImpulse != 0, vBounds, constForce);
+			for (size_t i = 0; i < count; i++)
+			{
+				handles[recordedIds[i]] = replayedIds[i];
+			}
+			break;
+		}
+		case RecordedCall::AddCompoundBodies:
+		{
+			uint64_t childCount;
+			if (!Read(log, &offset, &childCount) || childCount > (log.size() - offset) / sizeof(CompoundChildDesc))
+			{
+				return -1;
+			}
+			vector<CompoundChildDesc> children(childCount);
+			for (size_t i = 0; i < childCount; i++)
+			{
+				Read(log, &offset, &children[i]);
+			}
+
+			uint64_t count;
+			uint8_t isDynamic;
+			uint8_t allowAngularImpulse;
+			LinearVelocityBounds vBounds;
+			XMFLOAT3 constForce;
+			if (!Read(log, &offset, &count) || !Read(log, &offset, &isDynamic) || !Read(log, &offset, &allowAngularImpulse) ||
+				!Read(log, &offset, &vBounds) || !Read(log, &offset, &constForce) ||
+				count > (log.size() - offset) / (sizeof(BodyProperties) + sizeof(uint64_t)))
+			{
+				return -1;
+			}
+
+			props.resize(count);
+			recordedIds.resize(count);
+			replayedIds.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				Read(log, &offset, &props[i]);
+				Read(log, &offset, &recordedIds[i]);
+			}
+
+			if (engine->AddCompoundBodies(children.data(), childCount, props.data(), count, isDynamic != 0,
+				replayedIds.data(), allowAngularImpulse != 0, vBounds, constForce) != 0)
+			{
+				return -1;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				handles[recordedIds[i]] = replayedIds[i];
+			}
+			break;
+		}
+		case RecordedCall::AddHeightfield:
+		{
+			HeightfieldDesc desc;
+			uint8_t hasMaterials;
+			BodyProperties props;
+			uint64_t recordedId;
+			if (!Read(log, &offset, &desc.columns) || !Read(log, &offset, &desc.rows) ||
+				!Read(log, &offset, &desc.cellSize) || !Read(log, &offset, &desc.heightScale) ||
+				!Read(log, &offset, &desc.heightOffset) || !Read(log, &offset, &hasMaterials) ||
+				!Read(log, &offset, &props) || !Read(log, &offset, &recordedId) ||
+				desc.columns < 2 || desc.rows < 2)
+			{
+				return -1;
+			}
+
+			size_t heightBytes = (size_t)desc.columns * desc.rows * sizeof(uint16_t);
+			size_t materialBytes = hasMaterials ? (size_t)(desc.columns - 1) * (desc.rows - 1) : 0;
+			if (offset + heightBytes + materialBytes > log.size())
+			{
+				return -1;
+			}
+
+			// log data may be unaligned for uint16_t
+			vector<uint16_t> heights(heightBytes / sizeof(uint16_t));
+			memcpy(heights.data(), log.data() + offset, heightBytes);
+			desc.heights = heights.data();
+			desc.materials = hasMaterials ? log.data() + offset + heightBytes : nullptr;
+			offset += heightBytes + materialBytes;
+
+			uint64_t replayedId;
+			if (engine->AddHeightfield(desc, props, &replayedId) != 0)
+			{
+				return -1;
+			}
+			handles[recordedId] = replayedId;
+			break;
+		}
+		case RecordedCall::AddMesh:
+		{
+			BodyProperties props;
+			uint64_t recordedId;
+			uint64_t blobSize;
+			if (!Read(log, &offset, &props) || !Read(log, &offset, &recordedId) ||
+				!Read(log, &offset, &blobSize) || blobSize > log.size() - offset)
+			{
+				return -1;
+			}
+
+			uint64_t replayedId;
+			if (engine->AddMeshFromBlob(log.data() + offset, blobSize, props, &replayedId) != 0)
+			{
+				return -1;
+			}
+			offset += blobSize;
+			handles[recordedId] = replayedId;
+			break;
+		}
+		case RecordedCall::RemoveBody:
+		{
+			uint64_t bodyId;
+			if (!Read(log, &offset, &bodyId))
+			{
+				return -1;
+			}
+			engine->RemoveBody(mapHandle(bodyId));
+			break;
+		}
+		case RecordedCall::AddForce:
+		case RecordedCall::SetLinearVelocity:
+		case RecordedCall::AddLinearVelocity:
+		{
+			uint64_t bodyId;
+			uint8_t component;
+			XMFLOAT3 value;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &component) || !Read(log, &offset, &value))
+			{
+				return -1;
+			}
+
+			if (call == RecordedCall::AddForce)
+			{
+				engine->AddForce(mapHandle(bodyId), component, value);
+			}
+			else if (call == RecordedCall::SetLinearVelocity)
+			{
+				engine->SetLinearVelocity(mapHandle(bodyId), component, value);
+			}
+			else
+			{
+				engine->AddLinearVelocity(mapHandle(bodyId), component, value);
+			}
+			break;
+		}
+		case RecordedCall::SetCollisionFilter:
+		{
+			uint64_t bodyId;
+			CollisionFilter filter;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &filter))
+			{
+				return -1;
+			}
+			engine->SetCollisionFilter(mapHandle(bodyId), filter);
+			break;
+		}
+		case RecordedCall::SetSensor:
+		{
+			uint64_t bodyId;
+			uint8_t isSensor;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &isSensor))
+			{
+				return -1;
+			}
+			engine->SetSensor(mapHandle(bodyId), isSensor != 0);
+			break;
+		}
+		case RecordedCall::SetKinematic:
+		{
+			uint64_t bodyId;
+			uint8_t isKinematic;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &isKinematic))
+			{
+				return -1;
+			}
+			engine->SetKinematic(mapHandle(bodyId), isKinematic != 0);
+			break;
+		}
+		case RecordedCall::SetKinematicTarget:
+		{
+			uint64_t bodyId;
+			XMFLOAT3 position;
+			XMFLOAT4 rotation;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &position) || !Read(log, &offset, &rotation))
+			{
+				return -1;
+			}
+			engine->SetKinematicTarget(mapHandle(bodyId), position, rotation);
+			break;
+		}
+		case RecordedCall::SetLodObservers:
+		{
+			uint64_t count;
+			if (!Read(log, &offset, &count) || count > (log.size() - offset) / sizeof(XMFLOAT3))
+			{
+				return -1;
+			}
+
+			vector<XMFLOAT3> positions(count);
+			for (XMFLOAT3& position : positions)
+			{
+				Read(log, &offset, &position);
+			}
+			engine->SetLodObservers(positions.data(), positions.size());
+			break;
+		}
+		case RecordedCall::SetSimulationLod:
+		{
+			SimulationLodSettings settings;
+			if (!Read(log, &offset, &settings))
+			{
+				return -1;
+			}
+			engine->SetSimulationLod(settings);
+			break;
+		}
+		case RecordedCall::SetContactMode:
+		{
+			uint8_t mode;
+			if (!Read(log, &offset, &mode) || mode > (uint8_t)ContactMode::Speculative)
+			{
+				return -1;
+			}
+			engine->SetContactMode((ContactMode)mode);
+			break;
+		}
+		case RecordedCall::SetSpeculativeContacts:
+		{
+			uint64_t bodyId;
+			uint8_t enabled;
+			if (!Read(log, &offset, &bodyId) || !Read(log, &offset, &enabled))
+			{
+				return -1;
+			}
+			engine->SetSpeculativeContacts(mapHandle(bodyId), enabled != 0);
+			break;
+		}
+		case RecordedCall::SetBodyReorderInterval:
+		{
+			uint32_t steps;
+			if (!Read(log, &offset, &steps))
+			{
+				return -1;
+			}
+			engine->SetBodyReorderInterval(steps);
+			break;
+		}
+		case RecordedCall::ReorderBodies:
+		{
+			engine->ReorderBodies();
+			break;
+		}
+		case RecordedCall::UpdateBodies:
+		{
+			ReplayStep step;
+			if (!Read(log, &offset, &step.dt) || !Read(log, &offset, &step.recordedChecksum))
+			{
+				return -1;
+			}
+
+			auto start = chrono::steady_clock::now();
+			engine->UpdateBodies(step.dt);
+			auto end = chrono::steady_clock::now();
+			step.stepTimeMs = chrono::duration<double, milli>(end - start).count();
+			step.replayedChecksum = engine->GetStateChecksum();
+
+			if (step.replayedChecksum != step.recordedChecksum && *firstDivergedStep == SIZE_MAX)
+			{
+				*firstDivergedStep = steps->size();
+			}
+			steps->push_back(step);
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <vector>
+#include <inttypes.h>
+#include "Body.hpp"
+#include "Shapes/ShapeHeightfield.hpp"
+#include "Shapes/ShapeMesh.hpp"
+
+struct PhysicsEnigne;
+struct SimulationLodSettings;
+enum class ContactMode : uint8_t;
+
+constexpr uint32_t RECORDING_MAGIC = 0x43524850; // "PHRC"
+constexpr uint32_t RECORDING_VERSION = 11;
+
+enum class RecordedCall : uint8_t
+{
+	AddBodies,
+	RemoveBody,
+	AddForce,
+	SetLinearVelocity,
+	UpdateBodies,
+	SetCollisionFilter,
+	SetSensor,
+	SetKinematic,
+	SetKinematicTarget,
+	AddHeightfield,
+	AddMesh,
+	AddCompoundBodies,
+	SetLodObservers,
+	SetSimulationLod,
+	SetContactMode,
+	SetSpeculativeContacts,
+	SetBodyReorderInterval,
+	ReorderBodies,
+	AddLinearVelocity
+};
+
+/*
+	Log of calls that change world state, every entry is RecordedCall followed by its arguments.
+	Body handles are stored as they were returned during recording, replay maps them
+	to handles of the replaying engine. UpdateBodies entry also stores checksum of
+	world state after the step.
+*/
+struct PhysicsRecorder
+{
+	PhysicsRecorder();
+
+	void Clear();
+
+	void RecordAddBodies(
+		const BodyProperties* props,
+		size_t count,
+		ShapeType shapeType,
+		const DirectX::XMFLOAT3& scales,
+		bool isDynamic,
+		const uint64_t* bodyIds,
+		bool allowAngularImpulse,
+		const LinearVelocityBounds& vBounds,
+		const DirectX::XMFLOAT3& constForce);
+
+	void RecordAddCompoundBodies(
+		const CompoundChildDesc* children,
+		size_t childCount,
+		const BodyProperties* props,
+		size_t count,
+		bool isDynamic,
+		const uint64_t* bodyIds,
+		bool allowAngularImpulse,
+		const LinearVelocityBounds& vBounds,
+		const DirectX::XMFLOAT3& constForce);
+
+	// heights and materials are stored in the log
+	void RecordAddHeightfield(
+		const HeightfieldDesc& desc,
+		const BodyProperties& props,
+		uint64_t bodyId);
+
+	// mesh is stored as blob, replay doesn't rebuild its tree
+	void RecordAddMesh(
+		const Shape* shape,
+		const BodyProperties& props,
+		uint64_t bodyId);
+
+	void RecordRemoveBody(
+		uint64_t bodyId);
+
+	void RecordAddForce(
+		uint64_t bodyId,
+		uint8_t forceComponent,
+		const DirectX::XMFLOAT3& force);
+
+	void RecordSetLinearVelocity(
+		uint64_t bodyId,
+		uint8_t velocityComponent,
+		const DirectX::XMFLOAT3& v);
+
+	void RecordAddLinearVelocity(
+		uint64_t bodyId,
+		uint8_t velocityComponent,
+		const DirectX::XMFLOAT3& v);
+
+	void RecordSetCollisionFilter(
+		uint64_t bodyId,
+		const CollisionFilter& filter);
+
+	void RecordSetSensor(
+		uint64_t bodyId,
+		bool isSensor);
+
+	void RecordSetKinematic(
+		uint64_t bodyId,
+		bool isKinematic);
+
+	void RecordSetKinematicTarget(
+		uint64_t bodyId,
+		const DirectX::XMFLOAT3& position,
+		const DirectX::XMFLOAT4& rotation);
+
+	void RecordSetLodObservers(
+		const DirectX::XMFLOAT3* positions,
+		size_t count);
+
+	void RecordSetSimulationLod(
+		const SimulationLodSettings& settings);
+
+	void RecordSetContactMode(
+		ContactMode mode);
+
+	void RecordSetSpeculativeContacts(
+		uint64_t bodyId,
+		bool enabled);
+
+	void RecordSetBodyReorderInterval(
+		uint32_t steps);
+
+	void RecordReorderBodies();
+
+	void RecordUpdateBodies(
+		float dt,
+		uint64_t checksum);
+
+	int64_t Save(
+		const char* path) const;
+
+	int64_t Load(
+		const char* path);
+
+public:
+	std::vector<uint8_t> log;
+};
+
+struct ReplayStep
+{
+	float dt;
+	uint64_t recordedChecksum;
+	uint64_t replayedChecksum;
+	double stepTimeMs;
+};
+
+/*
+	Executes recorded calls on engine, engine is expected to be empty.
+	Every UpdateBodies is timed and its checksum compared with the recorded one.
+	firstDivergedStep is SIZE_MAX when every checksum matched.
+	Returns -1 when log is malformed or holds shape type engine can't create.
+*/
+int64_t ReplayRecording(
+	const PhysicsRecorder& recorder,
+	PhysicsEnigne* engine,
+	std::vector<ReplayStep>* steps,
+	size_t* firstDivergedStep);
@@ -0,0 +1,406 @@
+#include "PhysicsEnigne.h"
+#include <string.h>
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+static size_t AlignOffset(
+	size_t offset)
+{
+	return (offset + 7) & ~(size_t)7;
+}
+
+static bool Float3Equal(
+	const XMFLOAT3& a,
+	const XMFLOAT3& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// zeroed first, padding doesn't break memcmp of states
+static void GetBodyState(
+	const Body& body,
+	BodyState* state)
+{
+	memset(state, 0, sizeof(BodyState));
+	state->position = body.position;
+	state->rotation = body.rotation;
+	state->linVelocity = body.linVelocity;
+	state->angVelocity = body.angVelocity;
+	state->massInv = body.massInv;
+	state->elasticity = body.elasticity;
+	state->friction = body.friction;
+	state->lodPendingTime = body.lodPendingTime;
+	state->vBounds = body.vBounds;
+	state->filter = body.filter;
+	state->lodTier = body.lodTier;
+	state->allowAngularImpulse = body.allowAngularImpulse;
+	state->isSensor = body.isSensor;
+	state->isKinematic = body.isKinematic;
+	state->speculativeContacts = body.speculativeContacts;
+	state->lodSkipped = body.lodSkipped;
+}
+
+static bool BodyMatchesState(
+	const Body& body,
+	const BodyState& state,
+	const Shape& shape)
+{
+	BodyState bodyState;
+	GetBodyState(body, &bodyState);
+	return body.shape.shapeData == shape.shapeData && memcmp(&bodyState, &state, sizeof(BodyState)) == 0;
+}
+
+// inertia and center of mass are recomputed only when shape or mass differ from what body had
+static void ApplyBodyState(
+	const BodyState& state,
+	const Shape& shape,
+	Body* body)
+{
+	bool keepsConstants = body->shape.shapeData == shape.shapeData && body->massInv == state.massInv;
+	body->position = state.position;
+	body->rotation = state.rotation;
+	body->linVelocity = state.linVelocity;
+	body->angVelocity = state.angVelocity;
+	body->massInv = state.massInv;
+	body->elasticity = state.elasticity;
+	body->friction = state.friction;
+	body->lodPendingTime = state.lodPendingTime;
+	body->vBounds = state.vBounds;
+	body->filter = state.filter;
+	body->lodTier = state.lodTier;
+	body->allowAngularImpulse = state.allowAngularImpulse;
+	body->isSensor = state.isSensor;
+	body->isKinematic = state.isKinematic;
+	body->speculativeContacts = state.speculativeContacts;
+	body->lodSkipped = state.lodSkipped;
+	body->shape = shape;
+	if (keepsConstants)
+	{
+		body->UpdateCachedTransforms();
+	}
+	else
+	{
+		body->InitCachedProperties();
+	}
+}
+
+// freeShapeData clears pointer of the shape passed in, copy keeps body intact
+static void ReleaseShapeReference(
+	Shape shape)
+{
+	shape.freeShapeData(&shape);
+}
+
+struct SnapshotView
+{
+	const SnapshotHeader* header;
+	const Shape* shapes;
+	const DynamicBodyRecord* dynamicRecords;
+	const StaticBodyRecord* staticRecords;
+	const BodySlot* dynamicSlots;
+	const uint32_t* dynamicDenseToSlot;
+	const uint32_t* dynamicFreeSlots;
+	const BodySlot* staticSlots;
+	const uint32_t* staticDenseToSlot;
+	const uint32_t* staticFreeSlots;
+	const CollisionPair* sensorOverlaps;
+};
+
+// offsets of all parts of the blob, returns total size
+static size_t GetSnapshotLayout(
+	const SnapshotHeader& header,
+	size_t offsets[11])
+{
+	size_t offset = 0;
+	offsets[0] = offset; offset = AlignOffset(offset + sizeof(SnapshotHeader));
+	offsets[1] = offset; offset = AlignOffset(offset + header.shapeCount * sizeof(Shape));
+	offsets[2] = offset; offset = AlignOffset(offset + header.dynamicRecordCount * sizeof(DynamicBodyRecord));
+	offsets[3] = offset; offset = AlignOffset(offset + header.staticRecordCount * sizeof(StaticBodyRecord));
+	offsets[4] = offset; offset = AlignOffset(offset + header.dynamicSlotCount * sizeof(BodySlot));
+	offsets[5] = offset; offset = AlignOffset(offset + header.dynamicCount * sizeof(uint32_t));
+	offsets[6] = offset; offset = AlignOffset(offset + header.dynamicFreeCount * sizeof(uint32_t));
+	offsets[7] = offset; offset = AlignOffset(offset + header.staticSlotCount * sizeof(BodySlot));
+	offsets[8] = offset; offset = AlignOffset(offset + header.staticCount * sizeof(uint32_t));
+	offsets[9] = offset; offset = AlignOffset(offset + header.staticFreeCount * sizeof(uint32_t));
+	offsets[10] = offset; offset = AlignOffset(offset + header.sensorOverlapCount * sizeof(CollisionPair));
+	return offset;
+}
+
+static int64_t GetSnapshotView(
+	const PhysicsSnapshot& snapshot,
+	SnapshotView* view)
+{
+	if (snapshot.data.size() < sizeof(SnapshotHeader))
+	{
+		return -1;
+	}
+
+	const uint8_t* data = snapshot.data.data();
+	const SnapshotHeader* header = (const SnapshotHeader*)data;
+	size_t offsets[11];
+	if (header->magic != SNAPSHOT_MAGIC || GetSnapshotLayout(*header, offsets) != snapshot.data.size())
+	{
+		return -1;
+	}
+
+	view->header = header;
+	view->shapes = (const Shape*)(data + offsets[1]);
+	view->dynamicRecords = (const DynamicBodyRecord*)(data + offsets[2]);
+	view->staticRecords = (const StaticBodyRecord*)(data + offsets[3]);
+	view->dynamicSlots = (const BodySlot*)(data + offsets[4]);
+	view->dynamicDenseToSlot = (const uint32_t*)(data + offsets[5]);
+	view->dynamicFreeSlots = (const uint32_t*)(data + offsets[6]);
+	view->staticSlots = (const BodySlot*)(data + offsets[7]);
+	view->staticDenseToSlot = (const uint32_t*)(data + offsets[8]);
+	view->staticFreeSlots = (const uint32_t*)(data + offsets[9]);
+	view->sensorOverlaps = (const CollisionPair*)(data + offsets[10]);
+	return 0;
+}
+
+static void RestoreHandleTable(
+	BodyHandleTable* table,
+	const BodySlot* slots,
+	size_t slotCount,
+	const uint32_t* denseToSlot,
+	size_t denseCount,
+	const uint32_t* freeSlots,
+	size_t freeCount)
+{
+	table->slots.assign(slots, slots + slotCount);
+	table->denseToSlot.assign(denseToSlot, denseToSlot + denseCount);
+	table->freeSlots.assign(freeSlots, freeSlots + freeCount);
+}
+
+int64_t PhysicsEnigne::Snapshot(
+	PhysicsSnapshot* snapshot,
+	const PhysicsSnapshot* base)
+{
+	SnapshotView baseView = {};
+	if (base == snapshot)
+	{
+		return -1;
+	}
+	if (base && (GetSnapshotView(*base, &baseView) != 0 || (baseView.header->flags & SNAPSHOT_DELTA) > 0))
+	{
+		return -1;
+	}
+
+	SnapshotHeader header = {};
+	header.magic = SNAPSHOT_MAGIC;
+	header.flags = base ? SNAPSHOT_DELTA : 0;
+	header.id = ++snapshotCounter;
+	header.baseId = base ? baseView.header->id : 0;
+	header.dynamicCount = (uint32_t)dynamicBodies.size();
+	header.staticCount = (uint32_t)staticBodies.size();
+	header.dynamicSlotCount = (uint32_t)dynamicHandles.slots.size();
+	header.dynamicFreeCount = (uint32_t)dynamicHandles.freeSlots.size();
+	header.staticSlotCount = (uint32_t)staticHandles.slots.size();
+	header.staticFreeCount = (uint32_t)staticHandles.freeSlots.size();
+	header.sensorOverlapCount = (uint32_t)sensorOverlaps.size();
+	header.lodStepCounter = lodStepCounter;
+	header.stepsSinceReorder = stepsSinceReorder;
+
+	// record per body that is missing in base or differs from it
+	auto dynamicChanged = [&](size_t i)
+	{
+		if (!base || i >= baseView.header->dynamicCount)
+		{
+			return true;
+		}
+		const DynamicBodyRecord& record = baseView.dynamicRecords[i];
+		return !BodyMatchesState(dynamicBodies[i], record.state, baseView.shapes[record.shapeIdx]) ||
+			!Float3Equal(record.constForce, constForces[i]) ||
+			!Float3Equal(record.dynamicForce, dynamicForces[i]);
+	};
+	auto staticChanged = [&](size_t i)
+	{
+		if (!base || i >= baseView.header->staticCount)
+		{
+			return true;
+		}
+		const StaticBodyRecord& record = baseView.staticRecords[i];
+		return !BodyMatchesState(staticBodies[i], record.state, baseView.shapes[record.shapeIdx]);
+	};
+	// every distinct shape of recorded bodies is stored once
+	snapshotShapes.clear();
+	snapshotShapeIndices.clear();
+	auto addShape = [&](const Shape& shape)
+	{
+		auto inserted = snapshotShapeIndices.emplace(shape.shapeData, (uint32_t)snapshotShapes.size());
+		if (inserted.second)
+		{
+			snapshotShapes.push_back(shape);
+		}
+		return inserted.first->second;
+	};
+
+	for (size_t i = 0; i < dynamicBodies.size(); i++)
+	{
+		if (dynamicChanged(i))
+		{
+			header.dynamicRecordCount++;
+			addShape(dynamicBodies[i].shape);
+		}
+	}
+	for (size_t i = 0; i < staticBodies.size(); i++)
+	{
+		if (staticChanged(i))
+		{
+			header.staticRecordCount++;
+			addShape(staticBodies[i].shape);
+		}
+	}
+	header.shapeCount = (uint32_t)snapshotShapes.size();
+
+	// previous content of snapshot may share shapes with current bodies, new references are taken first
+	for (Shape& shape : snapshotShapes)
+	{
+		shape.addShapeReference(&shape);
+	}
+	ReleaseSnapshot(snapshot);
+
+	size_t offsets[11];
+	snapshot->data.resize(GetSnapshotLayout(header, offsets));
+	uint8_t* data = snapshot->data.data();
+	memcpy(data, &header, sizeof(SnapshotHeader));
+	memcpy(data + offsets[1], snapshotShapes.data(), header.shapeCount * sizeof(Shape));
+
+	DynamicBodyRecord* dynamicRecord = (DynamicBodyRecord*)(data + offsets[2]);
+	for (size_t i = 0; i < dynamicBodies.size(); i++)
+	{
+		if (dynamicChanged(i))
+		{
+			dynamicRecord->bodyIdx = (uint32_t)i;
+			dynamicRecord->shapeIdx = addShape(dynamicBodies[i].shape);
+			GetBodyState(dynamicBodies[i], &dynamicRecord->state);
+			dynamicRecord->constForce = constForces[i];
+			dynamicRecord->dynamicForce = dynamicForces[i];
+			dynamicRecord++;
+		}
+	}
+
+	StaticBodyRecord* staticRecord = (StaticBodyRecord*)(data + offsets[3]);
+	for (size_t i = 0; i < staticBodies.size(); i++)
+	{
+		if (staticChanged(i))
+		{
+			staticRecord->bodyIdx = (uint32_t)i;
+			staticRecord->shapeIdx = addShape(staticBodies[i].shape);
+			GetBodyState(staticBodies[i], &staticRecord->state);
+			staticRecord++;
+		}
+	}
+
+	memcpy(data + offsets[4], dynamicHandles.slots.data(), header.dynamicSlotCount * sizeof(BodySlot));
+	memcpy(data + offsets[5], dynamicHandles.denseToSlot.data(), header.dynamicCount * sizeof(uint32_t));
+	memcpy(data + offsets[6], dynamicHandles.freeSlots.data(), header.dynamicFreeCount * sizeof(uint32_t));
+	memcpy(data + offsets[7], staticHandles.slots.data(), header.staticSlotCount * sizeof(BodySlot));
+	memcpy(data + offsets[8], staticHandles.denseToSlot.data(), header.staticCount * sizeof(uint32_t));
+	memcpy(data + offsets[9], staticHandles.freeSlots.data(), header.staticFreeCount * sizeof(uint32_t));
+	memcpy(data + offsets[10], sensorOverlaps.data(), header.sensorOverlapCount * sizeof(CollisionPair));
+	return 0;
+}
+
+int64_t PhysicsEnigne::Restore(
+	const PhysicsSnapshot& snapshot,
+	const PhysicsSnapshot* base)
+{
+	SnapshotView view;
+	if (recorder || GetSnapshotView(snapshot, &view) != 0)
+	{
+		return -1;
+	}
+
+	const SnapshotHeader& header = *view.header;
+	SnapshotView baseView = {};
+	if ((header.flags & SNAPSHOT_DELTA) > 0)
+	{
+		if (!base || GetSnapshotView(*base, &baseView) != 0 || baseView.header->id != header.baseId)
+		{
+			return -1;
+		}
+	}
+
+	// every restored body takes its own reference, references of replaced bodies are dropped after
+	auto addReference = [](Body& body) { body.shape.addShapeReference(&body.shape); };
+	auto freeReference = [](Body& body) { ReleaseShapeReference(body.shape); };
+	for_each(dynamicBodies.begin(), dynamicBodies.end(), freeReference);
+	for_each(staticBodies.begin(), staticBodies.end(), freeReference);
+
+	// storage only grows, restoring world of the same or smaller size doesn't allocate
+	lodStepCounter = header.lodStepCounter;
+	stepsSinceReorder = header.stepsSinceReorder;
+	dynamicBodies.resize(header.dynamicCount);
+	constForces.resize(header.dynamicCount);
+	dynamicForces.resize(header.dynamicCount);
+	staticBodies.resize(header.staticCount);
+
+	auto restoreDynamic = [&](const SnapshotView& from, const DynamicBodyRecord& record)
+	{
+		ApplyBodyState(record.state, from.shapes[record.shapeIdx], &dynamicBodies[record.bodyIdx]);
+		constForces[record.bodyIdx] = record.constForce;
+		dynamicForces[record.bodyIdx] = record.dynamicForce;
+	};
+	auto restoreStatic = [&](const SnapshotView& from, const StaticBodyRecord& record)
+	{
+		ApplyBodyState(record.state, from.shapes[record.shapeIdx], &staticBodies[record.bodyIdx]);
+	};
+
+	if (baseView.header)
+	{
+		for (size_t i = 0; i < min(header.dynamicCount, baseView.header->dynamicCount); i++)
+		{
+			restoreDynamic(baseView, baseView.dynamicRecords[i]);
+		}
+		for (size_t i = 0; i < min(header.staticCount, baseView.header->staticCount); i++)
+		{
+			restoreStatic(baseView, baseView.staticRecords[i]);
+		}
+	}
+
+	for (size_t i = 0; i < header.dynamicRecordCount; i++)
+	{
+		restoreDynamic(view, view.dynamicRecords[i]);
+	}
+	for (size_t i = 0; i < header.staticRecordCount; i++)
+	{
+		restoreStatic(view, view.staticRecords[i]);
+	}
+	for_each(dynamicBodies.begin(), dynamicBodies.end(), addReference);
+	for_each(staticBodies.begin(), staticBodies.end(), addReference);
+
+	RestoreHandleTable(&dynamicHandles, view.dynamicSlots, header.dynamicSlotCount,
+		view.dynamicDenseToSlot, header.dynamicCount, view.dynamicFreeSlots, header.dynamicFreeCount);
+	RestoreHandleTable(&staticHandles, view.staticSlots, header.staticSlotCount,
+		view.staticDenseToSlot, header.staticCount, view.staticFreeSlots, header.staticFreeCount);
+	sensorOverlaps.assign(view.sensorOverlaps, view.sensorOverlaps + header.sensorOverlapCount);
+	// targets were set for the world that is replaced
+	kinematicTargets.clear();
+	staticTreeDirty = true;
+	dynamicTreeDirty = true;
+
+	size_t bodyCount = dynamicBodies.size() + staticBodies.size();
+	if (sortedBodies.size() < bodyCount * 2)
+	{
+		sortedBodies.resize(bodyCount * 2);
+	}
+	return 0;
+}
+
+void PhysicsEnigne::ReleaseSnapshot(
+	PhysicsSnapshot* snapshot)
+{
+	SnapshotView view;
+	if (GetSnapshotView(*snapshot, &view) != 0)
+	{
+		snapshot->data.clear();
+		return;
+	}
+
+	for (size_t i = 0; i < view.header->shapeCount; i++)
+	{
+		ReleaseShapeReference(view.shapes[i]);
+	}
+	snapshot->data.clear();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <inttypes.h>
+#include "Body.hpp"
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x4E534850; // "PHSN"
+constexpr uint32_t SNAPSHOT_DELTA = 0x01;
+
+/*
+	Blob layout, every part is 8 byte aligned:
+		SnapshotHeader
+		Shape[shapeCount]
+		DynamicBodyRecord[dynamicRecordCount]
+		StaticBodyRecord[staticRecordCount]
+		BodySlot[dynamicSlotCount], uint32_t[dynamicCount], uint32_t[dynamicFreeCount]
+		BodySlot[staticSlotCount], uint32_t[staticCount], uint32_t[staticFreeCount]
+		CollisionPair[sensorOverlapCount]
+	Full snapshot has record for every body, delta only for bodies that differ from its base.
+	Sensor overlaps are stored whole in both, so events after Restore continue from the snapshot.
+	Records keep BodyState only, cached transforms and inertia are rebuilt by Restore. Shapes used
+	by records are stored once with their function pointers and shared geometry, blob is valid only
+	inside the process that created it.
+*/
+struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t flags;
+	uint64_t id;
+	uint64_t baseId; // id of full snapshot delta was taken against
+	uint32_t dynamicCount;
+	uint32_t staticCount;
+	uint32_t dynamicRecordCount;
+	uint32_t staticRecordCount;
+	uint32_t dynamicSlotCount;
+	uint32_t dynamicFreeCount;
+	uint32_t staticSlotCount;
+	uint32_t staticFreeCount;
+	uint32_t sensorOverlapCount;
+	uint32_t shapeCount;
+	uint64_t lodStepCounter; // keeps simulation LOD schedule of restored world
+	uint32_t stepsSinceReorder; // keeps body reorder schedule of restored world
+};
+
+// every field of Body that isn't derived from shape, massInv and rotation
+struct BodyState
+{
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;
+	DirectX::XMFLOAT3 linVelocity;
+	DirectX::XMFLOAT3 angVelocity;
+	float massInv;
+	float elasticity;
+	float friction;
+	float lodPendingTime;
+	LinearVelocityBounds vBounds;
+	CollisionFilter filter;
+	uint8_t lodTier;
+	bool allowAngularImpulse;
+	bool isSensor;
+	bool isKinematic;
+	bool speculativeContacts;
+	bool lodSkipped;
+};
+
+struct DynamicBodyRecord
+{
+	uint32_t bodyIdx;
+	uint32_t shapeIdx; // into shapes of the same blob
+	BodyState state;
+	DirectX::XMFLOAT3 constForce;
+	DirectX::XMFLOAT3 dynamicForce;
+};
+
+struct StaticBodyRecord
+{
+	uint32_t bodyIdx;
+	uint32_t shapeIdx;
+	BodyState state;
+};
+
+/*
+	Snapshot holds one reference to shape data of every stored shape,
+	references are dropped by PhysicsEnigne::ReleaseSnapshot.
+*/
+struct PhysicsSnapshot
+{
+	std::vector<uint8_t> data;
+};
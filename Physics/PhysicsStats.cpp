@@ -0,0 +1,18 @@
+#include "PhysicsStats.hpp"
+
+void IntersectionStats::Add(
+	const IntersectionStats& other)
+{
+	for (size_t i = 0; i < GJK_HISTOGRAM_BUCKETS; i++)
+	{
+		gjkIterations[i] += other.gjkIterations[i];
+	}
+	for (size_t i = 0; i < EPA_HISTOGRAM_BUCKETS; i++)
+	{
+		epaIterations[i] += other.epaIterations[i];
+	}
+	gjkMaxIterationHits += other.gjkMaxIterationHits;
+	substeps += other.substeps;
+	triangleTests += other.triangleTests;
+	speculativeContacts += other.speculativeContacts;
+}
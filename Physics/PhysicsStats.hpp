@@ -0,0 +1,51 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+
+constexpr size_t GJK_HISTOGRAM_BUCKETS = 11; // GJK stops after 10 iterations
+constexpr size_t EPA_HISTOGRAM_BUCKETS = 32; // last bucket counts everything above
+
+// counters of CheckIntersection, histograms are indexed by iteration count
+struct IntersectionStats
+{
+	uint64_t gjkIterations[GJK_HISTOGRAM_BUCKETS];
+	uint64_t gjkMaxIterationHits;
+	uint64_t epaIterations[EPA_HISTOGRAM_BUCKETS];
+	uint64_t substeps;
+	uint64_t triangleTests; // triangles of concave shapes tested against convex bodies
+	uint64_t speculativeContacts; // contacts of bodies that didn't touch yet
+
+	void Add(
+		const IntersectionStats& other);
+};
+
+enum class PhysicsPhase : uint8_t
+{
+	BroadPhase,
+	NarrowPhase,
+	Sort,
+	Resolve,
+	Integrate,
+	Count
+};
+
+/*
+	Statistics of the last UpdateBodies call.
+	Phase times are summed over all threads, phases that overlap can add up to more than stepMs.
+	Bodies never sleep yet, every dynamic body is counted as awake.
+*/
+struct PhysicsStats
+{
+	double phaseMs[(size_t)PhysicsPhase::Count];
+	double stepMs;
+	uint64_t candidatePairs;
+	uint64_t contacts;
+	uint64_t islands;
+	uint64_t awakeBodies;
+	uint64_t lodSkippedBodies; // dynamic bodies not stepped because of simulation LOD
+	uint64_t reorderedBodies; // dynamic bodies moved by periodic Morton code reorder
+	uint64_t sensorPairs;
+	uint64_t sensorEvents;
+	uint64_t droppedSensorEvents; // events that didn't fit into sensor event buffer
+	IntersectionStats intersection;
+};
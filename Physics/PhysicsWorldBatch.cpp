@@ -0,0 +1,75 @@
+#include "PhysicsWorldBatch.hpp"
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+PhysicsWorldBatch::PhysicsWorldBatch(
+	JobSystem* jobSystem,
+	size_t worldsPerGroup) :
+	worldsPerGroup(max<size_t>(worldsPerGroup, 1)),
+	jobSystem(jobSystem)
+{
+	if (!this->jobSystem)
+	{
+		ownedJobSystem = make_unique<JobSystem>(max(thread::hardware_concurrency(), 1u) - 1);
+		this->jobSystem = ownedJobSystem.get();
+	}
+}
+
+size_t PhysicsWorldBatch::AddWorld(
+	size_t expectedDynamicBodies,
+	size_t expectedStaticBodies)
+{
+	// worlds never run their own job graphs in the batch, batch job system is only passed
+	// so engine doesn't start its own threads
+	worlds.push_back(make_unique<PhysicsEnigne>(expectedDynamicBodies, expectedStaticBodies, jobSystem));
+	worlds.back()->shapeCache = &shapeCache;
+	return worlds.size() - 1;
+}
+
+PhysicsEnigne* PhysicsWorldBatch::GetWorld(
+	size_t worldIdx)
+{
+	return worldIdx < worlds.size() ? worlds[worldIdx].get() : nullptr;
+}
+
+size_t PhysicsWorldBatch::GetWorldCount() const
+{
+	return worlds.size();
+}
+
+void PhysicsWorldBatch::UpdateWorlds(
+	float dt)
+{
+	stepGraph.Clear();
+	stepGraph.AddTask([this, dt](size_t begin, size_t end)
+		{
+			for (size_t group = begin; group < end; group++)
+			{
+				StepGroup(group, dt);
+			}
+		}, (worlds.size() + worldsPerGroup - 1) / worldsPerGroup, 1);
+	jobSystem->Run(stepGraph);
+}
+
+void PhysicsWorldBatch::StepGroup(
+	size_t groupIdx,
+	float dt)
+{
+	size_t firstWorld = groupIdx * worldsPerGroup;
+	size_t lastWorld = min(firstWorld + worldsPerGroup, worlds.size());
+	for (size_t w = firstWorld; w < lastWorld; w++)
+	{
+		worlds[w]->StepSerial(dt);
+	}
+}
+
+size_t PhysicsWorldBatch::GetMemoryUsage() const
+{
+	size_t bytes = worlds.capacity() * sizeof(unique_ptr<PhysicsEnigne>);
+	for (const unique_ptr<PhysicsEnigne>& world : worlds)
+	{
+		bytes += sizeof(PhysicsEnigne) + world->GetMemoryUsage();
+	}
+	return bytes;
+}
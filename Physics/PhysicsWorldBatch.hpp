@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "PhysicsEnigne.h"
+
+/*
+	Many small independent worlds stepped by one call.
+	Worlds share immutable shape data through shapeCache. Consecutive worlds form groups,
+	every group is one job stepping its worlds one after another with StepSerial,
+	so small worlds don't pay for scheduling of their own task graphs.
+	Adding and removing bodies is not thread safe and must not overlap UpdateWorlds.
+*/
+struct PhysicsWorldBatch
+{
+	/*
+		Groups run on jobSystem, batch creates its own
+		with one worker per hardware thread when nullptr is passed.
+	*/
+	PhysicsWorldBatch(
+		JobSystem* jobSystem = nullptr,
+		size_t worldsPerGroup = 16);
+
+	// returns index of the new world, indices stay valid for lifetime of the batch
+	size_t AddWorld(
+		size_t expectedDynamicBodies = 16,
+		size_t expectedStaticBodies = 16);
+
+	PhysicsEnigne* GetWorld(
+		size_t worldIdx);
+
+	size_t GetWorldCount() const;
+
+	// steps every world by dt, worlds must not be stepped by UpdateBodies at the same time
+	void UpdateWorlds(
+		float dt);
+
+	// bytes reserved by worlds, shape data is not included
+	size_t GetMemoryUsage() const;
+
+	void StepGroup(
+		size_t groupIdx,
+		float dt);
+
+public:
+	ShapeCache shapeCache;
+	std::vector<std::unique_ptr<PhysicsEnigne>> worlds;
+	size_t worldsPerGroup;
+	JobSystem* jobSystem;
+	std::unique_ptr<JobSystem> ownedJobSystem;
+	TaskGraph stepGraph;
+};
@@ -0,0 +1,176 @@
+#include "RayPacket.hpp"
+#include "Shapes/ShapeRaycast.hpp"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+using namespace DirectX;
+
+constexpr size_t TRAVERSAL_STACK_SIZE = 64; // tree is built by median splits, depth is log2 of item count
+
+void InitRayPacket(
+	RayPacket* packet,
+	const RayQuery* rays,
+	size_t count)
+{
+	packet->activeMask = 0;
+	XMVECTOR direction = XMVectorZero();
+	for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+	{
+		if (lane >= count)
+		{
+			// behind its origin everything is out of reach
+			packet->originX[lane] = packet->originY[lane] = packet->originZ[lane] = 0.0f;
+			packet->invDirX[lane] = packet->invDirY[lane] = packet->invDirZ[lane] = 1.0f;
+			packet->maxDistance[lane] = -1.0f;
+			continue;
+		}
+
+		const RayQuery& ray = rays[lane];
+		XMFLOAT3 invDir;
+		XMStoreFloat3(&invDir, GetRayInvDirection(ray.direction));
+		packet->originX[lane] = ray.origin.x;
+		packet->originY[lane] = ray.origin.y;
+		packet->originZ[lane] = ray.origin.z;
+		packet->invDirX[lane] = invDir.x;
+		packet->invDirY[lane] = invDir.y;
+		packet->invDirZ[lane] = invDir.z;
+		packet->maxDistance[lane] = ray.maxDistance;
+		packet->activeMask |= 1u << lane;
+		direction += XMLoadFloat3(&ray.direction);
+	}
+	XMStoreFloat3(&packet->direction, direction);
+}
+
+#if defined(__AVX__)
+uint32_t RayPacketHitsBox(
+	const RayPacket& packet,
+	const BoundingBox& box)
+{
+	__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.minC.x), _mm256_load_ps(packet.originX)), _mm256_load_ps(packet.invDirX));
+	__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.maxC.x), _mm256_load_ps(packet.originX)), _mm256_load_ps(packet.invDirX));
+	__m256 enter = _mm256_max_ps(_mm256_min_ps(t0, t1), _mm256_setzero_ps());
+	__m256 exit = _mm256_min_ps(_mm256_max_ps(t0, t1), _mm256_load_ps(packet.maxDistance));
+
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.minC.y), _mm256_load_ps(packet.originY)), _mm256_load_ps(packet.invDirY));
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.maxC.y), _mm256_load_ps(packet.originY)), _mm256_load_ps(packet.invDirY));
+	enter = _mm256_max_ps(enter, _mm256_min_ps(t0, t1));
+	exit = _mm256_min_ps(exit, _mm256_max_ps(t0, t1));
+
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.minC.z), _mm256_load_ps(packet.originZ)), _mm256_load_ps(packet.invDirZ));
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.maxC.z), _mm256_load_ps(packet.originZ)), _mm256_load_ps(packet.invDirZ));
+	enter = _mm256_max_ps(enter, _mm256_min_ps(t0, t1));
+	exit = _mm256_min_ps(exit, _mm256_max_ps(t0, t1));
+
+	return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ)) & packet.activeMask;
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+// lanes [first, first + 4) of packet
+static uint32_t RayPacketHalfHitsBox(
+	const RayPacket& packet,
+	const BoundingBox& box,
+	size_t first)
+{
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.minC.x), _mm_load_ps(packet.originX + first)), _mm_load_ps(packet.invDirX + first));
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.maxC.x), _mm_load_ps(packet.originX + first)), _mm_load_ps(packet.invDirX + first));
+	__m128 enter = _mm_max_ps(_mm_min_ps(t0, t1), _mm_setzero_ps());
+	__m128 exit = _mm_min_ps(_mm_max_ps(t0, t1), _mm_load_ps(packet.maxDistance + first));
+
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.minC.y), _mm_load_ps(packet.originY + first)), _mm_load_ps(packet.invDirY + first));
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.maxC.y), _mm_load_ps(packet.originY + first)), _mm_load_ps(packet.invDirY + first));
+	enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+	exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.minC.z), _mm_load_ps(packet.originZ + first)), _mm_load_ps(packet.invDirZ + first));
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.maxC.z), _mm_load_ps(packet.originZ + first)), _mm_load_ps(packet.invDirZ + first));
+	enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+	exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(enter, exit));
+}
+
+uint32_t RayPacketHitsBox(
+	const RayPacket& packet,
+	const BoundingBox& box)
+{
+	return (RayPacketHalfHitsBox(packet, box, 0) | RayPacketHalfHitsBox(packet, box, 4) << 4) & packet.activeMask;
+}
+#else
+uint32_t RayPacketHitsBox(
+	const RayPacket& packet,
+	const BoundingBox& box)
+{
+	uint32_t lanes = 0;
+	for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+	{
+		if ((packet.activeMask & (1u << lane)) == 0)
+		{
+			continue;
+		}
+		XMVECTOR origin = XMVectorSet(packet.originX[lane], packet.originY[lane], packet.originZ[lane], 0);
+		XMVECTOR invDir = XMVectorSet(packet.invDirX[lane], packet.invDirY[lane], packet.invDirZ[lane], 0);
+		if (RayHitsBox(origin, invDir, XMLoadFloat3(&box.minC), XMLoadFloat3(&box.maxC), packet.maxDistance[lane]))
+		{
+			lanes |= 1u << lane;
+		}
+	}
+	return lanes;
+}
+#endif
+
+static float CenterAlong(
+	const BoundingBox& box,
+	const XMFLOAT3& direction)
+{
+	return (box.minC.x + box.maxC.x) * direction.x + (box.minC.y + box.maxC.y) * direction.y + (box.minC.z + box.maxC.z) * direction.z;
+}
+
+void TraverseRayPacket(
+	const AabbTree& tree,
+	RayPacket* packet,
+	RayPacketVisitor visit,
+	void* context)
+{
+	if (tree.nodes.empty() || RayPacketHitsBox(*packet, tree.nodes[0].box) == 0)
+	{
+		return;
+	}
+
+	// nodes on stack were hit when pushed, missed children never get there
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0 && packet->activeMask != 0)
+	{
+		const AabbTreeNode& node = tree.nodes[stack[--stackSize]];
+		if (node.count == 0)
+		{
+			const BoundingBox& firstBox = tree.nodes[node.first].box;
+			const BoundingBox& secondBox = tree.nodes[node.first + 1].box;
+			bool hitsFirst = RayPacketHitsBox(*packet, firstBox) != 0;
+			bool hitsSecond = RayPacketHitsBox(*packet, secondBox) != 0;
+			if (hitsFirst && hitsSecond)
+			{
+				// nearer child goes last so it is popped first
+				bool firstIsNearer = CenterAlong(firstBox, packet->direction) <= CenterAlong(secondBox, packet->direction);
+				stack[stackSize++] = firstIsNearer ? node.first + 1 : node.first;
+				stack[stackSize++] = firstIsNearer ? node.first : node.first + 1;
+			}
+			else if (hitsFirst || hitsSecond)
+			{
+				stack[stackSize++] = hitsFirst ? node.first : node.first + 1;
+			}
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t lanes = RayPacketHitsBox(*packet, tree.itemBoxes[i]);
+			if (lanes != 0)
+			{
+				visit(context, tree.items[i], lanes, packet);
+			}
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include <DirectXMath.h>
+#include "AabbTree.hpp"
+
+constexpr size_t RAY_PACKET_SIZE = 8;
+
+struct RayQuery
+{
+	DirectX::XMFLOAT3 origin;
+	DirectX::XMFLOAT3 direction; // unit length
+	float maxDistance;
+};
+
+struct RayHit
+{
+	uint64_t bodyId;
+	float distance;
+	DirectX::XMFLOAT3 point;
+	DirectX::XMFLOAT3 normal;
+	bool hit; // other members are valid only when set
+};
+
+enum class RayQueryMode : uint8_t
+{
+	Closest,
+	AnyHit // ray stops at the first hit found, e.g. line of sight
+};
+
+/*
+	Up to RAY_PACKET_SIZE rays stored as structure of arrays, one box is tested
+	against every lane at once. Unused lanes never hit anything.
+*/
+struct alignas(32) RayPacket
+{
+	float originX[RAY_PACKET_SIZE];
+	float originY[RAY_PACKET_SIZE];
+	float originZ[RAY_PACKET_SIZE];
+	float invDirX[RAY_PACKET_SIZE];
+	float invDirY[RAY_PACKET_SIZE];
+	float invDirZ[RAY_PACKET_SIZE];
+	float maxDistance[RAY_PACKET_SIZE]; // lowered to distance of nearest hit found so far
+	DirectX::XMFLOAT3 direction; // sum of directions, orders children front to back
+	uint32_t activeMask; // lanes still traversed, bit i is lane i
+};
+
+void InitRayPacket(
+	RayPacket* packet,
+	const RayQuery* rays,
+	size_t count);
+
+// active lanes whose ray enters box before its maxDistance
+uint32_t RayPacketHitsBox(
+	const RayPacket& packet,
+	const BoundingBox& box);
+
+// lanes are those hitting box of item, visitor may lower maxDistance or clear lanes of activeMask
+typedef void(*RayPacketVisitor)(
+	void* context,
+	uint32_t item,
+	uint32_t lanes,
+	RayPacket* packet);
+
+/*
+	Visits items of tree, as passed to AabbTree::Build, whose box is hit by some active lane.
+	Nearer child is visited first, traversal stops once no lane is active.
+*/
+void TraverseRayPacket(
+	const AabbTree& tree,
+	RayPacket* packet,
+	RayPacketVisitor visit,
+	void* context);
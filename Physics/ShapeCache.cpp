@@ -0,0 +1,57 @@
+#include "ShapeCache.hpp"
+#include "Shapes/ShapeBox.hpp"
+#include "Shapes/ShapeCapsule.hpp"
+#include <stdlib.h>
+using namespace std;
+using namespace DirectX;
+
+ShapeCache::~ShapeCache()
+{
+	Clear();
+}
+
+Shape ShapeCache::Acquire(
+	ShapeType type,
+	const DirectX::XMFLOAT3& scales)
+{
+	for (ShapeCacheEntry& entry : entries)
+	{
+		if (entry.type == type && entry.scales.x == scales.x &&
+			entry.scales.y == scales.y && entry.scales.z == scales.z)
+		{
+			entry.shape.addShapeReference(&entry.shape);
+			return entry.shape;
+		}
+	}
+
+	ShapeCacheEntry entry;
+	entry.type = type;
+	entry.scales = scales;
+	switch (type)
+	{
+	case ShapeType::OrientedBox:
+		entry.shape = GetDefaultBoxShape(scales);
+		break;
+	case ShapeType::Capsule:
+		entry.shape = GetDefaultCapsuleShape(scales);
+		break;
+	default:
+		exit(-1);
+		break;
+	};
+
+	entries.push_back(entry);
+	entry.shape.addShapeReference(&entry.shape);
+	return entry.shape;
+}
+
+void ShapeCache::Clear()
+{
+	for (ShapeCacheEntry& entry : entries)
+	{
+		// free through a copy, it resets shapeData of the shape it gets
+		Shape shape = entry.shape;
+		shape.freeShapeData(&shape);
+	}
+	entries.clear();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "Body.hpp"
+
+struct ShapeCacheEntry
+{
+	ShapeType type;
+	DirectX::XMFLOAT3 scales;
+	Shape shape;
+};
+
+/*
+	Immutable shape data shared by every engine that points to the cache,
+	cache keeps one reference per entry. Entries are searched linearly,
+	worlds are expected to use only a handful of distinct shapes.
+	Not thread safe, bodies of engines sharing the cache must be added from one thread.
+*/
+struct ShapeCache
+{
+	~ShapeCache();
+
+	// returns shape with one reference added for the caller
+	Shape Acquire(
+		ShapeType type,
+		const DirectX::XMFLOAT3& scales);
+
+	// drops references of the cache, shapes used by bodies stay alive
+	void Clear();
+
+public:
+	std::vector<ShapeCacheEntry> entries;
+};
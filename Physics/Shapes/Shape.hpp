@@ -2,9 +2,26 @@
 #include <DirectXMath.h>
 #include "../BoundingBox.hpp"
 #include <inttypes.h>
+#include <vector>
 
 struct Shape;
 
+// triangle of concave shape in world space
+struct WorldTriangle
+{
+	DirectX::XMFLOAT3 vertices[3];
+	DirectX::XMFLOAT3 normal; // unit, points out of the shape
+	uint8_t material;
+};
+
+// convex child of compound shape, pose is relative to position and rotation of the owning body
+struct ShapeChild
+{
+	const Shape* shape;
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT4 rotation;
+};
+
 typedef int64_t(*GetTrasformationMatrix)(
 	char* shapeData,
 	DirectX::XMFLOAT4X4* destMat);
@@ -48,6 +65,50 @@ typedef void(*GetFaceNormalFromPoint)(
 	const DirectX::XMFLOAT3* pointOnShape,
 	DirectX::XMFLOAT3* normal);
 
+// shape data can be shared between bodies, data is released when last reference is freed
+typedef void(*FreeShapeData)(
+	Shape* shape);
+
+typedef void(*AddShapeReference)(
+	Shape* shape);
+
+/*
+	Appends triangles of concave shape whose bounds overlap box given in world space.
+	Concave shapes collide triangle by triangle, convex shapes leave this nullptr.
+*/
+typedef void(*CollectTriangles)(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const BoundingBox* box,
+	std::vector<WorldTriangle>* triangles);
+
+/*
+	Appends children of compound shape whose bounds overlap box given in world space.
+	Narrow phase tests every child as separate convex body, other shapes leave this nullptr.
+*/
+typedef void(*CollectChildren)(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const BoundingBox* box,
+	std::vector<ShapeChild>* children);
+
+/*
+	Nearest hit of ray with shape placed at position and rotation, everything in world space.
+	direction has to be unit length, ray starting inside convex shape hits at distance 0.
+	Returns false when ray misses within maxDistance.
+*/
+typedef bool(*Raycast)(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal);
+
 struct Shape
 {
 	GetTrasformationMatrix getTrasformationMatrix;
@@ -58,5 +119,10 @@ struct Shape
 	GetPartialInertiaTensor getPartialInertiaTensor;
 	GetBoundingBox getBoundingBox;
 	GetFaceNormalFromPoint getFaceNormalFromPoint;
+	FreeShapeData freeShapeData;
+	AddShapeReference addShapeReference;
+	CollectTriangles collectTriangles;
+	CollectChildren collectChildren;
+	Raycast raycast; // nullptr for shapes rays don't hit
 	char* shapeData;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "ShapeBox.hpp"
+#include "ShapeRaycast.hpp"
 #include <cstring>
 using namespace DirectX;
 
@@ -18,6 +19,7 @@ constexpr static uint8_t VertexCount = 8;
 
 struct Box
 {
+	uint32_t refCount;
 	XMFLOAT3 scales;
 	// 4 front vertecies
 	XMFLOAT3 vertecies[VertexCount];
@@ -172,6 +174,90 @@ static void GetFaceNormalFromPoint_Box(
 	}
 }
 
+// slab test in box space, normal is the face of the last slab ray enters
+static bool Raycast_Box(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal)
+{
+	Box* box = (Box*)shape->shapeData;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat));
+	XMFLOAT3 localOrigin, localDir;
+	XMStoreFloat3(&localOrigin, XMVector3Transform(XMLoadFloat3(origin) - XMLoadFloat3(position), toLocal));
+	XMStoreFloat3(&localDir, XMVector3Transform(XMLoadFloat3(direction), toLocal));
+
+	const float o[3] = { localOrigin.x, localOrigin.y, localOrigin.z };
+	const float d[3] = { localDir.x, localDir.y, localDir.z };
+	const float e[3] = { box->scales.x, box->scales.y, box->scales.z };
+	float enter = 0.0f;
+	float exit = maxDistance;
+	int8_t enterAxis = -1;
+	for (int8_t axis = 0; axis < 3; axis++)
+	{
+		if (fabsf(d[axis]) < 1e-12f)
+		{
+			if (fabsf(o[axis]) > e[axis])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		float invD = 1.0f / d[axis];
+		float t0 = (-e[axis] - o[axis]) * invD;
+		float t1 = (e[axis] - o[axis]) * invD;
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+		if (t0 > enter)
+		{
+			enter = t0;
+			enterAxis = axis;
+		}
+		exit = std::min(exit, t1);
+		if (enter > exit)
+		{
+			return false;
+		}
+	}
+
+	*distance = enter;
+	if (enterAxis < 0)
+	{
+		XMStoreFloat3(normal, -XMLoadFloat3(direction));
+		return true;
+	}
+	float localNormal[3] = { 0, 0, 0 };
+	localNormal[enterAxis] = d[enterAxis] > 0.0f ? -1.0f : 1.0f;
+	XMStoreFloat3(normal, XMVector3Transform(XMVectorSet(localNormal[0], localNormal[1], localNormal[2], 0), XMMatrixTranspose(toLocal)));
+	return true;
+}
+
+static void FreeShapeData_Box(
+	Shape* shape)
+{
+	Box* box = (Box*)shape->shapeData;
+	box->refCount--;
+	if (box->refCount == 0)
+	{
+		delete box;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Box(
+	Shape* shape)
+{
+	Box* box = (Box*)shape->shapeData;
+	box->refCount++;
+}
+
 Shape GetDefaultBoxShape(
 	DirectX::XMFLOAT3 scales)
 {
@@ -184,8 +270,14 @@ Shape GetDefaultBoxShape(
 	boxShape.getPartialInertiaTensor = GetPartialInertiaTensorBox;
 	boxShape.getBoundingBox = GetBoundingBox_Box;
 	boxShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Box;
+	boxShape.freeShapeData = FreeShapeData_Box;
+	boxShape.addShapeReference = AddShapeReference_Box;
+	boxShape.collectTriangles = nullptr;
+	boxShape.collectChildren = nullptr;
+	boxShape.raycast = Raycast_Box;
 
 	Box* box = new Box();
+	box->refCount = 1;
 	box->scales = scales;
 
 	box->vertecies[frt] = { 1.0f, 1.0f, -1.0f };
@@ -0,0 +1,283 @@
+#include "ShapeCapsule.hpp"
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+using namespace DirectX;
+
+struct Capsule
+{
+	uint32_t refCount;
+	float radius;
+	float halfHeight;
+};
+
+static int64_t TransformationMatrix(
+	char* shapeData,
+	DirectX::XMFLOAT4X4* destMat)
+{
+	Capsule* capsule = (Capsule*)shapeData;
+	XMMATRIX scaleMatrix = XMMatrixScaling(capsule->radius, capsule->halfHeight + capsule->radius, capsule->radius);
+	XMStoreFloat4x4(destMat, scaleMatrix);
+	return 0;
+}
+
+static void SupportFn(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pos,
+	const DirectX::XMFLOAT3* dir,
+	const DirectX::XMFLOAT4* rotQuat,
+	DirectX::XMFLOAT3* supportVec,
+	float bias)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+
+	XMVECTOR dirVec = XMLoadFloat3(dir);
+	XMMATRIX rotMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotQuat)));
+	XMVECTOR axis = XMVector3Transform(XMVectorSet(0, capsule->halfHeight, 0, 0), rotMat);
+
+	float prod;
+	XMStoreFloat(&prod, XMVector3Dot(axis, dirVec));
+	XMVECTOR vert = XMLoadFloat3(pos) + (prod >= 0.0f ? axis : -axis);
+
+	// zero direction only picks end of the segment
+	float lengthSq;
+	XMStoreFloat(&lengthSq, XMVector3LengthSq(dirVec));
+	if (lengthSq > 1e-12f)
+	{
+		vert = vert + XMVector3Normalize(dirVec) * (capsule->radius + bias);
+	}
+	XMStoreFloat3(supportVec, vert);
+}
+
+static void GetPartialInertiaTensorCapsule(
+	const Shape* shape,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+	memset(inertiaTensor, 0, sizeof(XMFLOAT4X4));
+
+	// unit mass split between cylinder and two hemispheres by volume
+	const float r = capsule->radius;
+	const float h = 2.0f * capsule->halfHeight;
+	const float cylinderVolume = XM_PI * r * r * h;
+	const float sphereVolume = 4.0f / 3.0f * XM_PI * r * r * r;
+	const float cylinderMass = cylinderVolume / (cylinderVolume + sphereVolume);
+	const float sphereMass = 1.0f - cylinderMass;
+
+	const float axial = cylinderMass * r * r / 2.0f + sphereMass * 2.0f * r * r / 5.0f;
+	const float lateral = cylinderMass * (h * h / 12.0f + r * r / 4.0f) +
+		sphereMass * (2.0f * r * r / 5.0f + h * h / 4.0f + 3.0f * h * r / 8.0f);
+
+	inertiaTensor->_11 = lateral;
+	inertiaTensor->_22 = axial;
+	inertiaTensor->_33 = lateral;
+	inertiaTensor->_44 = 1.0f;
+}
+
+static void GetInverseInertiaTensorCapsule(
+	const Shape* shape,
+	float invMass,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	XMFLOAT4X4 partial;
+	GetPartialInertiaTensorCapsule(shape, &partial);
+	memset(inertiaTensor, 0, sizeof(XMFLOAT4X4));
+	inertiaTensor->_11 = invMass / partial._11;
+	inertiaTensor->_22 = invMass / partial._22;
+	inertiaTensor->_33 = invMass / partial._33;
+	inertiaTensor->_44 = 1.0f;
+}
+
+static void GetInverseInertiaTensorWorldSpaceCapsule(
+	const Shape* shape,
+	float invMass,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	shape->getInverseInertiaTensor(shape, invMass, inertiaTensor);
+	XMMATRIX tensor = XMLoadFloat4x4(inertiaTensor);
+	XMMATRIX rotationMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat)));
+	tensor = rotationMat * tensor * XMMatrixTranspose(rotationMat);
+	XMStoreFloat4x4(inertiaTensor, tensor);
+}
+
+static void GetCenterOfMassCapsule(
+	const Shape* shape,
+	XMFLOAT3* CoM)
+{
+	CoM->x = 0;
+	CoM->y = 0;
+	CoM->z = 0;
+}
+
+static BoundingBox GetBoundingBox_Capsule(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+
+	XMMATRIX rotationMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat)));
+	XMVECTOR axis = XMVector3Transform(XMVectorSet(0, capsule->halfHeight, 0, 0), rotationMat);
+	XMVECTOR radius = XMVectorReplicate(capsule->radius);
+	XMVECTOR pos = XMLoadFloat3(position);
+
+	BoundingBox bBox;
+	XMStoreFloat3(&bBox.minC, pos - XMVectorAbs(axis) - radius);
+	XMStoreFloat3(&bBox.maxC, pos + XMVectorAbs(axis) + radius);
+	return bBox;
+}
+
+static void GetFaceNormalFromPoint_Capsule(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pointOnShape,
+	DirectX::XMFLOAT3* normal)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+
+	// direction from closest point of the segment
+	float y = pointOnShape->y;
+	y = y > capsule->halfHeight ? capsule->halfHeight : (y < -capsule->halfHeight ? -capsule->halfHeight : y);
+	XMVECTOR v_normal = XMLoadFloat3(pointOnShape) - XMVectorSet(0, y, 0, 0);
+	XMStoreFloat3(normal, XMVector3Normalize(v_normal));
+}
+
+// nearest t >= 0 where ray enters sphere at center, false when it misses
+static bool RayEntersSphere(
+	FXMVECTOR origin,
+	FXMVECTOR dir,
+	FXMVECTOR center,
+	float radius,
+	float* t)
+{
+	XMVECTOR m = origin - center;
+	float b, c;
+	XMStoreFloat(&b, XMVector3Dot(m, dir));
+	XMStoreFloat(&c, XMVector3LengthSq(m));
+	c -= radius * radius;
+	float disc = b * b - c;
+	if (disc < 0.0f)
+	{
+		return false;
+	}
+	*t = -b - sqrtf(disc);
+	return *t >= 0.0f;
+}
+
+// sphere is capsule with zero half height, only end caps are tested then
+static bool Raycast_Capsule(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+	const float h = capsule->halfHeight;
+	const float r = capsule->radius;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat));
+	XMVECTOR o = XMVector3Transform(XMLoadFloat3(origin) - XMLoadFloat3(position), toLocal);
+	XMVECTOR d = XMVector3Transform(XMLoadFloat3(direction), toLocal);
+	XMFLOAT3 lo, ld;
+	XMStoreFloat3(&lo, o);
+	XMStoreFloat3(&ld, d);
+
+	float closestY = lo.y > h ? h : (lo.y < -h ? -h : lo.y);
+	if ((lo.x * lo.x + (lo.y - closestY) * (lo.y - closestY) + lo.z * lo.z) <= r * r)
+	{
+		*distance = 0.0f;
+		XMStoreFloat3(normal, -XMLoadFloat3(direction));
+		return true;
+	}
+
+	float best = FLT_MAX;
+	// side of the cylinder, hit has to be between the caps
+	float a = ld.x * ld.x + ld.z * ld.z;
+	if (h > 0.0f && a > 1e-12f)
+	{
+		float b = lo.x * ld.x + lo.z * ld.z;
+		float c = lo.x * lo.x + lo.z * lo.z - r * r;
+		float disc = b * b - a * c;
+		if (disc >= 0.0f)
+		{
+			float t = (-b - sqrtf(disc)) / a;
+			float y = lo.y + ld.y * t;
+			if (t >= 0.0f && y >= -h && y <= h)
+			{
+				best = t;
+			}
+		}
+	}
+
+	float t;
+	if (RayEntersSphere(o, d, XMVectorSet(0, h, 0, 0), r, &t))
+	{
+		best = std::min(best, t);
+	}
+	if (h > 0.0f && RayEntersSphere(o, d, XMVectorSet(0, -h, 0, 0), r, &t))
+	{
+		best = std::min(best, t);
+	}
+	if (best > maxDistance)
+	{
+		return false;
+	}
+
+	XMFLOAT3 hitPoint;
+	XMStoreFloat3(&hitPoint, o + d * best);
+	XMFLOAT3 localNormal;
+	GetFaceNormalFromPoint_Capsule(shape, &hitPoint, &localNormal);
+	*distance = best;
+	XMStoreFloat3(normal, XMVector3Transform(XMLoadFloat3(&localNormal), XMMatrixTranspose(toLocal)));
+	return true;
+}
+
+static void FreeShapeData_Capsule(
+	Shape* shape)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+	capsule->refCount--;
+	if (capsule->refCount == 0)
+	{
+		delete capsule;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Capsule(
+	Shape* shape)
+{
+	Capsule* capsule = (Capsule*)shape->shapeData;
+	capsule->refCount++;
+}
+
+Shape GetDefaultCapsuleShape(
+	DirectX::XMFLOAT3 scales)
+{
+	Shape capsuleShape;
+	capsuleShape.getTrasformationMatrix = TransformationMatrix;
+	capsuleShape.supportFunction = SupportFn;
+	capsuleShape.getInverseInertiaTensor = GetInverseInertiaTensorCapsule;
+	capsuleShape.getInverseInertiaTensorWorldSpace = GetInverseInertiaTensorWorldSpaceCapsule;
+	capsuleShape.getCenterOfMass = GetCenterOfMassCapsule;
+	capsuleShape.getPartialInertiaTensor = GetPartialInertiaTensorCapsule;
+	capsuleShape.getBoundingBox = GetBoundingBox_Capsule;
+	capsuleShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Capsule;
+	capsuleShape.freeShapeData = FreeShapeData_Capsule;
+	capsuleShape.addShapeReference = AddShapeReference_Capsule;
+	capsuleShape.collectTriangles = nullptr;
+	capsuleShape.collectChildren = nullptr;
+	capsuleShape.raycast = Raycast_Capsule;
+
+	Capsule* capsule = new Capsule();
+	capsule->refCount = 1;
+	capsule->radius = scales.x;
+	capsule->halfHeight = scales.y;
+
+	capsuleShape.shapeData = (char*)capsule;
+	return capsuleShape;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "Shape.hpp"
+
+// segment along local y axis from -halfHeight to halfHeight inflated by radius, scales are {radius, halfHeight, radius}
+Shape GetDefaultCapsuleShape(DirectX::XMFLOAT3 scales);
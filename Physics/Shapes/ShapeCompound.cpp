@@ -0,0 +1,487 @@
+#include "ShapeCompound.hpp"
+#include "ShapeRaycast.hpp"
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+constexpr uint32_t INNER_NODE = 0xFFFFFFFF;
+constexpr size_t TRAVERSAL_STACK_SIZE = 64; // tree built by median splits, depth is log2 of child count
+
+// nodes are stored depth first, first subtree of inner node directly follows it
+struct CompoundNode
+{
+	BoundingBox bounds; // compound space
+	uint32_t child; // index of child for leaf, INNER_NODE otherwise
+	uint32_t second; // index of second subtree
+};
+
+struct Compound
+{
+	uint32_t refCount;
+	vector<Shape> shapes;
+	vector<ShapeChild> children; // shape points into shapes
+	vector<BoundingBox> childBounds; // compound space
+	vector<CompoundNode> nodes;
+	XMFLOAT3 centerOfMass;
+	XMFLOAT4X4 partialInertia; // about center of mass
+};
+
+static bool BoxesOverlap(
+	const BoundingBox& a,
+	const BoundingBox& b)
+{
+	return a.minC.x <= b.maxC.x && a.maxC.x >= b.minC.x &&
+		a.minC.y <= b.maxC.y && a.maxC.y >= b.minC.y &&
+		a.minC.z <= b.maxC.z && a.maxC.z >= b.minC.z;
+}
+
+void GetCompoundChildPose(
+	const ShapeChild& child,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT3* childPosition,
+	DirectX::XMFLOAT4* childRotation)
+{
+	XMVECTOR rotation = XMLoadFloat4(rotationQuat);
+	XMMATRIX toWorld = XMMatrixTranspose(XMMatrixRotationQuaternion(rotation));
+	XMStoreFloat3(childPosition, XMLoadFloat3(position) + XMVector3Transform(XMLoadFloat3(&child.position), toWorld));
+	XMStoreFloat4(childRotation, XMQuaternionMultiply(rotation, XMLoadFloat4(&child.rotation)));
+}
+
+static int64_t TransformationMatrix(
+	char* shapeData,
+	DirectX::XMFLOAT4X4* destMat)
+{
+	XMStoreFloat4x4(destMat, XMMatrixIdentity());
+	return 0;
+}
+
+// support of convex hull of children
+static void SupportFn(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pos,
+	const DirectX::XMFLOAT3* dir,
+	const DirectX::XMFLOAT4* rotQuat,
+	DirectX::XMFLOAT3* supportVec,
+	float bias)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	XMVECTOR direction = XMLoadFloat3(dir);
+	float best = -FLT_MAX;
+	for (const ShapeChild& child : compound->children)
+	{
+		XMFLOAT3 childPos, support;
+		XMFLOAT4 childRot;
+		GetCompoundChildPose(child, pos, rotQuat, &childPos, &childRot);
+		child.shape->supportFunction(child.shape, &childPos, dir, &childRot, &support, bias);
+
+		float proj;
+		XMStoreFloat(&proj, XMVector3Dot(XMLoadFloat3(&support), direction));
+		if (proj > best)
+		{
+			best = proj;
+			*supportVec = support;
+		}
+	}
+}
+
+static void GetInverseInertiaTensorCompound(
+	const Shape* shape,
+	float invMass,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	XMStoreFloat4x4(inertiaTensor, XMMatrixInverse(nullptr, XMLoadFloat4x4(&compound->partialInertia)));
+	for (uint8_t row = 0; row < 3; row++)
+	{
+		for (uint8_t col = 0; col < 3; col++)
+		{
+			inertiaTensor->m[row][col] *= invMass;
+		}
+	}
+}
+
+static void GetInverseInertiaTensorWorldSpaceCompound(
+	const Shape* shape,
+	float invMass,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	shape->getInverseInertiaTensor(shape, invMass, inertiaTensor);
+	XMMATRIX tensor = XMLoadFloat4x4(inertiaTensor);
+	XMMATRIX rotationMat = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat)));
+	tensor = rotationMat * tensor * XMMatrixTranspose(rotationMat);
+	XMStoreFloat4x4(inertiaTensor, tensor);
+}
+
+static void GetPartialInertiaTensorCompound(
+	const Shape* shape,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	*inertiaTensor = compound->partialInertia;
+}
+
+static void GetCenterOfMassCompound(
+	const Shape* shape,
+	XMFLOAT3* CoM)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	*CoM = compound->centerOfMass;
+}
+
+static BoundingBox GetBoundingBox_Compound(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	BoundingBox bBox;
+	for (const ShapeChild& child : compound->children)
+	{
+		XMFLOAT3 childPos;
+		XMFLOAT4 childRot;
+		GetCompoundChildPose(child, position, rotationQuat, &childPos, &childRot);
+		BoundingBox childBox = child.shape->getBoundingBox(child.shape, &childPos, &childRot);
+		bBox.Expand(childBox.minC);
+		bBox.Expand(childBox.maxC);
+	}
+	return bBox;
+}
+
+// normal of child whose bounds are closest to the point
+static void GetFaceNormalFromPoint_Compound(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pointOnShape,
+	DirectX::XMFLOAT3* normal)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	// point is relative to center of mass
+	XMVECTOR point = XMLoadFloat3(pointOnShape) + XMLoadFloat3(&compound->centerOfMass);
+
+	uint32_t closest = 0;
+	float closestDistSq = FLT_MAX;
+	for (uint32_t i = 0; i < (uint32_t)compound->children.size(); i++)
+	{
+		const BoundingBox& bounds = compound->childBounds[i];
+		XMVECTOR outside = XMVectorMax(XMLoadFloat3(&bounds.minC) - point, XMVectorZero()) +
+			XMVectorMax(point - XMLoadFloat3(&bounds.maxC), XMVectorZero());
+		float distSq;
+		XMStoreFloat(&distSq, XMVector3LengthSq(outside));
+		if (distSq < closestDistSq)
+		{
+			closestDistSq = distSq;
+			closest = i;
+		}
+	}
+
+	const ShapeChild& child = compound->children[closest];
+	XMMATRIX toCompound = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&child.rotation)));
+	XMFLOAT3 childPoint;
+	XMStoreFloat3(&childPoint, XMVector3Transform(point - XMLoadFloat3(&child.position), XMMatrixTranspose(toCompound)));
+	child.shape->getFaceNormalFromPoint(child.shape, &childPoint, normal);
+	XMStoreFloat3(normal, XMVector3Transform(XMLoadFloat3(normal), toCompound));
+}
+
+static void CollectChildren_Compound(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const BoundingBox* box,
+	std::vector<ShapeChild>* children)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat));
+
+	// box of the query box in compound space
+	XMVECTOR center = (XMLoadFloat3(&box->minC) + XMLoadFloat3(&box->maxC)) * 0.5f - XMLoadFloat3(position);
+	XMVECTOR extent = (XMLoadFloat3(&box->maxC) - XMLoadFloat3(&box->minC)) * 0.5f;
+	XMVECTOR localCenter = XMVector3Transform(center, toLocal);
+	XMVECTOR localExtent = XMVectorAbs(toLocal.r[0]) * XMVectorSplatX(extent) +
+		XMVectorAbs(toLocal.r[1]) * XMVectorSplatY(extent) +
+		XMVectorAbs(toLocal.r[2]) * XMVectorSplatZ(extent);
+	BoundingBox localBox;
+	XMStoreFloat3(&localBox.minC, localCenter - localExtent);
+	XMStoreFloat3(&localBox.maxC, localCenter + localExtent);
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const CompoundNode& node = compound->nodes[stack[--stackSize]];
+		if (!BoxesOverlap(node.bounds, localBox))
+		{
+			continue;
+		}
+
+		if (node.child != INNER_NODE)
+		{
+			children->push_back(compound->children[node.child]);
+			continue;
+		}
+		stack[stackSize++] = node.second;
+		stack[stackSize++] = (uint32_t)(&node - compound->nodes.data()) + 1;
+	}
+}
+
+// children are visited through the tree, ray is tested in compound space against child bounds
+static bool Raycast_Compound(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat));
+	XMVECTOR localOrigin = XMVector3Transform(XMLoadFloat3(origin) - XMLoadFloat3(position), toLocal);
+	XMFLOAT3 localDir;
+	XMStoreFloat3(&localDir, XMVector3Transform(XMLoadFloat3(direction), toLocal));
+	XMVECTOR invDir = GetRayInvDirection(localDir);
+
+	float best = maxDistance;
+	bool found = false;
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const CompoundNode& node = compound->nodes[stack[--stackSize]];
+		if (!RayHitsBox(localOrigin, invDir, XMLoadFloat3(&node.bounds.minC), XMLoadFloat3(&node.bounds.maxC), best))
+		{
+			continue;
+		}
+
+		if (node.child == INNER_NODE)
+		{
+			stack[stackSize++] = node.second;
+			stack[stackSize++] = (uint32_t)(&node - compound->nodes.data()) + 1;
+			continue;
+		}
+
+		const ShapeChild& child = compound->children[node.child];
+		XMFLOAT3 childPosition;
+		XMFLOAT4 childRotation;
+		GetCompoundChildPose(child, position, rotationQuat, &childPosition, &childRotation);
+		float childDistance;
+		XMFLOAT3 childNormal;
+		if (child.shape->raycast &&
+			child.shape->raycast(child.shape, &childPosition, &childRotation, origin, direction, best, &childDistance, &childNormal))
+		{
+			found = true;
+			best = childDistance;
+			*normal = childNormal;
+		}
+	}
+
+	*distance = best;
+	return found;
+}
+
+static void FreeShapeData_Compound(
+	Shape* shape)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	compound->refCount--;
+	if (compound->refCount == 0)
+	{
+		for (Shape& child : compound->shapes)
+		{
+			child.freeShapeData(&child);
+		}
+		delete compound;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Compound(
+	Shape* shape)
+{
+	Compound* compound = (Compound*)shape->shapeData;
+	compound->refCount++;
+}
+
+// splits children at median of bounds centers along the longest axis
+static void BuildNode(
+	Compound* compound,
+	vector<uint32_t>* order,
+	uint32_t first,
+	uint32_t count)
+{
+	uint32_t nodeIdx = (uint32_t)compound->nodes.size();
+	compound->nodes.push_back({});
+	BoundingBox bounds;
+	BoundingBox centers;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const BoundingBox& childBox = compound->childBounds[(*order)[i]];
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, (XMLoadFloat3(&childBox.minC) + XMLoadFloat3(&childBox.maxC)) * 0.5f);
+		bounds.Expand(childBox.minC);
+		bounds.Expand(childBox.maxC);
+		centers.Expand(center);
+	}
+	compound->nodes[nodeIdx].bounds = bounds;
+
+	if (count == 1)
+	{
+		compound->nodes[nodeIdx].child = (*order)[first];
+		compound->nodes[nodeIdx].second = 0;
+		return;
+	}
+
+	XMFLOAT3 size;
+	XMStoreFloat3(&size, XMLoadFloat3(&centers.maxC) - XMLoadFloat3(&centers.minC));
+	uint8_t axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+	uint32_t half = count / 2;
+	const vector<BoundingBox>& childBounds = compound->childBounds;
+	nth_element(order->begin() + first, order->begin() + first + half, order->begin() + first + count,
+		[&childBounds, axis](uint32_t a, uint32_t b)
+		{
+			return (&childBounds[a].minC.x)[axis] + (&childBounds[a].maxC.x)[axis] <
+				(&childBounds[b].minC.x)[axis] + (&childBounds[b].maxC.x)[axis];
+		});
+
+	BuildNode(compound, order, first, half);
+	compound->nodes[nodeIdx].child = INNER_NODE;
+	compound->nodes[nodeIdx].second = (uint32_t)compound->nodes.size();
+	BuildNode(compound, order, first + half, count - half);
+}
+
+Shape GetCompoundShape(
+	const ShapeChild* children,
+	const float* masses,
+	uint32_t count)
+{
+	Shape compoundShape;
+	compoundShape.getTrasformationMatrix = TransformationMatrix;
+	compoundShape.supportFunction = SupportFn;
+	compoundShape.getInverseInertiaTensor = GetInverseInertiaTensorCompound;
+	compoundShape.getInverseInertiaTensorWorldSpace = GetInverseInertiaTensorWorldSpaceCompound;
+	compoundShape.getCenterOfMass = GetCenterOfMassCompound;
+	compoundShape.getPartialInertiaTensor = GetPartialInertiaTensorCompound;
+	compoundShape.getBoundingBox = GetBoundingBox_Compound;
+	compoundShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Compound;
+	compoundShape.freeShapeData = FreeShapeData_Compound;
+	compoundShape.addShapeReference = AddShapeReference_Compound;
+	compoundShape.collectTriangles = nullptr;
+	compoundShape.collectChildren = CollectChildren_Compound;
+	compoundShape.raycast = Raycast_Compound;
+	compoundShape.shapeData = nullptr;
+
+	bool valid = count > 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		valid = valid && masses[i] > 0.0f &&
+			children[i].shape->collectTriangles == nullptr && children[i].shape->collectChildren == nullptr;
+	}
+	if (!valid)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Shape child = *children[i].shape;
+			child.freeShapeData(&child);
+		}
+		return compoundShape;
+	}
+
+	Compound* compound = new Compound();
+	compound->refCount = 1;
+	compound->shapes.reserve(count);
+	compound->children.reserve(count);
+	compound->childBounds.reserve(count);
+	XMVECTOR centerOfMass = XMVectorZero();
+	float totalMass = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		compound->shapes.push_back(*children[i].shape);
+		ShapeChild child = children[i];
+		child.shape = &compound->shapes.back();
+		compound->children.push_back(child);
+		compound->childBounds.push_back(child.shape->getBoundingBox(child.shape, &child.position, &child.rotation));
+
+		XMFLOAT3 childCoM;
+		child.shape->getCenterOfMass(child.shape, &childCoM);
+		XMMATRIX toCompound = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&child.rotation)));
+		centerOfMass += (XMLoadFloat3(&child.position) + XMVector3Transform(XMLoadFloat3(&childCoM), toCompound)) * masses[i];
+		totalMass += masses[i];
+	}
+	centerOfMass = centerOfMass / totalMass;
+	XMStoreFloat3(&compound->centerOfMass, centerOfMass);
+
+	// rotated child tensors moved to common center of mass, per unit of total mass
+	memset(&compound->partialInertia, 0, sizeof(XMFLOAT4X4));
+	compound->partialInertia._44 = 1.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const ShapeChild& child = compound->children[i];
+		XMFLOAT4X4 childInertia;
+		XMFLOAT3 childCoM;
+		child.shape->getPartialInertiaTensor(child.shape, &childInertia);
+		child.shape->getCenterOfMass(child.shape, &childCoM);
+		XMMATRIX toCompound = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&child.rotation)));
+		XMStoreFloat4x4(&childInertia, toCompound * XMLoadFloat4x4(&childInertia) * XMMatrixTranspose(toCompound));
+
+		XMFLOAT3 offset;
+		XMStoreFloat3(&offset, XMLoadFloat3(&child.position) + XMVector3Transform(XMLoadFloat3(&childCoM), toCompound) - centerOfMass);
+		const float d[3] = { offset.x, offset.y, offset.z };
+		float dSq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+		float weight = masses[i] / totalMass;
+		for (uint8_t row = 0; row < 3; row++)
+		{
+			for (uint8_t col = 0; col < 3; col++)
+			{
+				float shift = (row == col ? dSq : 0.0f) - d[row] * d[col];
+				compound->partialInertia.m[row][col] += (childInertia.m[row][col] + shift) * weight;
+			}
+		}
+	}
+
+	vector<uint32_t> order(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		order[i] = i;
+	}
+	compound->nodes.reserve(count * 2 - 1);
+	BuildNode(compound, &order, 0, count);
+
+	compoundShape.shapeData = (char*)compound;
+	return compoundShape;
+}
+
+uint32_t GetCompoundChildCount(
+	const Shape* shape)
+{
+	if (shape->collectChildren != CollectChildren_Compound)
+	{
+		return 0;
+	}
+	Compound* compound = (Compound*)shape->shapeData;
+	return (uint32_t)compound->children.size();
+}
+
+int64_t GetCompoundChildTransform(
+	const Shape* shape,
+	uint32_t child,
+	DirectX::XMFLOAT4X4* mat)
+{
+	if (child >= GetCompoundChildCount(shape))
+	{
+		return -1;
+	}
+
+	Compound* compound = (Compound*)shape->shapeData;
+	const ShapeChild& placed = compound->children[child];
+	placed.shape->getTrasformationMatrix(placed.shape->shapeData, mat);
+	XMMATRIX transform = XMLoadFloat4x4(mat) *
+		XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(&placed.rotation))) *
+		XMMatrixTranslation(placed.position.x, placed.position.y, placed.position.z);
+	XMStoreFloat4x4(mat, transform);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Shape.hpp"
+
+/*
+	Rigid group of convex shapes. Reference of every child shape is handed over to the compound,
+	also when creation fails. Body position is origin of compound space, center of mass and
+	inertia are combined from children weighted by masses. Children sit in a small local
+	AABB tree, so queries visit only children under the query box.
+	Returns shape with nullptr shapeData for no children, concave child or mass <= 0.
+*/
+Shape GetCompoundShape(
+	const ShapeChild* children,
+	const float* masses,
+	uint32_t count);
+
+uint32_t GetCompoundChildCount(
+	const Shape* shape);
+
+// render transform of child in body space, -1 for invalid index or shape that isn't compound
+int64_t GetCompoundChildTransform(
+	const Shape* shape,
+	uint32_t child,
+	DirectX::XMFLOAT4X4* mat);
+
+// world pose of child of body placed at position with rotationQuat
+void GetCompoundChildPose(
+	const ShapeChild& child,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT3* childPosition,
+	DirectX::XMFLOAT4* childRotation);
@@ -0,0 +1,504 @@
+#include "ShapeHeightfield.hpp"
+#include "ShapeRaycast.hpp"
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+constexpr uint32_t MATERIAL_TILE_SIZE = 16; // cells per side of material tile
+constexpr uint32_t MATERIAL_TILE_BYTES = MATERIAL_TILE_SIZE * MATERIAL_TILE_SIZE / 2;
+constexpr uint32_t UNIFORM_TILE = 0x80000000;
+
+struct Heightfield
+{
+	uint32_t refCount;
+	uint32_t columns;
+	uint32_t rows;
+	float cellSize;
+	float heightScale;
+	float heightOffset;
+	float originX; // local position of the first sample
+	float originZ;
+	float minHeight; // local heights of the lowest and highest sample
+	float maxHeight;
+	uint32_t tileColumns;
+	std::vector<uint16_t> heights;
+	std::vector<uint32_t> tiles; // per tile UNIFORM_TILE | material or offset into tileMaterials, empty when all cells are material 0
+	std::vector<uint8_t> tileMaterials; // two cells per byte, low nibble first
+};
+
+static float SampleHeight(
+	const Heightfield* field,
+	uint32_t x,
+	uint32_t z)
+{
+	return field->heightOffset + field->heights[(size_t)z * field->columns + x] * field->heightScale;
+}
+
+static uint8_t CellMaterial(
+	const Heightfield* field,
+	uint32_t cellX,
+	uint32_t cellZ)
+{
+	if (field->tiles.empty())
+	{
+		return 0;
+	}
+
+	uint32_t tile = field->tiles[(cellZ / MATERIAL_TILE_SIZE) * field->tileColumns + cellX / MATERIAL_TILE_SIZE];
+	if ((tile & UNIFORM_TILE) > 0)
+	{
+		return (uint8_t)(tile & 0x0F);
+	}
+
+	uint32_t cellIdx = (cellZ % MATERIAL_TILE_SIZE) * MATERIAL_TILE_SIZE + cellX % MATERIAL_TILE_SIZE;
+	uint8_t pair = field->tileMaterials[tile + cellIdx / 2];
+	return (cellIdx & 1) > 0 ? pair >> 4 : pair & 0x0F;
+}
+
+static int64_t TransformationMatrix(
+	char* shapeData,
+	DirectX::XMFLOAT4X4* destMat)
+{
+	XMStoreFloat4x4(destMat, XMMatrixIdentity());
+	return 0;
+}
+
+// heightfield is concave, GJK only sees its bounds
+static void SupportFn(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pos,
+	const DirectX::XMFLOAT3* dir,
+	const DirectX::XMFLOAT4* rotQuat,
+	DirectX::XMFLOAT3* supportVec,
+	float bias)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	supportVec->x = pos->x + (dir->x >= 0.0f ? -field->originX : field->originX);
+	supportVec->y = pos->y + (dir->y >= 0.0f ? field->maxHeight : field->minHeight);
+	supportVec->z = pos->z + (dir->z >= 0.0f ? -field->originZ : field->originZ);
+	XMStoreFloat3(supportVec, XMLoadFloat3(supportVec) + XMVector3Normalize(XMLoadFloat3(dir)) * bias);
+}
+
+static void GetInverseInertiaTensorHeightfield(
+	const Shape* shape,
+	float invMass,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	// heightfields are static only
+	memset(inertiaTensor, 0, sizeof(XMFLOAT4X4));
+	inertiaTensor->_44 = 1.0f;
+}
+
+static void GetInverseInertiaTensorWorldSpaceHeightfield(
+	const Shape* shape,
+	float invMass,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	shape->getInverseInertiaTensor(shape, invMass, inertiaTensor);
+}
+
+static void GetPartialInertiaTensorHeightfield(
+	const Shape* shape,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	XMStoreFloat4x4(inertiaTensor, XMMatrixIdentity());
+}
+
+static void GetCenterOfMassHeightfield(
+	const Shape* shape,
+	XMFLOAT3* CoM)
+{
+	CoM->x = 0;
+	CoM->y = 0;
+	CoM->z = 0;
+}
+
+static BoundingBox GetBoundingBox_Heightfield(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	BoundingBox bBox;
+	bBox.minC = { position->x + field->originX, position->y + field->minHeight, position->z + field->originZ };
+	bBox.maxC = { position->x - field->originX, position->y + field->maxHeight, position->z - field->originZ };
+	return bBox;
+}
+
+/*
+	Cell is split along diagonal from its first sample, triangle (00, 01, 11)
+	covers the part where z fraction is larger than x fraction.
+*/
+static void GetCellTriangle(
+	const Heightfield* field,
+	const XMFLOAT3& position,
+	uint32_t cellX,
+	uint32_t cellZ,
+	bool upper,
+	WorldTriangle* triangle)
+{
+	float x = position.x + field->originX + cellX * field->cellSize;
+	float z = position.z + field->originZ + cellZ * field->cellSize;
+	XMFLOAT3 p00 = { x, position.y + SampleHeight(field, cellX, cellZ), z };
+	XMFLOAT3 p11 = { x + field->cellSize, position.y + SampleHeight(field, cellX + 1, cellZ + 1), z + field->cellSize };
+	XMFLOAT3 corner = upper ?
+		XMFLOAT3{ x, position.y + SampleHeight(field, cellX, cellZ + 1), z + field->cellSize } :
+		XMFLOAT3{ x + field->cellSize, position.y + SampleHeight(field, cellX + 1, cellZ), z };
+
+	triangle->vertices[0] = p00;
+	triangle->vertices[1] = upper ? corner : p11;
+	triangle->vertices[2] = upper ? p11 : corner;
+	XMVECTOR v0 = XMLoadFloat3(&triangle->vertices[0]);
+	XMVECTOR normal = XMVector3Cross(XMLoadFloat3(&triangle->vertices[1]) - v0, XMLoadFloat3(&triangle->vertices[2]) - v0);
+	XMStoreFloat3(&triangle->normal, XMVector3Normalize(normal));
+	triangle->material = CellMaterial(field, cellX, cellZ);
+}
+
+// returns false outside of the grid
+static bool FindCell(
+	const Heightfield* field,
+	float localX,
+	float localZ,
+	uint32_t* cellX,
+	uint32_t* cellZ,
+	bool* upper)
+{
+	float fx = (localX - field->originX) / field->cellSize;
+	float fz = (localZ - field->originZ) / field->cellSize;
+	if (!(fx >= 0.0f && fz >= 0.0f && fx <= (float)(field->columns - 1) && fz <= (float)(field->rows - 1)))
+	{
+		return false;
+	}
+
+	*cellX = min((uint32_t)fx, field->columns - 2);
+	*cellZ = min((uint32_t)fz, field->rows - 2);
+	*upper = fz - *cellZ > fx - *cellX;
+	return true;
+}
+
+static void GetFaceNormalFromPoint_Heightfield(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pointOnShape,
+	DirectX::XMFLOAT3* normal)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	uint32_t cellX, cellZ;
+	bool upper;
+	if (!FindCell(field, pointOnShape->x, pointOnShape->z, &cellX, &cellZ, &upper))
+	{
+		*normal = { 0, 1, 0 };
+		return;
+	}
+
+	WorldTriangle triangle;
+	GetCellTriangle(field, { 0, 0, 0 }, cellX, cellZ, upper, &triangle);
+	*normal = triangle.normal;
+}
+
+static void CollectTriangles_Heightfield(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const BoundingBox* box,
+	std::vector<WorldTriangle>* triangles)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+
+	// only cells under the box are visited
+	float x0 = position->x + field->originX;
+	float z0 = position->z + field->originZ;
+	float firstX = floorf((box->minC.x - x0) / field->cellSize);
+	float lastX = floorf((box->maxC.x - x0) / field->cellSize);
+	float firstZ = floorf((box->minC.z - z0) / field->cellSize);
+	float lastZ = floorf((box->maxC.z - z0) / field->cellSize);
+	const float maxCellX = (float)(field->columns - 2);
+	const float maxCellZ = (float)(field->rows - 2);
+	if (!(lastX >= 0.0f && lastZ >= 0.0f && firstX <= maxCellX && firstZ <= maxCellZ))
+	{
+		return;
+	}
+
+	uint32_t cellXBegin = (uint32_t)max(firstX, 0.0f);
+	uint32_t cellXEnd = (uint32_t)min(lastX, maxCellX);
+	uint32_t cellZBegin = (uint32_t)max(firstZ, 0.0f);
+	uint32_t cellZEnd = (uint32_t)min(lastZ, maxCellZ);
+	for (uint32_t cellZ = cellZBegin; cellZ <= cellZEnd; cellZ++)
+	{
+		for (uint32_t cellX = cellXBegin; cellX <= cellXEnd; cellX++)
+		{
+			if (CellMaterial(field, cellX, cellZ) == HEIGHTFIELD_HOLE)
+			{
+				continue;
+			}
+
+			float h00 = SampleHeight(field, cellX, cellZ);
+			float h10 = SampleHeight(field, cellX + 1, cellZ);
+			float h01 = SampleHeight(field, cellX, cellZ + 1);
+			float h11 = SampleHeight(field, cellX + 1, cellZ + 1);
+			float cellMin = position->y + min(min(h00, h10), min(h01, h11));
+			float cellMax = position->y + max(max(h00, h10), max(h01, h11));
+			if (cellMin > box->maxC.y || cellMax < box->minC.y)
+			{
+				continue;
+			}
+
+			WorldTriangle triangle;
+			GetCellTriangle(field, *position, cellX, cellZ, true, &triangle);
+			triangles->push_back(triangle);
+			GetCellTriangle(field, *position, cellX, cellZ, false, &triangle);
+			triangles->push_back(triangle);
+		}
+	}
+}
+
+// walks cells under the ray in order of entry, first cell with a hit holds the nearest one
+static bool Raycast_Heightfield(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	XMFLOAT3 o = { origin->x - position->x, origin->y - position->y, origin->z - position->z };
+	const XMFLOAT3& d = *direction;
+
+	// part of the ray inside bounds of the field
+	XMFLOAT3 boundsMin = { field->originX, field->minHeight, field->originZ };
+	XMFLOAT3 boundsMax = { -field->originX, field->maxHeight, -field->originZ };
+	XMFLOAT3 tNear, tFar;
+	XMVECTOR invDir = GetRayInvDirection(d);
+	XMVECTOR t0 = (XMLoadFloat3(&boundsMin) - XMLoadFloat3(&o)) * invDir;
+	XMVECTOR t1 = (XMLoadFloat3(&boundsMax) - XMLoadFloat3(&o)) * invDir;
+	XMStoreFloat3(&tNear, XMVectorMin(t0, t1));
+	XMStoreFloat3(&tFar, XMVectorMax(t0, t1));
+	float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.0f));
+	float exit = min(min(tFar.x, tFar.y), min(tFar.z, maxDistance));
+	if (enter > exit)
+	{
+		return false;
+	}
+
+	const int64_t maxCellX = field->columns - 2;
+	const int64_t maxCellZ = field->rows - 2;
+	float startX = o.x + d.x * enter;
+	float startZ = o.z + d.z * enter;
+	int64_t cellX = min(max((int64_t)floorf((startX - field->originX) / field->cellSize), (int64_t)0), maxCellX);
+	int64_t cellZ = min(max((int64_t)floorf((startZ - field->originZ) / field->cellSize), (int64_t)0), maxCellZ);
+	int64_t stepX = d.x > 0.0f ? 1 : -1;
+	int64_t stepZ = d.z > 0.0f ? 1 : -1;
+	float deltaX = fabsf(d.x) > 1e-12f ? field->cellSize / fabsf(d.x) : FLT_MAX;
+	float deltaZ = fabsf(d.z) > 1e-12f ? field->cellSize / fabsf(d.z) : FLT_MAX;
+	float nextX = fabsf(d.x) > 1e-12f ?
+		(field->originX + (cellX + (stepX > 0 ? 1 : 0)) * field->cellSize - o.x) / d.x : FLT_MAX;
+	float nextZ = fabsf(d.z) > 1e-12f ?
+		(field->originZ + (cellZ + (stepZ > 0 ? 1 : 0)) * field->cellSize - o.z) / d.z : FLT_MAX;
+
+	const XMFLOAT3 localPosition = { 0, 0, 0 };
+	XMVECTOR localOrigin = XMLoadFloat3(&o);
+	XMVECTOR localDir = XMLoadFloat3(&d);
+	while (true)
+	{
+		if (CellMaterial(field, (uint32_t)cellX, (uint32_t)cellZ) != HEIGHTFIELD_HOLE)
+		{
+			float best = maxDistance;
+			bool found = false;
+			for (uint8_t upper = 0; upper < 2; upper++)
+			{
+				WorldTriangle triangle;
+				GetCellTriangle(field, localPosition, (uint32_t)cellX, (uint32_t)cellZ, upper != 0, &triangle);
+				float t;
+				if (RayHitsTriangle(localOrigin, localDir, XMLoadFloat3(&triangle.vertices[0]),
+					XMLoadFloat3(&triangle.vertices[1]), XMLoadFloat3(&triangle.vertices[2]), &t) && t <= best)
+				{
+					found = true;
+					best = t;
+					*normal = triangle.normal;
+				}
+			}
+			if (found)
+			{
+				*distance = best;
+				return true;
+			}
+		}
+
+		float cellExit = min(nextX, nextZ);
+		if (cellExit > exit)
+		{
+			return false;
+		}
+		if (nextX < nextZ)
+		{
+			cellX += stepX;
+			nextX += deltaX;
+		}
+		else
+		{
+			cellZ += stepZ;
+			nextZ += deltaZ;
+		}
+		if (cellX < 0 || cellZ < 0 || cellX > maxCellX || cellZ > maxCellZ)
+		{
+			return false;
+		}
+	}
+}
+
+static void FreeShapeData_Heightfield(
+	Shape* shape)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	field->refCount--;
+	if (field->refCount == 0)
+	{
+		delete field;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Heightfield(
+	Shape* shape)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	field->refCount++;
+}
+
+static void PackMaterials(
+	Heightfield* field,
+	const uint8_t* materials)
+{
+	uint32_t cellColumns = field->columns - 1;
+	uint32_t cellRows = field->rows - 1;
+	bool anyMaterial = false;
+	for (size_t i = 0; i < (size_t)cellColumns * cellRows && !anyMaterial; i++)
+	{
+		anyMaterial = materials[i] != 0;
+	}
+	if (!anyMaterial)
+	{
+		return;
+	}
+
+	field->tileColumns = (cellColumns + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE;
+	uint32_t tileRows = (cellRows + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE;
+	field->tiles.resize((size_t)field->tileColumns * tileRows);
+	for (uint32_t tileZ = 0; tileZ < tileRows; tileZ++)
+	{
+		for (uint32_t tileX = 0; tileX < field->tileColumns; tileX++)
+		{
+			uint32_t endX = min((tileX + 1) * MATERIAL_TILE_SIZE, cellColumns);
+			uint32_t endZ = min((tileZ + 1) * MATERIAL_TILE_SIZE, cellRows);
+			uint8_t first = materials[(size_t)tileZ * MATERIAL_TILE_SIZE * cellColumns + tileX * MATERIAL_TILE_SIZE] & 0x0F;
+			bool uniform = true;
+			for (uint32_t z = tileZ * MATERIAL_TILE_SIZE; z < endZ && uniform; z++)
+			{
+				for (uint32_t x = tileX * MATERIAL_TILE_SIZE; x < endX && uniform; x++)
+				{
+					uniform = (materials[(size_t)z * cellColumns + x] & 0x0F) == first;
+				}
+			}
+
+			uint32_t& tile = field->tiles[(size_t)tileZ * field->tileColumns + tileX];
+			if (uniform)
+			{
+				tile = UNIFORM_TILE | first;
+				continue;
+			}
+
+			tile = (uint32_t)field->tileMaterials.size();
+			field->tileMaterials.resize(field->tileMaterials.size() + MATERIAL_TILE_BYTES, 0);
+			for (uint32_t z = tileZ * MATERIAL_TILE_SIZE; z < endZ; z++)
+			{
+				for (uint32_t x = tileX * MATERIAL_TILE_SIZE; x < endX; x++)
+				{
+					uint32_t cellIdx = (z % MATERIAL_TILE_SIZE) * MATERIAL_TILE_SIZE + x % MATERIAL_TILE_SIZE;
+					uint8_t material = materials[(size_t)z * cellColumns + x] & 0x0F;
+					field->tileMaterials[tile + cellIdx / 2] |= (cellIdx & 1) > 0 ? material << 4 : material;
+				}
+			}
+		}
+	}
+	field->tileMaterials.shrink_to_fit();
+}
+
+Shape GetHeightfieldShape(
+	const HeightfieldDesc& desc)
+{
+	Shape fieldShape;
+	fieldShape.getTrasformationMatrix = TransformationMatrix;
+	fieldShape.supportFunction = SupportFn;
+	fieldShape.getInverseInertiaTensor = GetInverseInertiaTensorHeightfield;
+	fieldShape.getInverseInertiaTensorWorldSpace = GetInverseInertiaTensorWorldSpaceHeightfield;
+	fieldShape.getCenterOfMass = GetCenterOfMassHeightfield;
+	fieldShape.getPartialInertiaTensor = GetPartialInertiaTensorHeightfield;
+	fieldShape.getBoundingBox = GetBoundingBox_Heightfield;
+	fieldShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Heightfield;
+	fieldShape.freeShapeData = FreeShapeData_Heightfield;
+	fieldShape.addShapeReference = AddShapeReference_Heightfield;
+	fieldShape.collectTriangles = CollectTriangles_Heightfield;
+	fieldShape.collectChildren = nullptr;
+	fieldShape.raycast = Raycast_Heightfield;
+	fieldShape.shapeData = nullptr;
+
+	if (desc.columns < 2 || desc.rows < 2 || !desc.heights || !(desc.cellSize > 0.0f))
+	{
+		return fieldShape;
+	}
+
+	Heightfield* field = new Heightfield();
+	field->refCount = 1;
+	field->columns = desc.columns;
+	field->rows = desc.rows;
+	field->cellSize = desc.cellSize;
+	field->heightScale = desc.heightScale;
+	field->heightOffset = desc.heightOffset;
+	field->originX = -0.5f * (desc.columns - 1) * desc.cellSize;
+	field->originZ = -0.5f * (desc.rows - 1) * desc.cellSize;
+	field->tileColumns = 0;
+	field->heights.assign(desc.heights, desc.heights + (size_t)desc.columns * desc.rows);
+
+	auto range = minmax_element(field->heights.begin(), field->heights.end());
+	float low = desc.heightOffset + *range.first * desc.heightScale;
+	float high = desc.heightOffset + *range.second * desc.heightScale;
+	field->minHeight = min(low, high);
+	field->maxHeight = max(low, high);
+
+	if (desc.materials)
+	{
+		PackMaterials(field, desc.materials);
+	}
+
+	fieldShape.shapeData = (char*)field;
+	return fieldShape;
+}
+
+uint8_t GetHeightfieldMaterial(
+	const Shape* shape,
+	float localX,
+	float localZ)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	uint32_t cellX, cellZ;
+	bool upper;
+	if (!FindCell(field, localX, localZ, &cellX, &cellZ, &upper))
+	{
+		return HEIGHTFIELD_HOLE;
+	}
+	return CellMaterial(field, cellX, cellZ);
+}
+
+size_t GetHeightfieldMemoryUsage(
+	const Shape* shape)
+{
+	Heightfield* field = (Heightfield*)shape->shapeData;
+	return sizeof(Heightfield) + field->heights.capacity() * sizeof(uint16_t) +
+		field->tiles.capacity() * sizeof(uint32_t) + field->tileMaterials.capacity();
+}
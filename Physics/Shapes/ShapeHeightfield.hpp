@@ -0,0 +1,39 @@
+#pragma once
+#include "Shape.hpp"
+
+constexpr uint8_t HEIGHTFIELD_MAX_MATERIAL = 14;
+constexpr uint8_t HEIGHTFIELD_HOLE = 15; // cell material without triangles
+
+/*
+	Samples are stored row by row, row runs along x and rows follow along z.
+	Grid is centered at body position, sample height is heightOffset + sample * heightScale.
+*/
+struct HeightfieldDesc
+{
+	uint32_t columns; // samples along x, at least 2
+	uint32_t rows; // samples along z, at least 2
+	float cellSize;
+	float heightScale;
+	float heightOffset;
+	const uint16_t* heights; // columns * rows samples
+	const uint8_t* materials; // optional, (columns - 1) * (rows - 1) cell materials, HEIGHTFIELD_HOLE marks hole
+};
+
+/*
+	Heights are copied, materials are packed into 4 bits per cell and only tiles
+	with more than one material keep per cell data. Rotation of the body is ignored,
+	grid is always aligned with world x and z. Returns shape with nullptr shapeData
+	for invalid desc.
+*/
+Shape GetHeightfieldShape(
+	const HeightfieldDesc& desc);
+
+// material of cell containing point given relative to body position, HEIGHTFIELD_HOLE outside of the grid
+uint8_t GetHeightfieldMaterial(
+	const Shape* shape,
+	float localX,
+	float localZ);
+
+// bytes held by heightfield data
+size_t GetHeightfieldMemoryUsage(
+	const Shape* shape);
@@ -0,0 +1,844 @@
+#include "ShapeMesh.hpp"
+#include "ShapeRaycast.hpp"
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+using namespace DirectX;
+
+constexpr uint32_t EMPTY_CHILD = 0xFFFFFFFF;
+constexpr uint32_t LEAF_FLAG = 0x80000000; // child is leaf, first triangle in low bits, count - 1 above them
+constexpr uint32_t LEAF_COUNT_SHIFT = 27;
+constexpr uint32_t LEAF_FIRST_MASK = (1u << LEAF_COUNT_SHIFT) - 1;
+constexpr uint32_t MAX_LEAF_TRIANGLES = 4;
+constexpr uint32_t MAX_MESH_TRIANGLES = LEAF_FIRST_MASK + 1;
+constexpr float QUANTIZED_MAX = 65535.0f;
+constexpr size_t TRAVERSAL_STACK_SIZE = 256; // 4-wide tree built by median splits stays far below, loaded trees are checked
+
+// one cache line, bounds of children are offsets in quantization grid of the mesh
+struct alignas(64) MeshBvhNode
+{
+	uint16_t minX[4];
+	uint16_t minY[4];
+	uint16_t minZ[4];
+	uint16_t maxX[4];
+	uint16_t maxY[4];
+	uint16_t maxZ[4];
+	uint32_t children[4]; // node index, leaf reference or EMPTY_CHILD
+};
+static_assert(sizeof(MeshBvhNode) == 64, "node has to fill one cache line");
+
+struct Mesh
+{
+	uint32_t refCount;
+	XMFLOAT3 boundsMin; // local bounds, origin of quantization grid
+	XMFLOAT3 boundsMax;
+	XMFLOAT3 quantizeScale; // grid steps per unit
+	uint32_t root; // node index or leaf reference covering whole mesh
+	vector<XMFLOAT3> vertices;
+	vector<uint32_t> indices; // reordered so every leaf covers consecutive triangles
+	vector<uint32_t> triangleIds; // index in MeshDesc of reordered triangle
+	vector<uint8_t> materials; // empty when desc had none
+	vector<MeshBvhNode> nodes;
+};
+
+struct MeshBlobHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+	uint32_t nodeCount;
+	uint32_t root;
+	uint32_t hasMaterials;
+	XMFLOAT3 boundsMin;
+	XMFLOAT3 boundsMax;
+	XMFLOAT3 quantizeScale;
+};
+
+static bool IsLeaf(
+	uint32_t child)
+{
+	return child != EMPTY_CHILD && (child & LEAF_FLAG) > 0;
+}
+
+// conservative grid box, box has to overlap mesh bounds
+static void QuantizeBox(
+	const Mesh* mesh,
+	const XMFLOAT3& minC,
+	const XMFLOAT3& maxC,
+	uint16_t* qMin,
+	uint16_t* qMax)
+{
+	const float* lo = &minC.x;
+	const float* hi = &maxC.x;
+	const float* origin = &mesh->boundsMin.x;
+	const float* scale = &mesh->quantizeScale.x;
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		float low = floorf((lo[axis] - origin[axis]) * scale[axis]);
+		float high = ceilf((hi[axis] - origin[axis]) * scale[axis]);
+		qMin[axis] = (uint16_t)min(max(low, 0.0f), QUANTIZED_MAX);
+		qMax[axis] = (uint16_t)min(max(high, 0.0f), QUANTIZED_MAX);
+	}
+}
+
+static void DequantizeChild(
+	const Mesh* mesh,
+	const MeshBvhNode& node,
+	uint8_t child,
+	XMVECTOR* minC,
+	XMVECTOR* maxC)
+{
+	XMVECTOR origin = XMLoadFloat3(&mesh->boundsMin);
+	XMVECTOR step = XMVectorReciprocal(XMLoadFloat3(&mesh->quantizeScale));
+	*minC = origin + XMVectorSet(node.minX[child], node.minY[child], node.minZ[child], 0) * step;
+	*maxC = origin + XMVectorSet(node.maxX[child], node.maxY[child], node.maxZ[child], 0) * step;
+}
+
+static bool BoxesOverlap(
+	const XMFLOAT3& minA,
+	const XMFLOAT3& maxA,
+	const XMFLOAT3& minB,
+	const XMFLOAT3& maxB)
+{
+	return minA.x <= maxB.x && maxA.x >= minB.x &&
+		minA.y <= maxB.y && maxA.y >= minB.y &&
+		minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+// calls visit with reordered index of every triangle whose bounds overlap local box
+template<typename Visit>
+static void ForEachTriangleInBox(
+	const Mesh* mesh,
+	const XMFLOAT3& localMin,
+	const XMFLOAT3& localMax,
+	Visit visit)
+{
+	if (!BoxesOverlap(localMin, localMax, mesh->boundsMin, mesh->boundsMax))
+	{
+		return;
+	}
+
+	uint16_t qMin[3], qMax[3];
+	QuantizeBox(mesh, localMin, localMax, qMin, qMax);
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	size_t stackSize = 0;
+	stack[stackSize++] = mesh->root;
+	while (stackSize > 0)
+	{
+		uint32_t ref = stack[--stackSize];
+		if (IsLeaf(ref))
+		{
+			uint32_t first = ref & LEAF_FIRST_MASK;
+			uint32_t count = ((ref & ~LEAF_FLAG) >> LEAF_COUNT_SHIFT) + 1;
+			for (uint32_t tri = first; tri < first + count; tri++)
+			{
+				const XMFLOAT3& v0 = mesh->vertices[mesh->indices[tri * 3]];
+				const XMFLOAT3& v1 = mesh->vertices[mesh->indices[tri * 3 + 1]];
+				const XMFLOAT3& v2 = mesh->vertices[mesh->indices[tri * 3 + 2]];
+				XMFLOAT3 triMin, triMax;
+				XMStoreFloat3(&triMin, XMVectorMin(XMVectorMin(XMLoadFloat3(&v0), XMLoadFloat3(&v1)), XMLoadFloat3(&v2)));
+				XMStoreFloat3(&triMax, XMVectorMax(XMVectorMax(XMLoadFloat3(&v0), XMLoadFloat3(&v1)), XMLoadFloat3(&v2)));
+				if (BoxesOverlap(triMin, triMax, localMin, localMax))
+				{
+					visit(tri);
+				}
+			}
+			continue;
+		}
+
+		const MeshBvhNode& node = mesh->nodes[ref];
+		for (uint8_t child = 0; child < 4; child++)
+		{
+			if (node.children[child] != EMPTY_CHILD &&
+				node.minX[child] <= qMax[0] && node.maxX[child] >= qMin[0] &&
+				node.minY[child] <= qMax[1] && node.maxY[child] >= qMin[1] &&
+				node.minZ[child] <= qMax[2] && node.maxZ[child] >= qMin[2])
+			{
+				stack[stackSize++] = node.children[child];
+			}
+		}
+	}
+}
+
+static XMVECTOR TriangleNormal(
+	FXMVECTOR v0,
+	FXMVECTOR v1,
+	FXMVECTOR v2)
+{
+	return XMVector3Normalize(XMVector3Cross(v1 - v0, v2 - v0));
+}
+
+static int64_t TransformationMatrix(
+	char* shapeData,
+	DirectX::XMFLOAT4X4* destMat)
+{
+	XMStoreFloat4x4(destMat, XMMatrixIdentity());
+	return 0;
+}
+
+// mesh is concave, GJK only sees its bounds
+static void SupportFn(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pos,
+	const DirectX::XMFLOAT3* dir,
+	const DirectX::XMFLOAT4* rotQuat,
+	DirectX::XMFLOAT3* supportVec,
+	float bias)
+{
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	XMMATRIX toWorld = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotQuat)));
+	XMFLOAT3 localDir;
+	XMStoreFloat3(&localDir, XMVector3Transform(XMLoadFloat3(dir), XMMatrixTranspose(toWorld)));
+
+	XMFLOAT3 corner = {
+		localDir.x >= 0.0f ? mesh->boundsMax.x : mesh->boundsMin.x,
+		localDir.y >= 0.0f ? mesh->boundsMax.y : mesh->boundsMin.y,
+		localDir.z >= 0.0f ? mesh->boundsMax.z : mesh->boundsMin.z };
+	XMVECTOR vert = XMLoadFloat3(pos) + XMVector3Transform(XMLoadFloat3(&corner), toWorld);
+	XMStoreFloat3(supportVec, vert + XMVector3Normalize(XMLoadFloat3(dir)) * bias);
+}
+
+static void GetInverseInertiaTensorMesh(
+	const Shape* shape,
+	float invMass,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	// meshes are static only
+	memset(inertiaTensor, 0, sizeof(XMFLOAT4X4));
+	inertiaTensor->_44 = 1.0f;
+}
+
+static void GetInverseInertiaTensorWorldSpaceMesh(
+	const Shape* shape,
+	float invMass,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	shape->getInverseInertiaTensor(shape, invMass, inertiaTensor);
+}
+
+static void GetPartialInertiaTensorMesh(
+	const Shape* shape,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	XMStoreFloat4x4(inertiaTensor, XMMatrixIdentity());
+}
+
+static void GetCenterOfMassMesh(
+	const Shape* shape,
+	XMFLOAT3* CoM)
+{
+	CoM->x = 0;
+	CoM->y = 0;
+	CoM->z = 0;
+}
+
+static BoundingBox GetBoundingBox_Mesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat)
+{
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	XMMATRIX toWorld = XMMatrixTranspose(XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat)));
+	XMVECTOR center = (XMLoadFloat3(&mesh->boundsMin) + XMLoadFloat3(&mesh->boundsMax)) * 0.5f;
+	XMVECTOR extent = (XMLoadFloat3(&mesh->boundsMax) - XMLoadFloat3(&mesh->boundsMin)) * 0.5f;
+	XMVECTOR worldCenter = XMLoadFloat3(position) + XMVector3Transform(center, toWorld);
+	XMVECTOR worldExtent = XMVectorAbs(toWorld.r[0]) * XMVectorSplatX(extent) +
+		XMVectorAbs(toWorld.r[1]) * XMVectorSplatY(extent) +
+		XMVectorAbs(toWorld.r[2]) * XMVectorSplatZ(extent);
+
+	BoundingBox bBox;
+	XMStoreFloat3(&bBox.minC, worldCenter - worldExtent);
+	XMStoreFloat3(&bBox.maxC, worldCenter + worldExtent);
+	return bBox;
+}
+
+// normal of triangle whose plane is closest to point near the surface
+static void GetFaceNormalFromPoint_Mesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pointOnShape,
+	DirectX::XMFLOAT3* normal)
+{
+	constexpr float SEARCH_RADIUS = 0.01f;
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	XMVECTOR point = XMLoadFloat3(pointOnShape);
+	XMFLOAT3 localMin, localMax;
+	XMStoreFloat3(&localMin, point - XMVectorReplicate(SEARCH_RADIUS));
+	XMStoreFloat3(&localMax, point + XMVectorReplicate(SEARCH_RADIUS));
+
+	float closest = FLT_MAX;
+	*normal = { 0, 1, 0 };
+	ForEachTriangleInBox(mesh, localMin, localMax, [&](uint32_t tri)
+	{
+		XMVECTOR v0 = XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3]]);
+		XMVECTOR triNormal = TriangleNormal(v0,
+			XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3 + 1]]),
+			XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3 + 2]]));
+		float planeDist;
+		XMStoreFloat(&planeDist, XMVectorAbs(XMVector3Dot(point - v0, triNormal)));
+		if (planeDist < closest)
+		{
+			closest = planeDist;
+			XMStoreFloat3(normal, triNormal);
+		}
+	});
+}
+
+static void CollectTriangles_Mesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const BoundingBox* box,
+	std::vector<WorldTriangle>* triangles)
+{
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(rotationQuat));
+	XMMATRIX toWorld = XMMatrixTranspose(toLocal);
+	XMVECTOR pos = XMLoadFloat3(position);
+
+	// box of the query box in mesh space
+	XMVECTOR center = (XMLoadFloat3(&box->minC) + XMLoadFloat3(&box->maxC)) * 0.5f - pos;
+	XMVECTOR extent = (XMLoadFloat3(&box->maxC) - XMLoadFloat3(&box->minC)) * 0.5f;
+	XMVECTOR localCenter = XMVector3Transform(center, toLocal);
+	XMVECTOR localExtent = XMVectorAbs(toLocal.r[0]) * XMVectorSplatX(extent) +
+		XMVectorAbs(toLocal.r[1]) * XMVectorSplatY(extent) +
+		XMVectorAbs(toLocal.r[2]) * XMVectorSplatZ(extent);
+	XMFLOAT3 localMin, localMax;
+	XMStoreFloat3(&localMin, localCenter - localExtent);
+	XMStoreFloat3(&localMax, localCenter + localExtent);
+
+	ForEachTriangleInBox(mesh, localMin, localMax, [&](uint32_t tri)
+	{
+		XMVECTOR v[3];
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			v[i] = pos + XMVector3Transform(XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3 + i]]), toWorld);
+		}
+
+		XMVECTOR cross = XMVector3Cross(v[1] - v[0], v[2] - v[0]);
+		float areaSq;
+		XMStoreFloat(&areaSq, XMVector3LengthSq(cross));
+		if (areaSq < 1e-12f)
+		{
+			return;
+		}
+
+		WorldTriangle triangle;
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			XMStoreFloat3(&triangle.vertices[i], v[i]);
+		}
+		XMStoreFloat3(&triangle.normal, XMVector3Normalize(cross));
+		triangle.material = mesh->materials.empty() ? 0 : mesh->materials[tri];
+		triangles->push_back(triangle);
+	});
+}
+
+static void FreeShapeData_Mesh(
+	Shape* shape)
+{
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	mesh->refCount--;
+	if (mesh->refCount == 0)
+	{
+		delete mesh;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Mesh(
+	Shape* shape)
+{
+	Mesh* mesh = (Mesh*)shape->shapeData;
+	mesh->refCount++;
+}
+
+static bool Raycast_Mesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat,
+	const DirectX::XMFLOAT3* origin,
+	const DirectX::XMFLOAT3* direction,
+	float maxDistance,
+	float* distance,
+	DirectX::XMFLOAT3* normal)
+{
+	MeshRayHit hit;
+	if (!RaycastMesh(shape, *position, *rotationQuat, *origin, *direction, maxDistance, &hit))
+	{
+		return false;
+	}
+	*distance = hit.distance;
+	*normal = hit.normal;
+	return true;
+}
+
+static Shape GetEmptyMeshShape()
+{
+	Shape meshShape;
+	meshShape.getTrasformationMatrix = TransformationMatrix;
+	meshShape.supportFunction = SupportFn;
+	meshShape.getInverseInertiaTensor = GetInverseInertiaTensorMesh;
+	meshShape.getInverseInertiaTensorWorldSpace = GetInverseInertiaTensorWorldSpaceMesh;
+	meshShape.getCenterOfMass = GetCenterOfMassMesh;
+	meshShape.getPartialInertiaTensor = GetPartialInertiaTensorMesh;
+	meshShape.getBoundingBox = GetBoundingBox_Mesh;
+	meshShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Mesh;
+	meshShape.freeShapeData = FreeShapeData_Mesh;
+	meshShape.addShapeReference = AddShapeReference_Mesh;
+	meshShape.collectTriangles = CollectTriangles_Mesh;
+	meshShape.collectChildren = nullptr;
+	meshShape.raycast = Raycast_Mesh;
+	meshShape.shapeData = nullptr;
+	return meshShape;
+}
+
+// splits range of triangles near median of centers along the longest axis, returns size of first part
+static uint32_t SplitMedian(
+	vector<uint32_t>* order,
+	const vector<XMFLOAT3>& centers,
+	uint32_t first,
+	uint32_t count)
+{
+	XMVECTOR lo = XMLoadFloat3(&centers[(*order)[first]]);
+	XMVECTOR hi = lo;
+	for (uint32_t i = first + 1; i < first + count; i++)
+	{
+		lo = XMVectorMin(lo, XMLoadFloat3(&centers[(*order)[i]]));
+		hi = XMVectorMax(hi, XMLoadFloat3(&centers[(*order)[i]]));
+	}
+	XMFLOAT3 size;
+	XMStoreFloat3(&size, hi - lo);
+	uint8_t axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+
+	// split at multiple of leaf size so leaves come out full
+	uint32_t half = (count / 2 + MAX_LEAF_TRIANGLES - 1) / MAX_LEAF_TRIANGLES * MAX_LEAF_TRIANGLES;
+	if (half >= count)
+	{
+		half = count / 2;
+	}
+	nth_element(order->begin() + first, order->begin() + first + half, order->begin() + first + count,
+		[&centers, axis](uint32_t a, uint32_t b)
+		{
+			return (&centers[a].x)[axis] < (&centers[b].x)[axis];
+		});
+	return half;
+}
+
+static uint32_t BuildNode(
+	Mesh* mesh,
+	vector<uint32_t>* order,
+	const vector<BoundingBox>& boxes,
+	const vector<XMFLOAT3>& centers,
+	uint32_t first,
+	uint32_t count)
+{
+	if (count <= MAX_LEAF_TRIANGLES)
+	{
+		return LEAF_FLAG | ((count - 1) << LEAF_COUNT_SHIFT) | first;
+	}
+
+	// two levels of binary splits give up to four children
+	uint32_t groupFirst[4], groupCount[4];
+	uint8_t groups = 0;
+	uint32_t half = SplitMedian(order, centers, first, count);
+	uint32_t partFirst[2] = { first, first + half };
+	uint32_t partCount[2] = { half, count - half };
+	for (uint8_t part = 0; part < 2; part++)
+	{
+		if (partCount[part] <= MAX_LEAF_TRIANGLES)
+		{
+			groupFirst[groups] = partFirst[part];
+			groupCount[groups++] = partCount[part];
+			continue;
+		}
+
+		uint32_t quarter = SplitMedian(order, centers, partFirst[part], partCount[part]);
+		groupFirst[groups] = partFirst[part];
+		groupCount[groups++] = quarter;
+		groupFirst[groups] = partFirst[part] + quarter;
+		groupCount[groups++] = partCount[part] - quarter;
+	}
+
+	uint32_t nodeIdx = (uint32_t)mesh->nodes.size();
+	mesh->nodes.push_back({});
+	for (uint8_t child = 0; child < 4; child++)
+	{
+		MeshBvhNode& node = mesh->nodes[nodeIdx];
+		if (child >= groups)
+		{
+			// inverted bounds never overlap a query
+			node.minX[child] = node.minY[child] = node.minZ[child] = (uint16_t)QUANTIZED_MAX;
+			node.maxX[child] = node.maxY[child] = node.maxZ[child] = 0;
+			node.children[child] = EMPTY_CHILD;
+			continue;
+		}
+
+		BoundingBox bounds;
+		for (uint32_t i = groupFirst[child]; i < groupFirst[child] + groupCount[child]; i++)
+		{
+			bounds.Expand(boxes[(*order)[i]].minC);
+			bounds.Expand(boxes[(*order)[i]].maxC);
+		}
+		uint16_t qMin[3], qMax[3];
+		QuantizeBox(mesh, bounds.minC, bounds.maxC, qMin, qMax);
+		node.minX[child] = qMin[0];
+		node.minY[child] = qMin[1];
+		node.minZ[child] = qMin[2];
+		node.maxX[child] = qMax[0];
+		node.maxY[child] = qMax[1];
+		node.maxZ[child] = qMax[2];
+
+		// children are pushed after the parent, node reference may move
+		uint32_t childRef = BuildNode(mesh, order, boxes, centers, groupFirst[child], groupCount[child]);
+		mesh->nodes[nodeIdx].children[child] = childRef;
+	}
+	return nodeIdx;
+}
+
+Shape GetMeshShape(
+	const MeshDesc& desc)
+{
+	Shape meshShape = GetEmptyMeshShape();
+	if (!desc.vertices || !desc.indices || desc.vertexCount == 0 ||
+		desc.triangleCount == 0 || desc.triangleCount > MAX_MESH_TRIANGLES)
+	{
+		return meshShape;
+	}
+	for (size_t i = 0; i < (size_t)desc.triangleCount * 3; i++)
+	{
+		if (desc.indices[i] >= desc.vertexCount)
+		{
+			return meshShape;
+		}
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->refCount = 1;
+	mesh->vertices.assign(desc.vertices, desc.vertices + desc.vertexCount);
+
+	vector<BoundingBox> boxes(desc.triangleCount);
+	vector<XMFLOAT3> centers(desc.triangleCount);
+	BoundingBox bounds;
+	for (uint32_t tri = 0; tri < desc.triangleCount; tri++)
+	{
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			boxes[tri].Expand(desc.vertices[desc.indices[tri * 3 + i]]);
+		}
+		XMStoreFloat3(&centers[tri], (XMLoadFloat3(&boxes[tri].minC) + XMLoadFloat3(&boxes[tri].maxC)) * 0.5f);
+		bounds.Expand(boxes[tri].minC);
+		bounds.Expand(boxes[tri].maxC);
+	}
+	mesh->boundsMin = bounds.minC;
+	mesh->boundsMax = bounds.maxC;
+
+	// flat meshes still get a valid grid
+	XMVECTOR extent = XMVectorMax(XMLoadFloat3(&bounds.maxC) - XMLoadFloat3(&bounds.minC), XMVectorReplicate(1e-6f));
+	XMStoreFloat3(&mesh->quantizeScale, XMVectorReplicate(QUANTIZED_MAX) / extent);
+
+	vector<uint32_t> order(desc.triangleCount);
+	for (uint32_t tri = 0; tri < desc.triangleCount; tri++)
+	{
+		order[tri] = tri;
+	}
+	mesh->nodes.reserve(desc.triangleCount / 4 + 1);
+	mesh->root = BuildNode(mesh, &order, boxes, centers, 0, desc.triangleCount);
+	mesh->nodes.shrink_to_fit();
+
+	mesh->indices.resize((size_t)desc.triangleCount * 3);
+	mesh->triangleIds = order;
+	if (desc.materials)
+	{
+		mesh->materials.resize(desc.triangleCount);
+	}
+	for (uint32_t tri = 0; tri < desc.triangleCount; tri++)
+	{
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			mesh->indices[tri * 3 + i] = desc.indices[order[tri] * 3 + i];
+		}
+		if (desc.materials)
+		{
+			mesh->materials[tri] = desc.materials[order[tri]];
+		}
+	}
+
+	meshShape.shapeData = (char*)mesh;
+	return meshShape;
+}
+
+template<typename T>
+static void AppendArray(
+	vector<uint8_t>* blob,
+	const vector<T>& values)
+{
+	size_t offset = blob->size();
+	blob->resize(offset + values.size() * sizeof(T));
+	if (!values.empty())
+	{
+		memcpy(blob->data() + offset, values.data(), values.size() * sizeof(T));
+	}
+}
+
+template<typename T>
+static bool ReadArray(
+	const uint8_t* blob,
+	size_t size,
+	size_t* offset,
+	size_t count,
+	vector<T>* values)
+{
+	if (count > (size - *offset) / sizeof(T))
+	{
+		return false;
+	}
+	values->resize(count);
+	if (count > 0)
+	{
+		memcpy(values->data(), blob + *offset, count * sizeof(T));
+	}
+	*offset += count * sizeof(T);
+	return true;
+}
+
+void SaveMeshBlob(
+	const Shape* shape,
+	std::vector<uint8_t>* blob)
+{
+	const Mesh* mesh = (const Mesh*)shape->shapeData;
+	MeshBlobHeader header;
+	header.magic = MESH_BLOB_MAGIC;
+	header.version = MESH_BLOB_VERSION;
+	header.vertexCount = (uint32_t)mesh->vertices.size();
+	header.triangleCount = (uint32_t)mesh->triangleIds.size();
+	header.nodeCount = (uint32_t)mesh->nodes.size();
+	header.root = mesh->root;
+	header.hasMaterials = mesh->materials.empty() ? 0 : 1;
+	header.boundsMin = mesh->boundsMin;
+	header.boundsMax = mesh->boundsMax;
+	header.quantizeScale = mesh->quantizeScale;
+
+	blob->resize(sizeof(MeshBlobHeader));
+	memcpy(blob->data(), &header, sizeof(MeshBlobHeader));
+	AppendArray(blob, mesh->vertices);
+	AppendArray(blob, mesh->indices);
+	AppendArray(blob, mesh->triangleIds);
+	AppendArray(blob, mesh->nodes);
+	AppendArray(blob, mesh->materials);
+}
+
+// every reference stays inside arrays and points to a later node, so traversal ends
+static bool IsValidReference(
+	const Mesh* mesh,
+	uint32_t ref,
+	uint32_t parent)
+{
+	if (ref == EMPTY_CHILD)
+	{
+		return true;
+	}
+	if (IsLeaf(ref))
+	{
+		uint64_t first = ref & LEAF_FIRST_MASK;
+		uint64_t count = ((ref & ~LEAF_FLAG) >> LEAF_COUNT_SHIFT) + 1;
+		return first + count <= mesh->triangleIds.size();
+	}
+	return ref < mesh->nodes.size() && (parent == EMPTY_CHILD || ref > parent);
+}
+
+// internal levels on the longest path from root, references point to later nodes so children are done first
+static uint32_t GetTreeDepth(
+	const Mesh* mesh)
+{
+	vector<uint32_t> depths(mesh->nodes.size(), 1);
+	for (size_t nodeIdx = mesh->nodes.size(); nodeIdx-- > 0;)
+	{
+		for (uint8_t child = 0; child < 4; child++)
+		{
+			uint32_t ref = mesh->nodes[nodeIdx].children[child];
+			if (ref != EMPTY_CHILD && !IsLeaf(ref))
+			{
+				depths[nodeIdx] = max(depths[nodeIdx], depths[ref] + 1);
+			}
+		}
+	}
+	return IsLeaf(mesh->root) ? 0 : depths[mesh->root];
+}
+
+// quantization needs finite bounds and finite, positive grid steps
+static bool IsValidGrid(
+	const MeshBlobHeader& header)
+{
+	const float* boundsMin = &header.boundsMin.x;
+	const float* boundsMax = &header.boundsMax.x;
+	const float* scale = &header.quantizeScale.x;
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		if (!isfinite(boundsMin[axis]) || !isfinite(boundsMax[axis]) || boundsMin[axis] > boundsMax[axis] ||
+			!isfinite(scale[axis]) || !(scale[axis] > 0.0f))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+Shape GetMeshShapeFromBlob(
+	const uint8_t* blob,
+	size_t size)
+{
+	Shape meshShape = GetEmptyMeshShape();
+	MeshBlobHeader header;
+	if (!blob || size < sizeof(MeshBlobHeader))
+	{
+		return meshShape;
+	}
+	memcpy(&header, blob, sizeof(MeshBlobHeader));
+	if (header.magic != MESH_BLOB_MAGIC || header.version != MESH_BLOB_VERSION ||
+		header.triangleCount == 0 || header.triangleCount > MAX_MESH_TRIANGLES || !IsValidGrid(header))
+	{
+		return meshShape;
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->refCount = 1;
+	mesh->boundsMin = header.boundsMin;
+	mesh->boundsMax = header.boundsMax;
+	mesh->quantizeScale = header.quantizeScale;
+	mesh->root = header.root;
+
+	size_t offset = sizeof(MeshBlobHeader);
+	bool valid = ReadArray(blob, size, &offset, header.vertexCount, &mesh->vertices) &&
+		ReadArray(blob, size, &offset, (size_t)header.triangleCount * 3, &mesh->indices) &&
+		ReadArray(blob, size, &offset, header.triangleCount, &mesh->triangleIds) &&
+		ReadArray(blob, size, &offset, header.nodeCount, &mesh->nodes) &&
+		ReadArray(blob, size, &offset, header.hasMaterials ? header.triangleCount : 0, &mesh->materials) &&
+		offset == size && mesh->root != EMPTY_CHILD && IsValidReference(mesh, mesh->root, EMPTY_CHILD);
+
+	for (size_t i = 0; i < mesh->indices.size() && valid; i++)
+	{
+		valid = mesh->indices[i] < header.vertexCount;
+	}
+	for (uint32_t nodeIdx = 0; nodeIdx < header.nodeCount && valid; nodeIdx++)
+	{
+		for (uint8_t child = 0; child < 4 && valid; child++)
+		{
+			valid = IsValidReference(mesh, mesh->nodes[nodeIdx].children[child], nodeIdx);
+		}
+	}
+	// traversal keeps up to 3 siblings per level and 4 children of the deepest node
+	valid = valid && (size_t)GetTreeDepth(mesh) * 3 + 1 <= TRAVERSAL_STACK_SIZE;
+
+	if (!valid)
+	{
+		delete mesh;
+		return meshShape;
+	}
+	meshShape.shapeData = (char*)mesh;
+	return meshShape;
+}
+
+bool RaycastMesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3& position,
+	const DirectX::XMFLOAT4& rotation,
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& direction,
+	float maxDistance,
+	MeshRayHit* hit)
+{
+	if (shape->collectTriangles != CollectTriangles_Mesh)
+	{
+		return false;
+	}
+
+	const Mesh* mesh = (const Mesh*)shape->shapeData;
+	XMMATRIX toLocal = XMMatrixRotationQuaternion(XMLoadFloat4(&rotation));
+	XMMATRIX toWorld = XMMatrixTranspose(toLocal);
+	XMVECTOR localOrigin = XMVector3Transform(XMLoadFloat3(&origin) - XMLoadFloat3(&position), toLocal);
+	XMVECTOR localDir = XMVector3Transform(XMLoadFloat3(&direction), toLocal);
+
+	XMFLOAT3 dir;
+	XMStoreFloat3(&dir, localDir);
+	XMVECTOR invDir = GetRayInvDirection(dir);
+
+	if (!RayHitsBox(localOrigin, invDir, XMLoadFloat3(&mesh->boundsMin), XMLoadFloat3(&mesh->boundsMax), maxDistance))
+	{
+		return false;
+	}
+
+	float best = maxDistance;
+	uint32_t bestTriangle = EMPTY_CHILD;
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	size_t stackSize = 0;
+	stack[stackSize++] = mesh->root;
+	while (stackSize > 0)
+	{
+		uint32_t ref = stack[--stackSize];
+		if (IsLeaf(ref))
+		{
+			uint32_t first = ref & LEAF_FIRST_MASK;
+			uint32_t count = ((ref & ~LEAF_FLAG) >> LEAF_COUNT_SHIFT) + 1;
+			for (uint32_t tri = first; tri < first + count; tri++)
+			{
+				float distance;
+				if (RayHitsTriangle(localOrigin, localDir,
+					XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3]]),
+					XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3 + 1]]),
+					XMLoadFloat3(&mesh->vertices[mesh->indices[tri * 3 + 2]]), &distance) &&
+					distance <= best)
+				{
+					best = distance;
+					bestTriangle = tri;
+				}
+			}
+			continue;
+		}
+
+		const MeshBvhNode& node = mesh->nodes[ref];
+		for (uint8_t child = 0; child < 4; child++)
+		{
+			if (node.children[child] == EMPTY_CHILD)
+			{
+				continue;
+			}
+
+			XMVECTOR minC, maxC;
+			DequantizeChild(mesh, node, child, &minC, &maxC);
+			if (RayHitsBox(localOrigin, invDir, minC, maxC, best))
+			{
+				stack[stackSize++] = node.children[child];
+			}
+		}
+	}
+
+	if (bestTriangle == EMPTY_CHILD)
+	{
+		return false;
+	}
+
+	XMVECTOR normal = TriangleNormal(
+		XMLoadFloat3(&mesh->vertices[mesh->indices[bestTriangle * 3]]),
+		XMLoadFloat3(&mesh->vertices[mesh->indices[bestTriangle * 3 + 1]]),
+		XMLoadFloat3(&mesh->vertices[mesh->indices[bestTriangle * 3 + 2]]));
+	hit->distance = best;
+	XMStoreFloat3(&hit->point, XMLoadFloat3(&origin) + XMLoadFloat3(&direction) * best);
+	XMStoreFloat3(&hit->normal, XMVector3Transform(normal, toWorld));
+	hit->triangle = mesh->triangleIds[bestTriangle];
+	hit->material = mesh->materials.empty() ? 0 : mesh->materials[bestTriangle];
+	return true;
+}
+
+size_t GetMeshMemoryUsage(
+	const Shape* shape)
+{
+	const Mesh* mesh = (const Mesh*)shape->shapeData;
+	return sizeof(Mesh) + mesh->vertices.capacity() * sizeof(XMFLOAT3) +
+		mesh->indices.capacity() * sizeof(uint32_t) + mesh->triangleIds.capacity() * sizeof(uint32_t) +
+		mesh->materials.capacity() + mesh->nodes.capacity() * sizeof(MeshBvhNode);
+}
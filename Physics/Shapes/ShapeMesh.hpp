@@ -0,0 +1,56 @@
+#pragma once
+#include "Shape.hpp"
+
+constexpr uint32_t MESH_BLOB_MAGIC = 0x4248534D; // "MSHB"
+constexpr uint32_t MESH_BLOB_VERSION = 1;
+
+// triangle normal is (v1 - v0) x (v2 - v0), triangles collide only from the front
+struct MeshDesc
+{
+	const DirectX::XMFLOAT3* vertices;
+	uint32_t vertexCount;
+	const uint32_t* indices; // three per triangle
+	uint32_t triangleCount;
+	const uint8_t* materials; // optional, one per triangle
+};
+
+struct MeshRayHit
+{
+	float distance;
+	DirectX::XMFLOAT3 point;
+	DirectX::XMFLOAT3 normal; // of triangle, world space
+	uint32_t triangle; // index as passed in MeshDesc
+	uint8_t material;
+};
+
+/*
+	Static triangle mesh over a 4-wide BVH. Nodes take one cache line, bounds of children
+	are stored as 16 bit offsets inside mesh bounds and queries compare them as integers.
+	Returns shape with nullptr shapeData for invalid desc.
+*/
+Shape GetMeshShape(
+	const MeshDesc& desc);
+
+// serializes mesh with its BVH, blob can be loaded without rebuilding the tree
+void SaveMeshBlob(
+	const Shape* shape,
+	std::vector<uint8_t>* blob);
+
+// returns shape with nullptr shapeData when blob is malformed
+Shape GetMeshShapeFromBlob(
+	const uint8_t* blob,
+	size_t size);
+
+// nearest hit along direction within maxDistance, direction has to be unit length, false for other shapes
+bool RaycastMesh(
+	const Shape* shape,
+	const DirectX::XMFLOAT3& position,
+	const DirectX::XMFLOAT4& rotation,
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& direction,
+	float maxDistance,
+	MeshRayHit* hit);
+
+// bytes held by mesh data
+size_t GetMeshMemoryUsage(
+	const Shape* shape);
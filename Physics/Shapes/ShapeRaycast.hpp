@@ -0,0 +1,76 @@
+#pragma once
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cmath>
+
+// slab inverse of direction, zero components give infinite slabs
+inline DirectX::XMVECTOR GetRayInvDirection(
+	const DirectX::XMFLOAT3& dir)
+{
+	return DirectX::XMVectorSet(
+		fabsf(dir.x) > 1e-12f ? 1.0f / dir.x : 1e30f,
+		fabsf(dir.y) > 1e-12f ? 1.0f / dir.y : 1e30f,
+		fabsf(dir.z) > 1e-12f ? 1.0f / dir.z : 1e30f, 0);
+}
+
+// entry distance of ray into box, false when it misses or enters after maxDistance
+inline bool RayHitsBox(
+	DirectX::FXMVECTOR origin,
+	DirectX::FXMVECTOR invDir,
+	DirectX::FXMVECTOR minC,
+	DirectX::GXMVECTOR maxC,
+	float maxDistance)
+{
+	using namespace DirectX;
+	XMVECTOR t0 = (minC - origin) * invDir;
+	XMVECTOR t1 = (maxC - origin) * invDir;
+	XMFLOAT3 tNear, tFar;
+	XMStoreFloat3(&tNear, XMVectorMin(t0, t1));
+	XMStoreFloat3(&tFar, XMVectorMax(t0, t1));
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit;
+}
+
+// Moller-Trumbore, both sides of the triangle are hit
+inline bool RayHitsTriangle(
+	DirectX::FXMVECTOR origin,
+	DirectX::FXMVECTOR dir,
+	DirectX::FXMVECTOR v0,
+	DirectX::GXMVECTOR v1,
+	DirectX::HXMVECTOR v2,
+	float* distance)
+{
+	using namespace DirectX;
+	XMVECTOR edge1 = v1 - v0;
+	XMVECTOR edge2 = v2 - v0;
+	XMVECTOR p = XMVector3Cross(dir, edge2);
+	float det;
+	XMStoreFloat(&det, XMVector3Dot(edge1, p));
+	if (fabsf(det) < 1e-12f)
+	{
+		return false;
+	}
+
+	float invDet = 1.0f / det;
+	XMVECTOR s = origin - v0;
+	float u, v;
+	XMStoreFloat(&u, XMVector3Dot(s, p));
+	u *= invDet;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return false;
+	}
+
+	XMVECTOR q = XMVector3Cross(s, edge1);
+	XMStoreFloat(&v, XMVector3Dot(dir, q));
+	v *= invDet;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return false;
+	}
+
+	XMStoreFloat(distance, XMVector3Dot(edge2, q));
+	*distance *= invDet;
+	return *distance >= 0.0f;
+}
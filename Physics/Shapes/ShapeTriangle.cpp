@@ -0,0 +1,163 @@
+#include "ShapeTriangle.hpp"
+#include <cstring>
+using namespace DirectX;
+
+struct Triangle
+{
+	uint32_t refCount;
+	WorldTriangle triangle;
+};
+
+static int64_t TransformationMatrix(
+	char* shapeData,
+	DirectX::XMFLOAT4X4* destMat)
+{
+	XMStoreFloat4x4(destMat, XMMatrixIdentity());
+	return 0;
+}
+
+static void SupportFn(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pos,
+	const DirectX::XMFLOAT3* dir,
+	const DirectX::XMFLOAT4* rotQuat,
+	DirectX::XMFLOAT3* supportVec,
+	float bias)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+
+	XMVECTOR dirVec = XMLoadFloat3(dir);
+	XMVECTOR vert = XMLoadFloat3(&triangle->triangle.vertices[0]);
+	float maxProj;
+	XMStoreFloat(&maxProj, XMVector3Dot(vert, dirVec));
+	for (uint8_t i = 1; i < 3; i++)
+	{
+		XMVECTOR candidate = XMLoadFloat3(&triangle->triangle.vertices[i]);
+		float proj;
+		XMStoreFloat(&proj, XMVector3Dot(candidate, dirVec));
+		if (proj > maxProj)
+		{
+			maxProj = proj;
+			vert = candidate;
+		}
+	}
+
+	float lengthSq;
+	XMStoreFloat(&lengthSq, XMVector3LengthSq(dirVec));
+	if (lengthSq > 1e-12f)
+	{
+		vert = vert + XMVector3Normalize(dirVec) * bias;
+	}
+	XMStoreFloat3(supportVec, XMLoadFloat3(pos) + vert);
+}
+
+// triangle only takes part in queries, it never moves
+static void GetPartialInertiaTensorTriangle(
+	const Shape* shape,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	XMStoreFloat4x4(inertiaTensor, XMMatrixIdentity());
+}
+
+static void GetInverseInertiaTensorTriangle(
+	const Shape* shape,
+	float invMass,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	memset(inertiaTensor, 0, sizeof(XMFLOAT4X4));
+	inertiaTensor->_44 = 1.0f;
+}
+
+static void GetInverseInertiaTensorWorldSpaceTriangle(
+	const Shape* shape,
+	float invMass,
+	const DirectX::XMFLOAT4* rotationQuat,
+	DirectX::XMFLOAT4X4* inertiaTensor)
+{
+	shape->getInverseInertiaTensor(shape, invMass, inertiaTensor);
+}
+
+static void GetCenterOfMassTriangle(
+	const Shape* shape,
+	XMFLOAT3* CoM)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+	const XMFLOAT3* v = triangle->triangle.vertices;
+	XMStoreFloat3(CoM, (XMLoadFloat3(&v[0]) + XMLoadFloat3(&v[1]) + XMLoadFloat3(&v[2])) / 3.0f);
+}
+
+static BoundingBox GetBoundingBox_Triangle(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* position,
+	const DirectX::XMFLOAT4* rotationQuat)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+	const XMFLOAT3* v = triangle->triangle.vertices;
+	XMVECTOR pos = XMLoadFloat3(position);
+
+	BoundingBox bBox;
+	XMStoreFloat3(&bBox.minC, pos + XMVectorMin(XMVectorMin(XMLoadFloat3(&v[0]), XMLoadFloat3(&v[1])), XMLoadFloat3(&v[2])));
+	XMStoreFloat3(&bBox.maxC, pos + XMVectorMax(XMVectorMax(XMLoadFloat3(&v[0]), XMLoadFloat3(&v[1])), XMLoadFloat3(&v[2])));
+	return bBox;
+}
+
+static void GetFaceNormalFromPoint_Triangle(
+	const Shape* shape,
+	const DirectX::XMFLOAT3* pointOnShape,
+	DirectX::XMFLOAT3* normal)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+	*normal = triangle->triangle.normal;
+}
+
+static void FreeShapeData_Triangle(
+	Shape* shape)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+	triangle->refCount--;
+	if (triangle->refCount == 0)
+	{
+		delete triangle;
+	}
+	shape->shapeData = nullptr;
+}
+
+static void AddShapeReference_Triangle(
+	Shape* shape)
+{
+	Triangle* triangle = (Triangle*)shape->shapeData;
+	triangle->refCount++;
+}
+
+Shape GetTriangleShape(
+	const WorldTriangle& worldTriangle)
+{
+	Shape triangleShape;
+	triangleShape.getTrasformationMatrix = TransformationMatrix;
+	triangleShape.supportFunction = SupportFn;
+	triangleShape.getInverseInertiaTensor = GetInverseInertiaTensorTriangle;
+	triangleShape.getInverseInertiaTensorWorldSpace = GetInverseInertiaTensorWorldSpaceTriangle;
+	triangleShape.getCenterOfMass = GetCenterOfMassTriangle;
+	triangleShape.getPartialInertiaTensor = GetPartialInertiaTensorTriangle;
+	triangleShape.getBoundingBox = GetBoundingBox_Triangle;
+	triangleShape.getFaceNormalFromPoint = GetFaceNormalFromPoint_Triangle;
+	triangleShape.freeShapeData = FreeShapeData_Triangle;
+	triangleShape.addShapeReference = AddShapeReference_Triangle;
+	triangleShape.collectTriangles = nullptr;
+	triangleShape.collectChildren = nullptr;
+	triangleShape.raycast = nullptr;
+
+	Triangle* triangle = new Triangle();
+	triangle->refCount = 1;
+	triangle->triangle = worldTriangle;
+
+	triangleShape.shapeData = (char*)triangle;
+	return triangleShape;
+}
+
+void SetTriangleShapeTriangle(
+	Shape* shape,
+	const WorldTriangle& triangle)
+{
+	((Triangle*)shape->shapeData)->triangle = triangle;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "Shape.hpp"
+
+/*
+	Flat convex shape of single triangle given relative to body position, lets GJK queries run
+	against triangles of concave shapes. Triangle has no volume, it is only meant for static
+	bodies used in queries. Rotation of the body is ignored.
+*/
+Shape GetTriangleShape(
+	const WorldTriangle& triangle);
+
+// replaces triangle in place, avoids allocation when iterating over many triangles
+void SetTriangleShapeTriangle(
+	Shape* shape,
+	const WorldTriangle& triangle);
@@ -107,6 +107,8 @@ struct UboEntry
 struct UboPoolEntry
 {
 	std::vector<UboEntry> uboEntries;
+	// per resource type, ids of freed entries that can be reused
+	std::vector<std::vector<uint64_t>> freeUboIds;
 	MemoryPool uboPool;
 	VkDeviceSize bufferOffset;
 	size_t bufferIdx;
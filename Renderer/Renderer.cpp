@@ -339,6 +339,15 @@ int64_t Renderer::AllocateUboResource(
     uint64_t poolId, 
     uint64_t resourceId,
     uint64_t* allocatedUboId)
+{
+    return AllocateUboResources(poolId, resourceId, 1, allocatedUboId);
+}
+
+int64_t Renderer::AllocateUboResources(
+    uint64_t poolId,
+    uint64_t resourceId,
+    size_t count,
+    uint64_t* allocatedUboIds)
 {
     if (poolId > uboPoolEntries.size())
     {
@@ -353,31 +362,84 @@ int64_t Renderer::AllocateUboResource(
 
     const VkMemoryRequirements& resourceReqs = uboPoolEntry->uboPool.resourceReqs[resourceId];
     const VkBufferCreateInfo resourceInfo = uboPoolEntry->uboPool.bufferInfos[resourceId];
-    VkDeviceSize memoryUpdateSize;
-    UboEntry uboDesc = {};
-    uboDesc.resourceId = resourceId;
-    uboDesc.bufferIdx = uboPoolEntry->bufferIdx;
-    SET_UBO_ENTRY_ALIVE(&uboDesc);
-
-    VkResult result = findOffsetInBuffer(uboPoolEntry->bufferOffset, resourceReqs.alignment, resourceReqs.size,
-                        uboPoolEntry->uboPool.poolSize, resourceInfo.size, &uboDesc.bufferOffset, &memoryUpdateSize);
-    if (result == VK_ERROR_TOO_MANY_OBJECTS)
+    if (uboPoolEntry->freeUboIds.size() <= resourceId)
     {
-        if (uboPoolEntry->bufferIdx + 1 >= uboPoolEntry->uboPool.boundBuffers.size())
+        uboPoolEntry->freeUboIds.resize(resourceId + 1);
+    }
+    std::vector<uint64_t>* freeIds = &uboPoolEntry->freeUboIds[resourceId];
+    uboPoolEntry->uboEntries.reserve(uboPoolEntry->uboEntries.size() + count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (freeIds->size() > 0)
         {
-            return VK_ERROR_TOO_MANY_OBJECTS;
+            allocatedUboIds[i] = freeIds->back();
+            freeIds->pop_back();
+            SET_UBO_ENTRY_ALIVE(&uboPoolEntry->uboEntries[allocatedUboIds[i] - 1]);
+            continue;
         }
-        uboPoolEntry->bufferIdx++;
+
+        VkDeviceSize memoryUpdateSize;
+        UboEntry uboDesc = {};
+        uboDesc.resourceId = resourceId;
         uboDesc.bufferIdx = uboPoolEntry->bufferIdx;
-        uboPoolEntry->bufferOffset = 0;
-        EXIT_ON_VK_ERROR(findOffsetInBuffer(uboPoolEntry->bufferOffset, resourceReqs.alignment, resourceReqs.size,
-            uboPoolEntry->uboPool.poolSize, resourceInfo.size, &uboDesc.bufferOffset, &memoryUpdateSize));
+        SET_UBO_ENTRY_ALIVE(&uboDesc);
+
+        VkResult result = findOffsetInBuffer(uboPoolEntry->bufferOffset, resourceReqs.alignment, resourceReqs.size,
+                            uboPoolEntry->uboPool.poolSize, resourceInfo.size, &uboDesc.bufferOffset, &memoryUpdateSize);
+        if (result == VK_ERROR_TOO_MANY_OBJECTS)
+        {
+            if (uboPoolEntry->bufferIdx + 1 >= uboPoolEntry->uboPool.boundBuffers.size())
+            {
+                FreeUboResources(poolId, allocatedUboIds, i);
+                return VK_ERROR_TOO_MANY_OBJECTS;
+            }
+            uboPoolEntry->bufferIdx++;
+            uboDesc.bufferIdx = uboPoolEntry->bufferIdx;
+            uboPoolEntry->bufferOffset = 0;
+            EXIT_ON_VK_ERROR(findOffsetInBuffer(uboPoolEntry->bufferOffset, resourceReqs.alignment, resourceReqs.size,
+                uboPoolEntry->uboPool.poolSize, resourceInfo.size, &uboDesc.bufferOffset, &memoryUpdateSize));
+        }
+        uboPoolEntry->uboEntries.push_back(uboDesc);
+        uboPoolEntry->bufferOffset += memoryUpdateSize;
+
+        allocatedUboIds[i] = uboPoolEntry->uboEntries.size();
     }
-    uboPoolEntry->uboEntries.push_back(uboDesc);
-    uboPoolEntry->bufferOffset += memoryUpdateSize;
 
-    *allocatedUboId = uboPoolEntry->uboEntries.size();
+    return 0;
+}
 
+int64_t Renderer::FreeUboResources(
+    uint64_t poolId,
+    const uint64_t* uboIds,
+    size_t count)
+{
+    if (poolId > uboPoolEntries.size())
+    {
+        return -1;
+    }
+
+    UboPoolEntry* uboPoolEntry = &uboPoolEntries[poolId - 1];
+    for (size_t i = 0; i < count; i++)
+    {
+        if (uboIds[i] == 0 || uboIds[i] > uboPoolEntry->uboEntries.size())
+        {
+            return -2;
+        }
+
+        UboEntry* entry = &uboPoolEntry->uboEntries[uboIds[i] - 1];
+        if (!IS_UBO_ENTRY_ALIVE(entry))
+        {
+            continue;
+        }
+        SET_UBO_ENTRY_DEAD(entry);
+
+        if (uboPoolEntry->freeUboIds.size() <= entry->resourceId)
+        {
+            uboPoolEntry->freeUboIds.resize(entry->resourceId + 1);
+        }
+        uboPoolEntry->freeUboIds[entry->resourceId].push_back(uboIds[i]);
+    }
     return 0;
 }
 
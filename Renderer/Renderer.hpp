@@ -54,6 +54,21 @@ public:
 		uint64_t resourceId,
 		uint64_t* allocatedUboId);
 
+	/*
+		Allocates count resources of the same type, freed entries are reused first.
+		On error ids allocated before failure are freed again, nothing is allocated.
+	*/
+	int64_t AllocateUboResources(
+		uint64_t poolId,
+		uint64_t resourceId,
+		size_t count,
+		uint64_t* allocatedUboIds);
+
+	int64_t FreeUboResources(
+		uint64_t poolId,
+		const uint64_t* uboIds,
+		size_t count);
+
 	int64_t BindUboPoolToPipeline(
 		uint64_t pipelineId,
 		uint64_t uboPoolId,
@@ -0,0 +1,318 @@
+#include "Scene.hpp"
+using namespace DirectX;
+using namespace std;
+
+Scene::Scene(
+    PhysicsEnigne* physicsEngine)
+    :
+    physicsEngine(physicsEngine), listener({ nullptr, nullptr, nullptr }), calculatePhysics(true), frameMode(true),
+    characterVelocity({ 0, 0, 0 }), characterSpeed(6.0f), forwardDir({ 1, 0, 0 }), rightDir({ 0, 0, -1 }),
+    characterId(0), character(physicsEngine, GetDefaultCharacterControllerSettings())
+{
+}
+
+int64_t Scene::SetListener(
+    const SceneListener& listener)
+{
+    this->listener = listener;
+    if (listener.entitiesAdded != nullptr && !physicsEntities.empty())
+    {
+        return listener.entitiesAdded(listener.context, 0, physicsEntities.size());
+    }
+    return 0;
+}
+
+void Scene::GenerateObjects()
+{
+    // character, kinematic body only follows the controller and pushes dynamic bodies
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { -3, 1, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0.0f;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 0.0f;
+        bodyProps.friction = 0.0f;
+        XMFLOAT3 scales = { character.settings.radius, character.settings.halfHeight, character.settings.radius };
+        XMUINT4 objInfo = {0, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::Capsule, bodyProps, scales, objInfo, bounds, false, { 0, 0, 0 });
+        characterId = physicsEntities.back();
+        physicsEngine->SetKinematic(characterId, true);
+        character.bodyId = characterId;
+        character.SetPosition(bodyProps.position);
+    }
+
+    // collider
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 10, 2, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 1.0f / 20.f;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 0.5f;
+        bodyProps.friction = 1.0f;
+        XMFLOAT3 scales = { 1.0f, 1.0f, 1.0f };
+        XMUINT4 objInfo = { 1, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // floor
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 0, -2, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 35, 1, 35 };
+        XMUINT4 objInfo = { 2, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+    // left wall
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { -35, 0, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 1, 20, 39 };
+        XMUINT4 objInfo = { 3, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // right wall
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 35, 0, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 1, 20, 35 };
+        XMUINT4 objInfo = { 3, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // front wall
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 0, 0, -35 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 35, 20, 1 };
+        XMUINT4 objInfo = { 3, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // back wall
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 0, 0, 35 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 35, 20, 1 };
+        XMUINT4 objInfo = { 3, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+
+    // ramp
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 0, 0, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        float angle = -3.14f / 6.0f;
+        bodyProps.rotation = { 0, 0, 1.0f * sinf(angle/2.0f), cosf(angle/ 2.0f)};
+        bodyProps.elasticity = 0.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 5, 1, 1 };
+        XMUINT4 objInfo = { 4, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // balcony
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { 8.85, 2.374, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0, 0, 0, 1 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 5, 1, 5 };
+        XMUINT4 objInfo = { 5, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, true);
+    }
+
+    // rotated box
+    {
+        BodyProperties bodyProps;
+        bodyProps.position = { -15, 14, 0 };
+        bodyProps.linVelocity = { 0, 0, 0 };
+        bodyProps.angVelocity = { 0, 0, 0 };
+        bodyProps.massInv = 0;
+        bodyProps.rotation = { 0.4364358, 0.8728716, 0.2182179, 0.7 };
+        bodyProps.elasticity = 1.0f;
+        bodyProps.friction = 0.01f;
+        XMFLOAT3 scales = { 1.4, 1.4, 1.4 };
+        XMUINT4 objInfo = { 5, 0, 0 ,0 };
+        LinearVelocityBounds bounds = { -1000, 1000, -1000, 1000, -1000, 1000 };
+        AddBody(ShapeType::OrientedBox, bodyProps, scales, objInfo, bounds, false);
+    }
+
+}
+
+int64_t Scene::AddBody(
+    const ShapeType& type,
+    const BodyProperties& props,
+    const DirectX::XMFLOAT3& scales,
+    const DirectX::XMUINT4& objInfo,
+    const LinearVelocityBounds& vBounds,
+    bool allowAngularImpulse,
+    const DirectX::XMFLOAT3& constForce)
+{
+    return AddBodies(type, &props, 1, scales, objInfo, vBounds, allowAngularImpulse, constForce);
+}
+
+int64_t Scene::AddBodies(
+    const ShapeType& type,
+    const BodyProperties* props,
+    size_t count,
+    const DirectX::XMFLOAT3& scales,
+    const DirectX::XMUINT4& objInfo,
+    const LinearVelocityBounds& vBounds,
+    bool allowAngularImpulse,
+    const DirectX::XMFLOAT3& constForce)
+{
+    size_t firstEntity = physicsEntities.size();
+    physicsEntities.resize(firstEntity + count);
+    entityInfos.resize(firstEntity + count, objInfo);
+
+    // consecutive bodies of the same kind go to physics engine in one call
+    size_t runStart = 0;
+    while (runStart < count)
+    {
+        bool isDynamic = props[runStart].massInv != 0.0f;
+        size_t runEnd = runStart + 1;
+        while (runEnd < count && (props[runEnd].massInv != 0.0f) == isDynamic)
+        {
+            runEnd++;
+        }
+
+        physicsEngine->AddBodies(props + runStart, runEnd - runStart, type, scales, isDynamic,
+            &physicsEntities[firstEntity + runStart], allowAngularImpulse, vBounds, constForce);
+        runStart = runEnd;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        entityIndices[physicsEntities[firstEntity + i]] = firstEntity + i;
+    }
+
+    if (listener.entitiesAdded != nullptr && listener.entitiesAdded(listener.context, firstEntity, count) != 0)
+    {
+        // listener has nothing of the batch, so it isn't told about removal
+        for (size_t i = firstEntity; i < firstEntity + count; i++)
+        {
+            entityIndices.erase(physicsEntities[i]);
+        }
+        physicsEngine->RemoveBodies(&physicsEntities[firstEntity], count);
+        physicsEntities.resize(firstEntity);
+        entityInfos.resize(firstEntity);
+        return -1;
+    }
+    return 0;
+}
+
+void Scene::RemoveBodies(
+    const uint64_t* bodyIds,
+    size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        auto entity = entityIndices.find(bodyIds[i]);
+        if (entity == entityIndices.end())
+        {
+            continue;
+        }
+
+        size_t entityIdx = entity->second;
+        size_t lastIdx = physicsEntities.size() - 1;
+        if (listener.entityRemoved != nullptr)
+        {
+            listener.entityRemoved(listener.context, entityIdx);
+        }
+
+        entityIndices.erase(entity);
+        if (entityIdx != lastIdx)
+        {
+            physicsEntities[entityIdx] = physicsEntities[lastIdx];
+            entityInfos[entityIdx] = entityInfos[lastIdx];
+            entityIndices[physicsEntities[entityIdx]] = entityIdx;
+        }
+        physicsEntities.pop_back();
+        entityInfos.pop_back();
+    }
+
+    physicsEngine->RemoveBodies(bodyIds, count);
+}
+
+void Scene::Step(
+    float dt)
+{
+    if (calculatePhysics)
+    {
+        XMFLOAT3 velocity;
+        XMStoreFloat3(&velocity,
+            characterSpeed * (characterVelocity.z * XMLoadFloat3(&forwardDir) + characterVelocity.x * XMLoadFloat3(&rightDir)));
+
+        character.Move(velocity, dt);
+
+        stepObservers.assign(lodObservers.begin(), lodObservers.end());
+        stepObservers.push_back(character.position);
+        physicsEngine->SetLodObservers(stepObservers.data(), stepObservers.size());
+        physicsEngine->UpdateBodies(dt);
+
+        if (frameMode)
+        {
+            calculatePhysics = false;
+        }
+    }
+
+    characterVelocity = { 0, 0, 0 };
+}
+
+void Scene::GetPhysicsStats(
+    PhysicsStats* stats) const
+{
+    physicsEngine->GetStats(stats);
+}
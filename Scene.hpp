@@ -0,0 +1,96 @@
+#pragma once
+#include <DirectXMath.h>
+#include "Physics/PhysicsEnigne.h"
+#include "Physics/CharacterController.hpp"
+#include <vector>
+#include <unordered_map>
+
+// entities [firstEntity, firstEntity + count) were appended, -1 rejects them
+typedef int64_t(*EntitiesAdded)(
+	void* context,
+	size_t firstEntity,
+	size_t count);
+
+// entity is about to be removed, last entity takes its place
+typedef void(*EntityRemoved)(
+	void* context,
+	size_t entityIdx);
+
+/*
+	Lets presentation layer mirror entity arrays of the scene,
+	headless scene runs without listener.
+*/
+struct SceneListener
+{
+	void* context;
+	EntitiesAdded entitiesAdded;
+	EntityRemoved entityRemoved;
+};
+
+/*
+	Simulation side of the application: entities and character controller.
+	Doesn't depend on window or renderer, so the same scene can run on headless server.
+*/
+struct Scene
+{
+	Scene(
+		PhysicsEnigne* physicsEngine);
+
+	// listener is notified about entities that already exist as well, returns -1 when it rejects them
+	int64_t SetListener(
+		const SceneListener& listener);
+
+	void GenerateObjects();
+
+	int64_t AddBody(const ShapeType& type,
+		const BodyProperties& props,
+		const DirectX::XMFLOAT3& scales,
+		const DirectX::XMUINT4& objInfo,
+		const LinearVelocityBounds& vBounds,
+		bool allowAngularImpulse,
+		const DirectX::XMFLOAT3& constForce = { 0, -15, 0 });
+
+	/*
+		Bodies share shape, objInfo and bounds; static and dynamic bodies can be mixed.
+		Returns -1 and removes the bodies again when listener rejects them.
+	*/
+	int64_t AddBodies(const ShapeType& type,
+		const BodyProperties* props,
+		size_t count,
+		const DirectX::XMFLOAT3& scales,
+		const DirectX::XMUINT4& objInfo,
+		const LinearVelocityBounds& vBounds,
+		bool allowAngularImpulse,
+		const DirectX::XMFLOAT3& constForce = { 0, -15, 0 });
+
+	void RemoveBodies(
+		const uint64_t* bodyIds,
+		size_t count);
+
+	// moves character by its input, advances physics and consumes the input,
+	// bodies far from character and lodObservers are simulated at lower rate
+	void Step(
+		float dt);
+
+	// statistics of the last physics step
+	void GetPhysicsStats(
+		PhysicsStats* stats) const;
+public:
+	PhysicsEnigne* physicsEngine;
+	SceneListener listener;
+	bool calculatePhysics;
+	bool frameMode;
+	// ----- character management -----
+	DirectX::XMFLOAT3 characterVelocity; // input of the current step, x along rightDir and z along forwardDir
+	float characterSpeed;
+	DirectX::XMFLOAT3 forwardDir;
+	DirectX::XMFLOAT3 rightDir;
+	uint64_t characterId; // kinematic capsule following the controller
+	CharacterController character;
+	std::vector<DirectX::XMFLOAT3> lodObservers; // e.g. camera, character is always an observer
+	std::vector<DirectX::XMFLOAT3> stepObservers; // lodObservers and character passed to engine
+	// ----- Entity related -----
+	std::vector<uint64_t> physicsEntities;
+	std::vector<DirectX::XMUINT4> entityInfos; // objInfo passed at creation, per entity
+	std::unordered_map<uint64_t, size_t> entityIndices; // body id -> index in entity arrays
+};
@@ -0,0 +1,84 @@
+#include "../Scene.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+using namespace std;
+
+/*
+	Runs the scene of the application without window and renderer, at fixed tick rate.
+	usage: SceneServer [--ticks count] [--rate ticksPerSecond] [--threads count] [--unpaced]
+	--ticks 0 runs until the process is killed, --unpaced doesn't wait for the wall clock between ticks.
+*/
+
+int main(int argc, char** argv)
+{
+	size_t ticks = 0;
+	size_t rate = 60;
+	size_t threads = SIZE_MAX;
+	bool paced = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--unpaced") == 0) { paced = false; }
+		else if (i + 1 < argc && strcmp(argv[i], "--ticks") == 0) { ticks = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--rate") == 0) { rate = strtoull(argv[++i], nullptr, 10); }
+		else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) { threads = strtoull(argv[++i], nullptr, 10); }
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return -1;
+		}
+	}
+	if (rate == 0)
+	{
+		fprintf(stderr, "tick rate has to be positive\n");
+		return -1;
+	}
+
+	// --threads counts calling thread as well
+	JobSystem jobSystem(threads == SIZE_MAX ? max(thread::hardware_concurrency(), 1u) - 1 : (threads > 0 ? threads - 1 : 0));
+	PhysicsEnigne physicsEngine(200, 200, &jobSystem);
+	Scene scene(&physicsEngine);
+	scene.frameMode = false;
+	scene.GenerateObjects();
+
+	const float dt = 1.0f / (float)rate;
+	const chrono::nanoseconds tickDuration(1'000'000'000 / rate);
+	auto nextTick = chrono::steady_clock::now();
+	double stepMsSum = 0.0;
+	double stepMsMax = 0.0;
+	PhysicsStats stats;
+	for (size_t tick = 1; ticks == 0 || tick <= ticks; tick++)
+	{
+		auto start = chrono::steady_clock::now();
+		scene.Step(dt);
+		double stepMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		stepMsSum += stepMs;
+		stepMsMax = stepMs > stepMsMax ? stepMs : stepMsMax;
+
+		// one line per simulated second
+		if (tick % rate == 0 || tick == ticks)
+		{
+			const Body* character = physicsEngine.GetBody(scene.characterId);
+			size_t window = tick % rate == 0 ? rate : tick % rate;
+			scene.GetPhysicsStats(&stats);
+			printf("tick %zu: step %.3f ms avg, %.3f ms max, %llu contacts, character at [%.3f, %.3f, %.3f]\n",
+				tick, stepMsSum / window, stepMsMax, (unsigned long long)stats.contacts,
+				character->position.x, character->position.y, character->position.z);
+			fflush(stdout);
+			stepMsSum = 0.0;
+			stepMsMax = 0.0;
+		}
+
+		if (paced)
+		{
+			nextTick += tickDuration;
+			this_thread::sleep_until(nextTick);
+		}
+	}
+
+	printf("checksum %016llx\n", (unsigned long long)physicsEngine.GetStateChecksum());
+	return 0;
+}
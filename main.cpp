@@ -12,7 +12,9 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     TextureDim skyboxDim = { 1000, 1000 };
     Renderer renderer(hInstance, wnd.GetWindowHWND(), &skyboxDim, 1'000'000'000);
     PhysicsEnigne physicsEngine{};
-    Composer comp(&renderer, &physicsEngine);
+    Scene scene(&physicsEngine);
+    scene.GenerateObjects();
+    Composer comp(&renderer, &scene);
 
 
     float dt = 0.001;